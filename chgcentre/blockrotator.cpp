@@ -0,0 +1,272 @@
+#include "blockrotator.h"
+
+#include <casacore/measures/Measures/MBaseline.h>
+#include <casacore/measures/Measures/MCBaseline.h>
+#include <casacore/measures/Measures/MCDirection.h>
+#include <casacore/measures/Measures/MCuvw.h>
+#include <casacore/measures/Measures/MeasConvert.h>
+
+#include <casacore/casa/Quanta/Quantum.h>
+
+#include <cmath>
+#include <iostream>
+
+using namespace casacore;
+
+Muvw calculateUVW(const MPosition &antennaPos,
+									const MPosition &refPos, const MEpoch &time, const MDirection &direction)
+{
+	const Vector<double> posVec = antennaPos.getValue().getVector();
+	const Vector<double> refVec = refPos.getValue().getVector();
+	MVPosition relativePos(posVec[0]-refVec[0], posVec[1]-refVec[1], posVec[2]-refVec[2]);
+	MeasFrame frame(time, refPos, direction);
+	MBaseline baseline(MVBaseline(relativePos), MBaseline::Ref(MBaseline::ITRF, frame));
+	MBaseline j2000Baseline = MBaseline::Convert(baseline, MBaseline::J2000)();
+	MVuvw uvw(j2000Baseline.getValue(), direction.getValue());
+	return Muvw(uvw, Muvw::J2000);
+}
+
+void rotateVisibilities(const BandData &bandData, double shiftFactor, unsigned polarizationCount, Array<Complex>::contiter dataIter)
+{
+	for(unsigned ch=0; ch!=bandData.ChannelCount(); ++ch)
+	{
+		const double wShiftRad = shiftFactor / bandData.ChannelWavelength(ch);
+		double rotSin, rotCos;
+		sincos(wShiftRad, &rotSin, &rotCos);
+		for(unsigned p=0; p!=polarizationCount; ++p)
+		{
+			Complex v = *dataIter;
+			*dataIter = Complex(
+				v.real() * rotCos  -  v.imag() * rotSin,
+				v.real() * rotSin  +  v.imag() * rotCos);
+			++dataIter;
+		}
+	}
+}
+
+bool isRegularlySpaced(const BandData& band)
+{
+	const size_t n = band.ChannelCount();
+	if(n < 3)
+		return true;
+	const double
+		first = band.ChannelFrequency(0),
+		step = (band.ChannelFrequency(n-1) - first) / (n-1);
+	for(size_t ch=1; ch!=n-1; ++ch)
+	{
+		// A mHz deviation causes phase errors of order 1e-6 rad for 100 km baselines
+		if(std::fabs(band.ChannelFrequency(ch) - (first + ch*step)) > 1e-3)
+			return false;
+	}
+	return true;
+}
+
+void rotateVisibilities(const BandData &bandData, bool isRegular, double shiftFactor, unsigned polarizationCount, Complex* data, std::complex<double>* phasors)
+{
+	const size_t channelCount = bandData.ChannelCount();
+	if(isRegular && channelCount > 1)
+	{
+		const double
+			firstRad = shiftFactor / bandData.ChannelWavelength(0),
+			stepRad = (shiftFactor / bandData.ChannelWavelength(channelCount-1) - firstRad) / (channelCount-1);
+		double stepSin, stepCos;
+		sincos(stepRad, &stepSin, &stepCos);
+		const std::complex<double> step(stepCos, stepSin);
+		for(size_t ch=0; ch!=channelCount; ++ch)
+		{
+			if(ch%64 == 0)
+			{
+				double rotSin, rotCos;
+				sincos(firstRad + stepRad*ch, &rotSin, &rotCos);
+				phasors[ch] = std::complex<double>(rotCos, rotSin);
+			}
+			else {
+				phasors[ch] = phasors[ch-1] * step;
+			}
+		}
+	}
+	else {
+		for(size_t ch=0; ch!=channelCount; ++ch)
+		{
+			double rotSin, rotCos;
+			sincos(shiftFactor / bandData.ChannelWavelength(ch), &rotSin, &rotCos);
+			phasors[ch] = std::complex<double>(rotCos, rotSin);
+		}
+	}
+	for(size_t ch=0; ch!=channelCount; ++ch)
+	{
+		const float rotCos = phasors[ch].real(), rotSin = phasors[ch].imag();
+		for(unsigned p=0; p!=polarizationCount; ++p)
+		{
+			const Complex v = data[p];
+			data[p] = Complex(
+				v.real() * rotCos  -  v.imag() * rotSin,
+				v.real() * rotSin  +  v.imag() * rotCos);
+		}
+		data += polarizationCount;
+	}
+}
+
+MainColumns::MainColumns(MeasurementSet& set, const std::vector<std::string>& dataColumnNames) :
+	antenna1(set, set.columnName(MSMainEnums::ANTENNA1)),
+	antenna2(set, set.columnName(MSMainEnums::ANTENNA2)),
+	fieldId(set, set.columnName(MSMainEnums::FIELD_ID)),
+	dataDescId(set, set.columnName(MSMainEnums::DATA_DESC_ID)),
+	time(set, set.columnName(MSMainEnums::TIME)),
+	uvw(set, set.columnName(MSMainEnums::UVW)),
+	nRows(set.nrow())
+{
+	for(const std::string& name : dataColumnNames)
+		data.emplace_back(new ArrayColumn<Complex>(set, name));
+}
+
+void MainColumns::Read(RowBlock& block, size_t startRow, size_t maxRows)
+{
+	size_t rowCount = std::min<size_t>(maxRows, nRows - startRow);
+	Vector<int> dataDescIds = dataDescId.getColumnRange(Slicer(IPosition(1, startRow), IPosition(1, rowCount)));
+	block.dataDescId = dataDescIds[0];
+	for(size_t i=1; i!=rowCount; ++i)
+	{
+		if(dataDescIds[i] != block.dataDescId)
+		{
+			rowCount = i;
+			break;
+		}
+	}
+	const Slicer rowRange(IPosition(1, startRow), IPosition(1, rowCount));
+	block.startRow = startRow;
+	block.rowCount = rowCount;
+	block.antenna1.reference(antenna1.getColumnRange(rowRange));
+	block.antenna2.reference(antenna2.getColumnRange(rowRange));
+	block.fieldId.reference(fieldId.getColumnRange(rowRange));
+	block.time.reference(time.getColumnRange(rowRange));
+	block.uvw.reference(uvw.getColumnRange(rowRange));
+	block.data.resize(data.size());
+	for(size_t i=0; i!=data.size(); ++i)
+		block.data[i].reference(data[i]->getColumnRange(rowRange));
+}
+
+void MainColumns::Write(const RowBlock& block)
+{
+	const Slicer rowRange(IPosition(1, block.startRow), IPosition(1, block.rowCount));
+	uvw.putColumnRange(rowRange, block.uvw);
+	for(size_t i=0; i!=data.size(); ++i)
+		data[i]->putColumnRange(rowRange, block.data[i]);
+}
+
+size_t MainColumns::MaxBlockRows() const
+{
+	size_t bytesPerRow = sizeof(double)*3;
+	if(!data.empty() && nRows != 0)
+		bytesPerRow += data.size() * data.front()->shape(0).product() * sizeof(Complex);
+	return std::max<size_t>(1, (size_t(64)*1024*1024*std::max<size_t>(1, data.size())) / bytesPerRow);
+}
+
+std::vector<std::string> getDataColumnNames(MeasurementSet& set, const std::string& dataColumn, bool onlyUVW)
+{
+	std::vector<std::string> names;
+	if(!onlyUVW)
+	{
+		if(dataColumn.empty())
+		{
+			names.push_back(set.columnName(MSMainEnums::DATA));
+			if(set.isColumn(casacore::MSMainEnums::CORRECTED_DATA))
+				names.push_back(set.columnName(MSMainEnums::CORRECTED_DATA));
+			if(set.isColumn(casacore::MSMainEnums::MODEL_DATA))
+				names.push_back(set.columnName(MSMainEnums::MODEL_DATA));
+		}
+		else {
+			names.push_back(dataColumn);
+		}
+	}
+	return names;
+}
+
+BlockRotator::BlockRotator(const std::vector<MPosition>& antennas, const MultiBandData& bandData,
+	const MPosition& arrayPos, const MDirection& newDirection,
+	const MEpoch::Ref& timeRef, bool flipUVWSign, double oldDl, double oldDm, double newDl, double newDm, size_t threadCount) :
+	_antennas(antennas),
+	_bandData(bandData),
+	_arrayPos(arrayPos),
+	_refDirection(MDirection::Convert(newDirection, MDirection::Ref(MDirection::J2000))()),
+	_timeRef(timeRef),
+	_flipUVWSign(flipUVWSign),
+	_oldDl(oldDl), _oldDm(oldDm), _newDl(newDl), _newDm(newDm),
+	_threadCount(threadCount),
+	_isRegularBand(bandData.DataDescCount()),
+	_uvws(antennas.size()),
+	_uvwTime(-1.0)
+{
+	for(size_t i=0; i!=bandData.DataDescCount(); ++i)
+		_isRegularBand[i] = isRegularlySpaced(bandData[i]);
+}
+
+void BlockRotator::calculateAntennaUVWs(double time, size_t threadCount)
+{
+	// The epoch is constructed from the time value, because the table may not
+	// be accessed while the main thread is reading the next block.
+	_uvwTime = time;
+	MEpoch epoch(MVEpoch(Quantity(time, "s")), _timeRef);
+	parallelFor(_antennas.size(), threadCount, [&](size_t a) {
+		_uvws[a] = calculateUVW(_antennas[a], _arrayPos, epoch, _refDirection);
+	});
+}
+
+void BlockRotator::Process(RowBlock& block, int fieldIndex, bool printFirstRows)
+{
+	const BandData& thisBand = _bandData[block.dataDescId];
+	const bool isRegular = _isRegularBand[block.dataDescId];
+	const unsigned polarizationCount = block.data.empty() ? 0 : block.data.front().shape()[0];
+	const size_t valuesPerRow = polarizationCount * thisBand.ChannelCount();
+	std::vector<double> shiftFactors(block.rowCount);
+	double* uvwPtr = block.uvw.data();
+	for(size_t i=0; i!=block.rowCount; ++i)
+	{
+		if(fieldIndex >= 0 && block.fieldId[i] != fieldIndex)
+			continue;
+		
+		if(block.time[i] != _uvwTime)
+			calculateAntennaUVWs(block.time[i], _threadCount);
+		
+		// Calculate the new UVW
+		MVuvw newUVW = _uvws[block.antenna1[i]].getValue() - _uvws[block.antenna2[i]].getValue();
+		if(_flipUVWSign)
+			newUVW = -newUVW;
+		const double* oldUVW = &uvwPtr[i*3];
+		
+		// If one of the first results, output values for analyzing them.
+		if(printFirstRows && block.startRow + i < 5)
+		{
+			const Vector<double> v = newUVW.getVector();
+			std::cout << "Old " << Muvw(MVuvw(oldUVW[0], oldUVW[1], oldUVW[2]), Muvw::J2000) << " (" << std::sqrt(oldUVW[0]*oldUVW[0] + oldUVW[1]*oldUVW[1] + oldUVW[2]*oldUVW[2]) << ")\n";
+			std::cout << "New " << newUVW << " (" << std::sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]) << ")\n\n";
+		}
+		
+		double shiftFactor =
+			-2.0*M_PI* (newUVW.getVector()[2] - oldUVW[2]);
+		double dnu = newUVW.getVector()[0], dnv = newUVW.getVector()[1];
+		shiftFactor +=
+			-2.0*M_PI* (dnu*_newDl + dnv*_newDm);
+		shiftFactor -=
+			-2.0*M_PI* (oldUVW[0]*_oldDl + oldUVW[1]*_oldDm);
+		shiftFactors[i] = shiftFactor;
+		
+		// Store uvws
+		for(size_t j=0; j!=3; ++j)
+			uvwPtr[i*3 + j] = newUVW.getVector()[j];
+	}
+	
+	if(polarizationCount != 0)
+	{
+		// Phase-rotate the visibilities
+		parallelFor(block.rowCount, _threadCount, [&](size_t i) {
+			if(fieldIndex < 0 || block.fieldId[i] == fieldIndex)
+			{
+				thread_local std::vector<std::complex<double>> phasors;
+				phasors.resize(thisBand.ChannelCount());
+				for(Array<Complex>& data : block.data)
+					rotateVisibilities(thisBand, isRegular, shiftFactors[i], polarizationCount, data.data() + i*valuesPerRow, phasors.data());
+			}
+		});
+	}
+}
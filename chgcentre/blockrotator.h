@@ -0,0 +1,247 @@
+#ifndef BLOCK_ROTATOR_H
+#define BLOCK_ROTATOR_H
+
+#include <algorithm>
+#include <complex>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <casacore/ms/MeasurementSets/MeasurementSet.h>
+
+#include <casacore/measures/Measures/MDirection.h>
+#include <casacore/measures/Measures/MEpoch.h>
+#include <casacore/measures/Measures/MPosition.h>
+#include <casacore/measures/Measures/Muvw.h>
+
+#include <casacore/tables/Tables/ArrayColumn.h>
+#include <casacore/tables/Tables/ScalarColumn.h>
+
+#include "banddata.h"
+#include "multibanddata.h"
+#include "progressbar.h"
+
+casacore::Muvw calculateUVW(const casacore::MPosition &antennaPos,
+	const casacore::MPosition &refPos, const casacore::MEpoch &time, const casacore::MDirection &direction);
+
+void rotateVisibilities(const BandData &bandData, double shiftFactor, unsigned polarizationCount, casacore::Array<casacore::Complex>::contiter dataIter);
+
+/**
+ * Runs func(index) for all indices in [0, count), divided in contiguous ranges over
+ * the given number of threads.
+ */
+template<typename Func>
+void parallelFor(size_t count, size_t threadCount, Func func)
+{
+	threadCount = std::max<size_t>(1, std::min(threadCount, count));
+	if(threadCount == 1)
+	{
+		for(size_t i=0; i!=count; ++i)
+			func(i);
+	}
+	else {
+		std::vector<std::thread> threads;
+		threads.reserve(threadCount);
+		for(size_t t=0; t!=threadCount; ++t)
+		{
+			const size_t start = count*t/threadCount, end = count*(t+1)/threadCount;
+			threads.emplace_back([start, end, &func]() {
+				for(size_t i=start; i!=end; ++i)
+					func(i);
+			});
+		}
+		for(std::thread& thread : threads)
+			thread.join();
+	}
+}
+
+/**
+ * Returns true when the channel frequencies are equally spaced, in which case the phase
+ * of a rotation increases linearly with the channel index.
+ */
+bool isRegularlySpaced(const BandData& band);
+
+/**
+ * Like rotateVisibilities(), but for a row in a contiguous buffer. For regularly spaced
+ * channels, the phasors are calculated with a recurrence, which replaces the sincos per
+ * channel by a complex multiplication. To bound the accumulation of rounding errors, the
+ * recurrence is restarted from an exact sincos every 64 channels. The phasors are first
+ * stored in @p phasors (which should have space for a phasor per channel), after which
+ * they are applied in a loop that the compiler can vectorize.
+ */
+void rotateVisibilities(const BandData &bandData, bool isRegular, double shiftFactor, unsigned polarizationCount, casacore::Complex* data, std::complex<double>* phasors);
+
+/**
+ * A range of consecutive rows of the main table, of which the values of the columns
+ * are read at once with getColumnRange(). All rows in a block have the same data
+ * description id, such that the data columns have the same shape for each row.
+ */
+struct RowBlock
+{
+	size_t startRow, rowCount;
+	casacore::Vector<int> antenna1, antenna2, fieldId;
+	int dataDescId;
+	casacore::Vector<double> time;
+	/** Shape [3, rowCount]. */
+	casacore::Array<double> uvw;
+	/** One array for each column that is phase rotated, each of shape [pol, ch, rowCount]. */
+	std::vector<casacore::Array<casacore::Complex>> data;
+	
+	/**
+	 * Make this block a copy of @p source. The columns that are changed by the rotation
+	 * are deep copied, the others are referenced.
+	 */
+	void CopyFrom(const RowBlock& source)
+	{
+		startRow = source.startRow;
+		rowCount = source.rowCount;
+		antenna1.reference(source.antenna1);
+		antenna2.reference(source.antenna2);
+		fieldId.reference(source.fieldId);
+		dataDescId = source.dataDescId;
+		time.reference(source.time);
+		uvw.reference(source.uvw.copy());
+		data.resize(source.data.size());
+		for(size_t i=0; i!=data.size(); ++i)
+			data[i].reference(source.data[i].copy());
+	}
+};
+
+/**
+ * The columns of the main table that are needed to rotate blocks of rows.
+ */
+struct MainColumns
+{
+	MainColumns(casacore::MeasurementSet& set, const std::vector<std::string>& dataColumnNames);
+	
+	/**
+	 * Reads the next block of rows starting at @p startRow. The block will contain at most
+	 * @p maxRows rows, and ends before the data description id changes.
+	 */
+	void Read(RowBlock& block, size_t startRow, size_t maxRows);
+	
+	/**
+	 * Writes the uvws and visibilities of the block back.
+	 */
+	void Write(const RowBlock& block);
+	
+	/**
+	 * Maximum number of rows per block, such that a block takes roughly 64 MB per data
+	 * column.
+	 */
+	size_t MaxBlockRows() const;
+	
+	casacore::ROScalarColumn<int> antenna1, antenna2, fieldId, dataDescId;
+	casacore::ROScalarColumn<double> time;
+	casacore::ArrayColumn<double> uvw;
+	std::vector<std::unique_ptr<casacore::ArrayColumn<casacore::Complex>>> data;
+	size_t nRows;
+};
+
+/**
+ * Names of the columns that are phase rotated: the given data column, or otherwise
+ * DATA, CORRECTED_DATA and MODEL_DATA when they exist.
+ */
+std::vector<std::string> getDataColumnNames(casacore::MeasurementSet& set, const std::string& dataColumn, bool onlyUVW);
+
+/**
+ * Calculates the new uvws of the rows in a block and phase rotates their visibilities
+ * towards a new direction. The antenna uvws are calculated once per timestep, and are kept
+ * between blocks because a timestep can span multiple blocks. Therefore, blocks should be
+ * processed in row order.
+ */
+class BlockRotator
+{
+public:
+	BlockRotator(const std::vector<casacore::MPosition>& antennas, const MultiBandData& bandData,
+		const casacore::MPosition& arrayPos, const casacore::MDirection& newDirection,
+		const casacore::MEpoch::Ref& timeRef, bool flipUVWSign, double oldDl, double oldDm, double newDl, double newDm, size_t threadCount);
+	
+	/**
+	 * Calculates the antenna uvws of the given time on the calling thread. On the first
+	 * conversion, casacore loads the IERS tables through the table system, which is not
+	 * thread safe. This should therefore be called before blocks are processed while
+	 * another thread accesses a table.
+	 */
+	void Initialize(double time)
+	{
+		calculateAntennaUVWs(time, 1);
+	}
+	
+	/**
+	 * Process the rows in the block that have the given field id, or all rows when
+	 * @p fieldIndex is negative. The block's table is not accessed, so this may run
+	 * while another thread reads or writes the table.
+	 */
+	void Process(RowBlock& block, int fieldIndex, bool printFirstRows);
+	
+private:
+	void calculateAntennaUVWs(double time, size_t threadCount);
+	
+	const std::vector<casacore::MPosition>& _antennas;
+	const MultiBandData& _bandData;
+	casacore::MPosition _arrayPos;
+	casacore::MDirection _refDirection;
+	casacore::MEpoch::Ref _timeRef;
+	bool _flipUVWSign;
+	double _oldDl, _oldDm, _newDl, _newDm;
+	size_t _threadCount;
+	std::vector<bool> _isRegularBand;
+	std::vector<casacore::Muvw> _uvws;
+	double _uvwTime;
+};
+
+/**
+ * Streams all rows of a table through read, process and write steps. The process step
+ * of a block runs asynchronously, while the calling thread writes the previous block
+ * and reads the next one. Hence, three blocks are kept in memory. The read and write
+ * functions are only called from the calling thread, so only they may access the table.
+ * @param read Function (BlockType&, size_t startRow) that reads the block starting at the
+ * given row, and returns the number of rows that were read.
+ * @param process Function (BlockType&) that processes a block.
+ * @param write Function (BlockType&) that writes a processed block.
+ */
+template<typename BlockType, typename ReadFunc, typename ProcessFunc, typename WriteFunc>
+void runBlockPipeline(size_t rowCount, const std::string& taskDescription, ReadFunc read, ProcessFunc process, WriteFunc write)
+{
+	std::unique_ptr<ProgressBar> progressBar;
+	BlockType blocks[3];
+	size_t blockEnds[3];
+	size_t reading = 0, rotating = 1, writing = 2;
+	bool hasRotating = false, hasWriting = false;
+	size_t nextRow = 0;
+	if(nextRow != rowCount)
+	{
+		nextRow += read(blocks[rotating], nextRow);
+		blockEnds[rotating] = nextRow;
+		hasRotating = true;
+	}
+	while(hasRotating)
+	{
+		std::future<void> processing = std::async(std::launch::async, [&]() { process(blocks[rotating]); });
+		if(hasWriting)
+		{
+			write(blocks[writing]);
+			if(progressBar == nullptr)
+				progressBar.reset(new ProgressBar(taskDescription));
+			progressBar->SetProgress(blockEnds[writing], rowCount);
+		}
+		const bool hasReading = nextRow != rowCount;
+		if(hasReading)
+		{
+			nextRow += read(blocks[reading], nextRow);
+			blockEnds[reading] = nextRow;
+		}
+		processing.get();
+		std::swap(writing, rotating);
+		std::swap(rotating, reading);
+		hasWriting = true;
+		hasRotating = hasReading;
+	}
+	if(hasWriting)
+		write(blocks[writing]);
+}
+
+#endif
@@ -1,5 +1,10 @@
+#include <algorithm>
+#include <complex>
+#include <future>
 #include <iostream>
 #include <memory>
+#include <sstream>
+#include <thread>
 
 #include <casacore/ms/MeasurementSets/MeasurementSet.h>
 
@@ -18,10 +23,15 @@
 #include <casacore/measures/Measures/MeasConvert.h>
 #include <casacore/measures/Measures/MeasTable.h>
 
+#include <casacore/casa/Containers/Block.h>
+#include <casacore/casa/Quanta/Quantum.h>
+
+#include <casacore/tables/Tables/TableCopy.h>
 #include <casacore/tables/Tables/TableRecord.h>
 
 #include "radeccoord.h"
 #include "banddata.h"
+#include "blockrotator.h"
 #include "progressbar.h"
 #include "imagecoordinates.h"
 #include "multibanddata.h"
@@ -69,37 +79,6 @@ double length(const Vector<double> &v)
 	return sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
 }
 
-Muvw calculateUVW(const MPosition &antennaPos,
-									const MPosition &refPos, const MEpoch &time, const MDirection &direction)
-{
-	const Vector<double> posVec = antennaPos.getValue().getVector();
-	const Vector<double> refVec = refPos.getValue().getVector();
-	MVPosition relativePos(posVec[0]-refVec[0], posVec[1]-refVec[1], posVec[2]-refVec[2]);
-	MeasFrame frame(time, refPos, direction);
-	MBaseline baseline(MVBaseline(relativePos), MBaseline::Ref(MBaseline::ITRF, frame));
-	MBaseline j2000Baseline = MBaseline::Convert(baseline, MBaseline::J2000)();
-	MVuvw uvw(j2000Baseline.getValue(), direction.getValue());
-	return Muvw(uvw, Muvw::J2000);
-}
-
-void rotateVisibilities(const BandData &bandData, double shiftFactor, unsigned polarizationCount, Array<Complex>::contiter dataIter)
-{
-	for(unsigned ch=0; ch!=bandData.ChannelCount(); ++ch)
-	{
-		const double wShiftRad = shiftFactor / bandData.ChannelWavelength(ch);
-		double rotSin, rotCos;
-		sincos(wShiftRad, &rotSin, &rotCos);
-		for(unsigned p=0; p!=polarizationCount; ++p)
-		{
-			Complex v = *dataIter;
-			*dataIter = Complex(
-				v.real() * rotCos  -  v.imag() * rotSin,
-				v.real() * rotSin  +  v.imag() * rotCos);
-			++dataIter;
-		}
-	}
-}
-
 casacore::MPosition ArrayCentroid(MeasurementSet& set)
 {
 	casacore::MSAntenna aTable = set.antenna();
@@ -200,48 +179,13 @@ void getShift(MSField& fieldTable, double& dl, double& dm)
 
 void processField(
 	MeasurementSet &set, const std::string& dataColumn, int fieldIndex, MSField &fieldTable, const MDirection &newDirection,
-	bool onlyUVW, bool shiftback, double newDl, double newDm, bool flipUVWSign, bool force)
+	bool onlyUVW, bool shiftback, double newDl, double newDm, bool flipUVWSign, bool force, size_t threadCount)
 {
 	MultiBandData bandData(set.spectralWindow(), set.dataDescription());
 	ROScalarColumn<casacore::String> nameCol(fieldTable, fieldTable.columnName(MSFieldEnums::NAME));
 	MDirection::ArrayColumn phaseDirCol(fieldTable, fieldTable.columnName(MSFieldEnums::PHASE_DIR));
 	MEpoch::ROScalarColumn timeCol(set, set.columnName(MSMainEnums::TIME));
 	
-	ROScalarColumn<int>
-		antenna1Col(set, set.columnName(MSMainEnums::ANTENNA1)),
-		antenna2Col(set, set.columnName(MSMainEnums::ANTENNA2)),
-		fieldIdCol(set, set.columnName(MSMainEnums::FIELD_ID)),
-		dataDescIdCol(set, set.columnName(MSMainEnums::DATA_DESC_ID));
-	Muvw::ROScalarColumn
-		uvwCol(set, set.columnName(MSMainEnums::UVW));
-	ArrayColumn<double>
-		uvwOutCol(set, set.columnName(MSMainEnums::UVW));
-	
-	const bool
-		hasCorrData = dataColumn.empty() && set.isColumn(casacore::MSMainEnums::CORRECTED_DATA),
-		hasModelData = dataColumn.empty() && set.isColumn(casacore::MSMainEnums::MODEL_DATA);
-	std::unique_ptr<ArrayColumn<Complex> > dataCol, correctedDataCol, modelDataCol;
-	if(!onlyUVW)
-	{
-		if(dataColumn.empty())
-		{
-			dataCol.reset(new ArrayColumn<Complex>(set, set.columnName(MSMainEnums::DATA)));
-			if(hasCorrData)
-			{
-				correctedDataCol.reset(new ArrayColumn<Complex>(set,
-					set.columnName(MSMainEnums::CORRECTED_DATA)));
-			}
-			if(hasModelData)
-			{
-				modelDataCol.reset(new ArrayColumn<Complex>(set,
-					set.columnName(MSMainEnums::MODEL_DATA)));
-			}
-		}
-		else {
-			dataCol.reset(new ArrayColumn<Complex>(set, dataColumn));
-		}
-	}
-	
 	MPosition arrayPos = ArrayPosition(set);
 	Vector<MDirection> phaseDirVector = phaseDirCol(fieldIndex);
 	MDirection phaseDirection = phaseDirVector[0];
@@ -274,97 +218,21 @@ void processField(
 		if(isSameDirection)
 			std::cout << "Phase centre not changed, but forcing update.\n";
 		
-		MDirection refDirection =
-			MDirection::Convert(newDirection,
-													MDirection::Ref(MDirection::J2000))();
-		IPosition dataShape;
-		unsigned polarizationCount = 0;
-		std::unique_ptr<Array<Complex> > dataArray;
-		if(!onlyUVW)
-		{
-			dataShape = dataCol->shape(0);
-			polarizationCount = dataShape[0];
-			dataArray.reset(new Array<Complex>(dataShape));
-		}
-		
-		std::unique_ptr<ProgressBar> progressBar;
+		MainColumns columns(set, getDataColumnNames(set, dataColumn, onlyUVW));
+		const size_t maxBlockRows = columns.MaxBlockRows();
+		const MEpoch::Ref timeRef = set.nrow() == 0 ? MEpoch::Ref() : MEpoch::Ref(timeCol(0).getRef());
+		BlockRotator rotator(antennas, bandData, arrayPos, newDirection, timeRef, flipUVWSign, oldDl, oldDm, newDl, newDm, threadCount);
+		if(set.nrow() != 0)
+			rotator.Initialize(columns.time(0));
 		
-		std::vector<Muvw> uvws(antennas.size());
-		MEpoch time(MVEpoch(-1.0));
-		for(unsigned row=0; row!=set.nrow(); ++row)
-		{
-			if(fieldIdCol(row) == fieldIndex)
-			{
-				// Read values from set
-				const int
-					antenna1 = antenna1Col(row),
-					antenna2 = antenna2Col(row),
-					dataDescId = dataDescIdCol(row);
-				const Muvw oldUVW = uvwCol(row);
-				
-				MEpoch rowTime = timeCol(row);
-				if(rowTime.getValue() != time.getValue())
-				{
-					time = rowTime;
-					for(size_t a=0; a!=antennas.size(); ++a)
-						uvws[a] = calculateUVW(antennas[a], arrayPos, time, refDirection);
-				}
-
-				// Calculate the new UVW
-				MVuvw newUVW = uvws[antenna1].getValue() - uvws[antenna2].getValue();
-				if(flipUVWSign)
-					newUVW = -newUVW;
-				
-				// If one of the first results, output values for analyzing them.
-				if(row < 5)
-				{
-					std::cout << "Old " << oldUVW << " (" << length(oldUVW) << ")\n";
-					std::cout << "New " << newUVW << " (" << length(newUVW) << ")\n\n";
-				}
-				else {
-					if(progressBar == nullptr)
-						progressBar.reset(new ProgressBar("Changing phase centre"));
-					progressBar->SetProgress(row, set.nrow());
-				}
-				
-				if(!onlyUVW)
-				{
-					// Read the visibilities and phase-rotate them
-					double shiftFactor =
-						-2.0*M_PI* (newUVW.getVector()[2] - oldUVW.getValue().getVector()[2]);
-
-					double dnu = newUVW.getVector()[0], dnv = newUVW.getVector()[1];
-					shiftFactor +=
-						-2.0*M_PI* (dnu*newDl + dnv*newDm);
-					double dou = oldUVW.getValue().getVector()[0], dov = oldUVW.getValue().getVector()[1];
-					shiftFactor -=
-						-2.0*M_PI* (dou*oldDl + dov*oldDm);
-					
-					const BandData& thisBand = bandData[dataDescId];
-					dataCol->get(row, *dataArray);
-					rotateVisibilities(thisBand, shiftFactor, polarizationCount, dataArray->cbegin());
-					dataCol->put(row, *dataArray);
-						
-					if(hasCorrData)
-					{
-						correctedDataCol->get(row, *dataArray);
-						rotateVisibilities(thisBand, shiftFactor, polarizationCount, dataArray->cbegin());
-						correctedDataCol->put(row, *dataArray);
-					}
-					
-					if(hasModelData)
-					{
-						modelDataCol->get(row, *dataArray);
-						rotateVisibilities(thisBand, shiftFactor, polarizationCount, dataArray->cbegin());
-						modelDataCol->put(row, *dataArray);
-					}
-				}
-				
-				// Store uvws
-				uvwOutCol.put(row, newUVW.getVector());
-			}
-		}
-		progressBar.reset();
+		runBlockPipeline<RowBlock>(set.nrow(), "Changing phase centre",
+			[&](RowBlock& block, size_t startRow) {
+				columns.Read(block, startRow, maxBlockRows);
+				return block.rowCount;
+			},
+			[&](RowBlock& block) { rotator.Process(block, fieldIndex, true); },
+			[&](RowBlock& block) { columns.Write(block); }
+		);
 		
 		phaseDirVector[0] = newDirection;
 		phaseDirCol.put(fieldIndex, phaseDirVector);
@@ -389,6 +257,111 @@ void processField(
 	}
 }
 
+/**
+ * Phase rotates the measurement set towards several directions in one pass over the
+ * data. For each direction, a new measurement set named "<prefix>-<index>.ms" is
+ * created, which is a copy of the input set with its uvws and visibilities rotated
+ * towards that direction. The input set is not changed.
+ * 
+ * The input is read once per block of rows. The columns that are not rotated are
+ * copied to the outputs per block, while the block is still in the table cache.
+ * The rotations towards the different directions run in parallel.
+ */
+void fanOut(
+	MeasurementSet &set, const std::string& dataColumn, const std::vector<MDirection>& newDirections,
+	const std::string& outputPrefix, bool flipUVWSign, size_t threadCount)
+{
+	MultiBandData bandData(set.spectralWindow(), set.dataDescription());
+	MEpoch::ROScalarColumn timeCol(set, set.columnName(MSMainEnums::TIME));
+	MSField fieldTable = set.field();
+	MPosition arrayPos = ArrayPosition(set);
+	double oldDl, oldDm;
+	getShift(fieldTable, oldDl, oldDm);
+	
+	const std::vector<std::string> dataColumnNames = getDataColumnNames(set, dataColumn, false);
+	MainColumns inputColumns(set, dataColumnNames);
+	
+	// Columns that are copied without change
+	std::vector<std::string> copiedNames;
+	const Vector<String> allNames = set.tableDesc().columnNames();
+	for(const String& name : allNames)
+	{
+		if(name != set.columnName(MSMainEnums::UVW) &&
+			std::find(dataColumnNames.begin(), dataColumnNames.end(), name) == dataColumnNames.end())
+			copiedNames.push_back(name);
+	}
+	casacore::Block<String> copiedNamesBlock(copiedNames.size());
+	for(size_t i=0; i!=copiedNames.size(); ++i)
+		copiedNamesBlock[i] = copiedNames[i];
+	Table copiedInput = set.project(copiedNamesBlock);
+	
+	const size_t directionCount = newDirections.size();
+	const MEpoch::Ref timeRef = set.nrow() == 0 ? MEpoch::Ref() : MEpoch::Ref(timeCol(0).getRef());
+	const size_t threadsPerDirection = std::max<size_t>(1, threadCount / directionCount);
+	std::vector<std::unique_ptr<MeasurementSet>> outputs(directionCount);
+	std::vector<std::unique_ptr<MainColumns>> outputColumns(directionCount);
+	std::vector<Table> copiedOutputs(directionCount);
+	std::vector<std::unique_ptr<BlockRotator>> rotators(directionCount);
+	for(size_t d=0; d!=directionCount; ++d)
+	{
+		std::ostringstream name;
+		name << outputPrefix << '-' << d << ".ms";
+		std::cout << "Creating " << name.str() << " for direction " << dirToString(newDirections[d]) << "...\n";
+		set.deepCopy(name.str(), Table::New, false, Table::AipsrcEndian, true);
+		outputs[d].reset(new MeasurementSet(name.str(), Table::Update));
+		outputs[d]->addRow(set.nrow());
+		outputColumns[d].reset(new MainColumns(*outputs[d], dataColumnNames));
+		copiedOutputs[d] = outputs[d]->project(copiedNamesBlock);
+		rotators[d].reset(new BlockRotator(antennas, bandData, arrayPos, newDirections[d], timeRef, flipUVWSign, oldDl, oldDm, 0.0, 0.0, threadsPerDirection));
+		if(set.nrow() != 0)
+			rotators[d]->Initialize(inputColumns.time(0));
+	}
+	
+	// Each output has its own copy of the rotated columns. A block of all directions
+	// is therefore directionCount times as large as a single block.
+	const size_t maxBlockRows = std::max<size_t>(1, inputColumns.MaxBlockRows() / directionCount);
+	runBlockPipeline<std::vector<RowBlock>>(set.nrow(), "Changing phase centres",
+		[&](std::vector<RowBlock>& blocks, size_t startRow) {
+			blocks.resize(directionCount);
+			inputColumns.Read(blocks[0], startRow, maxBlockRows);
+			return blocks[0].rowCount;
+		},
+		[&](std::vector<RowBlock>& blocks) {
+			// Block 0 holds the input, so it is copied before it is rotated
+			for(size_t d=1; d!=directionCount; ++d)
+				blocks[d].CopyFrom(blocks[0]);
+			parallelFor(directionCount, threadCount, [&](size_t d) {
+				rotators[d]->Process(blocks[d], -1, false);
+			});
+		},
+		[&](std::vector<RowBlock>& blocks) {
+			const RowBlock& first = blocks.front();
+			for(size_t d=0; d!=directionCount; ++d)
+			{
+				TableCopy::copyRows(copiedOutputs[d], copiedInput, first.startRow, first.startRow, first.rowCount, false);
+				outputColumns[d]->Write(blocks[d]);
+			}
+		}
+	);
+	
+	for(size_t d=0; d!=directionCount; ++d)
+	{
+		MSField outField = outputs[d]->field();
+		MDirection::ArrayColumn phaseDirCol(outField, outField.columnName(MSFieldEnums::PHASE_DIR));
+		for(size_t fieldIndex=0; fieldIndex!=outField.nrow(); ++fieldIndex)
+		{
+			Vector<MDirection> phaseDirVector = phaseDirCol(fieldIndex);
+			phaseDirVector[0] = newDirections[d];
+			phaseDirCol.put(fieldIndex, phaseDirVector);
+		}
+		if(outField.keywordSet().isDefined("WSCLEAN_DL"))
+			outField.rwKeywordSet().removeField(RecordFieldId("WSCLEAN_DL"));
+		if(outField.keywordSet().isDefined("WSCLEAN_DM"))
+			outField.rwKeywordSet().removeField(RecordFieldId("WSCLEAN_DM"));
+		outputs[d]->flush();
+	}
+}
+
 void showChanges(
 	MeasurementSet &set, int fieldIndex, MSField &fieldTable, const MDirection &newDirection, bool flipUVWSign)
 {
@@ -692,6 +665,9 @@ int main(int argc, char **argv)
 			"The format of Dec can either be 00d00m00.0s or 00.00.00.0\n\n"
 			"Example to rotate to HydA:\n"
 			"\tchgcentre myset.ms 09h18m05.8s -12d05m44s\n\n"
+			"Syntax to rotate to several directions in one pass:\n"
+			"\tchgcentre -fanout <prefix> [options] <ms> <ra1> <dec1> [<ra2> <dec2> ...]\n"
+			"This writes the rotated sets to <prefix>-0.ms, <prefix>-1.ms, etc. and leaves the input set unchanged.\n\n"
 			"Some options:\n"
 			"-geozenith\n"
 			"\tWill calculate the RA,dec of zenith for each timestep, and moves there. This make the set non-standard.\n"
@@ -711,6 +687,8 @@ int main(int argc, char **argv)
 			"-datacolumn <name>\n"
 			"\tOnly phase-rotate the visibilities in the given column. Otherwise, the columns\n"
 			"\tDATA, MODEL_DATA and CORRECTED_DATA will all be processed if they exist.\n"
+			"-j <threads>\n"
+			"\tNumber of threads used for the phase rotation. Default: all cores.\n"
 			"\n";
 	} else {
 		int argi=1;
@@ -718,7 +696,8 @@ int main(int argc, char **argv)
 			toZenith = false, toMinW = false, onlyUVW = false,
 			shiftback = false, toGeozenith = false, flipUVWSign = false, force = false, show = false, same = false;
 		double newDl = 0.0, newDm = 0.0;
-		std::string templateMS;
+		size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+		std::string templateMS, fanOutPrefix;
 		std::string dataColumn;
 		while(argv[argi][0] == '-')
 		{
@@ -764,6 +743,16 @@ int main(int argc, char **argv)
 				++argi;
 				dataColumn = argv[argi];
 			}
+			else if(param == "j")
+			{
+				++argi;
+				threadCount = std::max(1, atoi(argv[argi]));
+			}
+			else if(param == "fanout")
+			{
+				++argi;
+				fanOutPrefix = argv[argi];
+			}
 			else if(param == "from-ms")
 			{
 				++argi;
@@ -774,6 +763,21 @@ int main(int argc, char **argv)
 		}
 		if(argi == argc)
 			std::cout << "Missing parameter.\n";
+		else if(!fanOutPrefix.empty())
+		{
+			if(argi+1 == argc || (argc-argi-1)%2 != 0)
+				throw std::runtime_error("-fanout requires a measurement set followed by one or more RA/dec pairs");
+			MeasurementSet set(argv[argi]);
+			readAntennas(set, antennas);
+			std::vector<MDirection> newDirections;
+			for(int i=argi+1; i!=argc; i+=2)
+			{
+				double newRA = RaDecCoord::ParseRA(argv[i]);
+				double newDec = RaDecCoord::ParseDec(argv[i+1]);
+				newDirections.emplace_back(MVDirection(newRA, newDec), MDirection::Ref(MDirection::J2000));
+			}
+			fanOut(set, dataColumn, newDirections, fanOutPrefix, flipUVWSign, threadCount);
+		}
 		else if(argi+1 == argc && !toZenith && !toMinW && !toGeozenith && !same && templateMS.empty())
 		{
 			MeasurementSet set(argv[argi]);
@@ -825,7 +829,7 @@ int main(int argc, char **argv)
 				else if(toGeozenith)
 					rotateToGeoZenith(set, fieldIndex, fieldTable, onlyUVW, flipUVWSign);
 				else
-					processField(set, dataColumn, fieldIndex, fieldTable, newDirection, onlyUVW, shiftback, newDl, newDm, flipUVWSign, force);
+					processField(set, dataColumn, fieldIndex, fieldTable, newDirection, onlyUVW, shiftback, newDl, newDm, flipUVWSign, force, threadCount);
 			}
 		}
 	}
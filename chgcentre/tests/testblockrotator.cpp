@@ -0,0 +1,178 @@
+#include <boost/test/unit_test.hpp>
+
+#include "../blockrotator.h"
+
+#include <casacore/ms/MeasurementSets/MSDataDescColumns.h>
+#include <casacore/ms/MeasurementSets/MSSpWindowColumns.h>
+
+#include <casacore/measures/Measures/MCDirection.h>
+
+#include <casacore/casa/Quanta/Quantum.h>
+
+#include <casacore/tables/Tables/SetupNewTab.h>
+
+#include <cmath>
+
+BOOST_AUTO_TEST_SUITE(block_rotator)
+
+namespace {
+	const size_t antennaCount = 5, timestepCount = 3, channelCount = 70, polarizationCount = 4;
+
+	std::vector<casacore::MPosition> makeAntennas()
+	{
+		std::vector<casacore::MPosition> antennas;
+		for(size_t a=0; a!=antennaCount; ++a)
+		{
+			antennas.emplace_back(casacore::MVPosition(
+				3826577.0 + 731.0*a, 461022.0 - 1259.0*(a%3), 5064892.0 + 317.0*a*a
+			), casacore::MPosition::ITRF);
+		}
+		return antennas;
+	}
+
+	/**
+	 * Creates a scratch measurement set with a regularly spaced band and an irregular
+	 * band. All baselines are stored for each timestep, and the uvws correspond with
+	 * the @p oldDirection. The visibilities are arbitrary.
+	 */
+	casacore::MeasurementSet makeSet(const std::vector<casacore::MPosition>& antennas, const casacore::MDirection& oldDirection)
+	{
+		casacore::TableDesc description = casacore::MeasurementSet::requiredTableDesc();
+		casacore::MeasurementSet::addColumnToDesc(description, casacore::MSMainEnums::DATA, 2);
+		casacore::SetupNewTable setup("test-block-rotator.ms", description, casacore::Table::Scratch);
+		casacore::MeasurementSet set(setup);
+		set.createDefaultSubtables(casacore::Table::Scratch);
+
+		casacore::MSSpectralWindow spwTable = set.spectralWindow();
+		casacore::MSDataDescription dataDescTable = set.dataDescription();
+		casacore::MSSpWindowColumns spwColumns(spwTable);
+		casacore::MSDataDescColumns dataDescColumns(dataDescTable);
+		for(size_t band=0; band!=2; ++band)
+		{
+			casacore::Vector<double> frequencies(channelCount), widths(channelCount, 195e3);
+			for(size_t ch=0; ch!=channelCount; ++ch)
+			{
+				frequencies[ch] = 140e6 + 195e3*ch;
+				// The second band is made irregular
+				if(band == 1)
+					frequencies[ch] += 10e3*ch*ch;
+			}
+			spwTable.addRow();
+			spwColumns.numChan().put(band, channelCount);
+			spwColumns.chanFreq().put(band, frequencies);
+			spwColumns.chanWidth().put(band, widths);
+			dataDescTable.addRow();
+			dataDescColumns.spectralWindowId().put(band, band);
+			dataDescColumns.polarizationId().put(band, 0);
+		}
+
+		casacore::ScalarColumn<int>
+			antenna1Column(set, set.columnName(casacore::MSMainEnums::ANTENNA1)),
+			antenna2Column(set, set.columnName(casacore::MSMainEnums::ANTENNA2)),
+			dataDescIdColumn(set, set.columnName(casacore::MSMainEnums::DATA_DESC_ID));
+		casacore::ScalarColumn<double> timeColumn(set, set.columnName(casacore::MSMainEnums::TIME));
+		casacore::ArrayColumn<double> uvwColumn(set, set.columnName(casacore::MSMainEnums::UVW));
+		casacore::ArrayColumn<casacore::Complex> dataColumn(set, set.columnName(casacore::MSMainEnums::DATA));
+		const casacore::IPosition shape(2, polarizationCount, channelCount);
+		size_t row = 0;
+		for(size_t band=0; band!=2; ++band)
+		{
+			for(size_t t=0; t!=timestepCount; ++t)
+			{
+				const double time = 4.9e9 + 3600.0*t + 10000.0*band;
+				casacore::MEpoch epoch(casacore::MVEpoch(casacore::Quantity(time, "s")), casacore::MEpoch::UTC);
+				for(size_t a1=0; a1!=antennaCount; ++a1)
+				{
+					for(size_t a2=a1+1; a2!=antennaCount; ++a2)
+					{
+						set.addRow();
+						antenna1Column.put(row, a1);
+						antenna2Column.put(row, a2);
+						dataDescIdColumn.put(row, band);
+						timeColumn.put(row, time);
+						casacore::Vector<double> uvw =
+							calculateUVW(antennas[a1], antennas[0], epoch, oldDirection).getValue().getVector() -
+							calculateUVW(antennas[a2], antennas[0], epoch, oldDirection).getValue().getVector();
+						uvwColumn.put(row, uvw);
+						casacore::Array<casacore::Complex> data(shape);
+						for(size_t i=0; i!=data.size(); ++i)
+							data.data()[i] = casacore::Complex(std::cos(0.1*(row+i)), std::sin(0.3*row + 0.2*i));
+						dataColumn.put(row, data);
+						++row;
+					}
+				}
+			}
+		}
+		return set;
+	}
+}
+
+BOOST_AUTO_TEST_CASE( pipeline_matches_direct_rotation )
+{
+	const std::vector<casacore::MPosition> antennas = makeAntennas();
+	const casacore::MDirection
+		oldDirection(casacore::Quantity(2.0, "rad"), casacore::Quantity(0.9, "rad"), casacore::MDirection::J2000),
+		newDirection(casacore::Quantity(2.05, "rad"), casacore::Quantity(0.87, "rad"), casacore::MDirection::J2000);
+	const double newDl = 0.01, newDm = -0.02;
+	casacore::MeasurementSet set = makeSet(antennas, oldDirection);
+	casacore::MSSpectralWindow spwTable = set.spectralWindow();
+	casacore::MSDataDescription dataDescTable = set.dataDescription();
+	const MultiBandData bandData(spwTable, dataDescTable);
+	BOOST_CHECK(isRegularlySpaced(bandData[0]));
+	BOOST_CHECK(!isRegularlySpaced(bandData[1]));
+
+	// Read the unrotated values before the table is changed
+	const size_t rowCount = set.nrow();
+	MainColumns columns(set, getDataColumnNames(set, std::string(), false));
+	RowBlock original;
+	columns.Read(original, 0, rowCount / 2);
+	BOOST_REQUIRE_EQUAL(original.rowCount, rowCount / 2);
+	RowBlock originalSecondBand;
+	columns.Read(originalSecondBand, rowCount / 2, rowCount);
+	BOOST_REQUIRE_EQUAL(originalSecondBand.rowCount, rowCount / 2);
+
+	// Blocks of 7 rows make timesteps span multiple blocks
+	const casacore::MEpoch::Ref timeRef(casacore::MEpoch::UTC);
+	BlockRotator rotator(antennas, bandData, antennas[0], newDirection, timeRef, false, 0.0, 0.0, newDl, newDm, 4);
+	rotator.Initialize(columns.time(0));
+	runBlockPipeline<RowBlock>(rowCount, "Changing phase centre",
+		[&](RowBlock& block, size_t startRow) {
+			columns.Read(block, startRow, 7);
+			return block.rowCount;
+		},
+		[&](RowBlock& block) { rotator.Process(block, -1, false); },
+		[&](RowBlock& block) { columns.Write(block); }
+	);
+
+	// Direct, single-threaded computation per row
+	const casacore::ArrayColumn<double> uvwColumn(set, set.columnName(casacore::MSMainEnums::UVW));
+	const casacore::ArrayColumn<casacore::Complex> dataColumn(set, set.columnName(casacore::MSMainEnums::DATA));
+	for(size_t row=0; row!=rowCount; ++row)
+	{
+		const RowBlock& block = row < rowCount/2 ? original : originalSecondBand;
+		const size_t i = row < rowCount/2 ? row : row - rowCount/2;
+		casacore::MEpoch epoch(casacore::MVEpoch(casacore::Quantity(block.time[i], "s")), timeRef);
+		const casacore::Vector<double> newUVW =
+			calculateUVW(antennas[block.antenna1[i]], antennas[0], epoch, newDirection).getValue().getVector() -
+			calculateUVW(antennas[block.antenna2[i]], antennas[0], epoch, newDirection).getValue().getVector();
+		const double* oldUVW = &block.uvw.data()[i*3];
+		const double shiftFactor =
+			-2.0*M_PI* (newUVW[2] - oldUVW[2])
+			-2.0*M_PI* (newUVW[0]*newDl + newUVW[1]*newDm);
+		casacore::Array<casacore::Complex> expected(casacore::IPosition(2, polarizationCount, channelCount));
+		std::copy_n(block.data[0].data() + i*expected.size(), expected.size(), expected.data());
+		rotateVisibilities(bandData[block.dataDescId], shiftFactor, polarizationCount, expected.cbegin());
+
+		const casacore::Vector<double> uvw = uvwColumn(row);
+		for(size_t j=0; j!=3; ++j)
+			BOOST_CHECK_CLOSE_FRACTION(uvw[j], newUVW[j], 1e-10);
+		const casacore::Array<casacore::Complex> data = dataColumn(row);
+		for(size_t v=0; v!=data.size(); ++v)
+		{
+			BOOST_CHECK_SMALL(data.data()[v].real() - expected.data()[v].real(), 1e-4f);
+			BOOST_CHECK_SMALL(data.data()[v].imag() - expected.data()[v].imag(), 1e-4f);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
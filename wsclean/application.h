@@ -11,9 +11,19 @@
 class Application {
 public:
 	static void Run(const std::string& commandLine)
+	{
+		Wait(Start(commandLine));
+	}
+	
+	/**
+	 * Start a command line application without waiting for it to finish, such that
+	 * several applications can run concurrently.
+	 * @returns The process id, to be passed to Wait().
+	 */
+	static pid_t Start(const std::string& commandLine)
 	{
 		Logger::Info << "Running: " << commandLine << '\n';
-		int pid = vfork();
+		pid_t pid = vfork();
 		switch (pid) {
 			case -1: // Error
 				throw std::runtime_error("Could not vfork() new process for executing command line application");
@@ -21,7 +31,14 @@ public:
 				execl("/bin/sh", "sh", "-c", commandLine.c_str(), NULL);
 				_exit(127);
 		}
-		// Wait for process to terminate
+		return pid;
+	}
+	
+	/**
+	 * Wait for a process that was started with Start() to terminate.
+	 */
+	static void Wait(pid_t pid)
+	{
 		int pStatus;
 		do {
 			int pidReturn;
@@ -37,6 +37,8 @@ public:
 		if(aterms.empty())
 			throw std::runtime_error("No a-term correction given in parset (aterms key is an empty list)");
 		
+		// Together, the caches of the FITS a-terms may use a tenth of the memory limit
+		const size_t maxCacheSize = _settings.MemoryLimit() / (10.0 * aterms.size());
 		for(const std::string atermName : aterms)
 		{
 			std::string atermType = reader.GetStringOr(atermName + ".type", atermName);
@@ -45,6 +47,7 @@ public:
 				std::vector<std::string> tecFiles = reader.GetStringList(atermName + ".images");
 				std::unique_ptr<FitsATerm> f(new FitsATerm(_nAntenna, _coordinateSystem));
 				f->OpenTECFiles(tecFiles);
+				f->SetMaxCacheSize(maxCacheSize);
 				std::string windowStr = reader.GetStringOr(atermName + ".window", "rectangular");
 				WindowFunction::Type window = WindowFunction::GetType(windowStr);
 				if(window == WindowFunction::Tukey)
@@ -58,6 +61,7 @@ public:
 				std::vector<std::string> diagFiles = reader.GetStringList(atermName + ".images");
 				std::unique_ptr<FitsATerm> f(new FitsATerm(_nAntenna, _coordinateSystem));
 				f->OpenDiagGainFiles(diagFiles);
+				f->SetMaxCacheSize(maxCacheSize);
 				std::string windowStr = reader.GetStringOr(atermName + ".window", "rectangular");
 				WindowFunction::Type window = WindowFunction::GetType(windowStr);
 				if(window == WindowFunction::Tukey)
@@ -71,6 +75,7 @@ public:
 				std::vector<std::string> dldmFiles = reader.GetStringList(atermName + ".images");
 				std::unique_ptr<DLDMATerm> f(new DLDMATerm(_nAntenna, _coordinateSystem));
 				f->Open(dldmFiles);
+				f->SetMaxCacheSize(maxCacheSize);
 				f->SetUpdateInterval( reader.GetDoubleOr("dldm.update_interval", 5.0*60.0) );
 				std::string windowStr = reader.GetStringOr(atermName + ".window", "rectangular");
 				WindowFunction::Type window = WindowFunction::GetType(windowStr);
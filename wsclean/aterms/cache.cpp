@@ -1,5 +1,61 @@
 #include "cache.h"
 
-#include <limits>
+#include <algorithm>
+#include <iterator>
 
-const size_t Cache::NOT_FOUND = std::numeric_limits<size_t>::max();
+namespace {
+	std::mutex registryMutex;
+	std::map<std::string, std::shared_ptr<Cache>> registry;
+}
+
+std::shared_ptr<Cache> Cache::GetShared(const std::string& key, size_t atermSize, size_t maxEntries)
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	std::shared_ptr<Cache>& cache = registry[key];
+	if(cache == nullptr || cache->ATermSize() != atermSize || cache->MaxEntries() != maxEntries)
+		cache = std::make_shared<Cache>(atermSize, maxEntries);
+	return cache;
+}
+
+void Cache::ClearShared()
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	registry.clear();
+}
+
+bool Cache::Get(size_t timeIndex, double frequency, std::complex<float>* destination)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto iter = _index.find(Key(timeIndex, frequency));
+	if(iter == _index.end())
+		return false;
+	_entries.splice(_entries.begin(), _entries, iter->second);
+	std::copy_n(iter->second->ptr.get(), _atermSize, destination);
+	return true;
+}
+
+void Cache::Store(size_t timeIndex, double frequency, const std::complex<float>* data)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	const Key key(timeIndex, frequency);
+	auto iter = _index.find(key);
+	if(iter == _index.end())
+	{
+		if(_entries.size() < _maxEntries)
+		{
+			_entries.emplace_front();
+			_entries.front().ptr.reset(new std::complex<float>[_atermSize]);
+		}
+		else {
+			// Reuse the buffer of the least recently used entry
+			_index.erase(_entries.back().key);
+			_entries.splice(_entries.begin(), _entries, std::prev(_entries.end()));
+		}
+		_entries.front().key = key;
+		iter = _index.emplace(key, _entries.begin()).first;
+	}
+	else {
+		_entries.splice(_entries.begin(), _entries, iter->second);
+	}
+	std::copy_n(data, _atermSize, iter->second->ptr.get());
+}
@@ -3,116 +3,101 @@
 
 #include <algorithm>
 #include <complex>
+#include <list>
+#include <map>
 #include <memory>
-#include <vector>
+#include <mutex>
+#include <string>
 
 /**
- * A simple a-term cache that stores aterms for all frequencies in a single timestep.
- * Since each timestep will have the same frequency values, the cache maintains buffers
- * for each frequency value, and once all frequencies have been stored at least once,
+ * A least-recently-used cache of a-term buffers, keyed by the time index and the
+ * frequency for which they were calculated. It holds at most a fixed number of buffers:
+ * when the cache is full, the buffer that was least recently used is replaced, so that
  * no more allocations are performed.
- * 
- * Used by the FitsATerm class.
+ *
+ * A-term objects are recreated for every gridding pass. To keep calculated a-terms
+ * between passes (i.e., major iterations), a cache can be obtained with @ref GetShared(),
+ * which returns the same cache for the same key until @ref ClearShared() is called.
+ * All methods are thread safe.
+ *
+ * Used by the FitsATermBase class.
  */
 class Cache
 {
 public:
 	/**
 	 * Construct the cache.
+	 * @param atermSize Number of complex values of a single buffer.
+	 * @param maxEntries Maximum number of buffers that are kept.
 	 */
-	Cache() : _atermSize(0) { }
-	Cache(size_t atermSize) : _atermSize(atermSize) { }
-	
+	Cache(size_t atermSize, size_t maxEntries) :
+		_atermSize(atermSize),
+		_maxEntries(std::max<size_t>(maxEntries, 1))
+	{ }
+
 	Cache(const Cache&) = delete;
-	Cache(Cache&&) = default;
 	Cache& operator=(const Cache&) = delete;
-	Cache& operator=(Cache&&) = default;
-	
-	static const size_t NOT_FOUND;
-	
+
 	/**
-	 * Clears all stored values, such that e.g. the cache is ready for a new
-	 * timestep. After this call, @ref Find() will always return @ref NOT_FOUND .
+	 * Returns the cache for the given key. It is created with the given parameters when
+	 * no cache with this key exists yet. The key should describe everything that
+	 * the cached a-terms depend on, besides their time index and frequency.
 	 */
-	void Reset()
-	{
-		// The cache is 'emptied', but we don't entirely clear the data vector at
-		// the top level, as we can reuse the space from the individual entries
-		// and prevent reallocation.
-		for(Entry& entry : _entries)
-		{
-			entry.isValid = false;
-		}
-	}
-	
+	static std::shared_ptr<Cache> GetShared(const std::string& key, size_t atermSize, size_t maxEntries);
+
 	/**
-	 * Returns the index of the frequency, or @ref NOT_FOUND if not found.
+	 * Releases the shared caches. Caches that are still in use remain valid, but are
+	 * no longer returned by @ref GetShared(). Should be called when all gridding passes
+	 * that may reuse the a-terms are done.
 	 */
-	size_t Find(double frequency) const
-	{
-		auto iter = std::lower_bound(_frequencies.begin(), _frequencies.end(), frequency);
-		if(iter == _frequencies.end() || *iter != frequency)
-			return NOT_FOUND;
-		else {
-			size_t index = iter - _frequencies.begin();
-			if(_entries[index].isValid)
-				return index;
-			else
-				return NOT_FOUND;
-		}
-	}
-	
+	static void ClearShared();
+
 	/**
-	 * Retrieve a buffer given a frequency index (as returned by @ref Find() ).
+	 * Retrieve a buffer and mark it as most recently used.
 	 * @param destination Array with @ref ATermSize() elements.
+	 * @returns @c false if the buffer is not in the cache.
 	 */
-	void Get(size_t index, std::complex<float>* destination) const
+	bool Get(size_t timeIndex, double frequency, std::complex<float>* destination);
+
+	bool Contains(size_t timeIndex, double frequency) const
 	{
-		std::copy_n(_entries[index].ptr.get(), _atermSize, destination);
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _index.count(Key(timeIndex, frequency)) != 0;
 	}
-	
+
 	/**
-	 * Store the data for the given frequency in the cache. The data array should
-	 * be an array with @ref ATermSize() elements.
+	 * Store the data for the given time index and frequency in the cache. The data
+	 * array should be an array with @ref ATermSize() elements.
 	 */
-	void Store(double frequency, const std::complex<float>* data)
-	{
-		auto iter = std::lower_bound(_frequencies.begin(), _frequencies.end(), frequency);
-		if(iter!=_frequencies.end() && *iter == frequency)
-		{
-			size_t index = iter - _frequencies.begin();
-			std::copy_n(data, _atermSize, _entries[index].ptr.get());
-			_entries[index].isValid = true;
-		}
-		else {
-			size_t index = iter - _frequencies.begin();
-			_frequencies.emplace(iter, frequency);
-			Entry newEntry;
-			newEntry.ptr.reset( new std::complex<float>[_atermSize] );
-			newEntry.isValid = true;
-			std::copy_n(data, _atermSize, newEntry.ptr.get());
-			_entries.emplace(_entries.begin() + index, std::move(newEntry));
-		}
-	}
-	
+	void Store(size_t timeIndex, double frequency, const std::complex<float>* data);
+
 	/**
 	 * Size of one aterm buffer (in number of complex float values).
 	 */
 	size_t ATermSize() const { return _atermSize; }
-	
+
+	size_t MaxEntries() const { return _maxEntries; }
+
+	size_t EntryCount() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _entries.size();
+	}
+
 private:
-	// This array is always kept sorted
-	std::vector<double> _frequencies;
-	size_t _atermSize;
-	
+	typedef std::pair<size_t, double> Key;
+
 	struct Entry {
+		Key key;
 		std::unique_ptr<std::complex<float>[]> ptr;
-		bool isValid;
 	};
-	
-	// _entries[index] corresponds with _frequencies[index]
-	std::vector<Entry> _entries;
+
+	size_t _atermSize, _maxEntries;
+
+	// The most recently used entry is at the front
+	std::list<Entry> _entries;
+	std::map<Key, std::list<Entry>::iterator> _index;
+	mutable std::mutex _mutex;
 };
 
 #endif
-
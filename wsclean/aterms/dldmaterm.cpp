@@ -13,6 +13,11 @@ DLDMATerm::DLDMATerm(size_t nAntenna, const CoordinateSystem& coordinateSystem)
 {
 }
 
+DLDMATerm::~DLDMATerm()
+{
+	stopPrefetch();
+}
+
 void DLDMATerm::Open(const std::vector<std::string>& filenames)
 {
 	_readers.reserve(filenames.size());
@@ -22,61 +27,57 @@ void DLDMATerm::Open(const std::vector<std::string>& filenames)
 		if(_readers.back().NMatrixElements() != 2)
 			throw std::runtime_error("FITS file for dl,dm offsets did not have 2 matrix elements in it");
 	}
-	initializeFromFiles(_readers);
+	initializeFromFiles(_readers, "dldm", Width() * Height());
 }
 
 bool DLDMATerm::Calculate(std::complex<float>* buffer, double time, double frequency, size_t, const double* uvwInM)
 {
 	size_t timeIndex;
-	bool requiresRecalculation;
-	bool positionChanged = findFilePosition(buffer, time, frequency, timeIndex, requiresRecalculation);
+	bool positionChanged = findFilePosition(time, frequency, timeIndex);
 	bool outdated = std::fabs(time - _previousTime) > _updateInterval;
 	if(!positionChanged && !outdated)
 		return false;
 	else {
-		if(requiresRecalculation || outdated)
+		_previousTime = time;
+		Logger::Debug << "DLDMATerm::Calculate(buffer, " << time << ", " << frequency << ", uvw={... ";
+		if(NAntenna()>1)
 		{
-			_previousTime = time;
-			readImages(buffer, timeIndex, frequency, uvwInM);
-			storeInCache(frequency, buffer);
+			Logger::Debug << uvwInM[3] << ',' << uvwInM[4] << ',' << uvwInM[5];
+		}
+		Logger::Debug << " ... })\n";
+		_dldmImage.resize(Width() * Height());
+		getOrCalculate(_dldmImage.data(), timeIndex, frequency);
+		
+		double wavel = BandData::FrequencyToLambda(frequency);
+		for(size_t antennaIndex = 0; antennaIndex != NAntenna(); ++antennaIndex)
+		{
+			double uvw[3] = {
+				uvwInM[antennaIndex*3] / wavel,
+				uvwInM[antennaIndex*3+1] / wavel,
+				uvwInM[antennaIndex*3+2] / wavel
+			};
+			
+			std::complex<float>* antennaBuffer = buffer + antennaIndex * Width()*Height()*4;
+			evaluateDLDM(antennaBuffer, _dldmImage.data(), uvw);
 		}
 		return true;
 	}
 }
 
-void DLDMATerm::readImages(std::complex<float>* buffer, size_t timeIndex, double frequency, const double* uvwInM)
+void DLDMATerm::calculateCacheEntry(std::complex<float>* buffer, size_t timeIndex, double frequency)
 {
-	Logger::Debug << "DLDMATerm::readImages(buffer, " << timeIndex << ", " << frequency << ", uvw={... ";
-	if(NAntenna()>1)
-	{
-		Logger::Debug << uvwInM[3] << ',' << uvwInM[4] << ',' << uvwInM[5];
-	}
-	Logger::Debug << " ... })\n";
 	const size_t freqIndex = round((frequency - _readers.front().FrequencyDimensionStart())
 		/ _readers.front().FrequencyDimensionIncr());
 	const size_t imgIndex = _timesteps[timeIndex].imgIndex * NFrequencies() + freqIndex;
 	FitsReader& reader = _readers[_timesteps[timeIndex].readerIndex];
-	_scratch.resize(AllocatedWidth() * AllocatedHeight());
-	_dlImage.resize(std::max(Width()*Height(), reader.ImageWidth() * reader.ImageHeight()));
-	_dmImage.resize(std::max(Width()*Height(), reader.ImageWidth() * reader.ImageHeight()));
-	readAndResample(reader, imgIndex * 2, _scratch, _dlImage);
-	readAndResample(reader, imgIndex * 2 + 1, _scratch, _dmImage);
-
-	double wavel = BandData::FrequencyToLambda(frequency);
-	for(size_t antennaIndex = 0; antennaIndex != NAntenna(); ++antennaIndex)
-	{
-		double uvw[3] = {
-			uvwInM[antennaIndex*3] / wavel,
-			uvwInM[antennaIndex*3+1] / wavel,
-			uvwInM[antennaIndex*3+2] / wavel
-		};
-		
-		std::complex<float>* antennaBuffer = buffer + antennaIndex * Width()*Height()*4;
-		evaluateDLDM(antennaBuffer, _dlImage.data(), _dmImage.data(), uvw);
-	}
+	// The dl and dm images are stored consecutively
+	readAndResample(reader, imgIndex * 2, 2, _resampled);
+	const size_t imageSize = Width()*Height();
+	for(size_t i=0; i!=imageSize; ++i)
+		buffer[i] = std::complex<float>(_resampled[i], _resampled[imageSize + i]);
 }
 
-void DLDMATerm::evaluateDLDM(std::complex<float>* dest, const double* dl, const double* dm, const double* uvwInL)
+void DLDMATerm::evaluateDLDM(std::complex<float>* dest, const std::complex<float>* dldm, const double* uvwInL)
 {
 	// For a single source at l,m, we have:
 	//   dl = oldl - newl
@@ -100,19 +101,20 @@ void DLDMATerm::evaluateDLDM(std::complex<float>* dest, const double* dl, const
 			ImageCoordinates::XYToLM(x, y, DL(), DM(), Width(), Height(), l, m);
 			l += PhaseCentreDL();
 			m += PhaseCentreDM();
-			double lproj = l+(*dl), mproj = m+(*dm);
+			const double dl = dldm->real(), dm = dldm->imag();
+			double lproj = l+dl, mproj = m+dm;
 			double lmSq = l*l + m*m, lmprojSq = lproj*lproj + mproj*mproj;
 			double dn;
 			if(lmSq >= 1.0 || lmprojSq >= 1.0)
 				dn = 0.0;
 			else
 				dn = std::sqrt(1.0 - lmprojSq) - std::sqrt(1.0 - lmSq);
-			dest[0] = std::polar(1.0, 2.0*M_PI*(u*(*dl) + v*(*dm) + w*dn));
+			dest[0] = std::polar(1.0, 2.0*M_PI*(u*dl + v*dm + w*dn));
 			dest[1] = 0.0;
 			dest[2] = 0.0;
 			dest[3] = dest[0];
 			
-			++dl; ++dm; dest += 4;
+			++dldm; dest += 4;
 		}
 	}
 }
@@ -5,6 +5,7 @@
 
 #include "../fitsreader.h"
 
+#include <array>
 #include <complex>
 
 #include <casacore/ms/MeasurementSets/MeasurementSet.h>
@@ -13,6 +14,7 @@ class DLDMATerm final : public FitsATermBase
 {
 public:
 	DLDMATerm(size_t nAntenna, const CoordinateSystem& coordinateSystem);
+	~DLDMATerm();
 	
 	void Open(const std::vector<std::string>& filenames);
 	
@@ -26,12 +28,18 @@ public:
 	
 private:
 	std::vector<FitsReader> _readers;
-	ao::uvector<double> _scratch, _dlImage, _dmImage;
+	ao::uvector<double> _resampled;
+	/** The resampled dl (real) and dm (imaginary) values of the current timestep. */
+	ao::uvector<std::complex<float>> _dldmImage;
 	std::vector<std::array<double, 2>> _uvws;
 	double _updateInterval, _previousTime;
 	
-	void readImages(std::complex<float>* buffer, size_t timeIndex, double frequency, const double* uvwInM);
-	void evaluateDLDM(std::complex<float>* dest, const double* dl, const double* dm, const double* uvwInM);
+	/**
+	 * Caches the resampled dl and dm images. The a-terms themselves depend on the
+	 * uvws, and are therefore calculated from these each time.
+	 */
+	virtual void calculateCacheEntry(std::complex<float>* buffer, size_t timeIndex, double frequency) override;
+	void evaluateDLDM(std::complex<float>* dest, const std::complex<float>* dldm, const double* uvwInM);
 };
 
 #endif
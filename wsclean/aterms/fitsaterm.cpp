@@ -7,7 +7,9 @@ FitsATerm::FitsATerm(size_t nAntenna, const CoordinateSystem& coordinateSystem)
 { }
 
 FitsATerm::~FitsATerm()
-{ }
+{
+	stopPrefetch();
+}
 
 void FitsATerm::OpenTECFiles(const std::vector<std::string>& filenames)
 {
@@ -19,7 +21,7 @@ void FitsATerm::OpenTECFiles(const std::vector<std::string>& filenames)
 		if(_readers.back().NFrequencies() != 1)
 			throw std::runtime_error("FITS file for TEC A-terms has multiple frequencies in it");
 	}
-	initializeFromFiles(_readers);
+	initializeFromFiles(_readers, "tec", NAntenna() * 4 * Width() * Height());
 }
 
 void FitsATerm::OpenDiagGainFiles(const std::vector<std::string>& filenames)
@@ -32,22 +34,16 @@ void FitsATerm::OpenDiagGainFiles(const std::vector<std::string>& filenames)
 		if(_readers.back().NMatrixElements() != 4)
 			throw std::runtime_error("FITS file for diagonal gains did not have 4 matrix elements in it");
 	}
-	initializeFromFiles(_readers);
+	initializeFromFiles(_readers, "diagonal", NAntenna() * 4 * Width() * Height());
 }
 
 bool FitsATerm::Calculate(std::complex<float>* buffer, double time, double frequency, size_t, const double*)
 {
 	size_t timeIndex;
-	bool requiresRecalculation;
-	bool positionChanged = findFilePosition(buffer, time, frequency, timeIndex, requiresRecalculation);
-	if(!positionChanged)
+	if(!findFilePosition(time, frequency, timeIndex))
 		return false;
 	else {
-		if(requiresRecalculation)
-		{
-			readImages(buffer, timeIndex, frequency);
-			storeInCache(frequency, buffer);
-		}
+		getOrCalculate(buffer, timeIndex, frequency);
 		return true;
 	}
 }
@@ -58,43 +54,40 @@ void FitsATerm::readImages(std::complex<float>* buffer, size_t timeIndex, double
 		/ _readers.front().FrequencyDimensionIncr());
 	const size_t imgIndex = _timesteps[timeIndex].imgIndex * NFrequencies() + freqIndex;
 	FitsReader& reader = _readers[_timesteps[timeIndex].readerIndex];
-	_scratchA.resize(AllocatedWidth() * AllocatedHeight());
-	_scratchB.resize(std::max(Width()*Height(), reader.ImageWidth() * reader.ImageHeight()));
-	// TODO do this in parallel. Needs to fix Resampler too, as currently it can't run in
-	// parallel when a window is used.
-	for(size_t antennaIndex = 0; antennaIndex != NAntenna(); ++antennaIndex)
+	// In case there is only one antenna in the file, it is used for
+	// all antennas.
+	const size_t fileAntennaCount = reader.NAntennas() == 1 ? 1 : NAntenna();
+	const size_t imageSize = Width()*Height();
+	switch(_mode)
 	{
-		// In case there is only one antenna in the measurement set, copy it
-		// to all antennas. This is not very efficient as the single image
-		// is still read + resampled NAnt times, but it's a border case.
-		size_t antennaFileIndex = antennaIndex;
-		if(reader.NAntennas() == 1)
-			antennaFileIndex = 0;
-		std::complex<float>* antennaBuffer = buffer + antennaIndex * Width()*Height()*4;
+		case TECMode: {
+			// TODO When we are in the same timestep but at a different frequency, it would
+			// be possible to skip reading and resampling, and immediately call evaluateTEC()
+			// with the resampled data still there.
+			readAndResample(reader, imgIndex*NAntenna(), fileAntennaCount, _resampled);
+			for(size_t antennaIndex = 0; antennaIndex != NAntenna(); ++antennaIndex)
+			{
+				const size_t antennaFileIndex = fileAntennaCount == 1 ? 0 : antennaIndex;
+				std::complex<float>* antennaBuffer = buffer + antennaIndex * imageSize * 4;
+				evaluateTEC(antennaBuffer, &_resampled[antennaFileIndex * imageSize], frequency);
+			}
+		} break;
 		
-		switch(_mode)
-		{
-			case TECMode: { 
-				// TODO When we are in the same timestep but at a different frequency, it would
-				// be possible to skip reading and resampling, and immediately call evaluateTEC()
-				// with the "scratch" data still there.
-				readAndResample(reader, antennaFileIndex + imgIndex*NAntenna(), _scratchA, _scratchB);
-				evaluateTEC(antennaBuffer, _scratchB.data(), frequency);
-			} break;
-			
-			case DiagonalMode: {
+		case DiagonalMode: {
+			readAndResample(reader, imgIndex*NAntenna()*4, fileAntennaCount*4, _resampled);
+			for(size_t antennaIndex = 0; antennaIndex != NAntenna(); ++antennaIndex)
+			{
+				const size_t antennaFileIndex = fileAntennaCount == 1 ? 0 : antennaIndex;
+				std::complex<float>* antennaBuffer = buffer + antennaIndex * imageSize * 4;
 				for(size_t p=0; p!=2; ++p)
 				{
-					readAndResample(reader, (antennaFileIndex + imgIndex*NAntenna()) * 4 + p*2, _scratchA, _scratchB);
-					copyToRealPolarization(antennaBuffer, _scratchB.data(), p*3);
-					
-					readAndResample(reader, (antennaFileIndex + imgIndex*NAntenna()) * 4 + p*2 + 1, _scratchA, _scratchB);
-					copyToImaginaryPolarization(antennaBuffer, _scratchB.data(), p*3);
+					copyToRealPolarization(antennaBuffer, &_resampled[(antennaFileIndex*4 + p*2) * imageSize], p*3);
+					copyToImaginaryPolarization(antennaBuffer, &_resampled[(antennaFileIndex*4 + p*2 + 1) * imageSize], p*3);
 				}
 				setPolarization(antennaBuffer, 1, std::complex<float>(0.0, 0.0));
 				setPolarization(antennaBuffer, 2, std::complex<float>(0.0, 0.0));
-			} break;
-		}
+			}
+		} break;
 	}
 }
 
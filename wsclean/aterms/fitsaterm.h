@@ -30,6 +30,11 @@ public:
 private:
 	enum Mode { TECMode, DiagonalMode } _mode;
 	
+	virtual void calculateCacheEntry(std::complex<float>* buffer, size_t timeIndex, double frequency) override
+	{
+		readImages(buffer, timeIndex, frequency);
+	}
+	
 	void readImages(std::complex<float>* buffer, size_t timeIndex, double frequency);
 	
 	void resample(const FitsReader& reader, double* dest, const double* source);
@@ -40,7 +45,7 @@ private:
 	void copyToImaginaryPolarization(std::complex<float>* dest, const double* source, size_t polIndex);
 	void setPolarization(std::complex<float>* dest, size_t polIndex, std::complex<float> value);
 	
-	ao::uvector<double> _scratchA, _scratchB;
+	ao::uvector<double> _resampled;
 	std::vector<FitsReader> _readers;
 };
 
@@ -5,12 +5,15 @@
 #include "../units/imagecoordinates.h"
 
 #include "../fftresampler.h"
+#include "../system.h"
 
 #include <algorithm>
 #include <limits>
+#include <sstream>
 
 FitsATermBase::FitsATermBase(size_t nAntenna, const CoordinateSystem& coordinateSystem) :
-	_cache(nAntenna * 4 * coordinateSystem.width * coordinateSystem.height),
+	_cacheEntrySize(0),
+	_maxCacheSize(size_t(1024) * 1024 * 1024),
 	_curTimeindex(0),
 	_curFrequency(0),
 	_nFrequencies(0),
@@ -31,7 +34,7 @@ FitsATermBase::FitsATermBase(size_t nAntenna, const CoordinateSystem& coordinate
 FitsATermBase::~FitsATermBase()
 { }
 
-void FitsATermBase::initializeFromFiles(std::vector<FitsReader>& readers)
+void FitsATermBase::initializeFromFiles(std::vector<FitsReader>& readers, const std::string& typeName, size_t cacheEntrySize)
 {
 	// Sort the readers on observation time
 	std::sort(readers.begin(), readers.end(), [](const FitsReader& a, const FitsReader& b)->bool
@@ -64,6 +67,28 @@ void FitsATermBase::initializeFromFiles(std::vector<FitsReader>& readers)
 	}
 	_curTimeindex = std::numeric_limits<size_t>::max();
 	_curFrequency = std::numeric_limits<double>::max();
+	
+	std::ostringstream key;
+	key << typeName << ' ' << _nAntenna << ' ' << _width << ' ' << _height << ' ' << _allocatedWidth << ' ' << _allocatedHeight << ' '
+		<< _ra << ' ' << _dec << ' ' << _dl << ' ' << _dm << ' ' << _phaseCentreDL << ' ' << _phaseCentreDM;
+	for(const FitsReader& reader : readers)
+		key << ' ' << reader.Filename();
+	_cacheKey = key.str();
+	_cacheEntrySize = cacheEntrySize;
+}
+
+Cache& FitsATermBase::cache()
+{
+	// The cache is obtained on first use, because the window is set after the files
+	// are opened.
+	if(_cache == nullptr)
+	{
+		std::ostringstream key;
+		key << _cacheKey << ' ' << int(_window) << ' ' << _padding;
+		const size_t entryBytes = _cacheEntrySize * sizeof(std::complex<float>);
+		_cache = Cache::GetShared(key.str(), _cacheEntrySize, std::max<size_t>(2, _maxCacheSize / std::max<size_t>(entryBytes, 1)));
+	}
+	return *_cache;
 }
 
 double FitsATermBase::AverageUpdateTime() const
@@ -74,83 +99,162 @@ double FitsATermBase::AverageUpdateTime() const
 		return (_timesteps.back().time - _timesteps.front().time) / (_timesteps.size() - 1);
 }
 
-bool FitsATermBase::findFilePosition(std::complex<float>* buffer, double time, double frequency, size_t& timeindex, bool& requiresRecalculation)
+bool FitsATermBase::findFilePosition(double time, double frequency, size_t& timeIndex)
 {
-	requiresRecalculation = false;
+	bool changed = false;
 	if(_curTimeindex == std::numeric_limits<size_t>::max())
 	{
-		requiresRecalculation = true;
-		_cache.Reset();
+		changed = true;
 		_curTimeindex = 0;
 	}
 	
-	bool finishedSearch = false;
-	while(_curTimeindex+1 < _timesteps.size() && !finishedSearch)
+	// If we are closer to the next timestep, use the next. Gridding passes restart at the
+	// first timestep, hence the search can also go back.
+	while(_curTimeindex+1 < _timesteps.size() &&
+		std::fabs(_timesteps[_curTimeindex+1].time - time) < std::fabs(_timesteps[_curTimeindex].time - time))
 	{
-		// Do we need to calculate a next timestep?
-		double curTime = _timesteps[_curTimeindex].time;
-		double nextTime = _timesteps[_curTimeindex+1].time;
-		// If we are closer to the next timestep, use the next.
-		if(std::fabs(nextTime - time) < std::fabs(curTime - time))
-		{
-			++_curTimeindex;
-			requiresRecalculation = true;
-			_cache.Reset();
-			finishedSearch = false;
-		}
-		else {
-			finishedSearch = true;
-		}
+		++_curTimeindex;
+		changed = true;
+	}
+	while(_curTimeindex > 0 &&
+		std::fabs(_timesteps[_curTimeindex-1].time - time) < std::fabs(_timesteps[_curTimeindex].time - time))
+	{
+		--_curTimeindex;
+		changed = true;
 	}
-	timeindex = _curTimeindex;
+	timeIndex = _curTimeindex;
 	
-	if(!requiresRecalculation)
+	if(_curFrequency != frequency)
 	{
-		// If we are here, it means that the timestep didn't
-		// change. So if the frequency also didn't change, we're done...
-		if(_curFrequency == frequency)
-			return false;
-		// If it did change: do we have this frequency in the cache?
-		size_t cacheIndex = _cache.Find(frequency);
-		if(cacheIndex == Cache::NOT_FOUND)
-			requiresRecalculation = true;
-		else {
-			_cache.Get(cacheIndex, buffer);
-			_curFrequency = frequency;
-			return true;
-		}
+		_curFrequency = frequency;
+		changed = true;
+	}
+	return changed;
+}
+
+void FitsATermBase::getOrCalculate(std::complex<float>* buffer, size_t timeIndex, double frequency)
+{
+	// The background calculation might be busy with the requested entry, and
+	// calculateCacheEntry() may not run concurrently.
+	waitForPrefetch();
+	// The resampler is made here, because FFTW plans can not be made from the
+	// background thread.
+	initializeResampler();
+	Cache& c = cache();
+	if(!c.Get(timeIndex, frequency, buffer))
+	{
+		calculateCacheEntry(buffer, timeIndex, frequency);
+		c.Store(timeIndex, frequency, buffer);
 	}
 	
-	return true;
+	const size_t nextIndex = timeIndex + 1;
+	if(nextIndex < _timesteps.size() && !c.Contains(nextIndex, frequency))
+	{
+		_prefetchBuffer.resize(_cacheEntrySize);
+		_prefetch = std::async(std::launch::async, [this, &c, nextIndex, frequency]()
+		{
+			calculateCacheEntry(_prefetchBuffer.data(), nextIndex, frequency);
+			c.Store(nextIndex, frequency, _prefetchBuffer.data());
+		});
+	}
 }
 
-void FitsATermBase::storeInCache(double frequency, const std::complex<float>* buffer)
+void FitsATermBase::waitForPrefetch()
 {
-	_curFrequency = frequency;
-	_cache.Store(frequency, buffer);
+	if(_prefetch.valid())
+		_prefetch.get();
 }
 
-void FitsATermBase::readAndResample(FitsReader& reader, size_t fileIndex, ao::uvector<double>& scratch, ao::uvector<double>& output)
+void FitsATermBase::stopPrefetch()
+{
+	try {
+		waitForPrefetch();
+	} catch(std::exception& e) {
+		Logger::Warn << "Background calculation of a-terms failed: " << e.what() << '\n';
+	}
+}
+
+void FitsATermBase::initializeResampler()
 {
 	if(_resampler == nullptr)
 	{
-		_resampler.reset(new FFTResampler(_allocatedWidth, _allocatedHeight, _width, _height, 1, false));
+		const size_t threadCount = System::ProcessorCount();
+		_resampler.reset(new FFTResampler(_allocatedWidth, _allocatedHeight, _width, _height, threadCount, false));
 		if(_window == WindowFunction::Tukey)
 			_resampler->SetTukeyWindow(double(_allocatedWidth) / _padding, false);
 		else
 			_resampler->SetWindowFunction(_window, true);
 	}
+}
+
+void FitsATermBase::readAndResample(FitsReader& reader, size_t firstIndex, size_t count, ao::uvector<double>& output)
+{
+	const size_t
+		inSize = reader.ImageWidth() * reader.ImageHeight(),
+		allocatedSize = _allocatedWidth * _allocatedHeight,
+		outSize = _width * _height;
+	
+	// First, the images are regridded on a smaller image that fits in the kernel support allocated for the aterms.
+	// All images have the same coordinates, so the mapping is calculated once.
+	makeRegridIndices(reader, _regridIndices);
 	
-	reader.ReadIndex(output.data(), fileIndex);
+	// Only the box of input pixels that the regridding uses is read. The indices
+	// are made relative to this box.
+	const size_t inWidth = reader.ImageWidth();
+	size_t boxX1 = reader.ImageWidth(), boxX2 = 0, boxY1 = reader.ImageHeight(), boxY2 = 0;
+	for(size_t index : _regridIndices)
+	{
+		if(index != std::numeric_limits<size_t>::max())
+		{
+			const size_t x = index % inWidth, y = index / inWidth;
+			boxX1 = std::min(boxX1, x);
+			boxX2 = std::max(boxX2, x + 1);
+			boxY1 = std::min(boxY1, y);
+			boxY2 = std::max(boxY2, y + 1);
+		}
+	}
+	const size_t
+		boxWidth = boxX2 > boxX1 ? boxX2 - boxX1 : 0,
+		boxHeight = boxY2 > boxY1 ? boxY2 - boxY1 : 0,
+		boxSize = boxWidth * boxHeight;
+	for(size_t& index : _regridIndices)
+	{
+		if(index != std::numeric_limits<size_t>::max())
+			index = (index % inWidth - boxX1) + (index / inWidth - boxY1) * boxWidth;
+	}
+	_readBuffer.resize(boxSize * count);
+	if(boxSize == inSize)
+		reader.ReadIndices(_readBuffer.data(), firstIndex, count);
+	else {
+		for(size_t i=0; i!=count; ++i)
+			reader.ReadBox(&_readBuffer[i * boxSize], firstIndex + i, boxX1, boxY1, boxWidth, boxHeight);
+	}
 	
-	// First, the image is regridded on a smaller image that fits in the kernel support allocated for the aterms
-	regrid(reader, scratch.data(), output.data());
+	_regriddedBuffer.resize(allocatedSize * count);
+	for(size_t i=0; i!=count; ++i)
+	{
+		const double* source = _readBuffer.data() + i * boxSize;
+		double* dest = &_regriddedBuffer[i * allocatedSize];
+		for(size_t pixel=0; pixel!=allocatedSize; ++pixel)
+		{
+			const size_t index = _regridIndices[pixel];
+			dest[pixel] = index == std::numeric_limits<size_t>::max() ? 0.0 : source[index];
+		}
+	}
 	
-	// Now, the small image is enlarged so that it matches the kernel size
-	_resampler->Resample(scratch.data(), output.data());
+	// Now, the small images are enlarged so that they match the kernel size
+	output.resize(outSize * count);
+	if(count == 1)
+		_resampler->Resample(_regriddedBuffer.data(), output.data());
+	else {
+		_resampler->Start();
+		for(size_t i=0; i!=count; ++i)
+			_resampler->AddTask(&_regriddedBuffer[i * allocatedSize], &output[i * outSize]);
+		_resampler->Finish();
+	}
 }
 
-void FitsATermBase::regrid(const FitsReader& reader, double* dest, const double* source)
+void FitsATermBase::makeRegridIndices(const FitsReader& reader, ao::uvector<size_t>& indices) const
 {
 	size_t inWidth = reader.ImageWidth(), inHeight = reader.ImageHeight();
 	double inPixelSizeX = reader.PixelSizeX(), inPixelSizeY = reader.PixelSizeY();
@@ -167,6 +271,7 @@ void FitsATermBase::regrid(const FitsReader& reader, double* dest, const double*
 	 */
 	bool samePlane = inPhaseCentreRA == _ra && inPhaseCentreDec == _dec;
 	
+	indices.resize(_allocatedWidth * _allocatedHeight);
 	size_t index = 0;
 	for(size_t y=0; y!=_allocatedHeight; ++y)
 	{
@@ -187,12 +292,11 @@ void FitsATermBase::regrid(const FitsReader& reader, double* dest, const double*
 			int inX, inY;
 			ImageCoordinates::LMToXY(l, m, inPixelSizeX, inPixelSizeY, inWidth, inHeight, inX, inY);
 			if(inX < 0 || inY < 0 || inX >= int(inWidth) || inY >= int(inHeight))
-				dest[index] = 0;
+				indices[index] = std::numeric_limits<size_t>::max();
 			else {
-				dest[index] = source[inX + inY * inWidth];
+				indices[index] = inX + inY * inWidth;
 			}
 			++index;
 		}
 	}
 }
-
@@ -8,6 +8,10 @@
 #include "../windowfunction.h"
 #include "../uvector.h"
 
+#include <future>
+#include <memory>
+#include <string>
+
 class FitsATermBase : public ATermBase
 {
 public:
@@ -27,14 +31,63 @@ public:
 		_window = window;
 	}
 	
+	/**
+	 * Sets the number of bytes that the calculated a-terms may occupy in the cache.
+	 * Should be called before the first a-term is calculated.
+	 */
+	void SetMaxCacheSize(size_t maxCacheSize)
+	{
+		_maxCacheSize = maxCacheSize;
+	}
+	
 protected:
-	void initializeFromFiles(std::vector<FitsReader>& readers);
+	/**
+	 * @param typeName Name of the a-term type, to distinguish the a-terms of different types
+	 * in the shared cache.
+	 * @param cacheEntrySize Number of complex values that @ref calculateCacheEntry() produces.
+	 */
+	void initializeFromFiles(std::vector<FitsReader>& readers, const std::string& typeName, size_t cacheEntrySize);
+	
+	/**
+	 * Finds the timestep that is closest to the given time.
+	 * @returns @c false when neither the timestep nor the frequency changed since
+	 * the previous call.
+	 */
+	bool findFilePosition(double time, double frequency, size_t& timeIndex);
 	
-	bool findFilePosition(std::complex<float>* buffer, double time, double frequency, size_t& timeindex, bool& requiresRecalculation);
+	/**
+	 * Fills the buffer with the entry for the given time index and frequency, either from
+	 * the cache or by calling @ref calculateCacheEntry(). Afterwards, the entry of the next
+	 * timestep is calculated in the background, such that it is ready when gridding
+	 * reaches that timestep.
+	 */
+	void getOrCalculate(std::complex<float>* buffer, size_t timeIndex, double frequency);
 	
-	void storeInCache(double frequency, const std::complex<float>* buffer);
+	/**
+	 * Calculates what is cached for a timestep and frequency. This is also called from
+	 * the background thread, but never concurrently with itself.
+	 */
+	virtual void calculateCacheEntry(std::complex<float>* buffer, size_t timeIndex, double frequency) = 0;
 	
-	void readAndResample(FitsReader& reader, size_t fileIndex, ao::uvector<double>& scratch, ao::uvector<double>& output);
+	/**
+	 * Waits until the background calculation of the next timestep has finished, and
+	 * rethrows an exception that the calculation threw.
+	 */
+	void waitForPrefetch();
+	
+	/**
+	 * Like @ref waitForPrefetch(), but logs an exception instead of throwing it. Because
+	 * the background calculation uses the members of the derived class, this should be
+	 * called in the destructor of the derived class.
+	 */
+	void stopPrefetch();
+	
+	/**
+	 * Reads count consecutive images from the reader in one go, regrids them onto the
+	 * a-term coordinate system and resamples them in parallel. Resampled image i is
+	 * stored at output[i * Width() * Height()].
+	 */
+	void readAndResample(FitsReader& reader, size_t firstIndex, size_t count, ao::uvector<double>& output);
 	
 	struct Timestep {
 		double time;
@@ -55,9 +108,22 @@ protected:
 	double PhaseCentreDM() const { return _phaseCentreDM; }
 	
 private:
-	void regrid(const FitsReader& reader, double* dest, const double* source);
+	/**
+	 * Calculates for each pixel of the regridded image which pixel of the images in the
+	 * reader it takes its value from. Pixels outside the images are set to
+	 * std::numeric_limits<size_t>::max().
+	 */
+	void makeRegridIndices(const FitsReader& reader, ao::uvector<size_t>& indices) const;
+	
+	void initializeResampler();
+	
+	Cache& cache();
 	
-	Cache _cache;
+	std::shared_ptr<Cache> _cache;
+	std::string _cacheKey;
+	size_t _cacheEntrySize, _maxCacheSize;
+	ao::uvector<std::complex<float>> _prefetchBuffer;
+	std::future<void> _prefetch;
 	size_t _curTimeindex;
 	double _curFrequency;
 	size_t _nFrequencies, _nAntenna, _width, _height;
@@ -66,6 +132,8 @@ private:
 	WindowFunction::Type _window;
 	double _padding;
 	std::unique_ptr<class FFTResampler> _resampler;
+	ao::uvector<double> _readBuffer, _regriddedBuffer;
+	ao::uvector<size_t> _regridIndices;
 };
 
 #endif
@@ -0,0 +1,109 @@
+#include "../deconvolution/genericclean.h"
+#include "../deconvolution/imageset.h"
+
+#include "../wsclean/imagingtable.h"
+#include "../wsclean/logger.h"
+#include "../wsclean/wscleansettings.h"
+
+#include "../fftwmanager.h"
+#include "../image.h"
+#include "../stopwatch.h"
+#include "../uvector.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+/**
+ * Measures the speed of the minor iterations of the Högbom clean on synthetic
+ * data. The dirty image consists of a number of random point sources convolved
+ * with a Gaussian PSF plus Gaussian noise.
+ */
+int main(int argc, char* argv[])
+{
+	if(argc < 2)
+	{
+		std::cout
+			<< "Syntax: deconvolutionbenchmark <image size> [iterations] [source count] [subminor|hogbom] [threshold]\n"
+			<< "Performs a single major iteration of Högbom cleaning on a synthetic image\n"
+			<< "and reports the number of iterations per second. When 'subminor' is given,\n"
+			<< "the sub-minor optimization is used. The threshold defaults to zero, in which\n"
+			<< "case the Högbom clean subtracts the full PSF.\n";
+		return 0;
+	}
+	const size_t
+		size = atoi(argv[1]),
+		iterations = argc >= 3 ? atoi(argv[2]) : 1000,
+		sourceCount = argc >= 4 ? atoi(argv[3]) : 100;
+	const bool useSubMinor = argc >= 5 && std::string(argv[4]) == "subminor";
+	const double threshold = argc >= 6 ? atof(argv[5]) : 0.0;
+	Logger::SetVerbosity(Logger::QuietVerbosity);
+
+	ImagingTable table;
+	ImagingTableEntry& entry = table.AddEntry();
+	entry.index = 0;
+	entry.polarization = Polarization::StokesI;
+	entry.imageCount = 1;
+	table.Update();
+	WSCleanSettings settings;
+	settings.deconvolutionChannelCount = 1;
+	settings.linkedPolarizations = std::set<PolarizationEnum>{ Polarization::StokesI };
+
+	ImageBufferAllocator allocator;
+	ImageSet dirtySet(&table, allocator, settings, size, size), modelSet(&table, allocator, settings, size, size);
+	modelSet = 0.0;
+
+	Image psf(size, size, allocator);
+	const double sigma = 3.0;
+	for(size_t y=0; y!=size; ++y)
+	{
+		for(size_t x=0; x!=size; ++x)
+		{
+			double dx = double(x) - double(size/2), dy = double(y) - double(size/2);
+			psf[y*size + x] = std::exp(-(dx*dx + dy*dy) / (2.0*sigma*sigma));
+		}
+	}
+
+	std::mt19937 rnd(42);
+	std::normal_distribution<double> noise(0.0, 0.01);
+	std::uniform_real_distribution<double> flux(0.1, 10.0);
+	double* dirty = dirtySet[0];
+	for(size_t i=0; i!=size*size; ++i)
+		dirty[i] = noise(rnd);
+	const int halfWidth = std::ceil(sigma * 5.0);
+	for(size_t s=0; s!=sourceCount; ++s)
+	{
+		const int
+			sx = rnd() % size, sy = rnd() % size;
+		const double f = flux(rnd);
+		for(int y=std::max(0, sy-halfWidth); y!=std::min(int(size), sy+halfWidth+1); ++y)
+		{
+			for(int x=std::max(0, sx-halfWidth); x!=std::min(int(size), sx+halfWidth+1); ++x)
+				dirty[y*size + x] += f * psf[(y - sy + size/2) * size + (x - sx + size/2)];
+		}
+	}
+
+	FFTWManager fftwManager;
+	GenericClean clean(allocator, fftwManager, useSubMinor);
+	ForwardingLogReceiver logReceiver;
+	clean.SetLogReceiver(logReceiver);
+	clean.SetMaxNIter(iterations);
+	clean.SetThreshold(threshold);
+	clean.SetGain(0.1);
+	clean.SetMGain(1.0);
+	clean.SetAllowNegativeComponents(true);
+	clean.SetThreadCount(1);
+	ao::uvector<const double*> psfs(1, psf.data());
+
+	bool reachedMajorThreshold = false;
+	Stopwatch watch(true);
+	clean.ExecuteMajorIteration(dirtySet, modelSet, psfs, size, size, reachedMajorThreshold);
+	watch.Pause();
+	const size_t performed = clean.IterationNumber();
+	std::cout
+		<< "Image size: " << size << " x " << size << ", " << (useSubMinor ? "with" : "without") << " sub-minor optimization\n"
+		<< "Performed " << performed << " iterations in " << watch.ToString() << ": "
+		<< (double(performed) / watch.Seconds()) << " iterations/s\n";
+	return 0;
+}
@@ -0,0 +1,61 @@
+#include "../iuwt/iuwtdecomposition.h"
+
+#include "../stopwatch.h"
+#include "../threadpool.h"
+#include "../uvector.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+/**
+ * Measures the speed of the IUWT decomposition as used in the conjugate gradient
+ * loop of the IUWT deconvolution, e.g. for 4096 x 4096 and 16384 x 16384 images.
+ * The single-threaded reference decomposition is measured too, unless 'nost' is given.
+ */
+int main(int argc, char* argv[])
+{
+	if(argc < 2)
+	{
+		std::cout
+			<< "Syntax: iuwtbenchmark <image size> [repeats] [min scale] [nost]\n"
+			<< "Decomposes a noise image of the given size with the maximum number of scales\n"
+			<< "and reports the time per decomposition. Typical sizes are 4096 and 16384.\n";
+		return 0;
+	}
+	const size_t
+		size = atoi(argv[1]),
+		repeats = argc >= 3 ? atoi(argv[2]) : 5;
+	const int minScale = argc >= 4 ? atoi(argv[3]) : 0;
+	const bool skipST = argc >= 5 && std::string(argv[4]) == "nost";
+	const int endScale = IUWTDecomposition::EndScale(size);
+
+	std::mt19937 rnd(42);
+	std::normal_distribution<double> noise(0.0, 1.0);
+	ao::uvector<double> image(size*size), scratch(size*size);
+	for(double& v : image)
+		v = noise(rnd);
+
+	ThreadPool threadPool;
+	IUWTDecomposition iuwt(endScale, size, size);
+	// Warm up, such that all scales are allocated
+	iuwt.Decompose(threadPool, image.data(), scratch.data(), false, minScale);
+	Stopwatch watch(true);
+	for(size_t i=0; i!=repeats; ++i)
+		iuwt.Decompose(threadPool, image.data(), scratch.data(), false, minScale);
+	watch.Pause();
+	std::cout
+		<< "Image size: " << size << " x " << size << ", scales " << minScale << "-" << endScale
+		<< ", " << threadPool.size() << " threads\n"
+		<< "Fused multi-threaded decomposition: " << (watch.Seconds() / repeats) << " s per decomposition\n";
+
+	if(!skipST)
+	{
+		watch.Reset();
+		watch.Start();
+		iuwt.DecomposeST(image.data(), scratch.data());
+		watch.Pause();
+		std::cout << "Single-threaded reference decomposition: " << watch.Seconds() << " s\n";
+	}
+	return 0;
+}
@@ -6,6 +6,7 @@
 #include "iuwtdeconvolution.h"
 #include "genericclean.h"
 
+#include "../multiscale/convolvedpsfcache.h"
 #include "../multiscale/multiscalealgorithm.h"
 
 #include "../casamaskreader.h"
@@ -19,8 +20,12 @@
 #include "../wsclean/imagingtable.h"
 #include "../wsclean/wscleansettings.h"
 
+#include <boost/filesystem/operations.hpp>
+
 Deconvolution::Deconvolution(const class WSCleanSettings& settings) :
 	_settings(settings), _parallelDeconvolution(settings),
+	_psfCache(std::make_shared<ConvolvedPSFCache>()),
+	_psfCacheIsSaved(false),
 	_autoMaskIsFinished(false),
 	_imgWidth(0), // these are not yet set the in settings obj -- load later
 	_imgHeight(0),
@@ -34,12 +39,21 @@ Deconvolution::~Deconvolution()
 }
 
 void Deconvolution::Perform(const class ImagingTable& groupTable, bool& reachedMajorThreshold, size_t majorIterationNr)
+{
+	if(_settings.deconvolutionSinglePrecision)
+		perform<float>(groupTable, reachedMajorThreshold, majorIterationNr);
+	else
+		perform<double>(groupTable, reachedMajorThreshold, majorIterationNr);
+}
+
+template<typename NumT>
+void Deconvolution::perform(const ImagingTable& groupTable, bool& reachedMajorThreshold, size_t majorIterationNr)
 {
 	Logger::Info.Flush();
 	Logger::Info << " == Cleaning (" << majorIterationNr << ") ==\n";
 	
 	_imageAllocator->FreeUnused();
-	ImageSet
+	TImageSet<NumT>
 		residualSet(&groupTable, *_imageAllocator, _settings, _imgWidth, _imgHeight),
 		modelSet(&groupTable, *_imageAllocator, _settings, _imgWidth, _imgHeight);
 	
@@ -104,6 +118,10 @@ void Deconvolution::Perform(const class ImagingTable& groupTable, bool& reachedM
 		_parallelDeconvolution.SetThreshold(std::max(stddev * _settings.autoDeconvolutionThresholdSigma, _settings.deconvolutionThreshold));
 	integrated.reset();
 	
+	// Convolved PSFs that were not used in the previous major iteration (e.g. because the
+	// sub-image sizes changed) will likely not be used again.
+	_psfCache->RemoveUnused();
+	
 	std::vector<ao::uvector<double>> psfVecs(residualSet.PSFCount());
 	residualSet.LoadAndAveragePSFs(*_psfImages, psfVecs, _psfPolarization);
 	
@@ -129,7 +147,7 @@ void Deconvolution::Perform(const class ImagingTable& groupTable, bool& reachedM
 				_autoMask.resize(_imgWidth * _imgHeight);
 				for(size_t imgIndex=0; imgIndex!=modelSet.size(); ++imgIndex)
 				{
-					const double* image = modelSet[imgIndex];
+					const NumT* image = modelSet[imgIndex];
 					for(size_t i=0; i!=_imgWidth * _imgHeight; ++i)
 					{
 						_autoMask[i] = (image[i]==0.0) ? false : true;
@@ -142,6 +160,13 @@ void Deconvolution::Perform(const class ImagingTable& groupTable, bool& reachedM
 		
 	_parallelDeconvolution.ExecuteMajorIteration(residualSet, modelSet, psfs, reachedMajorThreshold);
 	
+	if(_settings.saveMultiscalePSFs && _settings.useMultiscale && !_psfCacheIsSaved)
+	{
+		Logger::Info << "Saving convolved PSFs to " << _psfCacheFilename << "...\n";
+		_psfCache->Save(_psfCacheFilename);
+		_psfCacheIsSaved = true;
+	}
+	
 	if(!reachedMajorThreshold && _settings.autoMask && !_autoMaskIsFinished)
 	{
 		Logger::Info << "Auto-masking threshold reached; continuing next major iteration with deeper threshold and mask.\n";
@@ -198,7 +223,7 @@ void Deconvolution::InitializeDeconvolutionAlgorithm(const ImagingTable& groupTa
 	if(_settings.useMoreSaneDeconvolution)
 	{
 		algorithm.reset(
-			new MoreSane(_settings.moreSaneLocation, _settings.moreSaneArgs, _settings.moreSaneSigmaLevels, _settings.prefixName, *_imageAllocator, _parallelDeconvolution.GetFFTWManager()));
+			new MoreSane(_settings.moreSaneLocation, _settings.moreSaneArgs, _settings.moreSaneSigmaLevels, _settings.prefixName, _settings.temporaryDirectory, _settings.moreSaneParallelRuns, *_imageAllocator, _parallelDeconvolution.GetFFTWManager()));
 	}
 	else if(_settings.useIUWTDeconvolution)
 	{
@@ -218,6 +243,8 @@ void Deconvolution::InitializeDeconvolutionAlgorithm(const ImagingTable& groupTa
 		msAlgorithm->SetTrackComponents(_settings.saveSourceList);
 		msAlgorithm->SetConvolutionPadding(_settings.multiscaleConvolutionPadding);
 		msAlgorithm->SetUseFastSubMinorLoop(_settings.multiscaleFastSubMinorLoop);
+		initializePSFCache(groupTable);
+		msAlgorithm->SetConvolvedPSFCache(_psfCache);
 		algorithm.reset(msAlgorithm);
 	}
 	else
@@ -242,6 +269,31 @@ void Deconvolution::InitializeDeconvolutionAlgorithm(const ImagingTable& groupTa
 	readMask(groupTable);
 }
 
+void Deconvolution::initializePSFCache(const ImagingTable& groupTable)
+{
+	_psfCache->Clear();
+	// Convolved PSFs can be recalculated, so they should not take memory away from gridding
+	_psfCache->SetMemoryLimit(_settings.MemoryLimit() / 10.0);
+	_psfCacheIsSaved = false;
+	const std::string filenameEnd = "-multiscale-psfs-" + std::to_string(groupTable.Front().joinedGroupIndex) + ".bin";
+	_psfCacheFilename = _settings.prefixName + filenameEnd;
+	if(_settings.reusePsf)
+	{
+		const std::string reuseFilename = _settings.reusePsfPrefix + filenameEnd;
+		if(boost::filesystem::exists(reuseFilename))
+		{
+			Logger::Info << "Reading convolved PSFs from " << reuseFilename << "...\n";
+			const size_t psfCount = (_settings.deconvolutionChannelCount == 0) ?
+				groupTable.SquaredGroupCount() : _settings.deconvolutionChannelCount;
+			try {
+				_psfCache->Load(reuseFilename, _imgWidth, _imgHeight, psfCount);
+			} catch(std::exception& e) {
+				Logger::Warn << "Convolved PSFs are not reused: " << e.what() << '\n';
+			}
+		}
+	}
+}
+
 void Deconvolution::readMask(const ImagingTable& groupTable)
 {
 	bool hasMask = false;
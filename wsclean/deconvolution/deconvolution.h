@@ -8,6 +8,8 @@
 #include "../uvector.h"
 
 #include <cstring>
+#include <memory>
+#include <string>
 
 class Deconvolution
 {
@@ -53,14 +55,24 @@ public:
 	}
 
 private:
+	template<typename NumT>
+	void perform(const ImagingTable& groupTable, bool& reachedMajorThreshold, size_t majorIterationNr);
+	
 	void correctChannelForPB(class ComponentList& list, const class ImagingTableEntry& entry) const;
 	
 	void readMask(const ImagingTable& groupTable);
 	
+	void initializePSFCache(const ImagingTable& groupTable);
+	
 	const class WSCleanSettings& _settings;
 	
 	ParallelDeconvolution _parallelDeconvolution;
 	
+	// Convolved PSFs of multi-scale cleaning, shared by all sub-image algorithms
+	std::shared_ptr<class ConvolvedPSFCache> _psfCache;
+	std::string _psfCacheFilename;
+	bool _psfCacheIsSaved;
+	
 	ao::uvector<bool> _cleanMask;
 	
 	bool _autoMaskIsFinished;
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <cmath>
+#include <stdexcept>
 
 #include "spectralfitter.h"
 
@@ -14,12 +15,26 @@ namespace ao {
 	template<typename T> class lane;
 }
 
+template<typename NumT> class TImageSet;
+typedef TImageSet<double> ImageSet;
+typedef TImageSet<float> FloatImageSet;
+
 class DeconvolutionAlgorithm
 {
 public:
 	virtual ~DeconvolutionAlgorithm() { }
 	
-	virtual double ExecuteMajorIteration(class ImageSet& dataImage, class ImageSet& modelImage, const ao::uvector<const double*>& psfImages, size_t width, size_t height, bool& reachedMajorThreshold) = 0;
+	virtual double ExecuteMajorIteration(ImageSet& dataImage, ImageSet& modelImage, const ao::uvector<const double*>& psfImages, size_t width, size_t height, bool& reachedMajorThreshold) = 0;
+	
+	/**
+	 * Same as ExecuteMajorIteration(), but with single-precision residual and model images.
+	 * Algorithms that support this override it; the settings only allow single-precision
+	 * deconvolution with those algorithms.
+	 */
+	virtual double ExecuteFloatMajorIteration(FloatImageSet& /*dataImage*/, FloatImageSet& /*modelImage*/, const ao::uvector<const double*>& /*psfImages*/, size_t /*width*/, size_t /*height*/, bool& /*reachedMajorThreshold*/)
+	{
+		throw std::runtime_error("Single-precision deconvolution is not supported by this deconvolution algorithm");
+	}
 	
 	virtual std::unique_ptr<DeconvolutionAlgorithm> Clone() const = 0;
 	
@@ -1,7 +1,11 @@
 #include "genericclean.h"
 
+#include "peakpyramid.h"
+#include "simdkernels.h"
 #include "subminorloop.h"
 
+#include "../fftconvolver.h"
+#include "../image.h"
 #include "../lane.h"
 
 #include "../multiscale/threadeddeconvolutiontools.h"
@@ -19,6 +23,17 @@ GenericClean::GenericClean(ImageBufferAllocator& allocator, class FFTWManager& f
 }
 
 double GenericClean::ExecuteMajorIteration(ImageSet& dirtySet, ImageSet& modelSet, const ao::uvector<const double*>& psfs, size_t width, size_t height, bool& reachedMajorThreshold)
+{
+	return executeMajorIteration(dirtySet, modelSet, psfs, width, height, reachedMajorThreshold);
+}
+
+double GenericClean::ExecuteFloatMajorIteration(FloatImageSet& dirtySet, FloatImageSet& modelSet, const ao::uvector<const double*>& psfs, size_t width, size_t height, bool& reachedMajorThreshold)
+{
+	return executeMajorIteration(dirtySet, modelSet, psfs, width, height, reachedMajorThreshold);
+}
+
+template<typename NumT>
+double GenericClean::executeMajorIteration(TImageSet<NumT>& dirtySet, TImageSet<NumT>& modelSet, const ao::uvector<const double*>& psfs, size_t width, size_t height, bool& reachedMajorThreshold)
 {
 	const size_t iterationCounterAtStart = _iterationNumber;
 	if(_stopOnNegativeComponent)
@@ -91,7 +106,7 @@ double GenericClean::ExecuteMajorIteration(ImageSet& dirtySet, ImageSet& modelSe
 			subMinorLoop.CorrectResidualDirty(_fftwManager, scratchA.data(), scratchB.data(), integrated.data(), imageIndex, dirtySet[imageIndex],  psf);
 			
 			subMinorLoop.GetFullIndividualModel(imageIndex, scratchA.data());
-			double* model = modelSet[imageIndex];
+			NumT* model = modelSet[imageIndex];
 			for(size_t i=0; i!=_width*_height; ++i)
 				model[i] += scratchA.data()[i];
 		}
@@ -102,6 +117,44 @@ double GenericClean::ExecuteMajorIteration(ImageSet& dirtySet, ImageSet& modelSe
 
 		ao::uvector<double> peakValues(dirtySet.size());
 		
+		// Like in a Clark clean, the components are subtracted only inside the support of
+		// the PSF: the box around the centre outside of which the PSF is smaller than the
+		// minor-loop threshold relative to the peak. The part of each subtraction that is
+		// skipped is therefore at most the gain times the threshold. The residuals outside the
+		// support are corrected exactly with a convolution after the minor loop.
+		size_t supportX, supportY;
+		const double supportCut = firstThreshold / std::fabs(*maxValue);
+		psfSupport(psfs, supportCut, supportX, supportY);
+		const bool isTruncated = supportX < _width/2 || supportY < _height/2;
+		std::vector<ao::uvector<double>> supportPSFs;
+		std::vector<size_t> componentIndices;
+		ao::uvector<double> componentValues;
+		if(isTruncated)
+		{
+			_logReceiver->Debug << "PSF support for subtraction: " << 2*supportX << " x " << 2*supportY << '\n';
+			supportPSFs.resize(psfs.size());
+			for(size_t psfIndex=0; psfIndex!=psfs.size(); ++psfIndex)
+			{
+				supportPSFs[psfIndex].resize(4*supportX*supportY);
+				Image::TrimBox(supportPSFs[psfIndex].data(), _width/2 - supportX, _height/2 - supportY, 2*supportX, 2*supportY, psfs[psfIndex], _width, _height);
+			}
+		}
+		
+		// The peak is tracked with a pyramid of tile maxima, such that after a subtraction
+		// only the integrated image and the tiles inside the support of the PSF need
+		// to be updated.
+		const size_t
+			horBorderSize = round(_width * CleanBorderRatio()),
+			vertBorderSize = round(_height * CleanBorderRatio());
+		PeakPyramid pyramid(_width, _height, horBorderSize, vertBorderSize, _width - std::min(horBorderSize, _width), _height - std::min(vertBorderSize, _height), _allowNegativeComponents);
+		if(_cleanMask)
+			pyramid.SetMask(_cleanMask);
+		if(!_rmsFactorImage.empty())
+			pyramid.SetRMSFactorImage(_rmsFactorImage.data());
+		// The integrated image holds the linear integration at this point; it is replaced
+		// by the square integration after the first subtraction.
+		bool isPyramidInitialized = false;
+		
 		while(maxValue && fabs(*maxValue) > firstThreshold && this->_iterationNumber < this->_maxIter && !(maxValue<0.0 && this->_stopOnNegativeComponent))
 		{
 			if(this->_iterationNumber <= 10 ||
@@ -122,16 +175,42 @@ double GenericClean::ExecuteMajorIteration(ImageSet& dirtySet, ImageSet& modelSe
 				
 				size_t psfIndex = dirtySet.PSFIndex(i);
 				
-				tools.SubtractImage(dirtySet[i], psfs[psfIndex], width, height, componentX, componentY, peakValues[i]);
+				if(isTruncated)
+					SimdKernels::PartialSubtractImage(dirtySet[i], _width, supportPSFs[psfIndex].data(), 2*supportX, 2*supportY, componentX, componentY, peakValues[i], 0, _height);
+				else
+					tools.SubtractImage(dirtySet[i], psfs[psfIndex], width, height, componentX, componentY, peakValues[i]);
+			}
+			if(isTruncated)
+			{
+				componentIndices.push_back(peakIndex);
+				componentValues.insert(componentValues.end(), peakValues.begin(), peakValues.end());
 			}
 			
-			dirtySet.GetSquareIntegrated(integrated.data(), scratchA.data());
-			maxValue = findPeak(integrated.data(), scratchA.data(), componentX, componentY);
+			if(isPyramidInitialized)
+			{
+				const size_t
+					x1 = componentX > supportX ? componentX - supportX : 0,
+					x2 = std::min(componentX + supportX, _width),
+					y1 = componentY > supportY ? componentY - supportY : 0,
+					y2 = std::min(componentY + supportY, _height);
+				for(size_t y=y1; y!=y2; ++y)
+					dirtySet.GetSquareIntegrated(integrated.data(), scratchA.data(), y*_width + x1, x2-x1);
+				pyramid.Update(integrated.data(), x1, y1, x2, y2);
+			}
+			else {
+				dirtySet.GetSquareIntegrated(integrated.data(), scratchA.data());
+				pyramid.Initialize(integrated.data());
+				isPyramidInitialized = true;
+			}
+			maxValue = pyramid.FindPeak(componentX, componentY);
 			
 			peakIndex = componentX + componentY*_width;
 			
 			++this->_iterationNumber;
 		}
+		
+		if(!componentIndices.empty())
+			subtractOutsideSupport(dirtySet, psfs, supportX, supportY, componentIndices, componentValues, integrated.data());
 	}
 	if(maxValue)
 	{
@@ -163,6 +242,69 @@ double GenericClean::ExecuteMajorIteration(ImageSet& dirtySet, ImageSet& modelSe
 	}
 }
 
+void GenericClean::psfSupport(const ao::uvector<const double*>& psfs, double cut, size_t& supportX, size_t& supportY) const
+{
+	supportX = 0;
+	supportY = 0;
+	const size_t centreX = _width/2, centreY = _height/2;
+	for(const double* psf : psfs)
+	{
+		for(size_t y=0; y!=_height; ++y)
+		{
+			const size_t distanceY = (y > centreY ? y - centreY : centreY - y) + 1;
+			for(size_t x=0; x!=_width; ++x)
+			{
+				if(std::fabs(psf[y*_width + x]) >= cut)
+				{
+					supportX = std::max(supportX, (x > centreX ? x - centreX : centreX - x) + 1);
+					supportY = std::max(supportY, distanceY);
+				}
+			}
+		}
+	}
+	supportX = std::min(supportX, centreX);
+	supportY = std::min(supportY, centreY);
+}
+
+template<typename NumT>
+void GenericClean::subtractOutsideSupport(TImageSet<NumT>& dirtySet, const ao::uvector<const double*>& psfs, size_t supportX, size_t supportY, const std::vector<size_t>& componentIndices, const ao::uvector<double>& componentValues, double* scratch) const
+{
+	// The PSF extends half an image beyond every side of a component, so a padding of
+	// 1.5 is required to avoid that the convolution wraps around into the image.
+	size_t
+		paddedWidth = _width + (_width+1)/2,
+		paddedHeight = _height + (_height+1)/2;
+	if(paddedWidth%2 != 0)
+		++paddedWidth;
+	if(paddedHeight%2 != 0)
+		++paddedHeight;
+	ImageBufferAllocator::Ptr paddedImage, paddedKernel;
+	_allocator.Allocate(paddedWidth*paddedHeight, paddedImage);
+	_allocator.Allocate(paddedWidth*paddedHeight, paddedKernel);
+	
+	for(size_t imageIndex=0; imageIndex!=dirtySet.size(); ++imageIndex)
+	{
+		// Get the padded kernel of the PSF without its support
+		std::copy_n(psfs[dirtySet.PSFIndex(imageIndex)], _width*_height, scratch);
+		for(size_t y=_height/2 - supportY; y!=_height/2 + supportY; ++y)
+			std::fill_n(&scratch[y*_width + _width/2 - supportX], 2*supportX, 0.0);
+		Image::Untrim(paddedImage.data(), paddedWidth, paddedHeight, scratch, _width, _height);
+		FFTConvolver::PrepareKernel(paddedKernel.data(), paddedImage.data(), paddedWidth, paddedHeight);
+		
+		// Convolve the components of this major iteration with it
+		std::fill_n(scratch, _width*_height, 0.0);
+		for(size_t i=0; i!=componentIndices.size(); ++i)
+			scratch[componentIndices[i]] += componentValues[i*dirtySet.size() + imageIndex];
+		Image::Untrim(paddedImage.data(), paddedWidth, paddedHeight, scratch, _width, _height);
+		FFTConvolver::ConvolveSameSize(_fftwManager, paddedImage.data(), paddedKernel.data(), paddedWidth, paddedHeight);
+		Image::Trim(scratch, _width, _height, paddedImage.data(), paddedWidth, paddedHeight);
+		
+		NumT* residual = dirtySet[imageIndex];
+		for(size_t i=0; i!=_width*_height; ++i)
+			residual[i] -= scratch[i];
+	}
+}
+
 std::string GenericClean::peakDescription(const double* image, size_t& x, size_t& y)
 {
 	std::ostringstream str;
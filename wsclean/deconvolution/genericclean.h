@@ -21,6 +21,8 @@ public:
 	
 	virtual double ExecuteMajorIteration(ImageSet& dirtySet, ImageSet& modelSet, const ao::uvector<const double*>& psfs, size_t width, size_t height, bool& reachedMajorThreshold) final override;
 	
+	virtual double ExecuteFloatMajorIteration(FloatImageSet& dirtySet, FloatImageSet& modelSet, const ao::uvector<const double*>& psfs, size_t width, size_t height, bool& reachedMajorThreshold) final override;
+	
 	virtual std::unique_ptr<DeconvolutionAlgorithm> Clone() const final override
 	{
 		return std::unique_ptr<DeconvolutionAlgorithm>(new GenericClean(*this));
@@ -31,10 +33,27 @@ private:
 	double _convolutionPadding;
 	bool _useSubMinorOptimization;
 	
+	template<typename NumT>
+	double executeMajorIteration(TImageSet<NumT>& dirtySet, TImageSet<NumT>& modelSet, const ao::uvector<const double*>& psfs, size_t width, size_t height, bool& reachedMajorThreshold);
+	
 	boost::optional<double> findPeak(const double *image, double* scratch, size_t &x, size_t &y);
 	
 	std::string peakDescription(const double* image, size_t& x, size_t& y);
 	
+	/**
+	 * Determine the half-size of the box around the PSF centre that contains all
+	 * pixels of the PSFs with an absolute value of at least @p cut.
+	 */
+	void psfSupport(const ao::uvector<const double*>& psfs, double cut, size_t& supportX, size_t& supportY) const;
+	
+	/**
+	 * Subtract the components from the residuals with the part of the PSFs that lies
+	 * outside their support. The values of component i are stored at
+	 * componentValues[i*dirtySet.size()], one for each image.
+	 */
+	template<typename NumT>
+	void subtractOutsideSupport(TImageSet<NumT>& dirtySet, const ao::uvector<const double*>& psfs, size_t supportX, size_t supportY, const std::vector<size_t>& componentIndices, const ao::uvector<double>& componentValues, double* scratch) const;
+	
 	void subtractImage(double *image, const double *psf, size_t x, size_t y, double factor, size_t startY, size_t endY) const
 	{
 		SimpleClean::PartialSubtractImage(image, _width, _height, psf, _width, _height, x, y, factor, startY, endY);
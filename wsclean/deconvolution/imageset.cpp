@@ -8,7 +8,10 @@
 #include "../wsclean/primarybeam.h"
 #include "../wsclean/primarybeamimageset.h"
 
-void ImageSet::initializeIndices()
+#include <type_traits>
+
+template<typename NumT>
+void TImageSet<NumT>::initializeIndices()
 {
 	size_t lastDeconvolutionChannel = 0;
 	size_t deconvolutionChannelStartIndex = 0, lastOutChannel = 0;
@@ -37,7 +40,7 @@ void ImageSet::initializeIndices()
 	for(size_t channel = 0; channel!=_channelsInDeconvolution; ++channel)
 	{
 		size_t sqIndex = channelToSqIndex(channel);
-		ImagingTable subTable = _imagingTable.GetSquaredGroup(sqIndex);
+		const ImagingTable& subTable = _squaredGroups[sqIndex];
 		for(size_t eIndex = 0; eIndex!=subTable.EntryCount(); ++eIndex)
 		{
 			const ImagingTableEntry& entry = subTable[eIndex];
@@ -47,7 +50,8 @@ void ImageSet::initializeIndices()
 	}
 }
 
-void ImageSet::LoadAndAverage(CachedImageSet& imageSet)
+template<typename NumT>
+void TImageSet<NumT>::LoadAndAverage(CachedImageSet& imageSet)
 {
 	for(size_t i=0; i!=_images.size(); ++i)
 		assign(_images[i], 0.0);
@@ -64,7 +68,7 @@ void ImageSet::LoadAndAverage(CachedImageSet& imageSet)
 		// makes sure that images of the same polarizations and that belong to the
 		// same deconvolution channel are averaged together.
 		size_t imgIndexForChannel = imgIndex;
-		ImagingTable subTable = _imagingTable.GetSquaredGroup(sqIndex);
+		const ImagingTable& subTable = _squaredGroups[sqIndex];
 		for(size_t eIndex=0; eIndex!=subTable.EntryCount(); ++eIndex)
 		{
 			const ImagingTableEntry& e = subTable[eIndex];
@@ -85,10 +89,14 @@ void ImageSet::LoadAndAverage(CachedImageSet& imageSet)
 	}
 	
 	for(size_t i=0; i!=_images.size(); ++i)
+	{
 		multiply(_images[i], 1.0/double(weights[i]));
+		evict(i);
+	}
 }
 
-void ImageSet::LoadAndAveragePSFs(CachedImageSet& psfSet, std::vector<ao::uvector<double>>& psfImages, PolarizationEnum psfPolarization)
+template<typename NumT>
+void TImageSet<NumT>::LoadAndAveragePSFs(CachedImageSet& psfSet, std::vector<ao::uvector<double>>& psfImages, PolarizationEnum psfPolarization)
 {
 	for(size_t chIndex=0; chIndex!=_channelsInDeconvolution; ++chIndex)
 		psfImages[chIndex].assign(_imageSize, 0.0);
@@ -101,7 +109,7 @@ void ImageSet::LoadAndAveragePSFs(CachedImageSet& psfSet, std::vector<ao::uvecto
 	for(size_t sqIndex=0; sqIndex!=_imagingTable.SquaredGroupCount(); ++sqIndex)
 	{
 		size_t chIndex = (sqIndex*_channelsInDeconvolution)/_imagingTable.SquaredGroupCount();
-		ImagingTable subTable = _imagingTable.GetSquaredGroup(sqIndex);
+		const ImagingTable& subTable = _squaredGroups[sqIndex];
 		const ImagingTableEntry& e = subTable.Front();
 		psfSet.Load(scratch.data(), psfPolarization, e.outputChannelIndex, 0);
 		add(psfImages[chIndex].data(), scratch.data());
@@ -112,7 +120,8 @@ void ImageSet::LoadAndAveragePSFs(CachedImageSet& psfSet, std::vector<ao::uvecto
 		multiply(psfImages[chIndex].data(), 1.0/double(weights[chIndex]));
 }
 
-void ImageSet::InterpolateAndStore(CachedImageSet& imageSet, const SpectralFitter& fitter)
+template<typename NumT>
+void TImageSet<NumT>::InterpolateAndStore(CachedImageSet& imageSet, const SpectralFitter& fitter)
 {
 	if(_channelsInDeconvolution == _imagingTable.SquaredGroupCount())
 	{
@@ -178,7 +187,8 @@ void ImageSet::InterpolateAndStore(CachedImageSet& imageSet, const SpectralFitte
 	}
 }
 
-void ImageSet::AssignAndStore(CachedImageSet& imageSet)
+template<typename NumT>
+void TImageSet<NumT>::AssignAndStore(CachedImageSet& imageSet)
 {
 	if(_channelsInDeconvolution == _imagingTable.SquaredGroupCount())
 	{
@@ -186,17 +196,21 @@ void ImageSet::AssignAndStore(CachedImageSet& imageSet)
 	}
 	else {
 		Logger::Info << "Assigning from " << _channelsInDeconvolution << " to " << _imagingTable.SquaredGroupCount() << " channels...\n";
+		ImageBufferAllocator::Ptr scratch;
+		if(!std::is_same<NumT, double>::value)
+			_allocator.Allocate(_imageSize, scratch);
 		size_t imgIndex = 0;
 		for(size_t sqIndex=0; sqIndex!=_imagingTable.SquaredGroupCount(); ++sqIndex)
 		{
 			size_t imgIndexForChannel = imgIndex;
-			ImagingTable subTable = _imagingTable.GetSquaredGroup(sqIndex);
+			const ImagingTable& subTable = _squaredGroups[sqIndex];
 			for(size_t eIndex=0; eIndex!=subTable.EntryCount(); ++eIndex)
 			{
 				const ImagingTableEntry& e = subTable[eIndex];
 				for(size_t i=0; i!=e.imageCount; ++i)
 				{
-					imageSet.Store(_images[imgIndex], e.polarization, e.outputChannelIndex, i==1);
+					imageSet.Store(asDouble(_images[imgIndex], scratch, _imageSize), e.polarization, e.outputChannelIndex, i==1);
+					evict(imgIndex);
 					++imgIndex;
 				}
 			}
@@ -208,32 +222,65 @@ void ImageSet::AssignAndStore(CachedImageSet& imageSet)
 	}
 }
 
-void ImageSet::directStore(CachedImageSet& imageSet)
+template<typename NumT>
+void TImageSet<NumT>::directStore(CachedImageSet& imageSet)
 {
+	ImageBufferAllocator::Ptr scratch;
+	if(!std::is_same<NumT, double>::value)
+		_allocator.Allocate(_imageSize, scratch);
 	size_t imgIndex = 0;
 	for(size_t i=0; i!=_imagingTable.EntryCount(); ++i)
 	{
 		const ImagingTableEntry& e = _imagingTable[i];
 		for(size_t i=0; i!=e.imageCount; ++i)
 		{
-			imageSet.Store(_images[imgIndex], e.polarization, e.outputChannelIndex, i==1);
+			imageSet.Store(asDouble(_images[imgIndex], scratch, _imageSize), e.polarization, e.outputChannelIndex, i==1);
+			evict(imgIndex);
 			++imgIndex;
 		}
 	}
 }
 
-void ImageSet::getSquareIntegratedWithNormalChannels(double* dest, double* scratch) const
+template<typename NumT>
+void TImageSet<NumT>::GetSquareIntegrated(double* dest, double* scratch, size_t offset, size_t count) const
+{
+	const size_t end = offset + count;
+	for(; offset<end; offset+=integrationTileSize())
+	{
+		const size_t tileCount = std::min(integrationTileSize(), end-offset);
+		if(_squareJoinedChannels)
+			getSquareIntegratedWithSquaredChannels(dest+offset, offset, tileCount);
+		else
+			getSquareIntegratedWithNormalChannels(dest+offset, scratch+offset, offset, tileCount);
+	}
+}
+
+template<typename NumT>
+void TImageSet<NumT>::getSquareIntegratedWithNormalChannels(double* dest, double* scratch) const
+{
+	// The integration is performed per tile, such that the tile of the output stays in the cache
+	// while the images are added, and with out-of-core storage only a tile of every image needs
+	// to be resident.
+	for(size_t offset=0; offset<_imageSize; offset+=integrationTileSize())
+	{
+		const size_t count = std::min(integrationTileSize(), _imageSize-offset);
+		getSquareIntegratedWithNormalChannels(dest+offset, scratch+offset, offset, count);
+	}
+}
+
+template<typename NumT>
+void TImageSet<NumT>::getSquareIntegratedWithNormalChannels(double* dest, double* scratch, size_t offset, size_t count) const
 {
 	// In case only one frequency channel is used, we do not have to use 'scratch',
 	// which saves copying and normalizing the data.
 	if(_channelsInDeconvolution == 1)
 	{
-		ImagingTable subTable = _imagingTable.GetSquaredGroup(0);
+		const ImagingTable& subTable = _squaredGroups[0];
 		if(subTable.EntryCount() == 1)
 		{
 			const ImagingTableEntry& entry = subTable[0];
 			size_t imageIndex = _tableIndexToImageIndex.find(entry.index)->second;
-			assign(dest, _images[imageIndex]);
+			assign(dest, _images[imageIndex]+offset, count);
 		}
 		else {
 			const bool useAllPolarizations = _linkedPolarizations.empty();
@@ -245,15 +292,15 @@ void ImageSet::getSquareIntegratedWithNormalChannels(double* dest, double* scrat
 					size_t imageIndex = _tableIndexToImageIndex.find(entry.index)->second;
 					if(eIndex == 0)
 					{
-						assign(dest, _images[0]);
-						square(dest);
+						assign(dest, _images[0]+offset, count);
+						square(dest, count);
 					}
 					else {
-						addSquared(dest, _images[imageIndex]);
+						addSquared(dest, _images[imageIndex]+offset, count);
 					}
 				}
 			}
-			squareRootMultiply(dest, sqrt(_polarizationNormalizationFactor));
+			squareRootMultiply(dest, sqrt(_polarizationNormalizationFactor), count);
 		}
 	}
 	else {
@@ -261,14 +308,14 @@ void ImageSet::getSquareIntegratedWithNormalChannels(double* dest, double* scrat
 		for(size_t chIndex = 0; chIndex!=_channelsInDeconvolution; ++chIndex)
 		{
 			size_t sqIndex = channelToSqIndex(chIndex);
-			ImagingTable subTable = _imagingTable.GetSquaredGroup(sqIndex);
+			const ImagingTable& subTable = _squaredGroups[sqIndex];
 			const double groupWeight = _weights[chIndex];
 			weightSum += groupWeight;
 			if(subTable.EntryCount() == 1)
 			{
 				const ImagingTableEntry& entry = subTable[0];
 				size_t imageIndex = _tableIndexToImageIndex.find(entry.index)->second;
-				assign(scratch, _images[imageIndex]);
+				assign(scratch, _images[imageIndex]+offset, count);
 			}
 			else {
 				const bool useAllPolarizations = _linkedPolarizations.empty();
@@ -280,30 +327,41 @@ void ImageSet::getSquareIntegratedWithNormalChannels(double* dest, double* scrat
 						size_t imageIndex = _tableIndexToImageIndex.find(entry.index)->second;
 						if(eIndex == 0)
 						{
-							assign(scratch, _images[imageIndex]);
-							square(scratch);
+							assign(scratch, _images[imageIndex]+offset, count);
+							square(scratch, count);
 						}
 						else {
-							addSquared(scratch, _images[imageIndex]);
+							addSquared(scratch, _images[imageIndex]+offset, count);
 						}
 					}
 				}
-				squareRoot(scratch);
+				squareRoot(scratch, count);
 			}
 			
 			if(chIndex == 0)
-				assignMultiply(dest, scratch, groupWeight);
+				assignMultiply(dest, scratch, groupWeight, count);
 			else
-				addFactor(dest, scratch, groupWeight);
+				addFactor(dest, scratch, groupWeight, count);
 		}
 		if(_channelsInDeconvolution > 0)
-			multiply(dest, sqrt(_polarizationNormalizationFactor)/weightSum);
+			multiply(dest, sqrt(_polarizationNormalizationFactor)/weightSum, count);
 		else
-			assign(dest, 0.0);
+			assign(dest, 0.0, count);
+	}
+}
+
+template<typename NumT>
+void TImageSet<NumT>::getSquareIntegratedWithSquaredChannels(double* dest) const
+{
+	for(size_t offset=0; offset<_imageSize; offset+=integrationTileSize())
+	{
+		const size_t count = std::min(integrationTileSize(), _imageSize-offset);
+		getSquareIntegratedWithSquaredChannels(dest+offset, offset, count);
 	}
 }
 
-void ImageSet::getSquareIntegratedWithSquaredChannels(double* dest) const
+template<typename NumT>
+void TImageSet<NumT>::getSquareIntegratedWithSquaredChannels(double* dest, size_t offset, size_t count) const
 {
 	bool isFirst = true;
 	const bool useAllPolarizations = _linkedPolarizations.empty();
@@ -311,7 +369,7 @@ void ImageSet::getSquareIntegratedWithSquaredChannels(double* dest) const
 	{
 		// TODO this should be weighted
 		size_t sqIndex = channelToSqIndex(channel);
-		ImagingTable subTable = _imagingTable.GetSquaredGroup(sqIndex);
+		const ImagingTable& subTable = _squaredGroups[sqIndex];
 		for(size_t eIndex = 0; eIndex!=subTable.EntryCount(); ++eIndex)
 		{
 			const ImagingTableEntry& entry = subTable[eIndex];
@@ -320,12 +378,12 @@ void ImageSet::getSquareIntegratedWithSquaredChannels(double* dest) const
 				size_t imageIndex = _tableIndexToImageIndex.find(entry.index)->second;
 				if(isFirst)
 				{
-					assign(dest, _images[imageIndex]);
-					square(dest);
+					assign(dest, _images[imageIndex]+offset, count);
+					square(dest, count);
 					isFirst = false;
 				}
 				else {
-					addSquared(dest, _images[imageIndex]);
+					addSquared(dest, _images[imageIndex]+offset, count);
 				}
 			}
 		}
@@ -333,18 +391,29 @@ void ImageSet::getSquareIntegratedWithSquaredChannels(double* dest) const
 	double factor = _channelsInDeconvolution > 0 ?
 		sqrt(_polarizationNormalizationFactor)/double(_channelsInDeconvolution)
 		: 0.0;
-	squareRootMultiply(dest, factor);
+	squareRootMultiply(dest, factor, count);
 }
 
-void ImageSet::getLinearIntegratedWithNormalChannels(double* dest) const
+template<typename NumT>
+void TImageSet<NumT>::getLinearIntegratedWithNormalChannels(double* dest) const
+{
+	for(size_t offset=0; offset<_imageSize; offset+=integrationTileSize())
+	{
+		const size_t count = std::min(integrationTileSize(), _imageSize-offset);
+		getLinearIntegratedWithNormalChannels(dest+offset, offset, count);
+	}
+}
+
+template<typename NumT>
+void TImageSet<NumT>::getLinearIntegratedWithNormalChannels(double* dest, size_t offset, size_t count) const
 {
 	const bool useAllPolarizations = _linkedPolarizations.empty();
-	if(_channelsInDeconvolution == 1 && _imagingTable.GetSquaredGroup(0).EntryCount() == 1)
+	if(_channelsInDeconvolution == 1 && _squaredGroups[0].EntryCount() == 1)
 	{
-		ImagingTable subTable = _imagingTable.GetSquaredGroup(0);
+		const ImagingTable& subTable = _squaredGroups[0];
 		const ImagingTableEntry& entry = subTable[0];
 		size_t imageIndex = _tableIndexToImageIndex.find(entry.index)->second;
-		assign(dest, _images[imageIndex]);
+		assign(dest, _images[imageIndex]+offset, count);
   }
 	else {
 		bool isFirst = true;
@@ -352,7 +421,7 @@ void ImageSet::getLinearIntegratedWithNormalChannels(double* dest) const
 		for(size_t channel = 0; channel!=_channelsInDeconvolution; ++channel)
 		{
 			size_t sqIndex = channelToSqIndex(channel);
-			ImagingTable subTable = _imagingTable.GetSquaredGroup(sqIndex);
+			const ImagingTable& subTable = _squaredGroups[sqIndex];
 			const double groupWeight = _weights[channel];
 			weightSum += groupWeight;
 			for(size_t eIndex = 0; eIndex!=subTable.EntryCount(); ++eIndex)
@@ -363,23 +432,24 @@ void ImageSet::getLinearIntegratedWithNormalChannels(double* dest) const
 					size_t imageIndex = _tableIndexToImageIndex.find(entry.index)->second;
 					if(isFirst)
 					{
-						assignMultiply(dest, _images[imageIndex], groupWeight);
+						assignMultiply(dest, _images[imageIndex]+offset, groupWeight, count);
 						isFirst = false;
 					}
 					else {
-						addFactor(dest, _images[imageIndex], groupWeight);
+						addFactor(dest, _images[imageIndex]+offset, groupWeight, count);
 					}
 				}
 			}
 		}
 		if(weightSum > 0.0)
-			multiply(dest, _polarizationNormalizationFactor/weightSum);
+			multiply(dest, _polarizationNormalizationFactor/weightSum, count);
 		else
-			assign(dest, 0.0);
+			assign(dest, 0.0, count);
 	}
 }
 
-void ImageSet::CalculateDeconvolutionFrequencies(const ImagingTable& groupTable, ao::uvector<double>& frequencies, ao::uvector<double>& weights, size_t nDeconvolutionChannels)
+template<typename NumT>
+void TImageSet<NumT>::CalculateDeconvolutionFrequencies(const ImagingTable& groupTable, ao::uvector<double>& frequencies, ao::uvector<double>& weights, size_t nDeconvolutionChannels)
 {
 	size_t nInputChannels = groupTable.SquaredGroupCount();
 	if(nDeconvolutionChannels == 0) nDeconvolutionChannels = nInputChannels;
@@ -399,3 +469,6 @@ void ImageSet::CalculateDeconvolutionFrequencies(const ImagingTable& groupTable,
 	for(size_t i=0; i!=nDeconvolutionChannels; ++i)
 		frequencies[i] /= weights[i];
 }
+
+template class TImageSet<double>;
+template class TImageSet<float>;
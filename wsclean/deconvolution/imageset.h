@@ -1,19 +1,30 @@
 #ifndef IMAGE_SET_H
 #define IMAGE_SET_H
 
+#include "mappedimagestore.h"
+#include "simdkernels.h"
+
 #include "../uvector.h"
 #include "../wsclean/imagingtable.h"
 #include "../wsclean/imagebufferallocator.h"
 #include "../wsclean/wscleansettings.h"
 
+#include <algorithm>
 #include <vector>
 #include <map>
 #include <memory>
 
-class ImageSet
+/**
+ * The images of all polarizations and deconvolution channels that are deconvolved
+ * together. NumT is the type in which the images are stored: double, or float to
+ * halve the memory use and bandwidth of the deconvolution. Values that are calculated
+ * from the images, such as the integrated images, are always double.
+ */
+template<typename NumT>
+class TImageSet
 {
 public:
-	ImageSet(const ImagingTable* table, ImageBufferAllocator& allocator, const WSCleanSettings& settings) :
+	TImageSet(const ImagingTable* table, ImageBufferAllocator& allocator, const WSCleanSettings& settings) :
 		_images(),
 		_imageSize(0),
 		_channelsInDeconvolution(
@@ -22,14 +33,16 @@ public:
 			: settings.deconvolutionChannelCount),
 		_squareJoinedChannels(settings.squaredJoins),
 		_imagingTable(*table),
+		_squaredGroups(makeSquaredGroups(*table)),
 		_imageIndexToPSFIndex(),
 		_linkedPolarizations(settings.linkedPolarizations),
 		_settings(settings),
-		_allocator(allocator)
+		_allocator(allocator),
+		_isOutOfCore(settings.deconvolutionOutOfCore)
 	{
-		size_t nPol = table->GetSquaredGroup(0).EntryCount();
+		size_t nPol = _squaredGroups[0].EntryCount();
 		size_t nImages = nPol * _channelsInDeconvolution;
-		_images.assign(nImages, static_cast<double*>(0));
+		_images.assign(nImages, static_cast<NumT*>(0));
 		_imageIndexToPSFIndex.resize(nImages);
 		
 		initializePolFactor();
@@ -37,7 +50,7 @@ public:
 		CalculateDeconvolutionFrequencies(*table, _frequencies, _weights, _channelsInDeconvolution);
 	}
 	
-	ImageSet(const ImagingTable* table, ImageBufferAllocator& allocator, const WSCleanSettings& settings, size_t width, size_t height) :
+	TImageSet(const ImagingTable* table, ImageBufferAllocator& allocator, const WSCleanSettings& settings, size_t width, size_t height) :
 		_images(),
 		_imageSize(width*height),
 		_channelsInDeconvolution(
@@ -46,14 +59,16 @@ public:
 			: settings.deconvolutionChannelCount),
 		_squareJoinedChannels(settings.squaredJoins),
 		_imagingTable(*table),
+		_squaredGroups(makeSquaredGroups(*table)),
 		_imageIndexToPSFIndex(),
 		_linkedPolarizations(settings.linkedPolarizations),
 		_settings(settings),
-		_allocator(allocator)
+		_allocator(allocator),
+		_isOutOfCore(settings.deconvolutionOutOfCore)
 	{
-		size_t nPol = table->GetSquaredGroup(0).EntryCount();
+		size_t nPol = _squaredGroups[0].EntryCount();
 		size_t nImages = nPol * _channelsInDeconvolution;
-		_images.assign(nImages, static_cast<double*>(0));
+		_images.assign(nImages, static_cast<NumT*>(0));
 		_imageIndexToPSFIndex.resize(nImages);
 		
 		initializePolFactor();
@@ -62,7 +77,7 @@ public:
 		allocateImages();
 	}
 	
-	~ImageSet()
+	~TImageSet()
 	{
 		free();
 	}
@@ -80,19 +95,6 @@ public:
 		allocateImages();
 	}
 	
-	double* Release(size_t imageIndex)
-	{
-		double* image = _images[imageIndex];
-		_images[imageIndex] = 0;
-		return image;
-	}
-	
-	void Claim(size_t imageIndex, double* data)
-	{
-		_allocator.Free(_images[imageIndex]);
-		_images[imageIndex] = data;
-	}
-	
 	bool IsAllocated() const
 	{
 		return _imageSize!=0;
@@ -145,6 +147,16 @@ public:
 			getSquareIntegratedWithNormalChannels(dest, scratch);
 	}
 	
+	/**
+	 * Same as @ref GetSquareIntegrated(double*, double*) const, but only calculates
+	 * the pixels with indices [offset, offset+count). Other pixels in dest are left
+	 * untouched. This is used to update the integrated image after a change
+	 * to only part of the images.
+	 * @param dest Pre-allocated output array of the full image size.
+	 * @param scratch Pre-allocated scratch space, same size as image.
+	 */
+	void GetSquareIntegrated(double* dest, double* scratch, size_t offset, size_t count) const;
+	
 	/**
 	 * This function will calculate the 'linear' integration over all images, unless
 	 * joined channels are requested to be squared.
@@ -178,19 +190,19 @@ public:
 	
 	size_t ChannelsInDeconvolution() const { return _channelsInDeconvolution; }
 	
-	ImageSet& operator=(double val)
+	TImageSet<NumT>& operator=(double val)
 	{
 		for(size_t i=0; i!=size(); ++i)
 			assign(_images[i], val);
 		return *this;
 	}
 	
-	double* operator[](size_t index)
+	NumT* operator[](size_t index)
 	{
 		return _images[index];
 	}
 	
-	const double* operator[](size_t index) const
+	const NumT* operator[](size_t index) const
 	{
 		return _images[index];
 	}
@@ -201,9 +213,13 @@ public:
 	
 	const ImagingTable& Table() const { return _imagingTable; }
 	
-	std::unique_ptr<ImageSet> Trim(size_t x1, size_t y1, size_t x2, size_t y2, size_t oldWidth) const
+	std::unique_ptr<TImageSet<NumT>> Trim(size_t x1, size_t y1, size_t x2, size_t y2, size_t oldWidth) const
 	{
-		std::unique_ptr<ImageSet> p(new ImageSet(&_imagingTable, _allocator, _settings, x2-x1, y2-y1));
+		// Sub-images are small and only live during one major iteration, so they are kept
+		// in memory even when the full images are stored out of core.
+		std::unique_ptr<TImageSet<NumT>> p(new TImageSet<NumT>(&_imagingTable, _allocator, _settings));
+		p->_isOutOfCore = false;
+		p->AllocateImages(x2-x1, y2-y1);
 		for(size_t i=0; i!=_images.size(); ++i)
 		{
 			copySmallerPart(_images[i], p->_images[i], x1, y1, x2, y2, oldWidth);
@@ -211,7 +227,7 @@ public:
 		return p;
 	}
 	
-	void Copy(const ImageSet& from, size_t toX, size_t toY, size_t toWidth, size_t fromWidth, size_t fromHeight)
+	void Copy(const TImageSet<NumT>& from, size_t toX, size_t toY, size_t toWidth, size_t fromWidth, size_t fromHeight)
 	{
 		for(size_t i=0; i!=_images.size(); ++i)
 		{
@@ -219,7 +235,7 @@ public:
 		}
 	}
 	
-	void CopyMasked(const ImageSet& from, size_t toX, size_t toY, size_t toWidth, size_t fromWidth, size_t fromHeight, const bool* fromMask)
+	void CopyMasked(const TImageSet<NumT>& from, size_t toX, size_t toY, size_t toWidth, size_t fromWidth, size_t fromHeight, const bool* fromMask)
 	{
 		for(size_t i=0; i!=_images.size(); ++i)
 		{
@@ -227,27 +243,27 @@ public:
 		}
 	}
 	
-	ImageSet& operator*=(double factor)
+	TImageSet<NumT>& operator*=(double factor)
 	{
 		for(size_t i=0; i!=size(); ++i)
 			multiply(_images[i], factor);
 		return *this;
 	}
 	
-	ImageSet& operator+=(const ImageSet& other)
+	TImageSet<NumT>& operator+=(const TImageSet<NumT>& other)
 	{
 		for(size_t i=0; i!=size(); ++i)
 			add(_images[i], other._images[i]);
 		return *this;
 	}
 	
-	void FactorAdd(ImageSet& rhs, double factor)
+	void FactorAdd(TImageSet<NumT>& rhs, double factor)
 	{
 		for(size_t i=0; i!=size(); ++i)
 			addFactor(_images[i], rhs._images[i], factor);
 	}
 	
-	void Set(size_t index, const double* rhs)
+	void Set(size_t index, const NumT* rhs)
 	{
 		assign(_images[index], rhs);
 	}
@@ -267,97 +283,191 @@ public:
 	static void CalculateDeconvolutionFrequencies(const ImagingTable& groupTable, ao::uvector<double>& frequencies, ao::uvector<double>& weights, size_t nDeconvolutionChannels);
 	
 private:
-	ImageSet(const ImageSet&) = delete;
-	ImageSet& operator=(const ImageSet&) = delete;
+	TImageSet(const TImageSet<NumT>&) = delete;
+	TImageSet<NumT>& operator=(const TImageSet<NumT>&) = delete;
+	
+	/**
+	 * Number of doubles that hold an image. The allocator and the mapped store hand
+	 * out doubles; single-precision images use them like
+	 * ImageBufferAllocator::AllocateTPtr<float>() does.
+	 */
+	size_t storageSize() const
+	{
+		return (_imageSize * sizeof(NumT) + sizeof(double) - 1) / sizeof(double);
+	}
+	
+	NumT* allocateImage()
+	{
+		return reinterpret_cast<NumT*>(_allocator.Allocate(storageSize()));
+	}
+	
+	void freeImage(NumT* image)
+	{
+		_allocator.Free(reinterpret_cast<double*>(image));
+	}
 		
 	void allocateImages()
 	{
-		for(ao::uvector<double*>::iterator img=_images.begin();
-				img!=_images.end(); ++img)
+		if(_isOutOfCore && _imageSize != 0)
 		{
-			*img = _allocator.Allocate(_imageSize);
+			_store.reset(new MappedImageStore(_settings.temporaryDirectory, _images.size(), storageSize()));
+			for(size_t i=0; i!=_images.size(); ++i)
+				_images[i] = reinterpret_cast<NumT*>(_store->Image(i));
+		}
+		else {
+			for(NumT*& img : _images)
+				img = allocateImage();
 		}
 	}
 	
 	void free()
 	{
-		for(ao::uvector<double*>::iterator img=_images.begin();
-				img!=_images.end(); ++img)
-			_allocator.Free(*img);
+		if(_store)
+		{
+			_store.reset();
+			std::fill(_images.begin(), _images.end(), static_cast<NumT*>(0));
+		}
+		else {
+			for(NumT* img : _images)
+				freeImage(img);
+		}
+	}
+	
+	/**
+	 * With out-of-core storage, allow the kernel to write an image that is not needed
+	 * for a while back to disk.
+	 */
+	void evict(size_t imageIndex)
+	{
+		if(_store)
+			_store->Evict(imageIndex, 0, _store->ImageSize());
 	}
+	
+	/**
+	 * Returns the image as doubles, for passing it to functions that only take double
+	 * images, such as CachedImageSet::Store(). A single-precision image is
+	 * converted into scratch.
+	 */
+	static const double* asDouble(const double* image, ImageBufferAllocator::Ptr& /*scratch*/, size_t /*n*/)
+	{
+		return image;
+	}
+	
+	static const double* asDouble(const float* image, ImageBufferAllocator::Ptr& scratch, size_t n)
+	{
+		std::copy_n(image, n, scratch.data());
+		return scratch.data();
+	}
+	
+	/**
+	 * Number of pixels per tile in the integration functions. A tile of all images and
+	 * the output should fit in the cache.
+	 */
+	static size_t integrationTileSize() { return 16384; }
 		
-	void assign(double* lhs, const double* rhs) const
+	template<typename LhsT, typename RhsT>
+	void assign(LhsT* lhs, const RhsT* rhs) const
 	{
-		memcpy(lhs, rhs, sizeof(double) * _imageSize);
+		assign(lhs, rhs, _imageSize);
 	}
 	
-	void assign(double* lhs, const ImageBufferAllocator::Ptr& rhs) const
+	template<typename LhsT, typename RhsT>
+	static void assign(LhsT* lhs, const RhsT* rhs, size_t n)
 	{
-		memcpy(lhs, rhs.data(), sizeof(double) * _imageSize);
+		std::copy_n(rhs, n, lhs);
 	}
 	
-	void assignMultiply(double* lhs, const double* rhs, double factor) const
+	template<typename RhsT>
+	static void assignMultiply(double* lhs, const RhsT* rhs, double factor, size_t n)
 	{
-		for(size_t i=0; i!=_imageSize; ++i)
+		for(size_t i=0; i!=n; ++i)
 			lhs[i] = rhs[i] * factor;
 	}
 	
-	void assign(double* image, double value) const
+	template<typename T>
+	void assign(T* image, double value) const
 	{
-		for(size_t i=0; i!=_imageSize; ++i)
-			image[i] = value;
+		assign(image, value, _imageSize);
+	}
+	
+	template<typename T>
+	static void assign(T* image, double value, size_t n)
+	{
+		std::fill_n(image, n, T(value));
 	}
 	
-	void add(double* lhs, const double* rhs) const
+	template<typename LhsT, typename RhsT>
+	void add(LhsT* lhs, const RhsT* rhs) const
 	{
 		for(size_t i=0; i!=_imageSize; ++i)
 			lhs[i] += rhs[i];
 	}
 	
-	void square(double* image) const
+	static void square(double* image, size_t n)
 	{
-		for(size_t i=0; i!=_imageSize; ++i)
+		for(size_t i=0; i!=n; ++i)
 			image[i] *= image[i];
 	}
 	
-	void squareRoot(double* image) const
+	static void squareRoot(double* image, size_t n)
 	{
-		for(size_t i=0; i!=_imageSize; ++i)
+		for(size_t i=0; i!=n; ++i)
 			image[i] = sqrt(image[i]);
 	}
 	
-	void squareRootMultiply(double* image, double factor) const
+	static void squareRootMultiply(double* image, double factor, size_t n)
 	{
-		for(size_t i=0; i!=_imageSize; ++i)
-			image[i] = sqrt(image[i]) * factor;
+		SimdKernels::SquareRootMultiply(image, factor, n);
 	}
 	
-	void addSquared(double* lhs, const double* rhs) const
+	template<typename RhsT>
+	static void addSquared(double* lhs, const RhsT* rhs, size_t n)
 	{
-		for(size_t i=0; i!=_imageSize; ++i)
-			lhs[i] += rhs[i]*rhs[i];
+		SimdKernels::AddSquared(lhs, rhs, n);
 	}
 	
-	void addFactor(double* lhs, const double* rhs, double factor) const
+	template<typename LhsT, typename RhsT>
+	void addFactor(LhsT* lhs, const RhsT* rhs, double factor) const
 	{
-		for(size_t i=0; i!=_imageSize; ++i)
-			lhs[i] += rhs[i] * factor;
+		addFactor(lhs, rhs, factor, _imageSize);
+	}
+	
+	template<typename LhsT, typename RhsT>
+	static void addFactor(LhsT* lhs, const RhsT* rhs, double factor, size_t n)
+	{
+		SimdKernels::AddFactor(lhs, rhs, factor, n);
+	}
+	
+	template<typename T>
+	void multiply(T* image, double fact) const
+	{
+		multiply(image, fact, _imageSize);
 	}
 	
-	void multiply(double* image, double fact) const
+	template<typename T>
+	static void multiply(T* image, double fact, size_t n)
 	{
 		if(fact != 1.0)
 		{
-			for(size_t i=0; i!=_imageSize; ++i)
+			for(size_t i=0; i!=n; ++i)
 				image[i] *= fact;
 		}
 	}
 	
+	static std::vector<ImagingTable> makeSquaredGroups(const ImagingTable& table)
+	{
+		std::vector<ImagingTable> groups;
+		groups.reserve(table.SquaredGroupCount());
+		for(size_t i=0; i!=table.SquaredGroupCount(); ++i)
+			groups.emplace_back(table.GetSquaredGroup(i));
+		return groups;
+	}
+	
 	void initializeIndices();
 	
 	void initializePolFactor()
 	{
-		ImagingTable firstChannelGroup = _imagingTable.GetSquaredGroup(0);
+		const ImagingTable& firstChannelGroup = _squaredGroups[0];
 		std::set<PolarizationEnum> pols;
 		for(size_t i=0; i!=firstChannelGroup.EntryCount(); ++i)
 		{
@@ -377,13 +487,13 @@ private:
 			_polarizationNormalizationFactor = 1.0;
 	}
 	
-	static void copySmallerPart(const double* input, double* output, size_t x1, size_t y1, size_t x2, size_t y2, size_t oldWidth)
+	static void copySmallerPart(const NumT* input, NumT* output, size_t x1, size_t y1, size_t x2, size_t y2, size_t oldWidth)
 	{
 		size_t newWidth = x2 - x1;
 		for(size_t y=y1; y!=y2; ++y)
 		{
-			const double* oldPtr = &input[y*oldWidth];
-			double* newPtr = &output[(y-y1)*newWidth];
+			const NumT* oldPtr = &input[y*oldWidth];
+			NumT* newPtr = &output[(y-y1)*newWidth];
 			for(size_t x=x1; x!=x2; ++x)
 			{
 				newPtr[x - x1] = oldPtr[x];
@@ -391,7 +501,7 @@ private:
 		}
 	}
 	
-	static void copyToLarger(double* to, size_t toX, size_t toY, size_t toWidth, const double* from, size_t fromWidth, size_t fromHeight)
+	static void copyToLarger(NumT* to, size_t toX, size_t toY, size_t toWidth, const NumT* from, size_t fromWidth, size_t fromHeight)
 	{
 		for(size_t y=0; y!=fromHeight; ++y)
 		{
@@ -402,7 +512,7 @@ private:
 		}
 	}
 	
-	static void copyToLarger(double* to, size_t toX, size_t toY, size_t toWidth, const double* from, size_t fromWidth, size_t fromHeight, const bool* fromMask)
+	static void copyToLarger(NumT* to, size_t toX, size_t toY, size_t toWidth, const NumT* from, size_t fromWidth, size_t fromHeight, const bool* fromMask)
 	{
 		for(size_t y=0; y!=fromHeight; ++y)
 		{
@@ -417,10 +527,13 @@ private:
 	void directStore(class CachedImageSet& imageSet);
 	
 	void getSquareIntegratedWithNormalChannels(double* dest, double* scratch) const;
+	void getSquareIntegratedWithNormalChannels(double* dest, double* scratch, size_t offset, size_t count) const;
 	
 	void getSquareIntegratedWithSquaredChannels(double* dest) const;
+	void getSquareIntegratedWithSquaredChannels(double* dest, size_t offset, size_t count) const;
 	
 	void getLinearIntegratedWithNormalChannels(double* dest) const;
+	void getLinearIntegratedWithNormalChannels(double* dest, size_t offset, size_t count) const;
 	
 	size_t channelToSqIndex(size_t channel) const
 	{
@@ -431,18 +544,26 @@ private:
 		return fromFloor;
 	}
 	
-	ao::uvector<double*> _images;
+	ao::uvector<NumT*> _images;
 	size_t _imageSize, _channelsInDeconvolution;
 	// These vectors contain the info per deconvolution channel
 	ao::uvector<double> _frequencies, _weights;
 	bool _squareJoinedChannels;
 	const ImagingTable& _imagingTable;
+	// The squared groups of the imaging table, which are used in every integration
+	std::vector<ImagingTable> _squaredGroups;
 	std::map<size_t, size_t> _tableIndexToImageIndex;
 	ao::uvector<size_t> _imageIndexToPSFIndex;
 	double _polarizationNormalizationFactor;
 	std::set<PolarizationEnum> _linkedPolarizations;
 	const WSCleanSettings& _settings;
 	ImageBufferAllocator& _allocator;
+	bool _isOutOfCore;
+	// Only used with out-of-core storage, in which case _images point into the store
+	std::unique_ptr<MappedImageStore> _store;
 };
 
+typedef TImageSet<double> ImageSet;
+typedef TImageSet<float> FloatImageSet;
+
 #endif
@@ -0,0 +1,72 @@
+#include "mappedimagestore.h"
+
+#include "../system.h"
+
+#include <cerrno>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+MappedImageStore::MappedImageStore(const std::string& directory, size_t imageCount, size_t imageSize) :
+	_imageCount(imageCount),
+	_imageSize(imageSize),
+	_fd(-1),
+	_data(nullptr)
+{
+	std::string pattern = (directory.empty() ? std::string(".") : directory) + "/wsclean-imageset-XXXXXX";
+	std::vector<char> filename(pattern.begin(), pattern.end());
+	filename.push_back(0);
+	_fd = mkstemp(filename.data());
+	if(_fd == -1)
+		throw std::runtime_error("Error creating temporary image file " + pattern + ": " + System::StrError(errno));
+	// The file is unlinked immediately, so that it is removed when the store is closed.
+	unlink(filename.data());
+	
+	const size_t length = _imageCount * _imageSize * sizeof(double);
+	if(length != 0)
+	{
+		if(ftruncate(_fd, length) != 0)
+		{
+			std::string msg = System::StrError(errno);
+			close(_fd);
+			throw std::runtime_error("Error resizing temporary image file: " + msg);
+		}
+		void* map = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+		if(map == MAP_FAILED)
+		{
+			std::string msg = System::StrError(errno);
+			close(_fd);
+			throw std::runtime_error("Error creating memory map to temporary image file: mmap() returned MAP_FAILED with error message: " + msg);
+		}
+		_data = reinterpret_cast<double*>(map);
+	}
+}
+
+MappedImageStore::~MappedImageStore()
+{
+	if(_data != nullptr)
+		munmap(_data, _imageCount * _imageSize * sizeof(double));
+	close(_fd);
+}
+
+void MappedImageStore::Evict(size_t imageIndex, size_t offset, size_t count)
+{
+	// madvise() requires page-aligned ranges; only whole pages inside the range are evicted.
+	const size_t pageSize = sysconf(_SC_PAGESIZE);
+	char* start = reinterpret_cast<char*>(Image(imageIndex) + offset);
+	char* end = start + count * sizeof(double);
+	char* alignedStart = reinterpret_cast<char*>(
+		(reinterpret_cast<size_t>(start) + pageSize - 1) / pageSize * pageSize);
+	char* alignedEnd = reinterpret_cast<char*>(
+		reinterpret_cast<size_t>(end) / pageSize * pageSize);
+	if(alignedStart < alignedEnd)
+	{
+		// Start writing back dirty pages, then drop them. For shared file mappings,
+		// MADV_DONTNEED does not discard modifications.
+		msync(alignedStart, alignedEnd - alignedStart, MS_ASYNC);
+		madvise(alignedStart, alignedEnd - alignedStart, MADV_DONTNEED);
+	}
+}
@@ -0,0 +1,49 @@
+#ifndef MAPPED_IMAGE_STORE_H
+#define MAPPED_IMAGE_STORE_H
+
+#include <cstring>
+#include <string>
+
+/**
+ * Storage for a fixed number of equally sized images that is backed by a memory-mapped
+ * temporary file instead of by RAM. This allows an @ref ImageSet with many channels
+ * to be larger than the available memory: the kernel keeps only the pages that are in use
+ * resident, and writes the others back to disk.
+ *
+ * The temporary file is removed directly after creation, so it disappears when the store
+ * is destructed or the process ends.
+ */
+class MappedImageStore
+{
+public:
+	/**
+	 * @param directory Directory in which the temporary file is created. If empty, the current
+	 * directory is used.
+	 */
+	MappedImageStore(const std::string& directory, size_t imageCount, size_t imageSize);
+	
+	~MappedImageStore();
+	
+	double* Image(size_t index) { return _data + index * _imageSize; }
+	const double* Image(size_t index) const { return _data + index * _imageSize; }
+	
+	size_t ImageCount() const { return _imageCount; }
+	size_t ImageSize() const { return _imageSize; }
+	
+	/**
+	 * Tells the kernel that the pixels [offset, offset+count) of the given image are not going
+	 * to be used soon, so that they can be written back and dropped from memory. The data is
+	 * retained.
+	 */
+	void Evict(size_t imageIndex, size_t offset, size_t count);
+	
+private:
+	MappedImageStore(const MappedImageStore&) = delete;
+	MappedImageStore& operator=(const MappedImageStore&) = delete;
+	
+	size_t _imageCount, _imageSize;
+	int _fd;
+	double* _data;
+};
+
+#endif
@@ -1,15 +1,47 @@
 #include "moresane.h"
 
-#include <sys/types.h>
-#include <sys/wait.h>
-
 #include <unistd.h>
 
+#include "../application.h"
 #include "../fitsreader.h"
 #include "../fitswriter.h"
 #include "../fftconvolver.h"
 
-void MoreSane::ExecuteMajorIteration(double* dataImage, double* modelImage, const double* psfImage, size_t width, size_t height)
+#include <algorithm>
+#include <memory>
+
+std::string MoreSane::makeTempPrefix(const std::string& prefixName, const std::string& temporaryDirectory)
+{
+	std::string directory = temporaryDirectory;
+	if(directory.empty() && access("/dev/shm", W_OK) == 0)
+		directory = "/dev/shm";
+	if(directory.empty())
+		return prefixName + "-tmp-moresane";
+	else {
+		// Include the process id, as other runs might use the same directory
+		std::ostringstream str;
+		str << directory << "/wsclean-" << getpid() << "-tmp-moresane";
+		return str.str();
+	}
+}
+
+MoreSane::Run::~Run()
+{
+	if(isRunning)
+	{
+		// Let the process finish, so that it doesn't write its output after the files were removed
+		try {
+			Application::Wait(pid);
+		} catch(std::exception&) { }
+	}
+	unlink(dirtyName.c_str());
+	unlink(psfName.c_str());
+	unlink(maskName.c_str());
+	unlink((outputName+"_model.fits").c_str());
+	unlink((outputName+"_residual.fits").c_str());
+}
+
+void MoreSane::startRun(Run& run, double* dataImage, double* modelImage, const double* psfImage, size_t width, size_t height, size_t imageIndex, size_t threadCount)
 {
 	if(_iterationNumber!=0)
 	{
@@ -22,80 +54,81 @@ void MoreSane::ExecuteMajorIteration(double* dataImage, double* modelImage, cons
 		for(size_t i=0; i!=width*height; ++i)
 			dataImage[i] += modelImage[i];
 	}
-	std::ostringstream outputStr;
-	outputStr << _prefixName << "-tmp-moresaneoutput" << _iterationNumber;
-	const std::string
-		dirtyName(_prefixName + "-tmp-moresaneinput-dirty.fits"),
-		psfName(_prefixName + "-tmp-moresaneinput-psf.fits"),
-		maskName(_prefixName + "-tmp-moresaneinput-mask.fits"),
-		outputName(outputStr.str());
+	run.dataImage = dataImage;
+	run.modelImage = modelImage;
+	std::ostringstream inputStr, outputStr;
+	inputStr << _tempPrefix << "input" << imageIndex;
+	outputStr << _tempPrefix << "output" << _iterationNumber << '-' << imageIndex;
+	run.dirtyName = inputStr.str() + "-dirty.fits";
+	run.psfName = inputStr.str() + "-psf.fits";
+	run.maskName = inputStr.str() + "-mask.fits";
+	run.outputName = outputStr.str();
 	FitsWriter writer;
 	writer.SetImageDimensions(width, height);
 	if(this->_cleanMask != 0)
-		writer.WriteMask(maskName, _cleanMask);
-	writer.Write(dirtyName, dataImage);
-	writer.Write(psfName, psfImage);
+		writer.WriteMask(run.maskName, _cleanMask);
+	writer.Write(run.dirtyName, dataImage);
+	writer.Write(run.psfName, psfImage);
 	
 	std::ostringstream commandLine;
 	commandLine
-		<< "time python \"" << _moresaneLocation << "\" ";
+		<< "OMP_NUM_THREADS=" << threadCount << " time python \"" << _moresaneLocation << "\" ";
 	if(!_allowNegativeComponents)
 		commandLine << "-ep ";
 	if(this->_cleanMask != 0)
-		commandLine << "-m \"" << maskName + "\" ";
+		commandLine << "-m \"" << run.maskName + "\" ";
 	if(!_moresaneArguments.empty())
 		commandLine << _moresaneArguments<< ' ';
-	commandLine << "\"" << dirtyName << "\" \"" << psfName << "\" \"" <<  outputName << '\"';
+	commandLine << "\"" << run.dirtyName << "\" \"" << run.psfName << "\" \"" << run.outputName << '\"';
 	if(!_moresaneSigmaLevels.empty()) {
 		commandLine << " -sl " << _moresaneSigmaLevels[std::min(_iterationNumber,_moresaneSigmaLevels.size()-1)] << " ";
 	}
 	
-	// TODO should use Application::Run().
-	Logger::Info << "Running: " << commandLine.str() << '\n';
-	int pid = vfork();
-	switch (pid) {
-		case -1: // Error
-			throw std::runtime_error("Could not vfork() new process for executing MoreSane");
-		case 0: // Child
-			execl("/bin/sh", "sh", "-c", commandLine.str().c_str(), NULL);
-			_exit(127);
-	}
-	// Wait for process to terminate
-	int pStatus;
-	do {
-		int pidReturn;
-		do {
-			pidReturn = waitpid(pid, &pStatus, 0);
-		} while (pidReturn == -1 && errno == EINTR);
-	} while(!WIFEXITED(pStatus) && !WIFSIGNALED(pStatus));
-	if(WIFEXITED(pStatus))
-	{
-		// all good
-		// const int exitStatus = WEXITSTATUS(pStatus);
-	} else {
+	run.pid = Application::Start(commandLine.str());
+	run.isRunning = true;
+}
+
+void MoreSane::finishRun(MoreSane::Run& run)
+{
+	run.isRunning = false;
+	try {
+		Application::Wait(run.pid);
+	} catch(std::exception&) {
 		throw std::runtime_error("MoreSane returned an error");
 	}
 	
-	FitsReader modelReader(outputName+"_model.fits");
-	modelReader.Read(modelImage);
-	FitsReader residualReader(outputName+"_residual.fits");
-	residualReader.Read(dataImage);
-	
-	unlink(dirtyName.c_str());
-	unlink(psfName.c_str());
-	unlink(maskName.c_str());
-	unlink((outputName+"_model.fits").c_str());
-	unlink((outputName+"_residual.fits").c_str());
-	
+	FitsReader modelReader(run.outputName+"_model.fits");
+	modelReader.Read(run.modelImage);
+	FitsReader residualReader(run.outputName+"_residual.fits");
+	residualReader.Read(run.dataImage);
+}
+
+void MoreSane::ExecuteMajorIteration(double* dataImage, double* modelImage, const double* psfImage, size_t width, size_t height)
+{
+	Run run;
+	startRun(run, dataImage, modelImage, psfImage, width, height, 0, std::max<size_t>(1, _threadCount));
+	finishRun(run);
 }
 
 double MoreSane::ExecuteMajorIteration(ImageSet& dataImage, ImageSet& modelImage, const ao::uvector<const double*>& psfImages, size_t width, size_t height, bool& reachedMajorThreshold)
 {
-	for(size_t i=0; i!=dataImage.size(); ++i)
+	// The threads are divided over the MoreSane processes that run at the same time
+	const size_t
+		maxConcurrentRuns = std::max<size_t>(1, std::min(_parallelRuns, dataImage.size())),
+		threadsPerRun = std::max<size_t>(1, _threadCount / maxConcurrentRuns);
+	for(size_t batchStart=0; batchStart<dataImage.size(); batchStart+=maxConcurrentRuns)
 	{
-		double* residualData = dataImage[i];
-		double* modelData = modelImage[i];
-		ExecuteMajorIteration(residualData, modelData, psfImages[dataImage.PSFIndex(i)], width, height);
+		const size_t batchEnd = std::min(dataImage.size(), batchStart + maxConcurrentRuns);
+		std::vector<std::unique_ptr<Run>> runs;
+		for(size_t i=batchStart; i!=batchEnd; ++i)
+		{
+			double* residualData = dataImage[i];
+			double* modelData = modelImage[i];
+			runs.emplace_back(new Run());
+			startRun(*runs.back(), residualData, modelData, psfImages[dataImage.PSFIndex(i)], width, height, i, threadsPerRun);
+		}
+		for(std::unique_ptr<Run>& run : runs)
+			finishRun(*run);
 	}
 	
 	++_iterationNumber;
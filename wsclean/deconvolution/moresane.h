@@ -8,14 +8,24 @@
 
 #include "../wsclean/imagebufferallocator.h"
 
+/**
+ * Deconvolves by running the external PyMORESANE application on each image. The images
+ * are handed over as fits files. Unless a temporary directory is specified, these are
+ * stored in shared memory (/dev/shm) when available, to avoid disk I/O. The images of
+ * different channels can be deconvolved concurrently, in which case the threads are
+ * divided over the processes.
+ */
 class MoreSane : public DeconvolutionAlgorithm
 {
 	public:
 		MoreSane(const std::string& moreSaneLocation, const std::string& moresaneArguments, 
 		         const ao::uvector<double> &moresaneSigmaLevels, const std::string &prefixName,
+		         const std::string& temporaryDirectory, size_t parallelRuns,
 						 ImageBufferAllocator& allocator, class FFTWManager& fftwManager) :
 			_moresaneLocation(moreSaneLocation), _moresaneArguments(moresaneArguments), 
 			_moresaneSigmaLevels(moresaneSigmaLevels), _prefixName(prefixName),
+			_tempPrefix(makeTempPrefix(prefixName, temporaryDirectory)),
+			_parallelRuns(parallelRuns),
 			_allocator(&allocator),
 			_fftwManager(fftwManager)
 		{ }
@@ -29,10 +39,42 @@ class MoreSane : public DeconvolutionAlgorithm
 		
 		void ExecuteMajorIteration(double* dataImage, double* modelImage, const double* psfImage, size_t width, size_t height);
 	private:
+		/**
+		 * The files and process of a single MoreSane run. The destructor removes the files,
+		 * after waiting for the process when it was not finished. This makes sure that no
+		 * processes or files are left behind when another run fails.
+		 */
+		struct Run
+		{
+			Run() : dataImage(nullptr), modelImage(nullptr), pid(0), isRunning(false) { }
+			~Run();
+			Run(const Run&) = delete;
+			Run& operator=(const Run&) = delete;
+			
+			double *dataImage, *modelImage;
+			std::string dirtyName, psfName, maskName, outputName;
+			pid_t pid;
+			bool isRunning;
+		};
+		
+		static std::string makeTempPrefix(const std::string& prefixName, const std::string& temporaryDirectory);
+		
+		/**
+		 * Writes the input files for a single image and starts MoreSane on them, using
+		 * the given number of threads.
+		 */
+		void startRun(Run& run, double* dataImage, double* modelImage, const double* psfImage, size_t width, size_t height, size_t imageIndex, size_t threadCount);
+		
+		/**
+		 * Waits for the run to finish and reads the results back.
+		 */
+		void finishRun(Run& run);
+		
 		const std::string _moresaneLocation, _moresaneArguments;
 
 		const ao::uvector<double> _moresaneSigmaLevels;
-		const std::string _prefixName;
+		const std::string _prefixName, _tempPrefix;
+		const size_t _parallelRuns;
 		
 		ImageBufferAllocator* _allocator;
 		class FFTWManager& _fftwManager;
@@ -15,6 +15,15 @@
 
 #include "../aocommon/parallelfor.h"
 
+namespace {
+	/** The division is recalculated at least once per this many major iterations. */
+	const size_t maxDivisionReuseCount = 4;
+	/** Relative increase of the flux along a dividing line that causes a new division. */
+	const double divisionFluxTolerance = 1.5;
+	/** A line through a pixel this bright relative to the residual peak causes a new division. */
+	const double divisionPeakFraction = 0.5;
+}
+
 ParallelDeconvolution::ParallelDeconvolution(const class WSCleanSettings& settings) :
 	_horImages(0),
 	_verImages(0),
@@ -22,7 +31,8 @@ ParallelDeconvolution::ParallelDeconvolution(const class WSCleanSettings& settin
 	_allocator(nullptr),
 	_mask(nullptr),
 	_trackPerScaleMasks(false),
-	_usePerScaleMasks(false)
+	_usePerScaleMasks(false),
+	_divisionReuseCount(0)
 { }
 
 ParallelDeconvolution::~ParallelDeconvolution()
@@ -43,6 +53,7 @@ void ParallelDeconvolution::SetAlgorithm(std::unique_ptr<class DeconvolutionAlgo
 			maxSubImageSize = _settings.parallelDeconvolutionMaxSize;
 		_horImages = (width+maxSubImageSize-1) / maxSubImageSize,
 		_verImages = (height+maxSubImageSize-1) / maxSubImageSize;
+		clearDivision();
 		_algorithms.resize(_horImages * _verImages);
 		_algorithms.front() = std::move(algorithm);
 		size_t threadsPerAlg = (System::ProcessorCount()+_algorithms.size()-1)
@@ -87,13 +98,14 @@ void ParallelDeconvolution::SetCleanMask(const bool* mask)
 		_algorithms.front()->SetCleanMask(mask);
 }
 
-void ParallelDeconvolution::runSubImage(SubImage& subImg, ImageSet& dataImage, ImageSet& modelImage, const ao::uvector<const double*>& psfImages, double majorIterThreshold, bool findPeakOnly, std::mutex* mutex)
+template<typename NumT>
+void ParallelDeconvolution::runSubImage(SubImage& subImg, TImageSet<NumT>& dataImage, TImageSet<NumT>& modelImage, const ao::uvector<const double*>& psfImages, double majorIterThreshold, bool findPeakOnly, std::mutex* mutex)
 {
 	const size_t
 		width = _settings.trimmedImageWidth,
 		height = _settings.trimmedImageHeight;
 	
-	std::unique_ptr<ImageSet> subModel, subData;
+	std::unique_ptr<TImageSet<NumT>> subModel, subData;
 	{
 		std::lock_guard<std::mutex> lock(*mutex);
 		subModel = modelImage.Trim(
@@ -149,7 +161,7 @@ void ParallelDeconvolution::runSubImage(SubImage& subImg, ImageSet& dataImage, I
 		}
 	}
 	
-	subImg.peak = _algorithms[subImg.index]->ExecuteMajorIteration(
+	subImg.peak = runAlgorithm(*_algorithms[subImg.index],
 		*subData, *subModel, subPsfVector,
 		subImg.width, subImg.height, subImg.reachedMajorThreshold);
 	
@@ -196,7 +208,18 @@ void ParallelDeconvolution::runSubImage(SubImage& subImg, ImageSet& dataImage, I
 	}
 }
 
-void ParallelDeconvolution::ExecuteMajorIteration(class ImageSet& dataImage, class ImageSet& modelImage, const ao::uvector<const double*>& psfImages, bool& reachedMajorThreshold)
+void ParallelDeconvolution::ExecuteMajorIteration(ImageSet& dataImage, ImageSet& modelImage, const ao::uvector<const double*>& psfImages, bool& reachedMajorThreshold)
+{
+	executeMajorIteration(dataImage, modelImage, psfImages, reachedMajorThreshold);
+}
+
+void ParallelDeconvolution::ExecuteMajorIteration(FloatImageSet& dataImage, FloatImageSet& modelImage, const ao::uvector<const double*>& psfImages, bool& reachedMajorThreshold)
+{
+	executeMajorIteration(dataImage, modelImage, psfImages, reachedMajorThreshold);
+}
+
+template<typename NumT>
+void ParallelDeconvolution::executeMajorIteration(TImageSet<NumT>& dataImage, TImageSet<NumT>& modelImage, const ao::uvector<const double*>& psfImages, bool& reachedMajorThreshold)
 {
 	const size_t
 		width = _settings.trimmedImageWidth,
@@ -205,80 +228,50 @@ void ParallelDeconvolution::ExecuteMajorIteration(class ImageSet& dataImage, cla
 	{
 		ForwardingLogReceiver fwdReceiver;
 		_algorithms.front()->SetLogReceiver(fwdReceiver);
-		_algorithms.front()->ExecuteMajorIteration(dataImage, modelImage, psfImages, width, height, reachedMajorThreshold);
+		runAlgorithm(*_algorithms.front(), dataImage, modelImage, psfImages, width, height, reachedMajorThreshold);
 	}
 	else {
 		executeParallelRun(dataImage, modelImage, psfImages, reachedMajorThreshold);
 	}
 }
 
-void ParallelDeconvolution::executeParallelRun(class ImageSet& dataImage, class ImageSet& modelImage, const ao::uvector<const double *>& psfImages, bool& reachedMajorThreshold)
+template<typename NumT>
+void ParallelDeconvolution::executeParallelRun(TImageSet<NumT>& dataImage, TImageSet<NumT>& modelImage, const ao::uvector<const double *>& psfImages, bool& reachedMajorThreshold)
 {
 	const size_t
 		width = _settings.trimmedImageWidth,
-		height = _settings.trimmedImageHeight,
-		avgHSubImageSize = width / _horImages,
-		avgVSubImageSize = height / _verImages;
+		height = _settings.trimmedImageHeight;
 	
-	Image
-		image(width, height, *_allocator),
-		scratch(width, height, *_allocator),
-		dividingLines(width, height, 0.0, *_allocator);
+	Image image(width, height, *_allocator);
 	dataImage.GetLinearIntegrated(image.data());
 	
-	Subdivision divisor(width, height);
-			
-	// Make the horizontal subdivisions (i.e. the vertical lines)
-	for(size_t divNr=1; divNr!=_horImages; ++divNr)
+	if(canReuseDivision(image.data()))
 	{
-		Logger::Debug << "Vertical division " << divNr << '\n';
-		size_t
-			splitStart = width * divNr / _horImages - avgHSubImageSize/4,
-			splitEnd = width * divNr / _horImages + avgHSubImageSize/4;
-		divisor.DivideVertically(image.data(), scratch.data(), splitStart, splitEnd);
-		dividingLines += scratch;
+		Logger::Debug << "Reusing the subdivision of a previous major iteration.\n";
+		++_divisionReuseCount;
 	}
-	
-	// Make the vertical subdivisions (horizontal lines)
-	for(size_t divNr=1; divNr!=_verImages; ++divNr)
-	{
-		Logger::Debug << "Horizontal division " << divNr << '\n';
-		size_t
-			splitStart = height * divNr / _verImages - avgVSubImageSize/4,
-			splitEnd = height * divNr / _verImages + avgVSubImageSize/4;
-		divisor.DivideHorizontally(image.data(), scratch.data(), splitStart, splitEnd);
-		dividingLines += scratch;
+	else {
+		calculateDivision(image.data());
+		_divisionReuseCount = 0;
 	}
+	image.reset();
 	
-	// Find the bounding boxes and clean masks for each subimage
-	ao::uvector<bool>
-		mask(width * height),
-		visited(width * height,  false);
-	std::vector<SubImage> subImages;
-	for(size_t y=0; y!=_verImages; ++y)
+	std::vector<SubImage> subImages(_divisionSubImages);
+	// If a user mask is active, take the union of that mask with the division mask
+	if(_mask != nullptr)
 	{
-		for(size_t x=0; x!=_horImages; ++x)
+		ao::ParallelFor<size_t> maskLoop(System::ProcessorCount());
+		maskLoop.Run(0, subImages.size(), [&](size_t index, size_t)
 		{
-			size_t
-				midX = x * width / _horImages + avgHSubImageSize/2,
-				midY = y * height / _verImages + avgVSubImageSize/2;
-			subImages.emplace_back();
-			SubImage& subImage = subImages.back();
-			subImage.index = subImages.size()-1;
-			divisor.GetBoundingMask(dividingLines.data(), midX, midY, mask.data(), visited.data(), subImage.x, subImage.y, subImage.width, subImage.height);
-			Logger::Debug << "Subimage " << subImages.size() << " at (" << subImage.x << "," << subImage.y << ") - (" << subImage.x+subImage.width << "," << subImage.y+subImage.height << ")\n";
-			subImage.mask.resize(subImage.width * subImage.height);
-			Image::TrimBox(subImage.mask.data(), subImage.x, subImage.y, subImage.width, subImage.height, mask.data(), width, height);
-			
-			// If a user mask is active, take the union of that mask with the division mask
-			// (note that 'mask' is reused as a scratch space)
-			if(_mask != nullptr)
+			SubImage& subImage = subImages[index];
+			for(size_t y=0; y!=subImage.height; ++y)
 			{
-				Image::TrimBox(mask.data(), subImage.x, subImage.y, subImage.width, subImage.height, _mask, width, height);
-				for(size_t i=0; i!=subImage.mask.size(); ++i)
-					subImage.mask[i] = subImage.mask[i] && mask[i];
+				const bool* userMask = &_mask[(subImage.y + y) * width + subImage.x];
+				bool* subMask = &subImage.mask[y * subImage.width];
+				for(size_t x=0; x!=subImage.width; ++x)
+					subMask[x] = subMask[x] && userMask[x];
 			}
-		}
+		});
 	}
 	
 	// Initialize loggers
@@ -326,6 +319,8 @@ void ParallelDeconvolution::executeParallelRun(class ImageSet& dataImage, class
 	});
 	
 	_rmsImage.reset();
+	// The buffers of the sub-images have sizes that are not used outside parallel deconvolution
+	_allocator->FreeUnused();
 	
 	size_t subImagesFinished = 0;
 	reachedMajorThreshold = false;
@@ -351,6 +346,107 @@ void ParallelDeconvolution::executeParallelRun(class ImageSet& dataImage, class
 }
 
 
+void ParallelDeconvolution::calculateDivision(const double* image)
+{
+	const size_t
+		width = _settings.trimmedImageWidth,
+		height = _settings.trimmedImageHeight,
+		avgHSubImageSize = width / _horImages,
+		avgVSubImageSize = height / _verImages,
+		nVerticalLines = _horImages - 1,
+		nHorizontalLines = _verImages - 1;
+	
+	// Calculate the vertical lines (horizontal subdivisions) and horizontal lines
+	// (vertical subdivisions). Each line is searched for in its own band, so
+	// they can be calculated independently.
+	Subdivision divisor(width, height);
+	_dividingLines.assign(nVerticalLines + nHorizontalLines, ao::uvector<size_t>());
+	ao::ParallelFor<size_t> loop(System::ProcessorCount());
+	if(!_dividingLines.empty())
+	{
+		loop.Run(0, _dividingLines.size(), [&](size_t lineIndex, size_t)
+		{
+			if(lineIndex < nVerticalLines)
+			{
+				size_t
+					divNr = lineIndex + 1,
+					splitStart = width * divNr / _horImages - avgHSubImageSize/4,
+					splitEnd = width * divNr / _horImages + avgHSubImageSize/4;
+				_dividingLines[lineIndex] = divisor.DivideVertically(image, splitStart, splitEnd);
+			}
+			else {
+				size_t
+					divNr = lineIndex - nVerticalLines + 1,
+					splitStart = height * divNr / _verImages - avgVSubImageSize/4,
+					splitEnd = height * divNr / _verImages + avgVSubImageSize/4;
+				_dividingLines[lineIndex] = divisor.DivideHorizontally(image, splitStart, splitEnd);
+			}
+		});
+	}
+	Logger::Debug << "Calculated " << nVerticalLines << " vertical and " << nHorizontalLines << " horizontal division lines.\n";
+	
+	Image dividingLines(width, height, 0.0, *_allocator);
+	double imageMean, imagePeak;
+	Subdivision::AbsoluteStatistics(image, width * height, imageMean, imagePeak);
+	_dividingLineFlux.resize(_dividingLines.size());
+	for(size_t i=0; i!=_dividingLines.size(); ++i)
+	{
+		for(size_t index : _dividingLines[i])
+			dividingLines[index] = 1.0;
+		_dividingLineFlux[i] = Subdivision::RelativeLineFlux(image, _dividingLines[i], imageMean, imagePeak);
+	}
+	
+	// Find the bounding boxes of all subimages. The flood fills together visit every
+	// pixel once.
+	ao::uvector<uint32_t> labels(width * height, 0);
+	_divisionSubImages.clear();
+	for(size_t y=0; y!=_verImages; ++y)
+	{
+		for(size_t x=0; x!=_horImages; ++x)
+		{
+			size_t
+				midX = x * width / _horImages + avgHSubImageSize/2,
+				midY = y * height / _verImages + avgVSubImageSize/2;
+			_divisionSubImages.emplace_back();
+			SubImage& subImage = _divisionSubImages.back();
+			subImage.index = _divisionSubImages.size()-1;
+			divisor.LabelSubImage(dividingLines.data(), midX, midY, subImage.index+1, labels.data(), subImage.x, subImage.y, subImage.width, subImage.height);
+			Logger::Debug << "Subimage " << _divisionSubImages.size() << " at (" << subImage.x << "," << subImage.y << ") - (" << subImage.x+subImage.width << "," << subImage.y+subImage.height << ")\n";
+		}
+	}
+	
+	// Extract the clean masks for each subimage
+	loop.Run(0, _divisionSubImages.size(), [&](size_t index, size_t)
+	{
+		SubImage& subImage = _divisionSubImages[index];
+		subImage.mask.resize(subImage.width * subImage.height);
+		divisor.GetSubImageMask(labels.data(), subImage.index+1, subImage.x, subImage.y, subImage.width, subImage.height, subImage.mask.data());
+	});
+}
+
+bool ParallelDeconvolution::canReuseDivision(const double* image) const
+{
+	// The division lines go through areas with little flux. Cleaning lowers the residual
+	// everywhere, so the flux along a line is compared relative to the flux of the whole
+	// image: when a line has become brighter than its surroundings, or passes through
+	// emission that is bright compared to the current peak, a new division is made.
+	// The division is also recalculated regularly, to follow slower changes.
+	if(_divisionSubImages.empty() || _divisionReuseCount >= maxDivisionReuseCount)
+		return false;
+	double imageMean, imagePeak;
+	Subdivision::AbsoluteStatistics(image, _settings.trimmedImageWidth * _settings.trimmedImageHeight, imageMean, imagePeak);
+	for(size_t i=0; i!=_dividingLines.size(); ++i)
+	{
+		const Subdivision::LineFlux
+			flux = Subdivision::RelativeLineFlux(image, _dividingLines[i], imageMean, imagePeak),
+			& reference = _dividingLineFlux[i];
+		if(flux.meanFraction > reference.meanFraction * divisionFluxTolerance ||
+			flux.peakFraction > std::max(reference.peakFraction * divisionFluxTolerance, divisionPeakFraction))
+			return false;
+	}
+	return true;
+}
+
 void ParallelDeconvolution::SaveSourceList(CachedImageSet& modelImages, const ImagingTable& table, long double phaseCentreRA, long double phaseCentreDec)
 {
 	std::string filename = _settings.prefixName + "-sources.txt";
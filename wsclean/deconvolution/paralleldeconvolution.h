@@ -8,6 +8,8 @@
 #include "../wsclean/primarybeamimageset.h"
 
 #include "controllablelog.h"
+#include "deconvolutionalgorithm.h"
+#include "subdivision.h"
 
 #include <memory>
 #include <mutex>
@@ -49,12 +51,15 @@ public:
 	
 	void SetCleanMask(const bool* mask);
 	
-	void ExecuteMajorIteration(class ImageSet& dataImage, class ImageSet& modelImage, const ao::uvector<const double*>& psfImages, bool& reachedMajorThreshold);
+	void ExecuteMajorIteration(ImageSet& dataImage, ImageSet& modelImage, const ao::uvector<const double*>& psfImages, bool& reachedMajorThreshold);
+	
+	void ExecuteMajorIteration(FloatImageSet& dataImage, FloatImageSet& modelImage, const ao::uvector<const double*>& psfImages, bool& reachedMajorThreshold);
 	
 	void FreeDeconvolutionAlgorithms()
 	{
 		_algorithms.clear(); 
 		_mask = nullptr;
+		clearDivision();
 	}
 	
 	void SaveSourceList(class CachedImageSet& modelImages, const class ImagingTable& table, long double phaseCentreRA, long double phaseCentreDec);
@@ -64,7 +69,21 @@ public:
 	class FFTWManager& GetFFTWManager() { return _fftwManager; }
 	
 private:
-	void executeParallelRun(class ImageSet& dataImage, class ImageSet& modelImage, const ao::uvector<const double*>& psfImages, bool& reachedMajorThreshold);
+	template<typename NumT>
+	void executeMajorIteration(TImageSet<NumT>& dataImage, TImageSet<NumT>& modelImage, const ao::uvector<const double*>& psfImages, bool& reachedMajorThreshold);
+	
+	template<typename NumT>
+	void executeParallelRun(TImageSet<NumT>& dataImage, TImageSet<NumT>& modelImage, const ao::uvector<const double*>& psfImages, bool& reachedMajorThreshold);
+	
+	static double runAlgorithm(DeconvolutionAlgorithm& algorithm, ImageSet& dataImage, ImageSet& modelImage, const ao::uvector<const double*>& psfImages, size_t width, size_t height, bool& reachedMajorThreshold)
+	{
+		return algorithm.ExecuteMajorIteration(dataImage, modelImage, psfImages, width, height, reachedMajorThreshold);
+	}
+	
+	static double runAlgorithm(DeconvolutionAlgorithm& algorithm, FloatImageSet& dataImage, FloatImageSet& modelImage, const ao::uvector<const double*>& psfImages, size_t width, size_t height, bool& reachedMajorThreshold)
+	{
+		return algorithm.ExecuteFloatMajorIteration(dataImage, modelImage, psfImages, width, height, reachedMajorThreshold);
+	}
 	
 	struct SubImage {
 		size_t index, x, y, width, height;
@@ -73,7 +92,28 @@ private:
 		bool reachedMajorThreshold;
 	};
 		
-	void runSubImage(SubImage& subImg, ImageSet& dataImage, class ImageSet& modelImage, const ao::uvector<const double*>& psfImages, double majorIterThreshold, bool findPeakOnly, std::mutex* mutex);
+	/**
+	 * Calculates the lines that divide the image into subimages, and the
+	 * bounding boxes and masks of the subimages.
+	 */
+	void calculateDivision(const double* image);
+	
+	/**
+	 * Whether the division of a previous major iteration can be used for the
+	 * given integrated residual image.
+	 */
+	bool canReuseDivision(const double* image) const;
+	
+	template<typename NumT>
+	void runSubImage(SubImage& subImg, TImageSet<NumT>& dataImage, TImageSet<NumT>& modelImage, const ao::uvector<const double*>& psfImages, double majorIterThreshold, bool findPeakOnly, std::mutex* mutex);
+	
+	void clearDivision()
+	{
+		_dividingLines.clear();
+		_dividingLineFlux.clear();
+		_divisionReuseCount = 0;
+		_divisionSubImages.clear();
+	}
 	
 	void correctChannelForPB(class ComponentList& list, const class ImagingTableEntry& entry) const;
 	
@@ -92,6 +132,14 @@ private:
 	std::vector<ao::uvector<bool>> _scaleMasks;
 	std::unique_ptr<class ComponentList> _componentList;
 	Image _rmsImage;
+	/** Pixel indices of the lines that divide the image, kept for reuse in the next major iteration. */
+	std::vector<ao::uvector<size_t>> _dividingLines;
+	/** Relative flux along each dividing line at the time it was calculated. */
+	std::vector<Subdivision::LineFlux> _dividingLineFlux;
+	/** Number of major iterations that reused the division since it was calculated. */
+	size_t _divisionReuseCount;
+	/** Subimages with the masks from the division, before the user mask is applied. */
+	std::vector<SubImage> _divisionSubImages;
 };
 
 #endif
@@ -0,0 +1,139 @@
+#include "peakpyramid.h"
+
+#include <algorithm>
+#include <cmath>
+
+PeakPyramid::PeakPyramid(size_t width, size_t height, size_t x1, size_t y1, size_t x2, size_t y2, bool allowNegativeComponents, size_t tileSize) :
+	_width(width), _height(height),
+	_x1(x1), _y1(y1), _x2(std::max(x1, x2)), _y2(std::max(y1, y2)),
+	_allowNegativeComponents(allowNegativeComponents),
+	_tileSize(tileSize),
+	_tilesX((_x2 - _x1 + tileSize - 1) / tileSize),
+	_tilesY((_y2 - _y1 + tileSize - 1) / tileSize),
+	_leafCount(1),
+	_mask(nullptr),
+	_rmsFactorImage(nullptr)
+{
+	while(_leafCount < TileCount())
+		_leafCount *= 2;
+	Tile empty;
+	empty.key = -std::numeric_limits<double>::max();
+	empty.value = 0.0;
+	empty.index = invalidIndex();
+	_tiles.assign(TileCount() + 1, empty);
+	_tree.assign(_leafCount * 2, TileCount());
+}
+
+void PeakPyramid::Initialize(const double* image)
+{
+	for(size_t i=0; i!=TileCount(); ++i)
+	{
+		scanTile(image, i);
+		_tree[_leafCount + i] = i;
+	}
+	for(size_t node=_leafCount-1; node!=0; --node)
+	{
+		size_t left = _tree[node*2], right = _tree[node*2 + 1];
+		_tree[node] = isLarger(_tiles[right], _tiles[left]) ? right : left;
+	}
+}
+
+void PeakPyramid::Update(const double* image, size_t x1, size_t y1, size_t x2, size_t y2)
+{
+	x1 = std::max(x1, _x1); x2 = std::min(x2, _x2);
+	y1 = std::max(y1, _y1); y2 = std::min(y2, _y2);
+	if(x1 >= x2 || y1 >= y2)
+		return;
+	const size_t
+		tx1 = (x1 - _x1) / _tileSize, tx2 = (x2 - 1 - _x1) / _tileSize + 1,
+		ty1 = (y1 - _y1) / _tileSize, ty2 = (y2 - 1 - _y1) / _tileSize + 1;
+	for(size_t ty=ty1; ty!=ty2; ++ty)
+	{
+		for(size_t tx=tx1; tx!=tx2; ++tx)
+		{
+			size_t tileIndex = tx + ty*_tilesX;
+			scanTile(image, tileIndex);
+			updateTree(tileIndex);
+		}
+	}
+}
+
+void PeakPyramid::updateTree(size_t tileIndex)
+{
+	size_t node = (_leafCount + tileIndex) / 2;
+	while(node != 0)
+	{
+		size_t left = _tree[node*2], right = _tree[node*2 + 1];
+		_tree[node] = isLarger(_tiles[right], _tiles[left]) ? right : left;
+		node /= 2;
+	}
+}
+
+void PeakPyramid::scanTile(const double* image, size_t tileIndex)
+{
+	if(_allowNegativeComponents)
+	{
+		if(_mask)
+		{
+			if(_rmsFactorImage) scanTile<true, true, true>(image, tileIndex);
+			else scanTile<true, true, false>(image, tileIndex);
+		}
+		else {
+			if(_rmsFactorImage) scanTile<true, false, true>(image, tileIndex);
+			else scanTile<true, false, false>(image, tileIndex);
+		}
+	}
+	else {
+		if(_mask)
+		{
+			if(_rmsFactorImage) scanTile<false, true, true>(image, tileIndex);
+			else scanTile<false, true, false>(image, tileIndex);
+		}
+		else {
+			if(_rmsFactorImage) scanTile<false, false, true>(image, tileIndex);
+			else scanTile<false, false, false>(image, tileIndex);
+		}
+	}
+}
+
+template<bool AllowNegatives, bool HasMask, bool HasRMSFactor>
+void PeakPyramid::scanTile(const double* image, size_t tileIndex)
+{
+	const size_t
+		tx = tileIndex % _tilesX, ty = tileIndex / _tilesX,
+		xStart = _x1 + tx*_tileSize, xEnd = std::min(xStart + _tileSize, _x2),
+		yStart = _y1 + ty*_tileSize, yEnd = std::min(yStart + _tileSize, _y2);
+	// As in SimpleClean::FindPeak(), only values larger than the smallest positive
+	// value are accepted
+	double peakKey = std::numeric_limits<double>::min();
+	size_t peakIndex = invalidIndex();
+	for(size_t y=yStart; y!=yEnd; ++y)
+	{
+		const size_t rowStart = y*_width + xStart, rowEnd = y*_width + xEnd;
+		// The maximum of the row is determined first without keeping track of its index,
+		// which allows the compiler to vectorize the loop. Only when the row has a
+		// larger value, the position is searched for.
+		double rowMax = std::numeric_limits<double>::min();
+		for(size_t index=rowStart; index!=rowEnd; ++index)
+			rowMax = std::max(rowMax, key<AllowNegatives, HasMask, HasRMSFactor>(image, index));
+		if(rowMax > peakKey)
+		{
+			size_t index = rowStart;
+			while(key<AllowNegatives, HasMask, HasRMSFactor>(image, index) != rowMax)
+				++index;
+			peakKey = rowMax;
+			peakIndex = index;
+		}
+	}
+	Tile& tile = _tiles[tileIndex];
+	if(peakIndex == invalidIndex())
+	{
+		tile.key = -std::numeric_limits<double>::max();
+		tile.value = 0.0;
+	}
+	else {
+		tile.key = peakKey;
+		tile.value = HasRMSFactor ? image[peakIndex] * _rmsFactorImage[peakIndex] : image[peakIndex];
+	}
+	tile.index = peakIndex;
+}
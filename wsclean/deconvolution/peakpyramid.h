@@ -0,0 +1,122 @@
+#ifndef PEAK_PYRAMID_H
+#define PEAK_PYRAMID_H
+
+#include "../uvector.h"
+
+#include <boost/optional/optional.hpp>
+
+#include <cmath>
+#include <limits>
+
+/**
+ * Maintains the position of the peak in an image that is modified locally, such as
+ * the residual image in a Högbom clean. The clean region is divided in tiles of which
+ * the maximum is stored. The tile maxima are kept in a tournament tree, of which the
+ * root holds the maximum of the full image.
+ *
+ * After a part of the image has been changed, only the tiles that overlap with the
+ * changed area have to be rescanned, and updating the tree costs log2(tiles) per
+ * changed tile. This makes the peak search after a local change cost
+ * O(pixels in touched tiles) instead of O(N).
+ *
+ * The peak is selected in the same way as SimpleClean::FindPeak() and
+ * SimpleClean::FindPeakWithMask() select it: when several pixels have the same
+ * value, the first pixel in row-major order is returned.
+ */
+class PeakPyramid
+{
+public:
+	/**
+	 * Construct a pyramid for an image of the given size, in which the peak is searched
+	 * only in the box [x1, x2) x [y1, y2).
+	 */
+	PeakPyramid(size_t width, size_t height, size_t x1, size_t y1, size_t x2, size_t y2, bool allowNegativeComponents, size_t tileSize = 32);
+
+	/**
+	 * Only pixels for which the mask is true are considered. The mask should stay
+	 * available during the lifetime of the pyramid.
+	 */
+	void SetMask(const bool* mask) { _mask = mask; }
+
+	/**
+	 * The image values are multiplied with these factors before they are compared.
+	 * The image should stay available during the lifetime of the pyramid.
+	 */
+	void SetRMSFactorImage(const double* rmsFactorImage) { _rmsFactorImage = rmsFactorImage; }
+
+	/**
+	 * Scan all tiles of the image.
+	 */
+	void Initialize(const double* image);
+
+	/**
+	 * Rescan the tiles that overlap with the box [x1, x2) x [y1, y2), after the
+	 * image has changed inside that box.
+	 */
+	void Update(const double* image, size_t x1, size_t y1, size_t x2, size_t y2);
+
+	/**
+	 * Return the peak value, which is multiplied with the rms factor if it is set,
+	 * or an empty optional if there is no valid pixel.
+	 */
+	boost::optional<double> FindPeak(size_t& x, size_t& y) const
+	{
+		const Tile& peak = _tiles[_tree[1]];
+		if(peak.index == invalidIndex())
+		{
+			x = _width; y = _height;
+			return boost::optional<double>();
+		}
+		x = peak.index % _width;
+		y = peak.index / _width;
+		return peak.value;
+	}
+
+	size_t TileCount() const { return _tilesX * _tilesY; }
+
+private:
+	struct Tile
+	{
+		/** The value that is compared; the absolute value when negative components are allowed. */
+		double key;
+		double value;
+		size_t index;
+	};
+
+	static size_t invalidIndex() { return std::numeric_limits<size_t>::max(); }
+
+	static bool isLarger(const Tile& a, const Tile& b)
+	{
+		return a.key > b.key || (a.key == b.key && a.index < b.index);
+	}
+
+	template<bool AllowNegatives, bool HasMask, bool HasRMSFactor>
+	double key(const double* image, size_t index) const
+	{
+		double value = image[index];
+		if(HasRMSFactor) value *= _rmsFactorImage[index];
+		if(AllowNegatives) value = std::fabs(value);
+		if(HasMask) value = _mask[index] ? value : 0.0;
+		return value;
+	}
+
+	template<bool AllowNegatives, bool HasMask, bool HasRMSFactor>
+	void scanTile(const double* image, size_t tileIndex);
+
+	void scanTile(const double* image, size_t tileIndex);
+
+	void updateTree(size_t tileIndex);
+
+	size_t _width, _height;
+	size_t _x1, _y1, _x2, _y2;
+	bool _allowNegativeComponents;
+	size_t _tileSize, _tilesX, _tilesY, _leafCount;
+	const bool* _mask;
+	const double* _rmsFactorImage;
+	/** One tile per region tile, plus an empty tile at the end that pads the tree. */
+	ao::uvector<Tile> _tiles;
+	/** Tournament tree of tile indices, with the root at index 1 and the leaves from _leafCount. */
+	ao::uvector<size_t> _tree;
+};
+
+#endif
@@ -0,0 +1,201 @@
+#include "simdkernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+	/**
+	 * Whether one of the values is larger than threshold. This is a loop without
+	 * data dependencies, which vectorizes well, whereas a loop that keeps track of
+	 * the position of the maximum does not.
+	 */
+	SIMD_TARGET_CLONES
+	bool hasLargerValue(const double* values, size_t n, double threshold, bool allowNegatives)
+	{
+		int isLarger = 0;
+		if(allowNegatives)
+		{
+			for(size_t i=0; i!=n; ++i)
+				isLarger |= std::fabs(values[i]) > threshold;
+		}
+		else {
+			for(size_t i=0; i!=n; ++i)
+				isLarger |= values[i] > threshold;
+		}
+		return isLarger != 0;
+	}
+
+	/**
+	 * Scans the values for the first value larger than peak, and updates peak
+	 * and peakIndex accordingly. Only called for the few blocks that contain a
+	 * new peak.
+	 */
+	void updatePeak(const double* values, size_t n, bool allowNegatives, size_t indexOffset, double& peak, size_t& peakIndex)
+	{
+		for(size_t i=0; i!=n; ++i)
+		{
+			const double value = allowNegatives ? std::fabs(values[i]) : values[i];
+			if(value > peak)
+			{
+				peak = value;
+				peakIndex = indexOffset + i;
+			}
+		}
+	}
+
+	// Number of values that are tested at once in MaxIndex()
+	const size_t maxIndexBlockSize = 256;
+
+	/**
+	 * Implementation of PartialSubtractImage() for both image types. It is
+	 * inlined in the callers, so that it is compiled for each of their targets.
+	 */
+	template<typename NumT>
+	inline __attribute__((always_inline))
+	void partialSubtractImage(NumT* image, size_t imgWidth, const double* psf, size_t psfWidth, size_t psfHeight, size_t x, size_t y, double factor, size_t startY, size_t endY)
+	{
+		size_t startX, endX;
+		int offsetX = (int) x - psfWidth/2, offsetY = (int) y - psfHeight/2;
+
+		if(offsetX > 0)
+			startX = offsetX;
+		else
+			startX = 0;
+
+		if(offsetY > (int) startY)
+			startY = offsetY;
+
+		endX = std::min(x + psfWidth/2, imgWidth);
+
+		endY = std::min(y + psfHeight/2, endY);
+
+		for(size_t ypos = startY; ypos < endY; ++ypos)
+		{
+			NumT* __restrict imageRow = image + ypos * imgWidth + startX;
+			const double* __restrict psfRow = psf + (ypos - offsetY) * psfWidth + startX - offsetX;
+			for(size_t i = 0; i < endX - startX; ++i)
+				imageRow[i] -= psfRow[i] * factor;
+		}
+	}
+}
+
+boost::optional<double> SimdKernels::FindPeak(const double* image, size_t width, size_t height, size_t& x, size_t& y, bool allowNegativeComponents, size_t startY, size_t endY, size_t horizontalBorder, size_t verticalBorder)
+{
+	double peakMax = std::numeric_limits<double>::min();
+	size_t peakIndex = width * height;
+
+	size_t xiStart = horizontalBorder, xiEnd = width - horizontalBorder;
+	size_t yiStart = std::max(startY, verticalBorder), yiEnd = std::min(endY, height - verticalBorder);
+	if(xiEnd < xiStart) xiEnd = xiStart;
+	if(yiEnd < yiStart) yiEnd = yiStart;
+
+	for(size_t yi=yiStart; yi!=yiEnd; ++yi)
+	{
+		const size_t index = yi*width + xiStart;
+		if(hasLargerValue(&image[index], xiEnd - xiStart, peakMax, allowNegativeComponents))
+			updatePeak(&image[index], xiEnd - xiStart, allowNegativeComponents, index, peakMax, peakIndex);
+	}
+	if(peakIndex == width * height)
+	{
+		x = width; y = height;
+		return boost::optional<double>();
+	}
+	else {
+		x = peakIndex % width;
+		y = peakIndex / width;
+		return image[x + y*width];
+	}
+}
+
+size_t SimdKernels::MaxIndex(const double* values, size_t n, bool allowNegatives)
+{
+	if(n == 0)
+		return 0;
+	size_t peakIndex = 0;
+	double peak = allowNegatives ? std::fabs(values[0]) : values[0];
+	for(size_t blockStart=0; blockStart<n; blockStart+=maxIndexBlockSize)
+	{
+		const size_t blockSize = std::min(maxIndexBlockSize, n - blockStart);
+		if(hasLargerValue(&values[blockStart], blockSize, peak, allowNegatives))
+			updatePeak(&values[blockStart], blockSize, allowNegatives, blockStart, peak, peakIndex);
+	}
+	return peakIndex;
+}
+
+SIMD_TARGET_CLONES
+void SimdKernels::AddFactor(double* lhs, const double* rhs, double factor, size_t n)
+{
+	for(size_t i=0; i!=n; ++i)
+		lhs[i] += rhs[i] * factor;
+}
+
+SIMD_TARGET_CLONES
+void SimdKernels::AddFactor(double* lhs, const float* rhs, double factor, size_t n)
+{
+	for(size_t i=0; i!=n; ++i)
+		lhs[i] += rhs[i] * factor;
+}
+
+SIMD_TARGET_CLONES
+void SimdKernels::AddFactor(float* lhs, const float* rhs, double factor, size_t n)
+{
+	const float factorF = factor;
+	for(size_t i=0; i!=n; ++i)
+		lhs[i] += rhs[i] * factorF;
+}
+
+SIMD_TARGET_CLONES
+void SimdKernels::AddSquared(double* lhs, const double* rhs, size_t n)
+{
+	for(size_t i=0; i!=n; ++i)
+		lhs[i] += rhs[i] * rhs[i];
+}
+
+SIMD_TARGET_CLONES
+void SimdKernels::AddSquared(double* lhs, const float* rhs, size_t n)
+{
+	for(size_t i=0; i!=n; ++i)
+		lhs[i] += double(rhs[i]) * double(rhs[i]);
+}
+
+SIMD_TARGET_CLONES
+void SimdKernels::SquareRootMultiply(double* image, double factor, size_t n)
+{
+	for(size_t i=0; i!=n; ++i)
+		image[i] = std::sqrt(image[i]) * factor;
+}
+
+SIMD_TARGET_CLONES
+void SimdKernels::PartialSubtractImage(double* image, size_t imgWidth, const double* psf, size_t psfWidth, size_t psfHeight, size_t x, size_t y, double factor, size_t startY, size_t endY)
+{
+	partialSubtractImage(image, imgWidth, psf, psfWidth, psfHeight, x, y, factor, startY, endY);
+}
+
+SIMD_TARGET_CLONES
+void SimdKernels::PartialSubtractImage(float* image, size_t imgWidth, const double* psf, size_t psfWidth, size_t psfHeight, size_t x, size_t y, double factor, size_t startY, size_t endY)
+{
+	partialSubtractImage(image, imgWidth, psf, psfWidth, psfHeight, x, y, factor, startY, endY);
+}
+
+SIMD_TARGET_CLONES
+void SimdKernels::SubtractPSFAtPositions(double* values, const size_t* xs, const size_t* ys, size_t n, const double* psf, size_t width, size_t height, size_t x, size_t y, double factor)
+{
+	// Positions left of or above the PSF wrap around to large unsigned values,
+	// so that a single comparison per axis suffices. Pixels outside the PSF are
+	// handled with a zero factor instead of a branch, which allows a gather.
+	const size_t
+		offsetX = width/2 - x,
+		offsetY = height/2 - y;
+	double* __restrict valuesPtr = values;
+	for(size_t i=0; i!=n; ++i)
+	{
+		const size_t
+			psfX = xs[i] + offsetX,
+			psfY = ys[i] + offsetY;
+		const bool isInside = (psfX < width) & (psfY < height);
+		const size_t psfIndex = isInside ? psfX + psfY*width : 0;
+		const double pixelFactor = isInside ? factor : 0.0;
+		valuesPtr[i] -= psf[psfIndex] * pixelFactor;
+	}
+}
@@ -0,0 +1,79 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <cstddef>
+
+#include <boost/optional/optional.hpp>
+
+/**
+ * Compiles the function that follows for each of the instruction sets below, and
+ * selects the best version for the CPU when the program is loaded. Function
+ * multi-versioning needs GCC and a loader that supports indirect functions.
+ */
+#if defined __GNUC__ && !defined __clang__ && defined __x86_64__ && defined __gnu_linux__
+#define SIMD_TARGET_CLONES __attribute__((target_clones("avx512f", "avx2", "sse4.2", "default")))
+#else
+#define SIMD_TARGET_CLONES
+#endif
+
+/**
+ * Inner loops of the deconvolution algorithms, written such that the compiler
+ * can vectorize them. With GCC on x86-64, each kernel is compiled for several
+ * instruction sets (AVX-512, AVX2, SSE4.2 and the baseline of the build), and the
+ * version for the best instruction set of the running CPU is selected when the
+ * program is loaded. A portable build thereby makes use of the vector units of
+ * every machine it runs on, instead of only those of the build machine.
+ */
+class SimdKernels
+{
+public:
+	SimdKernels() = delete;
+
+	/**
+	 * Finds the (absolute) peak in the area that is not excluded by the borders
+	 * and the [startY, endY) row range. When several pixels have the same value,
+	 * the first is selected. Behaves like SimpleClean::FindPeakSimple().
+	 */
+	static boost::optional<double> FindPeak(const double* image, size_t width, size_t height, size_t& x, size_t& y, bool allowNegativeComponents, size_t startY, size_t endY, size_t horizontalBorder, size_t verticalBorder);
+
+	/**
+	 * Index of the first largest value. If allowNegatives is true, the largest
+	 * absolute value is searched for. When n is zero, zero is returned.
+	 */
+	static size_t MaxIndex(const double* values, size_t n, bool allowNegatives);
+
+	/**
+	 * lhs[i] += rhs[i] * factor
+	 */
+	static void AddFactor(double* lhs, const double* rhs, double factor, size_t n);
+	static void AddFactor(double* lhs, const float* rhs, double factor, size_t n);
+	static void AddFactor(float* lhs, const float* rhs, double factor, size_t n);
+
+	/**
+	 * lhs[i] += rhs[i] * rhs[i]
+	 */
+	static void AddSquared(double* lhs, const double* rhs, size_t n);
+	static void AddSquared(double* lhs, const float* rhs, size_t n);
+
+	/**
+	 * image[i] = sqrt(image[i]) * factor
+	 */
+	static void SquareRootMultiply(double* image, double factor, size_t n);
+
+	/**
+	 * Subtracts a PSF centred on (x, y) from the image rows [startY, endY), like
+	 * SimpleClean::PartialSubtractImage() does. The overload for single-precision
+	 * images calculates in double precision and rounds the result.
+	 */
+	static void PartialSubtractImage(double* image, size_t imgWidth, const double* psf, size_t psfWidth, size_t psfHeight, size_t x, size_t y, double factor, size_t startY, size_t endY);
+	static void PartialSubtractImage(float* image, size_t imgWidth, const double* psf, size_t psfWidth, size_t psfHeight, size_t x, size_t y, double factor, size_t startY, size_t endY);
+
+	/**
+	 * Subtracts a PSF centred on (x, y) from a list of pixels, as is done in the
+	 * sub-minor loop. Pixel i has position (xs[i], ys[i]) and value values[i].
+	 * Pixels for which the PSF is out of range are left untouched.
+	 */
+	static void SubtractPSFAtPositions(double* values, const size_t* xs, const size_t* ys, size_t n, const double* psf, size_t width, size_t height, size_t x, size_t y, double factor);
+};
+
+#endif
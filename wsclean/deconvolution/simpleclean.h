@@ -8,10 +8,7 @@
 #include <boost/optional/optional.hpp>
 
 #include "deconvolutionalgorithm.h"
-
-#ifdef __SSE__
-#define USE_INTRINSICS
-#endif
+#include "simdkernels.h"
 
 namespace ao {
 	template<typename T> class lane;
@@ -24,19 +21,6 @@ class SimpleClean
 		
 		static boost::optional<double> FindPeakSimple(const double *image, size_t width, size_t height, size_t &x, size_t &y, bool allowNegativeComponents, size_t startY, size_t endY, size_t horizontalBorder, size_t verticalBorder);
 		
-#if defined __AVX__ && defined USE_INTRINSICS && !defined FORCE_NON_AVX
-		template<bool AllowNegativeComponent>
-		static boost::optional<double> FindPeakAVX(const double *image, size_t width, size_t height, size_t &x, size_t &y, size_t startY, size_t endY, size_t horizontalBorder, size_t verticalBorder);
-		
-		static boost::optional<double> FindPeakAVX(const double *image, size_t width, size_t height, size_t &x, size_t &y, bool allowNegativeComponents, size_t startY, size_t endY, size_t horizontalBorder, size_t verticalBorder)
-		{
-			if(allowNegativeComponents)
-				return FindPeakAVX<true>(image, width, height, x, y, startY, endY, horizontalBorder, verticalBorder);
-			else
-				return FindPeakAVX<false>(image, width, height, x, y, startY, endY, horizontalBorder, verticalBorder);
-		}
-#endif
-
 		static boost::optional<double> FindPeak(const double *image, size_t width, size_t height, size_t &x, size_t &y, bool allowNegativeComponents, size_t startY, size_t endY, double borderRatio)
 		{
 			return FindPeak(image, width, height, x, y, allowNegativeComponents, startY, endY, round(width*borderRatio), round(height*borderRatio));
@@ -44,11 +28,7 @@ class SimpleClean
 
 		static boost::optional<double> FindPeak(const double *image, size_t width, size_t height, size_t &x, size_t &y, bool allowNegativeComponents, size_t startY, size_t endY, size_t horizontalBorder, size_t verticalBorder)
 		{
-#if defined __AVX__ && defined USE_INTRINSICS && !defined FORCE_NON_AVX
-			return FindPeakAVX(image, width, height, x, y, allowNegativeComponents, startY, endY, horizontalBorder, verticalBorder);
-#else
-			return FindPeakSimple(image, width, height, x, y, allowNegativeComponents, startY, endY, horizontalBorder, verticalBorder);
-#endif
+			return SimdKernels::FindPeak(image, width, height, x, y, allowNegativeComponents, startY, endY, horizontalBorder, verticalBorder);
 		}
 
 		static boost::optional<double> FindPeakWithMask(const double *image, size_t width, size_t height, size_t &x, size_t &y, bool allowNegativeComponents, const bool* cleanMask);
@@ -64,11 +44,9 @@ class SimpleClean
 		
 		static void PartialSubtractImage(double *image, const double *psf, size_t width, size_t height, size_t x, size_t y, double factor, size_t startY, size_t endY);
 		
-		static void PartialSubtractImage(double *image, size_t imgWidth, size_t imgHeight, const double *psf, size_t psfWidth, size_t psfHeight, size_t x, size_t y, double factor, size_t startY, size_t endY);
+		static void PartialSubtractImage(float *image, const double *psf, size_t width, size_t height, size_t x, size_t y, double factor, size_t startY, size_t endY);
 		
-#if defined __AVX__ && defined USE_INTRINSICS
-		static void PartialSubtractImageAVX(double *image, size_t imgWidth, size_t imgHeight, const double *psf, size_t psfWidth, size_t psfHeight, size_t x, size_t y, double factor, size_t startY, size_t endY);
-#endif
+		static void PartialSubtractImage(double *image, size_t imgWidth, size_t imgHeight, const double *psf, size_t psfWidth, size_t psfHeight, size_t x, size_t y, double factor, size_t startY, size_t endY);
 		
 	private:
 };
@@ -1,8 +1,15 @@
 #ifndef SUBDIVISION_H
 #define SUBDIVISION_H
 
+#include "../uvector.h"
+
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <queue>
+#include <set>
+#include <vector>
 
 class Subdivision
 {
@@ -26,7 +33,14 @@ public:
 		}
 	};
 	
-	void DivideVertically(const double* image, double* output, size_t x1, size_t x2) const
+	/**
+	 * Find the path from the top to the bottom of the image with the lowest sum of
+	 * absolute pixel values, within the band of columns [x1, x2). The distances are
+	 * only stored for the band, so that several divisions can be calculated
+	 * concurrently without needing full-size buffers.
+	 * @returns The pixel indices of the path.
+	 */
+	ao::uvector<size_t> DivideVertically(const double* image, size_t x1, size_t x2) const
 	{
 		using visitset = std::priority_queue<Visit>;
 		visitset visits;
@@ -39,21 +53,21 @@ public:
 			visit.from = Coord(x, 0);
 			visits.push(visit);
 		}
-		ao::uvector<Coord> path((x2-x1) * _height);
-		std::fill(output, output+_width*_height, std::numeric_limits<double>::max());
+		const size_t bandWidth = x2 - x1;
+		ao::uvector<Coord> path(bandWidth * _height);
+		ao::uvector<double> distances(bandWidth * _height, std::numeric_limits<double>::max());
 		Visit visit;
 		while(!visits.empty())
 		{
 			visit = visits.top();
 			visits.pop();
 			size_t x = visit.to.x, y = visit.to.y;
-			double curDistance = output[x + y*_width];
+			double& curDistance = distances[x-x1 + y*bandWidth];
 			double newDistance = visit.distance + std::fabs(image[x + y*_width]);
-			//std::cout << x << ',' << y << " " << curDistance << " " << newDistance << '\n';
 			if(newDistance < curDistance)
 			{
-				output[x + y*_width] = newDistance;
-				path[x-x1 + y*(x2-x1)] = visit.from;
+				curDistance = newDistance;
+				path[x-x1 + y*bandWidth] = visit.from;
 				if(y == _height-1)
 					break;
 				visit.distance = newDistance;
@@ -74,16 +88,21 @@ public:
 				}
 			}
 		}
-		std::fill(output, output+_width*_height, 0.0);
+		ao::uvector<size_t> line;
 		Coord pCoord = visit.to;
 		while(pCoord.y > 0) {
-			output[pCoord.x + pCoord.y*_width] = 1.0;
-			pCoord = path[pCoord.x-x1 + pCoord.y*(x2-x1)];
+			line.push_back(pCoord.x + pCoord.y*_width);
+			pCoord = path[pCoord.x-x1 + pCoord.y*bandWidth];
 		}
-		output[pCoord.x] = 1.0;
+		line.push_back(pCoord.x);
+		return line;
 	}
 	
-	void DivideHorizontally(const double* image, double* output, size_t y1, size_t y2) const
+	/**
+	 * Like @ref DivideVertically(), but finds a path from the left to the right side
+	 * within the band of rows [y1, y2).
+	 */
+	ao::uvector<size_t> DivideHorizontally(const double* image, size_t y1, size_t y2) const
 	{
 		using visitset = std::priority_queue<Visit>;
 		visitset visits;
@@ -97,19 +116,18 @@ public:
 			visits.push(visit);
 		}
 		ao::uvector<Coord> path(_width * (y2-y1));
-		std::fill(output, output+_width*_height, std::numeric_limits<double>::max());
+		ao::uvector<double> distances(_width * (y2-y1), std::numeric_limits<double>::max());
 		Visit visit;
 		while(!visits.empty())
 		{
 			visit = visits.top();
 			visits.pop();
 			size_t x = visit.to.x, y = visit.to.y;
-			double curDistance = output[x + y*_width];
+			double& curDistance = distances[x + (y-y1)*_width];
 			double newDistance = visit.distance + std::fabs(image[x + y*_width]);
-			//std::cout << x << ',' << y << " " << curDistance << " " << newDistance << '\n';
 			if(newDistance < curDistance)
 			{
-				output[x + y*_width] = newDistance;
+				curDistance = newDistance;
 				path[x + (y-y1)*_width] = visit.from;
 				if(x == _width-1)
 					break;
@@ -131,13 +149,58 @@ public:
 				}
 			}
 		}
-		std::fill(output, output+_width*_height, 0.0);
+		ao::uvector<size_t> line;
 		Coord pCoord = visit.to;
 		while(pCoord.x > 0) {
-			output[pCoord.x + pCoord.y*_width] = 1.0;
+			line.push_back(pCoord.x + pCoord.y*_width);
 			pCoord = path[pCoord.x + (pCoord.y-y1)*_width];
 		}
-		output[pCoord.y*_width] = 1.0;
+		line.push_back(pCoord.y*_width);
+		return line;
+	}
+	
+	/**
+	 * Flux along a line relative to the flux of the whole image. Unlike the
+	 * summed flux along the line, this does not decrease when cleaning lowers the
+	 * residual everywhere.
+	 */
+	struct LineFlux {
+		/** Mean absolute value along the line divided by the mean absolute value of the image. */
+		double meanFraction;
+		/** Largest absolute value along the line divided by the largest absolute value of the image. */
+		double peakFraction;
+	};
+	
+	/**
+	 * Calculates the mean and maximum of the absolute values of an image, as used by
+	 * @ref RelativeLineFlux().
+	 */
+	static void AbsoluteStatistics(const double* image, size_t size, double& mean, double& peak)
+	{
+		double sum = 0.0;
+		peak = 0.0;
+		for(size_t i=0; i!=size; ++i)
+		{
+			const double value = std::fabs(image[i]);
+			sum += value;
+			peak = std::max(peak, value);
+		}
+		mean = (size == 0) ? 0.0 : sum / size;
+	}
+	
+	static LineFlux RelativeLineFlux(const double* image, const ao::uvector<size_t>& line, double imageMean, double imagePeak)
+	{
+		double sum = 0.0, peak = 0.0;
+		for(size_t index : line)
+		{
+			const double value = std::fabs(image[index]);
+			sum += value;
+			peak = std::max(peak, value);
+		}
+		LineFlux flux;
+		flux.meanFraction = (imageMean == 0.0 || line.empty()) ? 0.0 : sum / (line.size() * imageMean);
+		flux.peakFraction = (imagePeak == 0.0) ? 0.0 : peak / imagePeak;
+		return flux;
 	}
 	
 	struct HorizontalSplits {
@@ -242,17 +305,20 @@ public:
 		return splits;
 	}
 	
-	void GetBoundingMask(const double* subdivision, size_t subImgX, size_t subImgY,
-		bool* mask, bool* visited, size_t& x, size_t& y, size_t& subWidth, size_t& subHeight) const
+	/**
+	 * Performs a flood fill of the subimage that contains the given pixel. All
+	 * pixels that are reached and were not labelled before are given the provided
+	 * label, and their bounding box is returned. Previously labelled pixels
+	 * prevent edge pixels from being stored in two subimages. Labels should
+	 * be non-zero and the labels image should be initialized to zero.
+	 * 
+	 * By labelling all subimages in one image, the total cost of finding all
+	 * subimages is proportional to the image size, instead of requiring a
+	 * full-size mask per subimage.
+	 */
+	void LabelSubImage(const double* subdivision, size_t subImgX, size_t subImgY,
+		uint32_t label, uint32_t* labels, size_t& x, size_t& y, size_t& subWidth, size_t& subHeight) const
 	{
-		// This function performs a flood fill of the subimage. Two results are stored: the
-		// mask containing all the pixels that belong to this subimage, as well as
-		// a visited image that contains the union of all masks so far created.
-		// The latter is necessary to prevent storing edge pixels in two subimages.
-		// (While this could also be deduced by tracing the subdivision paths, this
-		// was simpler -- at the cost of one extra array of booleans)
-		
-		std::fill(mask, mask+_width*_height, false);
 		std::vector<std::pair<size_t,size_t>> stack;
 		stack.emplace_back(subImgX, subImgY);
 		x = _width;
@@ -264,10 +330,9 @@ public:
 				curX = stack.back().first,
 				curY = stack.back().second;
 			stack.pop_back();
-			if(!visited[curX + curY*_width])
+			if(labels[curX + curY*_width] == 0)
 			{
-				visited[curX + curY*_width] = true;
-				mask[curX + curY*_width] = true;
+				labels[curX + curY*_width] = label;
 				x = std::min(x, curX); x2 = std::max(x2, curX);
 				y = std::min(y, curY); y2 = std::max(y2, curY);
 				if(subdivision[curX + curY * _width] == 0.0)
@@ -276,7 +341,7 @@ public:
 						stack.emplace_back(curX-1, curY);
 					// When moving down / to the right, we do not allow to be on the border,
 					// because the right border is excluded from the subdivision edge.
-					// (note that the 'visited' mask prevents overlap, but this way
+					// (note that the labels prevent overlap, but this way
 					// subimages consistenly include the left edge and exclude the right edge
 					// as long as the edge is not surrounded on three sides, in which case it is
 					// more or less random)
@@ -318,6 +383,21 @@ public:
 			}
 		}
 	}
+	
+	/**
+	 * Fill the mask of a subimage with the box (x, y, subWidth, subHeight) with
+	 * the pixels that have the given label.
+	 */
+	void GetSubImageMask(const uint32_t* labels, uint32_t label, size_t x, size_t y, size_t subWidth, size_t subHeight, bool* mask) const
+	{
+		for(size_t yi=0; yi!=subHeight; ++yi)
+		{
+			const uint32_t* labelRow = &labels[(y + yi) * _width + x];
+			bool* maskRow = &mask[yi * subWidth];
+			for(size_t xi=0; xi!=subWidth; ++xi)
+				maskRow[xi] = labelRow[xi] == label;
+		}
+	}
 private:
 	size_t _width, _height;
 };
@@ -2,14 +2,14 @@
 
 #include "../deconvolution/spectralfitter.h"
 #include "../deconvolution/componentlist.h"
+#include "../deconvolution/simdkernels.h"
 
 #include "../fftconvolver.h"
 #include "../image.h"
 
 #include "../wsclean/logger.h"
 
-template<bool AllowNegatives>
-size_t SubMinorModel::GetMaxComponent(double* scratch, double& maxValue) const
+size_t SubMinorModel::GetMaxComponent(double* scratch, double& maxValue, bool allowNegatives) const
 {
 	_residual->GetLinearIntegrated(scratch);
 	if(!_rmsFactorImage.empty())
@@ -17,26 +17,18 @@ size_t SubMinorModel::GetMaxComponent(double* scratch, double& maxValue) const
 		for(size_t i=0; i!=size(); ++i)
 			scratch[i] *= _rmsFactorImage[i];
 	}
-	size_t maxComponent = 0;
-	maxValue = scratch[0];
-	for(size_t i=0; i!=size(); ++i)
-	{
-		double value;
-		if(AllowNegatives)
-			value = std::fabs(scratch[i]);
-		else
-			value = scratch[i];
-		if(value > maxValue)
-		{
-			maxComponent = i;
-			maxValue = value;
-		}
-	}
+	const size_t maxComponent = SimdKernels::MaxIndex(scratch, size(), allowNegatives);
 	maxValue = scratch[maxComponent]; // If it was negative, make sure a negative value is returned
 	return maxComponent;
 }
 
-boost::optional<double> SubMinorLoop::Run(ImageSet& convolvedResidual, const ao::uvector<const double*>& doubleConvolvedPsfs)
+void SubMinorModel::SubtractPSF(size_t imageIndex, const double* psf, size_t component, double factor)
+{
+	SimdKernels::SubtractPSFAtPositions((*_residual)[imageIndex], _xPositions.data(), _yPositions.data(), size(), psf, _width, _height, X(component), Y(component), factor);
+}
+
+template<typename NumT>
+boost::optional<double> SubMinorLoop::Run(TImageSet<NumT>& convolvedResidual, const ao::uvector<const double*>& doubleConvolvedPsfs)
 {
 	_subMinorModel = SubMinorModel(_width, _height);
 	
@@ -67,28 +59,17 @@ boost::optional<double> SubMinorLoop::Run(ImageSet& convolvedResidual, const ao:
 		for(size_t imgIndex=0; imgIndex!=_subMinorModel.Model().size(); ++imgIndex)
 			_subMinorModel.Model()[imgIndex][maxComponent] += componentValues[imgIndex];
 		
-		size_t
-			x = _subMinorModel.X(maxComponent),
-			y = _subMinorModel.Y(maxComponent);
 		/*
 		  Commented out because even in verbose mode this is a bit too verbose, but useful in case divergence occurs:
-		_logReceiver.Debug << x << ", " << y << " " << maxValue << " -> ";
+		_logReceiver.Debug << _subMinorModel.X(maxComponent) << ", " << _subMinorModel.Y(maxComponent) << " " << maxValue << " -> ";
 		for(size_t imgIndex=0; imgIndex!=_clarkModel.Model().size(); ++imgIndex)
 		  _logReceiver.Debug << componentValues[imgIndex] << ' ';
 		_logReceiver.Debug << '\n';
 		*/
 		for(size_t imgIndex=0; imgIndex!=_subMinorModel.Residual().size(); ++imgIndex)
 		{
-			double* image = _subMinorModel.Residual()[imgIndex];
 			const double* psf = doubleConvolvedPsfs[_subMinorModel.Residual().PSFIndex(imgIndex)];
-			double psfFactor = componentValues[imgIndex];
-			for(size_t px=0; px!=_subMinorModel.size(); ++px)
-			{
-				int psfX = _subMinorModel.X(px) - x + _width/2;
-				int psfY = _subMinorModel.Y(px) - y + _height/2;
-				if(psfX >= 0 && psfX < int(_width) && psfY >= 0 && psfY < int(_height))
-					image[px] -= psf[psfX + psfY*_width] * psfFactor;
-			}
+			_subMinorModel.SubtractPSF(imgIndex, psf, maxComponent, componentValues[imgIndex]);
 		}
 		
 		maxComponent = _subMinorModel.GetMaxComponent(scratch.data(), maxValue, _allowNegativeComponents);
@@ -97,7 +78,8 @@ boost::optional<double> SubMinorLoop::Run(ImageSet& convolvedResidual, const ao:
 	return maxValue;
 }
 
-void SubMinorModel::MakeSets(const ImageSet& residualSet)
+template<typename NumT>
+void SubMinorModel::MakeSets(const TImageSet<NumT>& residualSet)
 {
 	_residual.reset(new ImageSet(
 			&residualSet.Table(), residualSet.Allocator(),
@@ -111,11 +93,11 @@ void SubMinorModel::MakeSets(const ImageSet& residualSet)
 	{
 		std::fill((*_model)[imgIndex], (*_model)[imgIndex]+size(), 0.0);
 		
-		const double* sourceResidual = residualSet[imgIndex];
+		const NumT* sourceResidual = residualSet[imgIndex];
 		double* destResidual = (*_residual)[imgIndex];
 		for(size_t pxIndex=0; pxIndex!=size(); ++pxIndex)
 		{
-			size_t srcIndex = _positions[pxIndex].second*_width + _positions[pxIndex].first;
+			size_t srcIndex = FullIndex(pxIndex);
 			destResidual[pxIndex] = sourceResidual[srcIndex];
 		}
 	}
@@ -126,12 +108,13 @@ void SubMinorModel::MakeRMSFactorImage(Image& rmsFactorImage)
 	_rmsFactorImage = Image(size(), 1, _residual->Allocator());
 	for(size_t pxIndex=0; pxIndex!=size(); ++pxIndex)
 	{
-		size_t srcIndex = _positions[pxIndex].second*_width + _positions[pxIndex].first;
+		size_t srcIndex = FullIndex(pxIndex);
 		_rmsFactorImage[pxIndex] = rmsFactorImage[srcIndex];
 	}
 }
 
-void SubMinorLoop::findPeakPositions(ImageSet& convolvedResidual)
+template<typename NumT>
+void SubMinorLoop::findPeakPositions(TImageSet<NumT>& convolvedResidual)
 {
 	Image integratedScratch(_width, _height, convolvedResidual.Allocator());
 	convolvedResidual.GetLinearIntegrated(integratedScratch.data());
@@ -191,7 +174,8 @@ void SubMinorLoop::GetFullIndividualModel(size_t imageIndex, double* individualM
 	}
 }
 
-void SubMinorLoop::CorrectResidualDirty(class FFTWManager& fftw, double* scratchA, double* scratchB, double* scratchC, size_t imageIndex, double* residual, const double* singleConvolvedPsf) const
+template<typename NumT>
+void SubMinorLoop::CorrectResidualDirty(class FFTWManager& fftw, double* scratchA, double* scratchB, double* scratchC, size_t imageIndex, NumT* residual, const double* singleConvolvedPsf) const
 {
 	// Get padded kernel in scratchB
 	Image::Untrim(scratchA, _paddedWidth, _paddedHeight, singleConvolvedPsf, _width, _height);
@@ -244,3 +228,9 @@ void SubMinorLoop::UpdateComponentList(class ComponentList& list, size_t scaleIn
 		}
 	}
 }
+
+template boost::optional<double> SubMinorLoop::Run(ImageSet&, const ao::uvector<const double*>&);
+template boost::optional<double> SubMinorLoop::Run(FloatImageSet&, const ao::uvector<const double*>&);
+
+template void SubMinorLoop::CorrectResidualDirty(FFTWManager&, double*, double*, double*, size_t, double*, const double*) const;
+template void SubMinorLoop::CorrectResidualDirty(FFTWManager&, double*, double*, double*, size_t, float*, const double*) const;
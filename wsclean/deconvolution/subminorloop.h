@@ -42,19 +42,27 @@
 class SubMinorModel
 {
 public:
-	SubMinorModel(size_t width, size_t /*height*/) :
-		_width(width)
+	SubMinorModel(size_t width, size_t height) :
+		_width(width), _height(height)
 	{ }
 	
 	void AddPosition(size_t x, size_t y)
-	{ _positions.push_back(std::make_pair(x, y)); }
+	{
+		_xPositions.push_back(x);
+		_yPositions.push_back(y);
+	}
 	
 	/**
 	 * Return number of selected pixels.
 	 */
-	size_t size() const { return _positions.size(); }
+	size_t size() const { return _xPositions.size(); }
 	
-	void MakeSets(const ImageSet& templateSet);
+	/**
+	 * Copies the selected pixels of the residual images. The copies are double
+	 * precision, also when the residual images are single precision.
+	 */
+	template<typename NumT>
+	void MakeSets(const TImageSet<NumT>& residualSet);
 	void MakeRMSFactorImage(Image& rmsFactorImage);
 	
 	ImageSet& Residual() { return *_residual; }
@@ -63,23 +71,22 @@ public:
 	ImageSet& Model() { return *_model; }
 	const ImageSet& Model() const { return *_model; }
 	
-	size_t X(size_t index) const { return _positions[index].first; }
-	size_t Y(size_t index) const { return _positions[index].second; }
+	size_t X(size_t index) const { return _xPositions[index]; }
+	size_t Y(size_t index) const { return _yPositions[index]; }
 	size_t FullIndex(size_t index) const { return X(index) + Y(index) * _width; }
-	template<bool AllowNegatives>
-	size_t GetMaxComponent(double* scratch, double& maxValue) const;
-	size_t GetMaxComponent(double* scratch, double& maxValue, bool allowNegatives) const
-	{
-		if(allowNegatives)
-			return GetMaxComponent<true>(scratch, maxValue);
-		else
-			return GetMaxComponent<false>(scratch, maxValue);
-	}
+	size_t GetMaxComponent(double* scratch, double& maxValue, bool allowNegatives) const;
+	
+	/**
+	 * Subtracts the PSF centred on the given component from all selected pixels
+	 * of the given residual image.
+	 */
+	void SubtractPSF(size_t imageIndex, const double* psf, size_t component, double factor);
 private:
-	std::vector<std::pair<size_t,size_t>> _positions;
+	// Stored separately, such that the sub-minor loop can be vectorized
+	std::vector<size_t> _xPositions, _yPositions;
 	std::unique_ptr<ImageSet> _residual, _model;
 	Image _rmsFactorImage;
-	size_t _width;
+	size_t _width, _height;
 };
 
 class SubMinorLoop
@@ -137,7 +144,8 @@ public:
 	
 	double FluxCleaned() const { return _fluxCleaned; }
 	
-	boost::optional<double> Run(ImageSet& convolvedResidual, const ao::uvector<const double*>& doubleConvolvedPsfs);
+	template<typename NumT>
+	boost::optional<double> Run(TImageSet<NumT>& convolvedResidual, const ao::uvector<const double*>& doubleConvolvedPsfs);
 	
 	/**
 	 * The produced model is convolved with the given psf, and the result is subtracted from the given residual image.
@@ -146,7 +154,8 @@ public:
 	 * scratchA and scratchB need to be able to store the full padded image (_untrimmedWidth x _untrimmedHeight).
 	 * scratchC only needs to store the trimmed size (_width x _height).
 	 */
-	void CorrectResidualDirty(class FFTWManager& fftw, double* scratchA, double* scratchB, double* scratchC, size_t imageIndex, double* residual, const double* singleConvolvedPsf) const;
+	template<typename NumT>
+	void CorrectResidualDirty(class FFTWManager& fftw, double* scratchA, double* scratchB, double* scratchC, size_t imageIndex, NumT* residual, const double* singleConvolvedPsf) const;
 	
 	void GetFullIndividualModel(size_t imageIndex, double* individualModelImg) const;
 	
@@ -155,7 +164,8 @@ public:
 	void UpdateComponentList(class ComponentList& list, size_t scaleIndex) const;
 	
 private:
-	void findPeakPositions(ImageSet& convolvedResidual);
+	template<typename NumT>
+	void findPeakPositions(TImageSet<NumT>& convolvedResidual);
 	
 	size_t _width, _height, _paddedWidth, _paddedHeight;
 	double _threshold, _consideredPixelThreshold, _gain;
@@ -4,8 +4,19 @@
 #include "model/model.h"
 #include "progressbar.h"
 
+#include "aocommon/parallelfor.h"
+
 #include <casacore/measures/TableMeasures/ArrayMeasColumn.h>
 
+#include <algorithm>
+#include <cmath>
+
+#define USE_INTRINSICS
+
+#if defined __AVX__ && defined USE_INTRINSICS
+#include <immintrin.h>
+#endif
+
 DFTPredictionImage::DFTPredictionImage(size_t width, size_t height, ImageBufferAllocator& allocator) :
 	_width(width),
 	_height(height),
@@ -157,14 +168,37 @@ struct ComponentInfo
 	std::vector<MC2x2> beamValues;
 };
 	
-void DFTPredictionInput::ConvertApparentToAbsolute(casacore::MeasurementSet& ms)
+std::vector<size_t> DFTPredictionInput::SelectTimestepRows(const double* times, size_t rowCount, double timeInterval)
+{
+	std::vector<std::pair<double, size_t>> timeRows;
+	timeRows.reserve(rowCount);
+	for(size_t row=0; row!=rowCount; ++row)
+		timeRows.emplace_back(times[row], row);
+	std::sort(timeRows.begin(), timeRows.end());
+	std::vector<size_t> timestepRows;
+	for(const std::pair<double, size_t>& timeRow : timeRows)
+	{
+		if(timestepRows.empty())
+			timestepRows.push_back(timeRow.second);
+		else {
+			const double previous = times[timestepRows.back()];
+			if(timeRow.first != previous && timeRow.first - previous >= timeInterval)
+				timestepRows.push_back(timeRow.second);
+		}
+	}
+	return timestepRows;
+}
+
+void DFTPredictionInput::ConvertApparentToAbsolute(casacore::MeasurementSet& ms, size_t threadCount, double timeInterval)
 {
 	std::vector<ComponentInfo> compInfos(_components.size());
 	
 	const BandData band(ms.spectralWindow());
-	LBeamEvaluator evaluator(ms);
+	
+	casacore::ROScalarColumn<double> timeValueColumn(ms, ms.columnName(casacore::MSMainEnums::TIME));
+	casacore::Vector<double> timeValues = timeValueColumn.getColumn();
+	const std::vector<size_t> timestepRows = SelectTimestepRows(timeValues.data(), timeValues.size(), timeInterval);
 	casacore::MEpoch::ROScalarColumn timeColumn(ms, ms.columnName(casacore::MSMainEnums::TIME));
-	size_t nrow = ms.nrow();
 
 	for(std::vector<ComponentInfo>::iterator cInfo=compInfos.begin(); cInfo!=compInfos.end(); ++cInfo)
 	{
@@ -172,29 +206,34 @@ void DFTPredictionInput::ConvertApparentToAbsolute(casacore::MeasurementSet& ms)
 		cInfo->count.assign(band.ChannelCount(), 0);
 	}
 	
+	// Every thread has its own evaluator, because an evaluator holds the time
+	// for which it evaluates.
+	std::vector<std::unique_ptr<LBeamEvaluator>> evaluators(threadCount);
+	for(std::unique_ptr<LBeamEvaluator>& evaluator : evaluators)
+		evaluator.reset(new LBeamEvaluator(ms));
+	ao::ParallelFor<size_t> loop(threadCount);
 	ProgressBar progress("Evaluating beam");
-	for(size_t row=0; row!=nrow; ++row)
+	for(size_t timestep=0; timestep!=timestepRows.size(); ++timestep)
 	{
-		casacore::MEpoch time = timeColumn(row);
-		if(time.getValue().get() != evaluator.Time().getValue().get())
+		casacore::MEpoch time = timeColumn(timestepRows[timestep]);
+		for(std::unique_ptr<LBeamEvaluator>& evaluator : evaluators)
+			evaluator->SetTime(time);
+		loop.Run(0, _components.size(), [&](size_t i, size_t thread)
 		{
-			evaluator.SetTime(time);
+			LBeamEvaluator& evaluator = *evaluators[thread];
+			const DFTPredictionComponent& c = _components[i];
+			ComponentInfo& cInfo = compInfos[i];
 			LBeamEvaluator::PrecalcPosInfo posInfo;
-			for(size_t i=0; i!=_components.size(); ++i)
+			evaluator.PrecalculatePositionInfo(posInfo, c.RA(), c.Dec());
+			for(size_t ch=0; ch!=band.ChannelCount(); ++ch)
 			{
-				const DFTPredictionComponent& c = _components[i];
-				ComponentInfo& cInfo = compInfos[i];
-				evaluator.PrecalculatePositionInfo(posInfo, c.RA(), c.Dec());
-				for(size_t ch=0; ch!=band.ChannelCount(); ++ch)
-				{
-					MC2x2 timeStepValue;
-					evaluator.EvaluateFullArray(posInfo, band.ChannelFrequency(ch), timeStepValue);
-					cInfo.beamValues[ch] += timeStepValue;
-					++cInfo.count[ch];
-				}
+				MC2x2 timeStepValue;
+				evaluator.EvaluateFullArray(posInfo, band.ChannelFrequency(ch), timeStepValue);
+				cInfo.beamValues[ch] += timeStepValue;
+				++cInfo.count[ch];
 			}
-		}
-		progress.SetProgress(row+1,nrow);
+		});
+		progress.SetProgress(timestep+1, timestepRows.size());
 	}
 	
 	for(size_t i=0; i!=_components.size(); ++i)
@@ -250,79 +289,296 @@ void DFTPredictionInput::InitializeFromModel(const Model& model, long double pha
 	}
 }
 
-void DFTPredictionAlgorithm::Predict(MC2x2& dest, double u, double v, double w, size_t channelIndex, size_t a1, size_t a2)
+namespace {
+	/**
+	 * Number of channels after which the phase recurrence is restarted from an exactly
+	 * calculated phase, to keep the accumulated rounding errors negligible.
+	 */
+	constexpr size_t phaseRecalculationInterval = 64;
+	
+	constexpr double speedOfLight = 299792458.0;
+	
+	bool isRegularlySpaced(const BandData& band)
+	{
+		const size_t n = band.ChannelCount();
+		if(n < 3)
+			return true;
+		const double
+			first = band.ChannelFrequency(0),
+			step = (band.ChannelFrequency(n-1) - first) / (n-1);
+		for(size_t ch=1; ch!=n-1; ++ch)
+		{
+			if(std::fabs(band.ChannelFrequency(ch) - (first + ch*step)) > 1e-3)
+				return false;
+		}
+		return true;
+	}
+	
+	/**
+	 * Adds the sum over components of flux x phasor to sum[8], for the 8 real/imaginary
+	 * elements of the fluxes. Element e of component i is stored in fluxes[e*stride + i].
+	 */
+	void accumulate(double* sum, const double* fluxes, size_t stride, const double* phasorR, const double* phasorI, size_t count)
+	{
+		size_t i = 0;
+#if defined __AVX__ && defined USE_INTRINSICS
+		__m256d sumR[4], sumI[4];
+		for(size_t p=0; p!=4; ++p)
+		{
+			sumR[p] = _mm256_setzero_pd();
+			sumI[p] = _mm256_setzero_pd();
+		}
+		for(; i+4<=count; i+=4)
+		{
+			__m256d
+				pR = _mm256_loadu_pd(&phasorR[i]),
+				pI = _mm256_loadu_pd(&phasorI[i]);
+			for(size_t p=0; p!=4; ++p)
+			{
+				__m256d
+					fR = _mm256_loadu_pd(&fluxes[p*2*stride + i]),
+					fI = _mm256_loadu_pd(&fluxes[(p*2+1)*stride + i]);
+				sumR[p] = _mm256_add_pd(sumR[p], _mm256_sub_pd(_mm256_mul_pd(fR, pR), _mm256_mul_pd(fI, pI)));
+				sumI[p] = _mm256_add_pd(sumI[p], _mm256_add_pd(_mm256_mul_pd(fR, pI), _mm256_mul_pd(fI, pR)));
+			}
+		}
+		for(size_t p=0; p!=4; ++p)
+		{
+			double r[4], im[4];
+			_mm256_storeu_pd(r, sumR[p]);
+			_mm256_storeu_pd(im, sumI[p]);
+			sum[p*2] += (r[0] + r[1]) + (r[2] + r[3]);
+			sum[p*2+1] += (im[0] + im[1]) + (im[2] + im[3]);
+		}
+#endif
+		for(; i!=count; ++i)
+		{
+			for(size_t p=0; p!=4; ++p)
+			{
+				double
+					fR = fluxes[p*2*stride + i],
+					fI = fluxes[(p*2+1)*stride + i];
+				sum[p*2] += fR * phasorR[i] - fI * phasorI[i];
+				sum[p*2+1] += fR * phasorI[i] + fI * phasorR[i];
+			}
+		}
+	}
+	
+	/**
+	 * Calculates B1 x F x B2^H for count components, where all matrices are
+	 * stored as 8 real/imaginary element arrays with the given stride.
+	 */
+	void applyBeam(double* dest, const double* flux, const double* beam1, const double* beam2, size_t stride, size_t count)
+	{
+		for(size_t i=0; i!=count; ++i)
+		{
+			std::complex<double> b1[4], f[4], b2[4];
+			for(size_t p=0; p!=4; ++p)
+			{
+				b1[p] = std::complex<double>(beam1[p*2*stride + i], beam1[(p*2+1)*stride + i]);
+				f[p] = std::complex<double>(flux[p*2*stride + i], flux[(p*2+1)*stride + i]);
+				b2[p] = std::complex<double>(beam2[p*2*stride + i], beam2[(p*2+1)*stride + i]);
+			}
+			const std::complex<double> t[4] = {
+				b1[0]*f[0] + b1[1]*f[2], b1[0]*f[1] + b1[1]*f[3],
+				b1[2]*f[0] + b1[3]*f[2], b1[2]*f[1] + b1[3]*f[3]
+			};
+			const std::complex<double> a[4] = {
+				t[0]*std::conj(b2[0]) + t[1]*std::conj(b2[1]),
+				t[0]*std::conj(b2[2]) + t[1]*std::conj(b2[3]),
+				t[2]*std::conj(b2[0]) + t[3]*std::conj(b2[1]),
+				t[2]*std::conj(b2[2]) + t[3]*std::conj(b2[3])
+			};
+			for(size_t p=0; p!=4; ++p)
+			{
+				dest[p*2*stride + i] = a[p].real();
+				dest[(p*2+1)*stride + i] = a[p].imag();
+			}
+		}
+	}
+}
+
+DFTPredictionAlgorithm::DFTPredictionAlgorithm(DFTPredictionInput& input, const BandData& band, size_t antennaCount) :
+	_input(input),
+	_band(band),
+	_hasBeam(false),
+	_isRegular(isRegularlySpaced(band)),
+	_antennaCount(antennaCount),
+	_componentCount(input.ComponentCount()),
+	_pointCount(0)
 {
-	dest = MC2x2::Zero();
-	MC2x2 single;
-	for(DFTPredictionInput::const_iterator c=_input.begin(); c!=_input.end(); ++c)
+	_inputIndices.reserve(_componentCount);
+	for(size_t i=0; i!=_componentCount; ++i)
+	{
+		if(!(input.begin()+i)->IsGaussian())
+			_inputIndices.push_back(i);
+	}
+	_pointCount = _inputIndices.size();
+	for(size_t i=0; i!=_componentCount; ++i)
 	{
-		predict(single, u, v, w, channelIndex, a1, a2, *c);
-		dest += single;
+		if((input.begin()+i)->IsGaussian())
+			_inputIndices.push_back(i);
+	}
+	_componentPositions.resize(_componentCount);
+	for(size_t c=0; c!=_componentCount; ++c)
+		_componentPositions[_inputIndices[c]] = c;
+	
+	_l.resize(_componentCount);
+	_m.resize(_componentCount);
+	_nMinusOne.resize(_componentCount);
+	for(size_t p=0; p!=4; ++p)
+		_gausTransf[p].resize(_componentCount - _pointCount);
+	_fluxes.resize(_band.ChannelCount() * 8 * _componentCount);
+	for(size_t c=0; c!=_componentCount; ++c)
+	{
+		const DFTPredictionComponent& component = *(input.begin() + _inputIndices[c]);
+		_l[c] = component.L();
+		_m[c] = component.M();
+		_nMinusOne[c] = component.LMSqrt() - 1.0;
+		if(c >= _pointCount)
+		{
+			for(size_t p=0; p!=4; ++p)
+				_gausTransf[p][c - _pointCount] = component.GausTransformationMatrix()[p];
+		}
+		for(size_t ch=0; ch!=_band.ChannelCount(); ++ch)
+		{
+			const MC2x2& flux = component.LinearFlux(ch);
+			for(size_t p=0; p!=4; ++p)
+			{
+				_fluxes[fluxIndex(ch, p*2) + c] = flux[p].real();
+				_fluxes[fluxIndex(ch, p*2+1) + c] = flux[p].imag();
+			}
+		}
 	}
 }
 
-void DFTPredictionAlgorithm::predict(MC2x2& dest, double u, double v, double w, size_t channelIndex, size_t a1, size_t a2, const DFTPredictionComponent& component)
+void DFTPredictionAlgorithm::Predict(MC2x2& dest, double u, double v, double w, size_t channelIndex, size_t a1, size_t a2) const
 {
-	double l = component.L(), m = component.M(), lmsqrt = component.LMSqrt();
-	double angle = 2.0*M_PI*(u*l + v*m + w*(lmsqrt-1.0));
-	double
-		sinangleOverLMS = sin(angle),
-		cosangleOverLMS = cos(angle);
-	MC2x2 appFlux;
+	const double lambda = _band.ChannelWavelength(channelIndex);
+	PredictRow(&dest, u*lambda, v*lambda, w*lambda, channelIndex, channelIndex+1, a1, a2);
+}
+
+void DFTPredictionAlgorithm::PredictRow(MC2x2* dest, double uInM, double vInM, double wInM, size_t startChannel, size_t endChannel, size_t a1, size_t a2, RowScratch& scratch) const
+{
+	const size_t
+		n = _componentCount,
+		gausCount = _componentCount - _pointCount;
+	if(n == 0)
+	{
+		for(size_t ch=startChannel; ch!=endChannel; ++ch)
+			dest[ch - startChannel] = MC2x2::Zero();
+		return;
+	}
+	const double twoPiOverC = 2.0 * M_PI / speedOfLight;
+	// The phase of a component is delay x frequency
+	ao::uvector<double>
+		&delays = scratch.delays, &phasorR = scratch.phasorR, &phasorI = scratch.phasorI,
+		&stepR = scratch.stepR, &stepI = scratch.stepI,
+		&gausExponents = scratch.gausExponents, &gausPhasorR = scratch.gausPhasorR,
+		&gausPhasorI = scratch.gausPhasorI, &apparentFluxes = scratch.apparentFluxes;
+	delays.resize(n);
+	phasorR.resize(n);
+	phasorI.resize(n);
+	gausExponents.resize(gausCount);
+	gausPhasorR.resize(gausCount);
+	gausPhasorI.resize(gausCount);
 	if(_hasBeam)
+		apparentFluxes.resize(n*8);
+	for(size_t c=0; c!=n; ++c)
+		delays[c] = twoPiOverC * (uInM*_l[c] + vInM*_m[c] + wInM*_nMinusOne[c]);
+	// The Gaussian attenuation is exp(exponent x frequency^2)
+	const double invCSquared = 1.0 / (speedOfLight * speedOfLight);
+	for(size_t i=0; i!=gausCount; ++i)
 	{
-		MC2x2 temp;
-		MC2x2::ATimesB(temp, component.AntennaInfo(a1).BeamValue(channelIndex), component.LinearFlux(channelIndex));
-		MC2x2::ATimesHermB(appFlux, temp, component.AntennaInfo(a2).BeamValue(channelIndex));
+		const double
+			uT = uInM*_gausTransf[0][i] + vInM*_gausTransf[1][i],
+			vT = uInM*_gausTransf[2][i] + vInM*_gausTransf[3][i];
+		gausExponents[i] = -(uT*uT + vT*vT) * invCSquared;
 	}
-	else {
-		appFlux = component.LinearFlux(channelIndex);
+	const bool useRecurrence = _isRegular && endChannel - startChannel > 1;
+	if(useRecurrence)
+	{
+		stepR.resize(n);
+		stepI.resize(n);
+		const double frequencyStep = _band.ChannelFrequency(startChannel+1) - _band.ChannelFrequency(startChannel);
+		for(size_t c=0; c!=n; ++c)
+			sincos(delays[c] * frequencyStep, &stepI[c], &stepR[c]);
 	}
-	if(component.IsGaussian())
+	
+	for(size_t ch=startChannel; ch!=endChannel; ++ch)
 	{
-		const double* gausTrans = component.GausTransformationMatrix();
-		double uTemp = u*gausTrans[0] + v*gausTrans[1];
-		v = u*gausTrans[2] + v*gausTrans[3];
-		u = uTemp;
-		double gaus = exp(-u*u - v*v);
-		for(size_t p=0; p!=4; ++p)
+		const double frequency = _band.ChannelFrequency(ch);
+		if(!useRecurrence || (ch - startChannel) % phaseRecalculationInterval == 0)
 		{
-			std::complex<double> val = appFlux[p] * gaus;
-			dest[p] = std::complex<double>(
-				val.real() * cosangleOverLMS - val.imag() * sinangleOverLMS,
-				val.real() * sinangleOverLMS + val.imag() * cosangleOverLMS);
+			for(size_t c=0; c!=n; ++c)
+				sincos(delays[c] * frequency, &phasorI[c], &phasorR[c]);
 		}
-	}
-	else {
+		
+		const double* fluxes = &_fluxes[fluxIndex(ch, 0)];
+		if(_hasBeam)
+		{
+			applyBeam(apparentFluxes.data(), fluxes, &_beamValues[beamIndex(a1, ch, 0)], &_beamValues[beamIndex(a2, ch, 0)], n, n);
+			fluxes = apparentFluxes.data();
+		}
+		double sum[8] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+		accumulate(sum, fluxes, n, phasorR.data(), phasorI.data(), _pointCount);
+		if(gausCount != 0)
+		{
+			const double fSquared = frequency * frequency;
+			for(size_t i=0; i!=gausCount; ++i)
+			{
+				const double gaus = std::exp(gausExponents[i] * fSquared);
+				gausPhasorR[i] = phasorR[_pointCount + i] * gaus;
+				gausPhasorI[i] = phasorI[_pointCount + i] * gaus;
+			}
+			accumulate(sum, fluxes + _pointCount, n, gausPhasorR.data(), gausPhasorI.data(), gausCount);
+		}
+		MC2x2& value = dest[ch - startChannel];
 		for(size_t p=0; p!=4; ++p)
+			value[p] = std::complex<double>(sum[p*2], sum[p*2+1]);
+		
+		if(useRecurrence)
 		{
-			std::complex<double> val = appFlux[p];
-			dest[p] = std::complex<double>(
-				val.real() * cosangleOverLMS - val.imag() * sinangleOverLMS,
-				val.real() * sinangleOverLMS + val.imag() * cosangleOverLMS);
+			for(size_t c=0; c!=n; ++c)
+			{
+				const double r = phasorR[c]*stepR[c] - phasorI[c]*stepI[c];
+				phasorI[c] = phasorR[c]*stepI[c] + phasorI[c]*stepR[c];
+				phasorR[c] = r;
+			}
 		}
 	}
 }
 
-void DFTPredictionAlgorithm::UpdateBeam(LBeamEvaluator& beamEvaluator, size_t startChannel, size_t endChannel)
+void DFTPredictionAlgorithm::setBeamValue(size_t c, size_t antenna, size_t channel, const MC2x2& beamValue)
 {
 	if(!_hasBeam)
 	{
+		_beamValues.assign(_antennaCount * _band.ChannelCount() * 8 * _componentCount, 0.0);
 		_hasBeam = true;
 	}
-	for(DFTPredictionInput::iterator component=_input.begin(); component!=_input.end(); ++component)
+	for(size_t p=0; p!=4; ++p)
+	{
+		_beamValues[beamIndex(antenna, channel, p*2) + c] = beamValue[p].real();
+		_beamValues[beamIndex(antenna, channel, p*2+1) + c] = beamValue[p].imag();
+	}
+}
+
+void DFTPredictionAlgorithm::UpdateBeam(LBeamEvaluator& beamEvaluator, size_t startChannel, size_t endChannel)
+{
+	for(size_t c=0; c!=_componentCount; ++c)
 	{
+		const DFTPredictionComponent& component = *(_input.begin() + _inputIndices[c]);
 		LBeamEvaluator::PrecalcPosInfo posInfo;
-		beamEvaluator.PrecalculatePositionInfo(posInfo, component->RA(), component->Dec());
+		beamEvaluator.PrecalculatePositionInfo(posInfo, component.RA(), component.Dec());
 		
-		for(size_t antenna=0; antenna!=component->AntennaCount(); ++antenna)
+		for(size_t antenna=0; antenna!=_antennaCount; ++antenna)
 		{
-			DFTAntennaInfo& antennaInfo = component->AntennaInfo(antenna);
-			
 			for(size_t channel=startChannel; channel!=endChannel; ++channel)
 			{
 				double freq = _band.ChannelFrequency(channel);
-				beamEvaluator.Evaluate(posInfo, freq, antenna, antennaInfo.BeamValue(channel));
+				MC2x2 beamValue;
+				beamEvaluator.Evaluate(posInfo, freq, antenna, beamValue);
+				setBeamValue(c, antenna, channel, beamValue);
 			}
 		}
 	}
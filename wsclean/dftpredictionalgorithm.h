@@ -17,28 +17,11 @@
  * Structure:
  * - PredictionImage: images[4] -- collects the model images.
  * - PredictionInput: components[nComponents] -- made from image, used as input for prediction.
- * - PredictionComponent: l, m, flux[nChannel x 4], antennaBeamValues[nAntenna] (these are updated per timestep)
- * - DFTAntennaInfo: beamValuesPerChannel[nChannel] of Matrix2x2
+ * - PredictionComponent: l, m, flux[nChannel x 4]
+ * - PredictionAlgorithm: the components as arrays, and the beam values per antenna and channel
+ *   (these are updated per timestep)
  */
 
-class DFTAntennaInfo
-{
-public:
-	const MC2x2& BeamValue(size_t channelIndex) const { return _beamValuesPerChannel[channelIndex]; }
-	MC2x2& BeamValue(size_t channelIndex) { return _beamValuesPerChannel[channelIndex]; }
-	
-	std::vector<MC2x2>::iterator begin() { return _beamValuesPerChannel.begin(); }
-	std::vector<MC2x2>::iterator end() { return _beamValuesPerChannel.end(); }
-	size_t ChannelCount() const { return _beamValuesPerChannel.size(); }
-	void InitializeChannelBuffers(size_t channelCount) { _beamValuesPerChannel.resize(channelCount); }
-	void SetUnitaryBeam() {
-		for(MC2x2& m : _beamValuesPerChannel)
-			m = MC2x2::Unity();
-	}
-private:
-	std::vector<MC2x2> _beamValuesPerChannel;
-};
-
 class DFTPredictionComponent
 {
 public:
@@ -79,21 +62,8 @@ public:
 	double LMSqrt() const { return _lmSqrt; }
 	bool IsGaussian() const { return _isGaussian; }
 	const double* GausTransformationMatrix() const { return _gausTransf; }
-	const DFTAntennaInfo& AntennaInfo(size_t antennaIndex) const { return _beamValuesPerAntenna[antennaIndex]; }
-	DFTAntennaInfo& AntennaInfo(size_t antennaIndex) { return _beamValuesPerAntenna[antennaIndex]; }
 	MC2x2& LinearFlux(size_t channelIndex) { return _flux[channelIndex]; }
 	const MC2x2& LinearFlux(size_t channelIndex) const { return _flux[channelIndex]; }
-	size_t AntennaCount() const { return _beamValuesPerAntenna.size(); }
-	void InitializeBeamBuffers(size_t antennaCount, size_t channelCount)
-	{
-		_beamValuesPerAntenna.resize(antennaCount);
-		for(std::vector<DFTAntennaInfo>::iterator a = _beamValuesPerAntenna.begin(); a!=_beamValuesPerAntenna.end(); ++a)
-			a->InitializeChannelBuffers(channelCount);
-	}
-	void SetUnitaryBeam() {
-		for(std::vector<DFTAntennaInfo>::iterator a = _beamValuesPerAntenna.begin(); a!=_beamValuesPerAntenna.end(); ++a)
-			a->SetUnitaryBeam();
-	}
 private:
 	void initializeGaussian(double positionAngle, double majorAxis, double minorAxis)
 	{
@@ -124,7 +94,6 @@ private:
 	bool _isGaussian;
 	double _gausTransf[4];
 	std::vector<MC2x2> _flux;
-	std::vector<DFTAntennaInfo> _beamValuesPerAntenna;
 };
 
 class DFTPredictionInput
@@ -145,15 +114,20 @@ public:
 		return _components.back();
 	}
 	size_t ComponentCount() const { return _components.size(); }
-	void InitializeBeamBuffers(size_t antennaCount, size_t channelCount) {
-		for(iterator c=begin(); c!=end(); ++c)
-			c->InitializeBeamBuffers(antennaCount, channelCount);
-	}
-	void SetUnitaryBeam() {
-		for(iterator c=begin(); c!=end(); ++c)
-			c->SetUnitaryBeam();
-	}
-	void ConvertApparentToAbsolute(casacore::MeasurementSet& ms);
+	/**
+	 * Divides the fluxes by the array-averaged beam, averaged over the timesteps of
+	 * the measurement set. The beam is evaluated on threadCount threads. When timeInterval
+	 * is larger than zero, timesteps closer than timeInterval seconds to the previously
+	 * evaluated timestep are skipped.
+	 */
+	void ConvertApparentToAbsolute(casacore::MeasurementSet& ms, size_t threadCount, double timeInterval = 0.0);
+	
+	/**
+	 * Selects the timesteps at which ConvertApparentToAbsolute() evaluates the beam. Returns
+	 * the first row of every distinct time, in order of time, skipping times that are closer
+	 * than timeInterval to the previously selected time.
+	 */
+	static std::vector<size_t> SelectTimestepRows(const double* times, size_t rowCount, double timeInterval);
 	
 	const_iterator begin() const { return _components.begin(); }
 	const_iterator end() const { return _components.end(); }
@@ -179,22 +153,99 @@ private:
 	std::vector<PolarizationEnum> _pols;
 };
 
+/**
+ * Predicts visibilities with a direct Fourier transform of the components of a
+ * @ref DFTPredictionInput.
+ *
+ * On construction, the components are copied into separate arrays per property
+ * (l, m, n-1, fluxes per channel), with the point sources before the Gaussians. This allows
+ * summing the components with vector instructions. Therefore, the input should be complete
+ * before the algorithm is constructed. The beam values that are set with @ref UpdateBeam()
+ * are stored in the same layout.
+ */
 class DFTPredictionAlgorithm
 {
 public:
-	DFTPredictionAlgorithm(DFTPredictionInput& input, const BandData& band) : _input(input), _band(band), _hasBeam(false)
-	{ }
+	DFTPredictionAlgorithm(DFTPredictionInput& input, const BandData& band, size_t antennaCount);
+	
+	/**
+	 * Predicts a single visibility. The uvw values are in units of wavelengths for the
+	 * given channel.
+	 */
+	void Predict(MC2x2& dest, double u, double v, double w, size_t channelIndex, size_t a1, size_t a2) const;
+	
+	/**
+	 * Predicts the visibilities of channels startChannel up to endChannel of one row, and
+	 * stores them in dest[0] ... dest[endChannel-startChannel-1]. The uvw values are in
+	 * metres. When the channels are regularly spaced, the phase term of each component is
+	 * only calculated exactly once every few channels: other channels are calculated by
+	 * multiplication with the phase step per channel. This function may be called
+	 * from several threads at the same time.
+	 */
+	void PredictRow(MC2x2* dest, double uInM, double vInM, double wInM, size_t startChannel, size_t endChannel, size_t a1, size_t a2) const
+	{
+		RowScratch scratch;
+		PredictRow(dest, uInM, vInM, wInM, startChannel, endChannel, a1, a2, scratch);
+	}
+	
+	/**
+	 * Work buffers of PredictRow(). A thread that predicts many rows should keep one
+	 * and pass it to every call, so that the buffers are not reallocated for each row.
+	 */
+	struct RowScratch
+	{
+		ao::uvector<double>
+			delays, phasorR, phasorI, stepR, stepI,
+			gausExponents, gausPhasorR, gausPhasorI,
+			apparentFluxes;
+	};
 	
-	void Predict(MC2x2& dest, double u, double v, double w, size_t channelIndex, size_t a1, size_t a2);
+	/**
+	 * Same as the other PredictRow(), but uses the buffers in @p scratch. The scratch
+	 * may not be used by multiple threads at the same time.
+	 */
+	void PredictRow(MC2x2* dest, double uInM, double vInM, double wInM, size_t startChannel, size_t endChannel, size_t a1, size_t a2, RowScratch& scratch) const;
 
 	void UpdateBeam(LBeamEvaluator& beamEvaluator, size_t startChannel, size_t endChannel);
 	
+	/**
+	 * Sets the beam (Jones matrix) of one antenna and channel towards the component
+	 * with the given index in the input. Once a beam value is set, the predicted
+	 * visibilities are the apparent values B1 x flux x B2^H, with the beams of all
+	 * other components, antennas and channels initialized to zero.
+	 */
+	void SetBeamValue(size_t componentIndex, size_t antenna, size_t channel, const MC2x2& beamValue)
+	{
+		setBeamValue(_componentPositions[componentIndex], antenna, channel, beamValue);
+	}
+	
 private:
-	void predict(MC2x2& dest, double u, double v, double w, size_t channelIndex, size_t a1, size_t a2, const DFTPredictionComponent& component);
+	void setBeamValue(size_t c, size_t antenna, size_t channel, const MC2x2& beamValue);
+	
+	/**
+	 * Element e of component c of channel ch, where the 8 elements are the real
+	 * and imaginary values of the 4 linear correlations.
+	 */
+	size_t fluxIndex(size_t channel, size_t element) const
+	{
+		return (channel*8 + element) * _componentCount;
+	}
+	size_t beamIndex(size_t antenna, size_t channel, size_t element) const
+	{
+		return ((antenna*_band.ChannelCount() + channel)*8 + element) * _componentCount;
+	}
 	
 	DFTPredictionInput& _input;
 	BandData _band;
-	bool _hasBeam;
+	bool _hasBeam, _isRegular;
+	size_t _antennaCount, _componentCount, _pointCount;
+	/** Index in the input of each (reordered) component, and the inverse mapping. */
+	ao::uvector<size_t> _inputIndices, _componentPositions;
+	ao::uvector<double> _l, _m, _nMinusOne;
+	/** The Gaussian transformation matrices of components _pointCount and onwards. */
+	ao::uvector<double> _gausTransf[4];
+	ao::uvector<double> _fluxes;
+	ao::uvector<double> _beamValues;
 };
 
 #endif
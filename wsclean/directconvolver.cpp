@@ -0,0 +1,102 @@
+#include "directconvolver.h"
+
+#include "uvector.h"
+
+#include <stdexcept>
+
+void DirectConvolver::Convolve(double* image, size_t imgWidth, size_t imgHeight, const double* kernel, size_t kernelSize, size_t x1, size_t y1, size_t x2, size_t y2)
+{
+	if(kernelSize > imgWidth || kernelSize > imgHeight)
+		throw std::runtime_error("Kernel size > image dimension");
+	const size_t
+		r = kernelSize/2,
+		boxWidth = x2 - x1,
+		boxHeight = y2 - y1,
+		rowWidth = boxWidth + 2*r,
+		nRows = std::min(imgHeight, boxHeight + 2*r),
+		firstColumn = (x1 + imgWidth - r) % imgWidth;
+	// Because the output is written in place, the rows that are read are first copied. The copied
+	// rows are extended by r pixels on both sides, so that the inner loop does not have to wrap around.
+	// When the box with its border covers all rows, row j of the copy is row j of the image.
+	const bool hasAllRows = (nRows == imgHeight);
+	const size_t firstRow = hasAllRows ? 0 : (y1 + imgHeight - r) % imgHeight;
+	ao::uvector<double> rows(nRows * rowWidth);
+	for(size_t j=0; j!=nRows; ++j)
+	{
+		const size_t y = (firstRow + j) % imgHeight;
+		copyRowCyclic(&rows[j * rowWidth], &image[y * imgWidth], imgWidth, firstColumn, rowWidth);
+	}
+	
+	ao::uvector<double> output(boxWidth);
+	for(size_t yi=0; yi!=boxHeight; ++yi)
+	{
+		std::fill(output.begin(), output.end(), 0.0);
+		for(size_t ky=0; ky!=kernelSize; ++ky)
+		{
+			// The input row is y1 + yi + r - ky
+			const size_t j = hasAllRows ?
+				(y1 + yi + r + imgHeight - ky) % imgHeight :
+				yi + 2*r - ky;
+			const double* kernelRow = &kernel[ky * kernelSize];
+			for(size_t kx=0; kx!=kernelSize; ++kx)
+			{
+				const double k = kernelRow[kx];
+				const double* input = &rows[j * rowWidth + 2*r - kx];
+				for(size_t xi=0; xi!=boxWidth; ++xi)
+					output[xi] += k * input[xi];
+			}
+		}
+		memcpy(&image[(y1 + yi) * imgWidth + x1], output.data(), boxWidth * sizeof(double));
+	}
+}
+
+void DirectConvolver::ConvolveSeparable(double* image, size_t imgWidth, size_t imgHeight, const double* kernel1D, size_t kernelSize, size_t x1, size_t y1, size_t x2, size_t y2)
+{
+	if(kernelSize > imgWidth || kernelSize > imgHeight)
+		throw std::runtime_error("Kernel size > image dimension");
+	const size_t
+		r = kernelSize/2,
+		boxWidth = x2 - x1,
+		boxHeight = y2 - y1,
+		rowWidth = boxWidth + 2*r,
+		nRows = std::min(imgHeight, boxHeight + 2*r),
+		firstColumn = (x1 + imgWidth - r) % imgWidth;
+	const bool hasAllRows = (nRows == imgHeight);
+	const size_t firstRow = hasAllRows ? 0 : (y1 + imgHeight - r) % imgHeight;
+	
+	// Horizontal pass: convolve all rows that are required by the vertical pass
+	ao::uvector<double>
+		rowBuffer(rowWidth),
+		rows(nRows * boxWidth, 0.0);
+	for(size_t j=0; j!=nRows; ++j)
+	{
+		const size_t y = (firstRow + j) % imgHeight;
+		copyRowCyclic(rowBuffer.data(), &image[y * imgWidth], imgWidth, firstColumn, rowWidth);
+		double* output = &rows[j * boxWidth];
+		for(size_t k=0; k!=kernelSize; ++k)
+		{
+			const double kernelValue = kernel1D[k];
+			const double* input = &rowBuffer[2*r - k];
+			for(size_t xi=0; xi!=boxWidth; ++xi)
+				output[xi] += kernelValue * input[xi];
+		}
+	}
+	
+	// Vertical pass
+	ao::uvector<double> output(boxWidth);
+	for(size_t yi=0; yi!=boxHeight; ++yi)
+	{
+		std::fill(output.begin(), output.end(), 0.0);
+		for(size_t k=0; k!=kernelSize; ++k)
+		{
+			const size_t j = hasAllRows ?
+				(y1 + yi + r + imgHeight - k) % imgHeight :
+				yi + 2*r - k;
+			const double kernelValue = kernel1D[k];
+			const double* input = &rows[j * boxWidth];
+			for(size_t xi=0; xi!=boxWidth; ++xi)
+				output[xi] += kernelValue * input[xi];
+		}
+		memcpy(&image[(y1 + yi) * imgWidth + x1], output.data(), boxWidth * sizeof(double));
+	}
+}
@@ -0,0 +1,68 @@
+#ifndef DIRECT_CONVOLVER_H
+#define DIRECT_CONVOLVER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+/**
+ * Convolves images with small kernels directly in the image domain. For small kernels,
+ * this is faster than convolving with the FFTConvolver, in particular when only a part
+ * of the image needs to be convolved.
+ *
+ * The convolution is cyclic, and therefore gives the same result as
+ * FFTConvolver::ConvolveSameSize() with a kernel prepared by FFTConvolver::PrepareSmallKernel().
+ * Kernels should have an odd size and have their middle pixel at n/2. The size of the
+ * kernel should not be larger than the image.
+ *
+ * The methods only calculate the output in the box [x1, x2) x [y1, y2). Pixels outside
+ * this box are left untouched.
+ */
+class DirectConvolver {
+public:
+	/**
+	 * Convolve an image with a (non-separable) square kernel of size kernelSize x kernelSize.
+	 */
+	static void Convolve(double* image, size_t imgWidth, size_t imgHeight, const double* kernel, size_t kernelSize, size_t x1, size_t y1, size_t x2, size_t y2);
+
+	/**
+	 * Convolve an image with a separable kernel. The 2D kernel is the outer product of
+	 * kernel1D with itself.
+	 */
+	static void ConvolveSeparable(double* image, size_t imgWidth, size_t imgHeight, const double* kernel1D, size_t kernelSize, size_t x1, size_t y1, size_t x2, size_t y2);
+
+	/**
+	 * Rough estimate of whether it is faster to directly convolve a box of the given size
+	 * than it is to convolve an image of fftWidth x fftHeight with FFTs. The FFT convolution
+	 * requires three FFTs, for which an equivalent cost of 5 log2(N) multiply-adds per pixel is
+	 * assumed.
+	 */
+	static bool IsFasterThanFFT(size_t kernelSize, bool isSeparable, size_t boxWidth, size_t boxHeight, size_t fftWidth, size_t fftHeight)
+	{
+		const double
+			directCostPerPixel = isSeparable ? 2.0 * kernelSize : double(kernelSize) * double(kernelSize),
+			directCost = directCostPerPixel * double(boxWidth) * double(boxHeight),
+			fftSize = double(fftWidth) * double(fftHeight),
+			fftCost = 5.0 * fftSize * std::log2(std::max(fftSize, 2.0));
+		return directCost < fftCost;
+	}
+
+private:
+	/**
+	 * Copy count pixels from the row, starting at column start, into dest. Reading
+	 * wraps around the edge of the row.
+	 */
+	static void copyRowCyclic(double* dest, const double* row, size_t width, size_t start, size_t count)
+	{
+		while(count != 0)
+		{
+			size_t n = std::min(count, width - start);
+			memcpy(dest, &row[start], n * sizeof(double));
+			dest += n;
+			count -= n;
+			start = 0;
+		}
+	}
+};
+
+#endif
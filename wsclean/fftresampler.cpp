@@ -217,7 +217,7 @@ void FFTResampler::makeTukeyWindow(ao::uvector<double>& data, size_t width) cons
 	}
 }
 
-void FFTResampler::applyWindow(double* data) const
+void FFTResampler::initializeWindow() const
 {
 	if(_windowRowIn.empty())
 	{
@@ -243,6 +243,11 @@ void FFTResampler::applyWindow(double* data) const
 			runSingle(task, true);
 		}
 	}
+}
+
+void FFTResampler::applyWindow(double* data) const
+{
+	initializeWindow();
 	for(size_t y=0; y!=_inputHeight; ++y)
 	{
 		for(size_t x=0; x!=_inputWidth; ++x)
@@ -34,6 +34,9 @@ public:
 	
 	void Start()
 	{
+		// The window is made before the threads start, as making it is not thread safe
+		if(_windowFunction != WindowFunction::Rectangular)
+			initializeWindow();
 		for(size_t i=0; i!=_tasks.capacity(); ++i)
 		{
 			_threads.emplace_back(&FFTResampler::runThread, this);
@@ -59,9 +62,6 @@ public:
 	
 	void SingleFT(const double* input, double* realOutput, double* imaginaryOutput);
 	
-	/**
-	 * Only to be used with SingleFT (it makes resampling thread unsafe!)
-	 */
 	void SetTukeyWindow(double insetSize, bool correctWindow)
 	{
 		_windowFunction = WindowFunction::Tukey;
@@ -84,6 +84,7 @@ public:
 private:
 	void runThread();
 	void runSingle(const Task& task, bool skipWindow) const;
+	void initializeWindow() const;
 	void applyWindow(double* data) const;
 	void unapplyWindow(double* data) const;
 	void makeWindow(ao::uvector<double>& data, size_t width) const;
@@ -1,4 +1,5 @@
 #include "fitsreader.h"
+#include "mappedfitsdata.h"
 #include "polarization.h"
 
 #include <stdexcept>
@@ -11,21 +12,19 @@
 
 FitsReader::FitsReader(const FitsReader& source) :
 	_fitsPtr(nullptr),
+	_mappedData(source._mappedData),
 	_meta(source._meta)
 {
 	int status = 0;
 	fits_open_file(&_fitsPtr, _meta.filename.c_str(), READONLY, &status);
 	checkStatus(status, _meta.filename);
 	
-	// Move to first HDU
-	int hduType;
-	fits_movabs_hdu(_fitsPtr, 1, &hduType, &status);
-	checkStatus(status, _meta.filename);
-	if(hduType != IMAGE_HDU) throw std::runtime_error("First HDU is not an image");
+	moveToImageHDU();
 }
 
 FitsReader::FitsReader(FitsReader&& source) :
 	_fitsPtr(source._fitsPtr),
+	_mappedData(std::move(source._mappedData)),
 	_meta(std::move(source._meta))
 {
 	source._fitsPtr = nullptr;
@@ -49,6 +48,7 @@ FitsReader& FitsReader::operator=(FitsReader&& rhs)
 		checkStatus(status, _meta.filename);
 	}
 	_meta = std::move(rhs._meta);
+	_mappedData = std::move(rhs._mappedData);
 	_fitsPtr = rhs._fitsPtr;
 	rhs._fitsPtr = nullptr;
 	
@@ -62,7 +62,10 @@ FitsReader& FitsReader::operator=(const FitsReader& rhs)
 		int status = 0;
 		fits_close_file(_fitsPtr, &status);
 		checkStatus(status, _meta.filename);
+		_fitsPtr = nullptr;
 	}
+	_meta = rhs._meta;
+	_mappedData = rhs._mappedData;
 	
 	if(rhs._fitsPtr != nullptr)
 	{
@@ -70,16 +73,82 @@ FitsReader& FitsReader::operator=(const FitsReader& rhs)
 		fits_open_file(&_fitsPtr, _meta.filename.c_str(), READONLY, &status);
 		checkStatus(status, _meta.filename);
 		
-		// Move to first HDU
-		int hduType;
-		fits_movabs_hdu(_fitsPtr, 1, &hduType, &status);
-		checkStatus(status, _meta.filename);
-		if(hduType != IMAGE_HDU) throw std::runtime_error("First HDU is not an image");
+		moveToImageHDU();
 	}
 	
 	return *this;
 }
 
+void FitsReader::moveToImageHDU()
+{
+	// Move to first HDU
+	int status = 0, hduType;
+	fits_movabs_hdu(_fitsPtr, 1, &hduType, &status);
+	checkStatus(status, _meta.filename);
+	if(hduType != IMAGE_HDU) throw std::runtime_error("First HDU is not an image");
+	
+	// Tile-compressed images are stored in the first extension, after an empty
+	// primary HDU. cfitsio decompresses them transparently.
+	int naxis = 0, hduCount = 0;
+	fits_get_img_dim(_fitsPtr, &naxis, &status);
+	checkStatus(status, _meta.filename);
+	fits_get_num_hdus(_fitsPtr, &hduCount, &status);
+	checkStatus(status, _meta.filename);
+	if(naxis == 0 && hduCount > 1)
+	{
+		fits_movabs_hdu(_fitsPtr, 2, &hduType, &status);
+		checkStatus(status, _meta.filename);
+		if(!fits_is_compressed_image(_fitsPtr, &status))
+			throw std::runtime_error("Primary HDU is empty and first extension is not a compressed image");
+		checkStatus(status, _meta.filename);
+	}
+}
+
+void FitsReader::initializeMapping(const std::vector<long>& naxes)
+{
+	_meta.isMappable = false;
+	int status = 0, bitPix = 0;
+	fits_get_img_type(_fitsPtr, &bitPix, &status);
+	checkStatus(status, _meta.filename);
+	const bool isCompressed = fits_is_compressed_image(_fitsPtr, &status);
+	checkStatus(status, _meta.filename);
+	// Files that cfitsio reads through another driver, such as gzipped files,
+	// have a different layout on disk.
+	char urlType[FLEN_FILENAME];
+	fits_url_type(_fitsPtr, urlType, &status);
+	checkStatus(status, _meta.filename);
+	double bScale = 1.0, bZero = 0.0;
+	ReadDoubleKeyIfExists("BSCALE", bScale);
+	ReadDoubleKeyIfExists("BZERO", bZero);
+	if(MappedFitsData::IsSupported(bitPix) && !isCompressed && std::string(urlType) == "file://" &&
+		bScale == 1.0 && bZero == 0.0 && _meta.filename.find('[') == std::string::npos)
+	{
+		LONGLONG headerStart, dataStart, dataEnd;
+		fits_get_hduaddrll(_fitsPtr, &headerStart, &dataStart, &dataEnd, &status);
+		checkStatus(status, _meta.filename);
+		_meta.isMappable = true;
+		_meta.bitPix = bitPix;
+		_meta.dataOffset = dataStart;
+		_meta.pixelCount = 1;
+		for(long n : naxes)
+			_meta.pixelCount *= n;
+	}
+}
+
+const MappedFitsData* FitsReader::mappedData()
+{
+	if(_mappedData == nullptr && _meta.isMappable)
+	{
+		try {
+			_mappedData.reset(new MappedFitsData(_meta.filename, _meta.dataOffset, _meta.pixelCount, _meta.bitPix));
+		} catch(std::exception&) {
+			// Fall back to reading with cfitsio
+			_meta.isMappable = false;
+		}
+	}
+	return _mappedData.get();
+}
+
 double FitsReader::ReadDoubleKey(const char *key)
 {
 	int status = 0;
@@ -164,11 +233,7 @@ void FitsReader::initialize()
 	fits_open_file(&_fitsPtr, _meta.filename.c_str(), READONLY, &status);
 	checkStatus(status, _meta.filename);
 	
-	// Move to first HDU
-	int hduType;
-	fits_movabs_hdu(_fitsPtr, 1, &hduType, &status);
-	checkStatus(status, _meta.filename);
-	if(hduType != IMAGE_HDU) throw std::runtime_error("First HDU is not an image");
+	moveToImageHDU();
 	
 	int naxis = 0;
 	fits_get_img_dim(_fitsPtr, &naxis, &status);
@@ -181,6 +246,7 @@ void FitsReader::initialize()
 	
 	_meta.imgWidth = naxes[0];
 	_meta.imgHeight = naxes[1];
+	initializeMapping(naxes);
 	
 	std::string tmp;
 	for(int i=2;i!=naxis;++i)
@@ -318,12 +384,19 @@ void FitsReader::initialize()
 	readHistory();
 }
 
-template void FitsReader::ReadIndex(float* image, size_t index);
-template void FitsReader::ReadIndex(double* image, size_t index);
+template void FitsReader::ReadIndices(float* image, size_t startIndex, size_t count);
+template void FitsReader::ReadIndices(double* image, size_t startIndex, size_t count);
 
 template<typename NumType>
-void FitsReader::ReadIndex(NumType* image, size_t index)
+void FitsReader::ReadIndices(NumType* image, size_t startIndex, size_t count)
 {
+	const size_t imageSize = _meta.imgWidth*_meta.imgHeight;
+	if(const MappedFitsData* data = mappedData())
+	{
+		data->Read(image, startIndex*imageSize, imageSize*count);
+		return;
+	}
+	
 	int status = 0;
 	int naxis = 0;
 	fits_get_img_dim(_fitsPtr, &naxis, &status);
@@ -331,17 +404,64 @@ void FitsReader::ReadIndex(NumType* image, size_t index)
 	std::vector<long> firstPixel(naxis);
 	for(int i=0;i!=naxis;++i) firstPixel[i] = 1;
 	if(naxis > 2)
-		firstPixel[2] = index+1;
+		firstPixel[2] = startIndex+1;
 	
+	// Pixels are read in file order, so reading beyond the end of an image continues with
+	// the next image.
+	const long long nElements = imageSize*count;
 	if(sizeof(NumType)==8)
-		fits_read_pix(_fitsPtr, TDOUBLE, &firstPixel[0], _meta.imgWidth*_meta.imgHeight, 0, image, 0, &status);
+		fits_read_pix(_fitsPtr, TDOUBLE, &firstPixel[0], nElements, 0, image, 0, &status);
 	else if(sizeof(NumType)==4)
-		fits_read_pix(_fitsPtr, TFLOAT, &firstPixel[0], _meta.imgWidth*_meta.imgHeight, 0, image, 0, &status);
+		fits_read_pix(_fitsPtr, TFLOAT, &firstPixel[0], nElements, 0, image, 0, &status);
 	else
 		throw std::runtime_error("sizeof(NumType)!=8 || 4 not implemented");
 	checkStatus(status, _meta.filename);
 }
 
+template void FitsReader::ReadBox(float* image, size_t index, size_t x, size_t y, size_t width, size_t height);
+template void FitsReader::ReadBox(double* image, size_t index, size_t x, size_t y, size_t width, size_t height);
+
+template<typename NumType>
+void FitsReader::ReadBox(NumType* image, size_t index, size_t x, size_t y, size_t width, size_t height)
+{
+	if(x + width > _meta.imgWidth || y + height > _meta.imgHeight)
+		throw std::runtime_error("Box to be read from " + _meta.filename + " exceeds the image size");
+	if(width == 0 || height == 0)
+		return;
+	
+	const size_t imageSize = _meta.imgWidth*_meta.imgHeight;
+	if(const MappedFitsData* data = mappedData())
+	{
+		data->ReadBox(image, index*imageSize + y*_meta.imgWidth + x, _meta.imgWidth, width, height);
+		return;
+	}
+	
+	int status = 0;
+	int naxis = 0;
+	fits_get_img_dim(_fitsPtr, &naxis, &status);
+	checkStatus(status, _meta.filename);
+	std::vector<long> naxes(naxis);
+	fits_get_img_size(_fitsPtr, naxis, &naxes[0], &status);
+	checkStatus(status, _meta.filename);
+	std::vector<long> firstPixel(naxis), lastPixel(naxis), increment(naxis, 1);
+	firstPixel[0] = x + 1;
+	firstPixel[1] = y + 1;
+	lastPixel[0] = x + width;
+	lastPixel[1] = y + height;
+	// The index counts the images over all further dimensions
+	for(int i=2; i!=naxis; ++i)
+	{
+		firstPixel[i] = index % naxes[i] + 1;
+		lastPixel[i] = firstPixel[i];
+		index /= naxes[i];
+	}
+	if(sizeof(NumType)==8)
+		fits_read_subset(_fitsPtr, TDOUBLE, &firstPixel[0], &lastPixel[0], &increment[0], 0, image, 0, &status);
+	else
+		fits_read_subset(_fitsPtr, TFLOAT, &firstPixel[0], &lastPixel[0], &increment[0], 0, image, 0, &status);
+	checkStatus(status, _meta.filename);
+}
+
 void FitsReader::readHistory()
 {
 	int status = 0;
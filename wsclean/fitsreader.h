@@ -1,6 +1,7 @@
 #ifndef FITSREADER_H
 #define FITSREADER_H
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -27,13 +28,28 @@ class FitsReader : public FitsIOChecker
 		FitsReader& operator=(const FitsReader& rhs);
 		FitsReader& operator=(FitsReader&& rhs);
 		
-		template<typename NumType> void ReadIndex(NumType *image, size_t index);
+		template<typename NumType> void ReadIndex(NumType *image, size_t index)
+		{
+			ReadIndices(image, index, 1);
+		}
+		
+		/**
+		 * Reads count consecutive images, starting at the given index, in one read
+		 * operation. The images are stored consecutively in the image array.
+		 */
+		template<typename NumType> void ReadIndices(NumType *image, size_t startIndex, size_t count);
 		
 		template<typename NumType> void Read(NumType *image)
 		{
 			ReadIndex(image, 0);
 		}
 		
+		/**
+		 * Reads the box of width x height pixels with its corner at (x, y) from the image
+		 * with the given index. The box is stored without gaps in the image array.
+		 */
+		template<typename NumType> void ReadBox(NumType *image, size_t index, size_t x, size_t y, size_t width, size_t height);
+		
 		size_t ImageWidth() const { return _meta.imgWidth; }
 		size_t ImageHeight() const { return _meta.imgHeight; }
 		
@@ -100,15 +116,24 @@ class FitsReader : public FitsIOChecker
 		bool readDateKeyIfExists(const char *key, double &dest);
 		
 		void initialize();
+		void moveToImageHDU();
+		void initializeMapping(const std::vector<long>& naxes);
+		const class MappedFitsData* mappedData();
 		
 		fitsfile* _fitsPtr;
+		/**
+		 * Uncompressed floating point images are read through a memory map, which is
+		 * made when the first image is read. It is shared by copies of the reader.
+		 */
+		std::shared_ptr<const class MappedFitsData> _mappedData;
 		
 		struct MetaData {
 			MetaData(const std::string &filename_, bool checkCType_, bool allowMultipleImages_) :
 				filename(filename_),
 				hasBeam(false),
 				checkCType(checkCType_),
-				allowMultipleImages(allowMultipleImages_)
+				allowMultipleImages(allowMultipleImages_),
+				isMappable(false)
 			{ }
 			std::string filename;
 			size_t imgWidth, imgHeight;
@@ -128,6 +153,10 @@ class FitsReader : public FitsIOChecker
 			std::vector<std::string> history;
 			
 			bool checkCType, allowMultipleImages;
+			
+			bool isMappable;
+			int bitPix;
+			size_t dataOffset, pixelCount;
 		} _meta;
 };
 
@@ -34,6 +34,16 @@ void FitsWriter::writeHeaders(fitsfile *& fptr, const std::string& filename, con
 	fits_create_file(&fptr, (std::string("!") + filename).c_str(), &status);
 	checkStatus(status, filename);
 	
+	if(_tileCompression)
+	{
+		// A quantize level of zero disables the (lossy) quantization of floating
+		// point values, which leaves the shuffled gzip as lossless compression.
+		fits_set_compression_type(fptr, GZIP_2, &status);
+		checkStatus(status, filename);
+		fits_set_quantize_level(fptr, 0.0, &status);
+		checkStatus(status, filename);
+	}
+	
 	// append image HDU
 	int bitPixInt = FLOAT_IMG;
 	std::vector<long> naxes(2 + extraDimensions.size());
@@ -33,6 +33,7 @@ public:
 		_polarization(Polarization::StokesI),
 		_unit(JanskyPerBeam),
 		_isUV(false),
+		_tileCompression(false),
 		_telescopeName(), _observer(), _objectName(),
 		_origin("AO/WSImager"), _originComment("Imager written by Andre Offringa"),
 		_multiFPtr(nullptr)
@@ -50,6 +51,7 @@ public:
 		_polarization(Polarization::StokesI),
 		_unit(JanskyPerBeam),
 		_isUV(false),
+		_tileCompression(false),
 		_telescopeName(), _observer(), _objectName(),
 		_origin("AO/WSImager"), _originComment("Imager written by Andre Offringa"),
 		_multiFPtr(nullptr)
@@ -148,6 +150,16 @@ public:
 	{
 		_isUV = isUV;
 	}
+	bool TileCompression() const { return _tileCompression; }
+	/**
+	 * Write images as tile-compressed FITS. The pixels are compressed losslessly
+	 * with cfitsio's GZIP_2 (byte shuffled) algorithm, and are stored in the first
+	 * extension, after an empty primary HDU. FitsReader reads both layouts.
+	 */
+	void SetTileCompression(bool tileCompression)
+	{
+		_tileCompression = tileCompression;
+	}
 	void SetTelescopeName(const std::string& telescopeName)
 	{
 		_telescopeName = telescopeName;
@@ -254,6 +266,7 @@ private:
 	PolarizationEnum _polarization;
 	Unit _unit;
 	bool _isUV;
+	bool _tileCompression;
 	std::string _telescopeName, _observer, _objectName;
 	std::string _origin, _originComment;
 	std::vector<std::string> _history;
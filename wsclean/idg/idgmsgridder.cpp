@@ -2,6 +2,7 @@
 
 #include "idgmsgridder.h"
 
+#include <algorithm>
 #include <cmath>
 #include <thread>
 
@@ -26,6 +27,13 @@
 
 #include "idgconfiguration.h"
 
+namespace {
+	// Number of row blocks in each of the pipeline lanes.
+	const size_t pipelineBlockCount = 4;
+	// Approximate size in bytes of the data in a row block.
+	const size_t pipelineBlockSize = 8*1024*1024;
+}
+
 IdgMsGridder::IdgMsGridder(const WSCleanSettings& settings, ImageBufferAllocator& allocator) :
 	_averageBeam(nullptr),
 	_outputProvider(nullptr),
@@ -226,56 +234,161 @@ void IdgMsGridder::gridMeasurementSet(MSGridderBase::MSData& msData)
 	if(!prepareForMeasurementSet(msData, aTermMaker, aTermBuffer, idg::api::BufferSetType::gridding))
 		return;
 	
-	ao::uvector<float> weightBuffer(_selectedBands.MaxChannels()*4);
-	ao::uvector<std::complex<float>> modelBuffer(_selectedBands.MaxChannels()*4);
-	ao::uvector<bool> isSelected(_selectedBands.MaxChannels()*4, true);
-	ao::uvector<std::complex<float>> dataBuffer(_selectedBands.MaxChannels()*4);
-	// The gridder doesn't need to know the absolute time index; this value indexes relatively to where we
-	// start in the measurement set, and only increases when the time changes.
-	int timeIndex = -1;
-	double currentTime = -1.0;
-	ao::uvector<double> uvws(msData.msProvider->NAntennas()*3, 0.0);
-	for(TimestepBuffer timestepBuffer(msData.msProvider, DoSubtractModel()) ; timestepBuffer.CurrentRowAvailable() ; timestepBuffer.NextRow())
-	{
-		MSProvider::MetaData metaData;
-		timestepBuffer.ReadMeta(metaData);
+	// The measurement set is read and the a-terms are calculated by a separate
+	// thread, so that these overlap with the gridding by IDG.
+	const size_t rowSize = _selectedBands.MaxChannels()*4;
+	BlockLane blockLane(pipelineBlockCount), availableBlocks(pipelineBlockCount);
+	initializeBlocks(availableBlocks, rowsPerBlock(), rowSize, true);
+	std::exception_ptr readError;
+	std::thread readThread(&IdgMsGridder::gridReadThread, this, &msData, aTermMaker.get(), &aTermBuffer, &blockLane, &availableBlocks, &readError);
+	
+	try {
+		std::unique_ptr<IDGRowBlock> block;
+		while(blockLane.read(block))
+		{
+			if(block->hasATerms)
+			{
+				const IDGRow& firstRow = block->rows.front();
+				_bufferset->get_gridder(firstRow.dataDescId)->set_aterm(firstRow.timeIndex, block->aTerms.data());
+			}
+			for(size_t i=0; i!=block->rows.size(); ++i)
+			{
+				IDGRow& row = block->rows[i];
+				_bufferset->get_gridder(row.dataDescId)->grid_visibilities(row.timeIndex, row.antenna1, row.antenna2, row.uvw, &block->data[i*rowSize], &block->weights[i*rowSize]);
+			}
+			availableBlocks.write(std::move(block));
+		}
+	} catch(...) {
+		availableBlocks.write_end();
+		readThread.join();
+		throw;
+	}
+	readThread.join();
+	if(readError)
+		std::rethrow_exception(readError);
+	
+	_bufferset->finished();
+}
 
-		if(currentTime != metaData.time)
+void IdgMsGridder::gridReadThread(MSGridderBase::MSData* msData, ATermBase* aTermMaker, ao::uvector<std::complex<float>>* aTermBuffer, BlockLane* outputLane, BlockLane* availableBlocks, std::exception_ptr* error)
+{
+	try {
+		const size_t rowSize = _selectedBands.MaxChannels()*4;
+		const size_t maxRows = rowsPerBlock();
+		ao::uvector<std::complex<float>> modelBuffer(rowSize);
+		ao::uvector<bool> isSelected(rowSize, true);
+		// The gridder doesn't need to know the absolute time index; this value indexes relatively to where we
+		// start in the measurement set, and only increases when the time changes.
+		int timeIndex = -1;
+		double currentTime = -1.0;
+		ao::uvector<double> uvws(msData->msProvider->NAntennas()*3, 0.0);
+		std::unique_ptr<IDGRowBlock> block;
+		if(availableBlocks->read(block))
 		{
-			currentTime = metaData.time;
-			timeIndex++;
-			
-			if(aTermMaker)
+			block->rows.clear();
+			block->hasATerms = false;
+		}
+		for(TimestepBuffer timestepBuffer(msData->msProvider, DoSubtractModel()) ; timestepBuffer.CurrentRowAvailable() && block ; timestepBuffer.NextRow())
+		{
+			MSProvider::MetaData metaData;
+			timestepBuffer.ReadMeta(metaData);
+
+			if(currentTime != metaData.time)
 			{
-				timestepBuffer.GetUVWsForTimestep(uvws);
-				if(aTermMaker->Calculate(aTermBuffer.data(), currentTime, _selectedBands[metaData.dataDescId].CentreFrequency(), metaData.fieldId, uvws.data()))
+				currentTime = metaData.time;
+				timeIndex++;
+				
+				if(aTermMaker)
 				{
-					_bufferset->get_gridder(metaData.dataDescId)->set_aterm(timeIndex, aTermBuffer.data());
-					Logger::Debug << "Calculated a-terms for timestep " << timeIndex << "\n";
+					timestepBuffer.GetUVWsForTimestep(uvws);
+					if(aTermMaker->Calculate(aTermBuffer->data(), currentTime, _selectedBands[metaData.dataDescId].CentreFrequency(), metaData.fieldId, uvws.data()))
+					{
+						// The new a-terms should be set before the rows of this timestep are gridded
+						if(!block->rows.empty())
+						{
+							nextBlock(block, *outputLane, *availableBlocks);
+							if(!block)
+								break;
+						}
+						block->hasATerms = true;
+						block->aTerms.assign(aTermBuffer->begin(), aTermBuffer->end());
+						Logger::Debug << "Calculated a-terms for timestep " << timeIndex << "\n";
+					}
 				}
 			}
+			if(block->rows.size() == maxRows)
+			{
+				nextBlock(block, *outputLane, *availableBlocks);
+				if(!block)
+					break;
+			}
+			
+			const BandData& curBand(_selectedBands[metaData.dataDescId]);
+			const size_t index = block->rows.size();
+			IDGInversionRow rowData;
+			rowData.data = &block->data[index*rowSize];
+			rowData.uvw[0] = metaData.uInM;
+			rowData.uvw[1] = metaData.vInM;
+			rowData.uvw[2] = metaData.wInM;
+			rowData.antenna1 = metaData.antenna1;
+			rowData.antenna2 = metaData.antenna2;
+			rowData.timeIndex = timeIndex;
+			rowData.dataDescId = metaData.dataDescId;
+			readAndWeightVisibilities<4>(timestepBuffer, rowData, curBand, &block->weights[index*rowSize], modelBuffer.data(), isSelected.data());
+
+			IDGRow row;
+			row.uvw[0] = metaData.uInM;
+			row.uvw[1] = -metaData.vInM;  // DEBUG vdtol, flip axis
+			row.uvw[2] = -metaData.wInM;  //
+			row.antenna1 = metaData.antenna1;
+			row.antenna2 = metaData.antenna2;
+			row.timeIndex = timeIndex;
+			row.dataDescId = metaData.dataDescId;
+			row.rowId = 0;
+			block->rows.push_back(row);
 		}
-		const BandData& curBand(_selectedBands[metaData.dataDescId]);
-		IDGInversionRow rowData;
-		
-		rowData.data = dataBuffer.data();
-		rowData.uvw[0] = metaData.uInM;
-		rowData.uvw[1] = metaData.vInM;
-		rowData.uvw[2] = metaData.wInM;
-		
-		rowData.antenna1 = metaData.antenna1;
-		rowData.antenna2 = metaData.antenna2;
-		rowData.timeIndex = timeIndex;
-		rowData.dataDescId = metaData.dataDescId;
-		readAndWeightVisibilities<4>(timestepBuffer, rowData, curBand, weightBuffer.data(), modelBuffer.data(), isSelected.data());
+		if(block && !block->rows.empty())
+			outputLane->write(std::move(block));
+	} catch(...) {
+		*error = std::current_exception();
+	}
+	outputLane->write_end();
+}
 
-		rowData.uvw[1] = -metaData.vInM;  // DEBUG vdtol, flip axis
-		rowData.uvw[2] = -metaData.wInM;  //
+size_t IdgMsGridder::rowsPerBlock() const
+{
+	const size_t rowSize = _selectedBands.MaxChannels()*4*(sizeof(std::complex<float>) + sizeof(float));
+	return std::max<size_t>(1, pipelineBlockSize / rowSize);
+}
 
-		_bufferset->get_gridder(rowData.dataDescId)->grid_visibilities(timeIndex, metaData.antenna1, metaData.antenna2, rowData.uvw, rowData.data, weightBuffer.data());
+void IdgMsGridder::initializeBlocks(BlockLane& availableBlocks, size_t rowsPerBlock, size_t rowSize, bool withWeights)
+{
+	// Each lane holds all blocks at once, so that writing to a lane never waits; the
+	// number of blocks limits how far the threads can run ahead of each other.
+	for(size_t i=0; i!=availableBlocks.capacity(); ++i)
+	{
+		std::unique_ptr<IDGRowBlock> block(new IDGRowBlock());
+		block->rows.reserve(rowsPerBlock);
+		block->firstRow = 0;
+		block->data.resize(rowsPerBlock*rowSize);
+		if(withWeights)
+			block->weights.resize(rowsPerBlock*rowSize);
+		block->hasATerms = false;
+		availableBlocks.write(std::move(block));
+	}
+}
+
+void IdgMsGridder::nextBlock(std::unique_ptr<IDGRowBlock>& block, BlockLane& outputLane, BlockLane& availableBlocks)
+{
+	outputLane.write(std::move(block));
+	if(availableBlocks.read(block))
+	{
+		block->rows.clear();
+		block->hasATerms = false;
+	}
+	else {
+		block.reset();
 	}
-	
-	_bufferset->finished();
 }
 
 void IdgMsGridder::Predict(ImageBufferAllocator::Ptr image)
@@ -420,7 +533,62 @@ void IdgMsGridder::predictMeasurementSet(MSGridderBase::MSData& msData)
 
 	_outputProvider = msData.msProvider;
 	
-	ao::uvector<std::complex<float>> buffer(_selectedBands.MaxChannels()*4);
+	// The meta data is read before the threads are started, because the provider can not
+	// be read while the writing thread writes to it.
+	std::vector<IDGRow> rows;
+	std::vector<IDGTimestep> timesteps;
+	readPredictionRows(msData, aTermMaker != nullptr, rows, timesteps);
+	
+	// The a-terms are calculated by a separate thread, and the predicted visibilities are
+	// written by a writing thread, such that both overlap with the degridding by IDG.
+	const size_t rowSize = _selectedBands.MaxChannels()*4;
+	BlockLane
+		blockLane(pipelineBlockCount), availableBlocks(pipelineBlockCount),
+		writeLane(pipelineBlockCount), availableWriteBlocks(pipelineBlockCount);
+	initializeBlocks(availableBlocks, rowsPerBlock(), 0, false);
+	initializeBlocks(availableWriteBlocks, rowsPerBlock(), rowSize, false);
+	std::exception_ptr blockError, writeError;
+	std::thread blockThread(&IdgMsGridder::predictBlockThread, this, &rows, &timesteps, aTermMaker.get(), &aTermBuffer, &blockLane, &availableBlocks, &blockError);
+	std::thread writeThread(&IdgMsGridder::predictWriteThread, this, &writeLane, &availableWriteBlocks, &writeError);
+	
+	try {
+		std::unique_ptr<IDGRowBlock> block;
+		while(blockLane.read(block))
+		{
+			if(block->hasATerms)
+			{
+				const IDGRow& firstRow = block->rows.front();
+				_bufferset->get_degridder(firstRow.dataDescId)->set_aterm(firstRow.timeIndex, block->aTerms.data());
+			}
+			for(size_t i=0; i!=block->rows.size(); ++i)
+				predictRow(block->rows[i], block->firstRow + i, rows, writeLane, availableWriteBlocks);
+			availableBlocks.write(std::move(block));
+		}
+		blockThread.join();
+		if(blockError)
+			std::rethrow_exception(blockError);
+		
+		for(size_t d=0; d!=_selectedBands.DataDescCount(); ++d)
+			computePredictionBuffer(d, rows, writeLane, availableWriteBlocks);
+	} catch(...) {
+		availableBlocks.write_end();
+		writeLane.write_end();
+		if(blockThread.joinable())
+			blockThread.join();
+		writeThread.join();
+		// A failing writer makes the predicting fail too; its error is the relevant one
+		if(writeError)
+			std::rethrow_exception(writeError);
+		throw;
+	}
+	writeLane.write_end();
+	writeThread.join();
+	if(writeError)
+		std::rethrow_exception(writeError);
+}
+
+void IdgMsGridder::readPredictionRows(MSGridderBase::MSData& msData, bool withATerms, std::vector<IDGRow>& rows, std::vector<IDGTimestep>& timesteps)
+{
 	int timeIndex = -1;
 	double currentTime = -1.0;
 	ao::uvector<double> uvws(msData.msProvider->NAntennas()*3, 0.0);
@@ -429,24 +597,24 @@ void IdgMsGridder::predictMeasurementSet(MSGridderBase::MSData& msData)
 		MSProvider::MetaData metaData;
 		timestepBuffer.ReadMeta(metaData);
 
-		size_t provRowId = timestepBuffer.RowId();
 		if(currentTime != metaData.time)
 		{
 			currentTime = metaData.time;
 			timeIndex++;
 			
-			if(aTermMaker)
+			if(withATerms)
 			{
 				timestepBuffer.GetUVWsForTimestep(uvws);
-				if(aTermMaker->Calculate(aTermBuffer.data(), currentTime, _selectedBands[metaData.dataDescId].CentreFrequency(), metaData.fieldId, uvws.data()))
-				{
-					_bufferset->get_degridder(metaData.dataDescId)->set_aterm(timeIndex, aTermBuffer.data());
-					Logger::Debug << "Calculated new a-terms for timestep " << timeIndex << "\n";
-				}
+				IDGTimestep timestep;
+				timestep.time = currentTime;
+				timestep.fieldId = metaData.fieldId;
+				timestep.dataDescId = metaData.dataDescId;
+				timestep.uvws = uvws;
+				timesteps.push_back(std::move(timestep));
 			}
 		}
 		
-		IDGPredictionRow row;
+		IDGRow row;
 		row.uvw[0] = metaData.uInM;
 		row.uvw[1] = -metaData.vInM;
 		row.uvw[2] = -metaData.wInM;
@@ -454,30 +622,118 @@ void IdgMsGridder::predictMeasurementSet(MSGridderBase::MSData& msData)
 		row.antenna2 = metaData.antenna2;
 		row.timeIndex = timeIndex;
 		row.dataDescId = metaData.dataDescId;
-		row.rowId = provRowId;
-		predictRow(row);
-  }
-	
-	for(size_t d=0; d!=_selectedBands.DataDescCount(); ++d)
-		computePredictionBuffer(d);
+		row.rowId = timestepBuffer.RowId();
+		rows.push_back(row);
+	}
 }
 
-void IdgMsGridder::predictRow(IDGPredictionRow& row)
+void IdgMsGridder::predictBlockThread(const std::vector<IDGRow>* rows, const std::vector<IDGTimestep>* timesteps, ATermBase* aTermMaker, ao::uvector<std::complex<float>>* aTermBuffer, BlockLane* outputLane, BlockLane* availableBlocks, std::exception_ptr* error)
 {
-	while (_bufferset->get_degridder(row.dataDescId)->request_visibilities(row.rowId, row.timeIndex, row.antenna1, row.antenna2, row.uvw))
+	try {
+		const size_t maxRows = rowsPerBlock();
+		size_t timeIndex = 0;
+		std::unique_ptr<IDGRowBlock> block;
+		if(availableBlocks->read(block))
+		{
+			block->rows.clear();
+			block->hasATerms = false;
+		}
+		for(size_t rowIndex=0; rowIndex!=rows->size() && block; ++rowIndex)
+		{
+			const IDGRow& row = (*rows)[rowIndex];
+			if(aTermMaker && (rowIndex == 0 || row.timeIndex != timeIndex))
+			{
+				timeIndex = row.timeIndex;
+				const IDGTimestep& timestep = (*timesteps)[timeIndex];
+				if(aTermMaker->Calculate(aTermBuffer->data(), timestep.time, _selectedBands[timestep.dataDescId].CentreFrequency(), timestep.fieldId, timestep.uvws.data()))
+				{
+					if(!block->rows.empty())
+					{
+						nextBlock(block, *outputLane, *availableBlocks);
+						if(!block)
+							break;
+					}
+					block->hasATerms = true;
+					block->aTerms.assign(aTermBuffer->begin(), aTermBuffer->end());
+					Logger::Debug << "Calculated new a-terms for timestep " << timeIndex << "\n";
+				}
+			}
+			if(block->rows.size() == maxRows)
+			{
+				nextBlock(block, *outputLane, *availableBlocks);
+				if(!block)
+					break;
+			}
+			
+			if(block->rows.empty())
+				block->firstRow = rowIndex;
+			block->rows.push_back(row);
+		}
+		if(block && !block->rows.empty())
+			outputLane->write(std::move(block));
+	} catch(...) {
+		*error = std::current_exception();
+	}
+	outputLane->write_end();
+}
+
+void IdgMsGridder::predictWriteThread(BlockLane* writeLane, BlockLane* availableBlocks, std::exception_ptr* error)
+{
+	try {
+		const size_t rowSize = _selectedBands.MaxChannels()*4;
+		std::unique_ptr<IDGRowBlock> block;
+		while(writeLane->read(block))
+		{
+			for(size_t i=0; i!=block->rows.size(); ++i)
+			{
+				// The v and w of the rows were flipped for IDG
+				const IDGRow& row = block->rows[i];
+				const double uvw[3] = { row.uvw[0], -row.uvw[1], -row.uvw[2] };
+				_outputProvider->WriteModel(row.rowId, &block->data[i*rowSize], uvw);
+			}
+			availableBlocks->write(std::move(block));
+		}
+	} catch(...) {
+		*error = std::current_exception();
+	}
+	// Unblocks the predicting thread when writing failed
+	availableBlocks->write_end();
+}
+
+void IdgMsGridder::predictRow(const IDGRow& row, size_t rowIndex, const std::vector<IDGRow>& rows, BlockLane& writeLane, BlockLane& availableWriteBlocks)
+{
+	while (_bufferset->get_degridder(row.dataDescId)->request_visibilities(rowIndex, row.timeIndex, row.antenna1, row.antenna2, row.uvw))
 	{
-		computePredictionBuffer(row.dataDescId);
+		computePredictionBuffer(row.dataDescId, rows, writeLane, availableWriteBlocks);
 	}
 }
 
-void IdgMsGridder::computePredictionBuffer(size_t dataDescId)
+void IdgMsGridder::computePredictionBuffer(size_t dataDescId, const std::vector<IDGRow>& rows, BlockLane& writeLane, BlockLane& availableWriteBlocks)
 {
 	auto available_row_ids = _bufferset->get_degridder(dataDescId)->compute();
 	Logger::Debug << "Computed " << available_row_ids.size() << " rows.\n";
+	// The results are only valid until finished_reading() is called, so they are copied
+	// into blocks for the writing thread. This allows IDG to continue while the rows are written.
+	const size_t
+		rowSize = _selectedBands.MaxChannels()*4,
+		valueCount = _selectedBands[dataDescId].ChannelCount()*4;
+	std::unique_ptr<IDGRowBlock> block;
 	for(auto i : available_row_ids)
 	{
-		_outputProvider->WriteModel(i.first, i.second);
+		if(!block)
+		{
+			if(!availableWriteBlocks.read(block))
+				throw std::runtime_error("Writing the predicted visibilities failed");
+			block->rows.clear();
+		}
+		// IDG identifies the rows by their index
+		std::copy_n(i.second, valueCount, &block->data[block->rows.size()*rowSize]);
+		block->rows.push_back(rows[i.first]);
+		if(block->rows.size()*rowSize == block->data.size())
+			writeLane.write(std::move(block));
 	}
+	if(block)
+		writeLane.write(std::move(block));
 	_bufferset->get_degridder(dataDescId)->finished_reading();
 }
 
@@ -14,6 +14,9 @@
 
 #include <boost/thread/mutex.hpp>
 
+#include <exception>
+#include <memory>
+
 class IdgMsGridder : public MSGridderBase
 {
 public:
@@ -82,12 +85,59 @@ private:
 	struct IDGInversionRow : public MSGridderBase::InversionRow {
 		size_t antenna1, antenna2, timeIndex;
 	};
-	struct IDGPredictionRow {
+	struct IDGRow {
 		double uvw[3];
 		size_t dataDescId, antenna1, antenna2, timeIndex, rowId;
 	};
-	void predictRow(IDGPredictionRow& row);
-	void computePredictionBuffer(size_t dataDescId);
+	/**
+	 * The meta data of a timestep that is needed to calculate its a-terms.
+	 */
+	struct IDGTimestep {
+		double time;
+		size_t fieldId, dataDescId;
+		ao::uvector<double> uvws;
+	};
+	/**
+	 * A block of consecutive rows that is passed between the thread that reads (or, during
+	 * prediction, prepares) the rows, the thread that calls IDG and the writing thread. The data (and weights) of row i start at
+	 * index i * rowSize. When the a-terms change at the first row of the block,
+	 * hasATerms is set and aTerms holds the new a-terms. During prediction, firstRow
+	 * is the index of the first row of the block in the rows of the measurement set.
+	 */
+	struct IDGRowBlock {
+		std::vector<IDGRow> rows;
+		size_t firstRow;
+		ao::uvector<std::complex<float>> data;
+		ao::uvector<float> weights;
+		bool hasATerms;
+		ao::uvector<std::complex<float>> aTerms;
+	};
+	typedef ao::lane<std::unique_ptr<IDGRowBlock>> BlockLane;
+	
+	size_t rowsPerBlock() const;
+	static void initializeBlocks(BlockLane& availableBlocks, size_t rowsPerBlock, size_t rowSize, bool withWeights);
+	/**
+	 * Sends a block to the output lane and takes an empty block from the available blocks.
+	 * If no more blocks are available, block is set to nullptr.
+	 */
+	static void nextBlock(std::unique_ptr<IDGRowBlock>& block, BlockLane& outputLane, BlockLane& availableBlocks);
+	
+	void gridReadThread(MSGridderBase::MSData* msData, ATermBase* aTermMaker, ao::uvector<std::complex<float>>* aTermBuffer, BlockLane* outputLane, BlockLane* availableBlocks, std::exception_ptr* error);
+	/**
+	 * Reads the meta data of all rows, and of all timesteps when a-terms are used. This is
+	 * done before the prediction starts, such that the provider is not read while the
+	 * writing thread writes to it.
+	 */
+	void readPredictionRows(MSGridderBase::MSData& msData, bool withATerms, std::vector<IDGRow>& rows, std::vector<IDGTimestep>& timesteps);
+	void predictBlockThread(const std::vector<IDGRow>* rows, const std::vector<IDGTimestep>* timesteps, ATermBase* aTermMaker, ao::uvector<std::complex<float>>* aTermBuffer, BlockLane* outputLane, BlockLane* availableBlocks, std::exception_ptr* error);
+	void predictWriteThread(BlockLane* writeLane, BlockLane* availableBlocks, std::exception_ptr* error);
+	
+	/**
+	 * The rows are identified to IDG by their index in the rows of the measurement set,
+	 * so that the predicted rows can be matched with their meta data.
+	 */
+	void predictRow(const IDGRow& row, size_t rowIndex, const std::vector<IDGRow>& rows, BlockLane& writeLane, BlockLane& availableWriteBlocks);
+	void computePredictionBuffer(size_t dataDescId, const std::vector<IDGRow>& rows, BlockLane& writeLane, BlockLane& availableWriteBlocks);
 	
 	std::unique_ptr<idg::api::BufferSet> _bufferset;
 	size_t _subgridSize;
@@ -8,6 +8,7 @@
 #include "wsclean/logger.h"
 
 #include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <cstring>
 
@@ -389,6 +390,32 @@ void ImageWeights::Save(const string& filename) const
 	writer.Write(filename, image.data());
 }
 
+void ImageWeights::Serialize(std::ostream& stream) const
+{
+	const uint64_t dimensions[2] = { _imageWidth, _imageHeight };
+	stream.write(reinterpret_cast<const char*>(dimensions), sizeof(dimensions));
+	stream.write(reinterpret_cast<const char*>(&_totalSum), sizeof(double));
+	stream.write(reinterpret_cast<const char*>(_grid.data()), _grid.size() * sizeof(double));
+}
+
+bool ImageWeights::Unserialize(std::istream& stream)
+{
+	uint64_t dimensions[2];
+	stream.read(reinterpret_cast<char*>(dimensions), sizeof(dimensions));
+	if(!stream || dimensions[0] != _imageWidth || dimensions[1] != _imageHeight)
+		return false;
+	double totalSum;
+	stream.read(reinterpret_cast<char*>(&totalSum), sizeof(double));
+	ao::uvector<double> grid(_grid.size());
+	stream.read(reinterpret_cast<char*>(grid.data()), grid.size() * sizeof(double));
+	if(!stream)
+		return false;
+	_totalSum = totalSum;
+	_grid = std::move(grid);
+	_isGriddingFinished = true;
+	return true;
+}
+
 void ImageWeights::RankFilter(double rankLimit, size_t windowSize)
 {
 	ao::uvector<double> newGrid(_grid);
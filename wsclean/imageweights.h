@@ -3,6 +3,7 @@
 
 #include <cstddef>
 #include <complex>
+#include <iosfwd>
 
 #include <casacore/ms/MeasurementSets/MeasurementSet.h>
 
@@ -49,6 +50,24 @@ class ImageWeights
 		void GetGrid(double* image) const;
 		void Save(const std::string& filename) const;
 		
+		/**
+		 * Write the finished weight grid in binary form, such that it can be
+		 * restored with @ref Unserialize().
+		 */
+		void Serialize(std::ostream& stream) const;
+		
+		/**
+		 * Restore a weight grid that was written with @ref Serialize(). The weights should
+		 * have been constructed with the same settings.
+		 * @returns @c false if the stream holds no grid of the right size.
+		 */
+		bool Unserialize(std::istream& stream);
+		
+		/**
+		 * Number of bytes used by the weight grid.
+		 */
+		size_t GridSizeInBytes() const { return _grid.size() * sizeof(double); }
+		
 		void RankFilter(double rankLimit, size_t windowSize);
 		
 		size_t Width() const { return _imageWidth; }
@@ -63,7 +63,7 @@ PyObject* setException(const char* c)
 	return NULL;
 }
 
-static PyObject* wsclean_initialize_func(PyObject* self, PyObject* args)
+static PyObject* initialize(PyObject* args, int inMemorySession)
 {
 	PyObject *parameters;
   int ok = PyArg_ParseTuple(args, "O", &parameters);
@@ -94,7 +94,10 @@ static PyObject* wsclean_initialize_func(PyObject* self, PyObject* args)
 
 	void *userData;
 	imaging_data d;
-	wsclean_initialize(&userData, &p, &d);
+	if(inMemorySession)
+		wsclean_initialize_session(&userData, &p, &d);
+	else
+		wsclean_initialize(&userData, &p, &d);
 	
 	PyObject* capsule = PyCapsule_New(userData, "pywsclean.userdata", NULL);
 	
@@ -117,6 +120,16 @@ static PyObject* wsclean_initialize_func(PyObject* self, PyObject* args)
 	return Py_BuildValue("OO", capsule, imagingDataObj);
 }
 
+static PyObject* wsclean_initialize_func(PyObject* self, PyObject* args)
+{
+	return initialize(args, 0);
+}
+
+static PyObject* wsclean_initialize_session_func(PyObject* self, PyObject* args)
+{
+	return initialize(args, 1);
+}
+
 static PyObject* wsclean_deinitialize_func(PyObject* self, PyObject* args)
 {
 	PyObject *pyUserData;
@@ -225,6 +238,7 @@ static PyObject* wsclean_operator_At_func(PyObject* self, PyObject* args)
 
 static PyMethodDef WSCleanMethods[] = {
  { "initialize", wsclean_initialize_func, METH_VARARGS, "Initialize the WSClean interface" },
+ { "initialize_session", wsclean_initialize_session_func, METH_VARARGS, "Initialize the WSClean interface, keeping the data in memory" },
  { "deinitialize", wsclean_deinitialize_func, METH_VARARGS, "Deinitialize the WSClean interface" },
  { "read", wsclean_read_func, METH_VARARGS, "Read the initial data (visibilities) from disk" },
  { "write", wsclean_write_func, METH_VARARGS, "Write an image result to disk" },
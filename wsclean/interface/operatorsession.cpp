@@ -0,0 +1,183 @@
+#include "operatorsession.h"
+
+#include "../banddata.h"
+#include "../fitswriter.h"
+#include "../image.h"
+#include "../msselection.h"
+
+#include "../wsclean/logger.h"
+#include "../wsclean/msgridderbase.h"
+
+#include <casacore/ms/MeasurementSets/MeasurementSet.h>
+
+#include <cmath>
+
+namespace {
+	size_t paddedSize(size_t size)
+	{
+		// Same default padding as WSClean uses for imaging
+		size_t padded = std::ceil(size * 1.2);
+		if(padded%2 != 0)
+			++padded;
+		return padded;
+	}
+}
+
+OperatorSession::OperatorSession(const std::string& msPath, size_t width, size_t height, double pixelScaleX, double pixelScaleY, bool normalize, size_t threadCount) :
+	_width(width), _height(height),
+	_paddedWidth(paddedSize(width)), _paddedHeight(paddedSize(height)),
+	_pixelScaleX(pixelScaleX), _pixelScaleY(pixelScaleY),
+	_normalize(normalize),
+	_rowCount(0),
+	_phaseCentreRA(0.0), _phaseCentreDec(0.0), _phaseCentreDL(0.0), _phaseCentreDM(0.0),
+	_weightSum(0.0),
+	_gridder(_paddedWidth, _paddedHeight, width, height, pixelScaleX, pixelScaleY, threadCount)
+{
+	readMeasurementSet(msPath);
+	_visBuffer.resize(DataSize());
+}
+
+void OperatorSession::readMeasurementSet(const std::string& msPath)
+{
+	casacore::MeasurementSet ms(msPath);
+	MSGridderBase::GetPhaseCentreInfo(ms, MSSelection::ALL_FIELDS, _phaseCentreRA, _phaseCentreDec, _phaseCentreDL, _phaseCentreDM);
+	BandData bandData(ms.spectralWindow());
+	const size_t nChannels = bandData.ChannelCount();
+	_frequencies.resize(nChannels);
+	for(size_t ch=0; ch!=nChannels; ++ch)
+		_frequencies[ch] = bandData.ChannelFrequency(ch);
+
+	const std::string dataColumnName = ms.tableDesc().isColumn("CORRECTED_DATA") ? "CORRECTED_DATA" : "DATA";
+	Logger::Info << "Reading " << dataColumnName << " column of " << msPath << " into memory...\n";
+	casacore::ScalarColumn<int> a1Col(ms, casacore::MeasurementSet::columnName(casacore::MSMainEnums::ANTENNA1));
+	casacore::ScalarColumn<int> a2Col(ms, casacore::MeasurementSet::columnName(casacore::MSMainEnums::ANTENNA2));
+	casacore::ArrayColumn<double> uvwCol(ms, casacore::MeasurementSet::columnName(casacore::MSMainEnums::UVW));
+	casacore::ArrayColumn<casacore::Complex> dataCol(ms, dataColumnName);
+	casacore::ArrayColumn<float> weightCol(ms, casacore::MeasurementSet::columnName(casacore::MSMainEnums::WEIGHT_SPECTRUM));
+	casacore::ArrayColumn<bool> flagCol(ms, casacore::MeasurementSet::columnName(casacore::MSMainEnums::FLAG));
+
+	_rowCount = 0;
+	for(size_t row=0; row!=ms.nrow(); ++row)
+	{
+		if(a1Col(row) != a2Col(row))
+			++_rowCount;
+	}
+	_uvw.resize(_rowCount * 3);
+	_data.resize(_rowCount * nChannels);
+	_weights.resize(_rowCount * nChannels);
+
+	casacore::IPosition shape = dataCol.shape(0);
+	const size_t polarizationCount = shape[0];
+	casacore::Array<casacore::Complex> dataArr(shape);
+	casacore::Array<bool> flagArr(shape);
+	casacore::Array<float> weightArr(shape);
+	casacore::Array<double> uvwArr(casacore::IPosition(1, 3));
+	size_t selectedRow = 0;
+	_weightSum = 0.0;
+	for(size_t row=0; row!=ms.nrow(); ++row)
+	{
+		if(a1Col(row) != a2Col(row))
+		{
+			uvwCol.get(row, uvwArr);
+			std::copy(uvwArr.cbegin(), uvwArr.cend(), &_uvw[selectedRow * 3]);
+			dataCol.get(row, dataArr);
+			flagCol.get(row, flagArr);
+			weightCol.get(row, weightArr);
+
+			casacore::Array<casacore::Complex>::const_contiter di = dataArr.cbegin();
+			casacore::Array<bool>::const_contiter fi = flagArr.cbegin();
+			casacore::Array<float>::const_contiter wi = weightArr.cbegin();
+			std::complex<float>* dataPtr = &_data[selectedRow * nChannels];
+			float* weightPtr = &_weights[selectedRow * nChannels];
+			for(size_t ch=0; ch!=nChannels; ++ch)
+			{
+				std::complex<float> val = 0.5f*(*di + *(di+polarizationCount-1));
+				float weight = 0.5f*(*wi + *(wi+polarizationCount-1));
+				bool flag = *fi || *(fi+polarizationCount-1);
+				if(flag || !std::isfinite(val.real()) || !std::isfinite(val.imag()))
+				{
+					val = 0.0;
+					weight = 0.0;
+				}
+				dataPtr[ch] = val;
+				weightPtr[ch] = weight;
+				_weightSum += weight;
+
+				di += polarizationCount;
+				fi += polarizationCount;
+				wi += polarizationCount;
+			}
+			++selectedRow;
+		}
+	}
+}
+
+void OperatorSession::Read(std::complex<double>* data, double* weights) const
+{
+	for(size_t i=0; i!=DataSize(); ++i)
+	{
+		data[i] = _data[i];
+		weights[i] = _weights[i];
+	}
+}
+
+void OperatorSession::OperatorA(std::complex<double>* dataOut, const double* image)
+{
+	std::vector<float> paddedImage(_paddedWidth * _paddedHeight, 0.0);
+	const size_t
+		startX = (_paddedWidth - _width) / 2,
+		startY = (_paddedHeight - _height) / 2;
+	for(size_t y=0; y!=_height; ++y)
+	{
+		float* row = &paddedImage[(y + startY) * _paddedWidth + startX];
+		const double* inputRow = &image[y * _width];
+		for(size_t x=0; x!=_width; ++x)
+			row[x] = std::isfinite(inputRow[x]) ? inputRow[x] : 0.0;
+	}
+	_gridder.InitializePrediction(std::move(paddedImage));
+	_gridder.PredictVisibilities(_rowCount, _frequencies.size(), _uvw.data(), _frequencies.data(), _visBuffer.data());
+	for(size_t i=0; i!=DataSize(); ++i)
+		dataOut[i] = _visBuffer[i];
+}
+
+void OperatorSession::OperatorAt(double* imageOut, const std::complex<double>* data)
+{
+	for(size_t i=0; i!=DataSize(); ++i)
+	{
+		// Zero visibilities are skipped by the gridder
+		if(_weights[i] == 0.0 || !std::isfinite(data[i].real()) || !std::isfinite(data[i].imag()))
+			_visBuffer[i] = 0.0;
+		else
+			_visBuffer[i] = std::complex<float>(data[i] * double(_weights[i]));
+	}
+	_gridder.InitializeInversion();
+	_gridder.AddInversionData(_rowCount, _frequencies.size(), _uvw.data(), _frequencies.data(), _visBuffer.data());
+	double factor = 1.0;
+	if(_normalize && _weightSum != 0.0)
+		factor = 1.0 / _weightSum;
+	_gridder.FinalizeImage(factor, false);
+	std::vector<float> paddedImage = _gridder.RealImage();
+	const size_t
+		startX = (_paddedWidth - _width) / 2,
+		startY = (_paddedHeight - _height) / 2;
+	for(size_t y=0; y!=_height; ++y)
+	{
+		const float* row = &paddedImage[(y + startY) * _paddedWidth + startX];
+		std::copy_n(row, _width, &imageOut[y * _width]);
+	}
+}
+
+void OperatorSession::Write(const std::string& filename, const double* image) const
+{
+	FitsWriter writer;
+	writer.SetImageDimensions(_width, _height, _phaseCentreRA, _phaseCentreDec, _pixelScaleX, _pixelScaleY);
+	writer.SetPhaseCentreShift(_phaseCentreDL, _phaseCentreDM);
+	if(!_frequencies.empty())
+	{
+		double
+			lowest = *std::min_element(_frequencies.begin(), _frequencies.end()),
+			highest = *std::max_element(_frequencies.begin(), _frequencies.end());
+		writer.SetFrequency(0.5 * (lowest + highest), highest - lowest);
+	}
+	writer.Write(filename, image);
+}
@@ -0,0 +1,73 @@
+#ifndef OPERATOR_SESSION_H
+#define OPERATOR_SESSION_H
+
+#include "../uvector.h"
+
+#include "../wgridder/wgriddinggridder_simple.h"
+
+#include <complex>
+#include <string>
+
+/**
+ * Keeps everything that is needed to apply the imaging operators in memory, such that
+ * the operators can be applied many times without disk access. This is used by the
+ * C interface when a session is requested with @ref wsclean_initialize_session().
+ *
+ * On construction, the uvw coordinates, visibilities and weights of all cross-correlations
+ * are read from the measurement set once. The operators then directly grid / degrid
+ * the caller's buffers with the w-gridder. Like the file-based operators, the
+ * visibilities are the average of the first and last polarization (i.e., Stokes I
+ * for XX/YY or RR/LL data). Natural weighting is applied using the visibility weights.
+ */
+class OperatorSession
+{
+public:
+	OperatorSession(const std::string& msPath, size_t width, size_t height, double pixelScaleX, double pixelScaleY, bool normalize, size_t threadCount);
+
+	OperatorSession(const OperatorSession&) = delete;
+	OperatorSession& operator=(const OperatorSession&) = delete;
+
+	/**
+	 * Number of visibilities: nr. of selected rows x nr. of channels.
+	 */
+	size_t DataSize() const { return _rowCount * _frequencies.size(); }
+
+	/**
+	 * Copy the visibilities and weights that were read on construction. Weights of
+	 * flagged and non-finite visibilities are zero.
+	 */
+	void Read(std::complex<double>* data, double* weights) const;
+
+	/**
+	 * Predict visibilities from an image of width x height.
+	 */
+	void OperatorA(std::complex<double>* dataOut, const double* image);
+
+	/**
+	 * Make a weighted dirty image of width x height from the given visibilities.
+	 */
+	void OperatorAt(double* imageOut, const std::complex<double>* data);
+
+	/**
+	 * Write an image to a fits file, with the coordinates of the observation.
+	 */
+	void Write(const std::string& filename, const double* image) const;
+
+private:
+	void readMeasurementSet(const std::string& msPath);
+
+	size_t _width, _height, _paddedWidth, _paddedHeight;
+	double _pixelScaleX, _pixelScaleY;
+	bool _normalize;
+	size_t _rowCount;
+	double _phaseCentreRA, _phaseCentreDec, _phaseCentreDL, _phaseCentreDM;
+	double _weightSum;
+	ao::uvector<double> _uvw, _frequencies;
+	ao::uvector<std::complex<float>> _data;
+	ao::uvector<float> _weights;
+	/** Scratch buffer for the visibilities that are passed to the gridder. */
+	ao::uvector<std::complex<float>> _visBuffer;
+	WGriddingGridder_Simple _gridder;
+};
+
+#endif
@@ -22,20 +22,28 @@ class ImagingData(object):
 	
 class Operator(object):
 	"""Class that wraps WSClean as an operator, so that it is easy
-	to get an image from data 'in memory' (and the inverse). Currently, the
+	to get an image from data 'in memory' (and the inverse). By default, the
 	operator will write that data to the MODEL_DATA Measurement Set before imaging.
+	When in_memory is True, the visibilities are kept in memory and gridded
+	directly, which is much faster but ignores the extraParameters and always
+	uses natural weighting.
 	The read/write/backward/forward methods can only be used within a "with" context."""
 	_userdata = None;
 	_parameters = None;
 	_imagingdata = None;
+	_inmemory = False;
 	
-	def __init__(self, parameters):
+	def __init__(self, parameters, in_memory=False):
 		"""Constructor: only sets parameters"""
 		self._parameters = parameters
+		self._inmemory = in_memory
 	
 	def __enter__(self):
 		"""Context manager entrance: initialize WSClean"""
-		self._userdata,self._imagingdata = _wsclean.initialize(self._parameters)
+		if self._inmemory:
+			self._userdata,self._imagingdata = _wsclean.initialize_session(self._parameters)
+		else:
+			self._userdata,self._imagingdata = _wsclean.initialize(self._parameters)
 		return self
 	
 	def __exit__(self, type, value, traceback):
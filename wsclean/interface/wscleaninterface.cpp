@@ -1,7 +1,9 @@
 #include "wscleaninterface.h"
+#include "operatorsession.h"
 
 #include "../wsclean/commandline.h"
 
+#include <memory>
 #include <string>
 
 #include <casacore/ms/MeasurementSets/MeasurementSet.h>
@@ -13,6 +15,7 @@
 #include "../banddata.h"
 #include "../fitsreader.h"
 #include "../fitswriter.h"
+#include "../system.h"
 
 #include "../wsclean/wsclean.h"
 
@@ -29,6 +32,9 @@ struct WSCleanUserData
 	std::string dataColumn;
 	size_t nACalls, nAtCalls;
 	
+	/** Only set when initialized with wsclean_initialize_session() */
+	std::unique_ptr<OperatorSession> session;
+	
 	boost::mutex mutex;
 };
 
@@ -108,12 +114,47 @@ void wsclean_initialize(
 	}
 }
 
+void wsclean_initialize_session(
+	void** userData,
+	const imaging_parameters* parameters,
+	imaging_data* imgData
+)
+{
+	WSCleanUserData* wscUserData = new WSCleanUserData();
+	boost::mutex::scoped_lock lock(wscUserData->mutex);
+	
+	wscUserData->msPath = parameters->msPath;
+	wscUserData->width = parameters->imageWidth;
+	wscUserData->height = parameters->imageHeight;
+	wscUserData->pixelScaleX = parameters->pixelScaleX;
+	wscUserData->pixelScaleY = parameters->pixelScaleY;
+	wscUserData->nACalls = 0;
+	wscUserData->nAtCalls = 0;
+	wscUserData->doNormalize = parameters->doNormalize;
+	try {
+		wscUserData->session.reset(new OperatorSession(wscUserData->msPath,
+			wscUserData->width, wscUserData->height,
+			wscUserData->pixelScaleX, wscUserData->pixelScaleY,
+			wscUserData->doNormalize != 0, System::ProcessorCount()));
+	} catch(...) {
+		lock.unlock();
+		delete wscUserData;
+		throw;
+	}
+	(*userData) = static_cast<void*>(wscUserData);
+	
+	imgData->dataSize = wscUserData->session->DataSize();
+	imgData->lhs_data_type = imaging_data::DATA_TYPE_COMPLEX_DOUBLE;
+	imgData->rhs_data_type = imaging_data::DATA_TYPE_DOUBLE;
+}
+
 void wsclean_deinitialize(void* userData)
 {
 	WSCleanUserData* wscUserData = static_cast<WSCleanUserData*>(userData);
 	boost::mutex::scoped_lock lock(wscUserData->mutex);
-	if(wscUserData->nAtCalls != 0)
+	if(wscUserData->nAtCalls != 0 && !wscUserData->session)
 		std::remove("tmp-operator-At-0-image.fits");
+	lock.unlock();
 		
 	delete wscUserData;
 }
@@ -123,6 +164,12 @@ void wsclean_read(void* userData, DCOMPLEX* data, double* weights)
 	WSCleanUserData* wscUserData = static_cast<WSCleanUserData*>(userData);
 	boost::mutex::scoped_lock lock(wscUserData->mutex);
 	
+	if(wscUserData->session)
+	{
+		wscUserData->session->Read(data, weights);
+		return;
+	}
+	
 	casacore::MeasurementSet ms(wscUserData->msPath);
 	BandData bandData(ms.spectralWindow());
 	size_t nChannels = bandData.ChannelCount();
@@ -185,6 +232,11 @@ void wsclean_write(void* userData, const char* filename, const double* image)
 	boost::mutex::scoped_lock lock(wscUserData->mutex);
 	
 	std::cout << "wsclean_write() : Writing " << filename << "...\n";
+	if(wscUserData->session)
+	{
+		wscUserData->session->Write(filename, image);
+		return;
+	}
 	FitsWriter writer;
 	writer.SetImageDimensions(wscUserData->width, wscUserData->height, wscUserData->pixelScaleX, wscUserData->pixelScaleY);
 	if(wscUserData->nAtCalls != 0)
@@ -229,6 +281,13 @@ void wsclean_operator_A(void* userData, DCOMPLEX* dataOut, const double* dataIn)
 	WSCleanUserData* wscUserData = static_cast<WSCleanUserData*>(userData);
 	boost::mutex::scoped_lock lock(wscUserData->mutex);
 	
+	if(wscUserData->session)
+	{
+		wscUserData->session->OperatorA(dataOut, dataIn);
+		++(wscUserData->nACalls);
+		return;
+	}
+	
 	std::cout << "------ wsclean_operator_A(), image: " << wscUserData->width << " x " << wscUserData->height << ", pixelscale=" << Angle::ToNiceString(wscUserData->pixelScaleX) << "," << Angle::ToNiceString(wscUserData->pixelScaleY) << '\n';
 	
 	// Remove non-finite values
@@ -313,6 +372,13 @@ void wsclean_operator_At(void* userData, double* dataOut, const DCOMPLEX* dataIn
 	WSCleanUserData* wscUserData = static_cast<WSCleanUserData*>(userData);
 	boost::mutex::scoped_lock lock(wscUserData->mutex);
 	
+	if(wscUserData->session)
+	{
+		wscUserData->session->OperatorAt(dataOut, dataIn);
+		++(wscUserData->nAtCalls);
+		return;
+	}
+	
 	// Write dataIn to the MODEL_DATA column
 	std::cout << "------ wsclean_operator_At(), image: " << wscUserData->width << " x " << wscUserData->height << ", pixelscale=" << Angle::ToNiceString(wscUserData->pixelScaleX) << "," << Angle::ToNiceString(wscUserData->pixelScaleY) << '\n';
 	casacore::MeasurementSet ms(wscUserData->msPath, casacore::Table::Update);
@@ -25,8 +25,10 @@
  * accomplished by using a global lock, such that this will actually not speed up
  * processing.
  * 
- * @todo Currently, these methods write the visibilities to disk before performing the
- * imaging or prediction operation. This is unnecessary overhead.
+ * When initialized with @ref wsclean_initialize(), these methods write the visibilities
+ * to disk before performing the imaging or prediction operation. To avoid this overhead,
+ * @ref wsclean_initialize_session() can be called instead, which keeps the data in memory
+ * and grids directly from the buffers of the caller.
  */
 
 /**
@@ -69,6 +71,28 @@ void wsclean_initialize(
 	imaging_data* imgData
 );
 
+/**
+ * Initialize WSClean like @ref wsclean_initialize(), but keep the uvw coordinates,
+ * visibilities and weights in memory for the remainder of the session. The operator
+ * functions then grid / degrid the caller's buffers directly with the w-gridder, without
+ * writing temporary fits files or measurement set columns and without running a full
+ * WSClean imaging run per call. This makes repeated operator calls much faster.
+ * 
+ * In a session, natural weighting is used and the extraParameters of the
+ * @ref imaging_parameters are ignored. The other functions of this interface are used
+ * in the same way as after @ref wsclean_initialize().
+ * 
+ * @param userData should be a pointer to a void pointer which will be set to
+ * a structure that WSClean internally uses.
+ * @param parameters domain specific information, containing the measurement set.
+ * @param imgData will be filled with info describing the data.
+ */
+void wsclean_initialize_session(
+	void** userData,
+	const imaging_parameters* parameters,
+	imaging_data* imgData
+);
+
 /**
  * Release all resources. After this call, the userData should no longer be used.
  * Every call to @ref wsclean_initialize() should be followed by a call to 
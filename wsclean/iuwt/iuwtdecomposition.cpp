@@ -2,286 +2,194 @@
 
 #include "../threadpool.h"
 
-void IUWTDecomposition::DecomposeMT(ThreadPool& threadPool, const double* input, double* scratch, bool includeLargest)
-{
-	ao::uvector<double>
-		&i1(_scales.back().Coefficients());
-	i1.resize(_width*_height);
-	
-	// The first iteration of the loop, unrolled, so that we don't have to
-	// copy the input into i0.
-	ao::uvector<double>& coefficients0 = _scales[0].Coefficients();
-	coefficients0.resize(_width*_height);
-	convolveMT(threadPool, i1.data(), input, scratch, _width, _height, 1);
-	convolveMT(threadPool, coefficients0.data(), i1.data(), scratch, _width, _height, 1);
-	
-	// coefficients = i0 - i2
-	differenceMT(threadPool, coefficients0.data(), input, coefficients0.data(), _width, _height);
-	
-	// i0 = i1;
-	ao::uvector<double>	i0(i1);
-	
-	for(int scale=1; scale!=int(_scaleCount); ++scale)
-	{
-		ao::uvector<double>& coefficients = _scales[scale].Coefficients();
-		coefficients.resize(_width*_height);
-		convolveMT(threadPool, i1.data(), i0.data(), scratch, _width, _height, scale+1);
-		convolveMT(threadPool, coefficients.data(), i1.data(), scratch, _width, _height, scale+1);
-		
-		// coefficients = i0 - i2
-		differenceMT(threadPool, coefficients.data(), i0.data(), coefficients.data(), _width, _height);
-		
-		// i0 = i1;
-		if(scale+1 != int(_scaleCount))
-			memcpy(i0.data(), i1.data(), sizeof(double)*_width*_height);
-	}
-	
-	// The largest (residual) scales are in i1, but since the
-	// largest scale is aliased to i1, it's already stored there.
-	// Hence we can skip this:
-	//if(includeLargest)
-	//	_scales.back().Coefficients() = i1;
-	
-	// Do free the memory of the largest scale if it is not necessary:
-	if(!includeLargest)
-		ao::uvector<double>().swap(_scales.back().Coefficients());
-}
+#include "../deconvolution/simdkernels.h"
 
-void IUWTDecomposition::convolveMT(ThreadPool& threadPool, double* output, const double* image, double* scratch, size_t width, size_t height, int scale)
-{
-	ConvolveHorizontalPartialFunc hFunc;
-	hFunc._output = scratch;
-	hFunc._image = image;
-	hFunc._width = width;
-	hFunc._scale = scale;
-	for(size_t t=0; t!=threadPool.size(); ++t)
-	{
-		hFunc._startY = (height * t) / threadPool.size();
-		hFunc._endY = (height * (t+1)) / threadPool.size();
-		threadPool.queue(hFunc);
-	}
-	threadPool.wait_for_all_tasks();
+#include <algorithm>
+
+namespace {
+	const double bSpline[5] = { 1.0/16.0, 4.0/16.0, 6.0/16.0, 4.0/16.0, 1.0/16.0 };
 	
-	ConvolveVerticalPartialFunc vFunc;
-	vFunc._output = output;
-	vFunc._image = scratch;
-	vFunc._width = width;
-	vFunc._height = height;
-	vFunc._scale = scale;
-	for(size_t t=0; t!=threadPool.size(); ++t)
+	/**
+	 * Calls func(startY, endY) for a strip of rows per thread, and waits for them.
+	 */
+	template<typename Func>
+	void forEachRowStrip(ThreadPool& threadPool, size_t height, Func func)
 	{
-		vFunc._startX = (width * t) / threadPool.size();
-		vFunc._endX = (width * (t+1)) / threadPool.size();
-		threadPool.queue(vFunc);
+		const size_t nThreads = std::min(threadPool.size(), height);
+		for(size_t t=0; t!=nThreads; ++t)
+		{
+			const size_t
+				startY = (height * t) / nThreads,
+				endY = (height * (t+1)) / nThreads;
+			threadPool.queue([startY, endY, &func]() { func(startY, endY); });
+		}
+		threadPool.wait_for_all_tasks();
 	}
-	threadPool.wait_for_all_tasks();
 }
 
-void IUWTDecomposition::differenceMT(class ThreadPool& threadPool, double* dest, const double* lhs, const double* rhs, size_t width, size_t height)
+void IUWTDecomposition::DecomposeMT(ThreadPool& threadPool, const double* input, double* scratch, bool includeLargest, int minScale)
 {
-	DifferencePartialFunc func;
-	func._dest = dest;
-	func._lhs = lhs;
-	func._rhs = rhs;
-	func._width = width;
-	for(size_t t=0; t!=threadPool.size(); ++t)
+	const size_t size = _width*_height;
+	const int scaleCount = _scaleCount;
+	
+	// The intermediate images i0 (the input of a scale) and i1 (the smoothed input)
+	// alternate between these two buffers, such that the last i1 ends up in the largest scale.
+	ao::uvector<double>& largest = _scales.back().Coefficients();
+	largest.resize(size);
+	_work.other.resize(size);
+	double* i1 = (scaleCount%2 == 1) ? largest.data() : _work.other.data();
+	double* nextI1 = (scaleCount%2 == 1) ? _work.other.data() : largest.data();
+	const double* i0 = input;
+	
+	// The horizontally convolved images. The scratch buffer can't be used when the
+	// input is stored in it.
+	double* horizontalA = scratch;
+	if(scratch == input)
 	{
-		func._startY = (height * t) / threadPool.size();
-		func._endY = (height * (t+1)) / threadPool.size();
-		threadPool.queue(func);
+		_work.horizontalA.resize(size);
+		horizontalA = _work.horizontalA.data();
 	}
-	threadPool.wait_for_all_tasks();
-}
-
-void IUWTDecomposition::convolveHorizontalFast(double* output, const double* image, size_t width, size_t height, int scale)
-{
-	const size_t H_SIZE = 5;
-	const double h[H_SIZE] = { 1.0/16.0, 4.0/16.0, 6.0/16.0, 4.0/16.0, 1.0/16.0 };
-	int scaleDist = (1 << scale);
-	int dist[H_SIZE];
-	size_t minX[H_SIZE], maxX[H_SIZE];
-	for(int hIndex=0; hIndex!=H_SIZE; ++hIndex)
+	_work.horizontalB.resize(size);
+	double* horizontalB = _work.horizontalB.data();
+	_work.zeroRow.assign(_width, 0.0);
+	const ao::uvector<double>& zeroRow = _work.zeroRow;
+	
+	// horizontalA = input (x) horizontal kernel
+	const size_t firstDist = tapDistance(1);
+	forEachRowStrip(threadPool, _height, [&](size_t startY, size_t endY)
 	{
-		int hShift = hIndex - H_SIZE / 2;
-		dist[hIndex] = (scaleDist-1)*hShift;
-		minX[hIndex] = std::max<int>(0, -dist[hIndex]);
-		maxX[hIndex] = std::min<int>(width, width - dist[hIndex]);
-	}
-	for(size_t y=0; y!=height; ++y)
+		for(size_t y=startY; y!=endY; ++y)
+			convolveRowHorizontal(&horizontalA[y*_width], &i0[y*_width], _width, firstDist);
+	});
+	
+	for(int scale=0; scale!=scaleCount; ++scale)
 	{
-		double* outputPtr = &output[y * width];
-		const double* inputPtr = &image[y * width];
-		
-		for(size_t x=0; x!=minX[1]; ++x)
+		const size_t dist = tapDistance(scale+1);
+		const bool hasNextScale = scale+1 != scaleCount;
+		const size_t nextDist = hasNextScale ? tapDistance(scale+2) : 0;
+		auto verticalRows = [&](const double* image, size_t y, const double** rows)
 		{
-			outputPtr[x] = inputPtr[x + dist[2]] * h[2]
-				+ inputPtr[x + dist[3]] * h[3]
-				+ inputPtr[x + dist[4]] * h[4];
-		}
-		
-		for(size_t x=minX[1]; x!=minX[0]; ++x)
-		{
-			outputPtr[x] = inputPtr[x + dist[2]] * h[2]
-				+ inputPtr[x + dist[1]] * h[1]
-				+ inputPtr[x + dist[3]] * h[3]
-				+ inputPtr[x + dist[4]] * h[4];
-		}
+			for(int k=0; k!=5; ++k)
+			{
+				const long rowY = long(y) + (k-2)*long(dist);
+				if(rowY < 0 || rowY >= long(_height))
+					rows[k] = zeroRow.data();
+				else
+					rows[k] = &image[rowY*_width];
+			}
+		};
 		
-		for(size_t x=minX[0]; x!=maxX[4]; ++x)
+		if(scale < minScale)
 		{
-			outputPtr[x] = inputPtr[x + dist[2]] * h[2]
-				+ inputPtr[x + dist[1]] * h[1]
-				+ inputPtr[x + dist[0]] * h[0]
-				+ inputPtr[x + dist[3]] * h[3]
-				+ inputPtr[x + dist[4]] * h[4];
+			// Only the smoothed image is needed: i1 = horizontalA (x) vertical kernel, and
+			// immediately convolve its rows horizontally for the next scale
+			forEachRowStrip(threadPool, _height, [&](size_t startY, size_t endY)
+			{
+				const double* rows[5];
+				for(size_t y=startY; y!=endY; ++y)
+				{
+					verticalRows(horizontalA, y, rows);
+					convolveRowVertical(&i1[y*_width], rows, nullptr, _width);
+					if(hasNextScale)
+						convolveRowHorizontal(&horizontalB[y*_width], &i1[y*_width], _width, nextDist);
+				}
+			});
+			std::swap(horizontalA, horizontalB);
 		}
-		
-		for(size_t x=maxX[4]; x!=maxX[3]; ++x)
-		{
-			outputPtr[x] = inputPtr[x + dist[2]] * h[2]
-				+ inputPtr[x + dist[1]] * h[1]
-				+ inputPtr[x + dist[0]] * h[0]
-				+ inputPtr[x + dist[3]] * h[3];
+		else {
+			ao::uvector<double>& coefficients = _scales[scale].Coefficients();
+			coefficients.resize(size);
+			double* coefficientData = coefficients.data();
+			
+			// i1 = horizontalA (x) vertical kernel; horizontalB = i1 (x) horizontal kernel
+			forEachRowStrip(threadPool, _height, [&](size_t startY, size_t endY)
+			{
+				const double* rows[5];
+				for(size_t y=startY; y!=endY; ++y)
+				{
+					verticalRows(horizontalA, y, rows);
+					convolveRowVertical(&i1[y*_width], rows, nullptr, _width);
+					convolveRowHorizontal(&horizontalB[y*_width], &i1[y*_width], _width, dist);
+				}
+			});
+			
+			// coefficients = i0 - horizontalB (x) vertical kernel;
+			// horizontalA = i1 (x) horizontal kernel of the next scale
+			forEachRowStrip(threadPool, _height, [&](size_t startY, size_t endY)
+			{
+				const double* rows[5];
+				for(size_t y=startY; y!=endY; ++y)
+				{
+					verticalRows(horizontalB, y, rows);
+					convolveRowVertical(&coefficientData[y*_width], rows, &i0[y*_width], _width);
+					if(hasNextScale)
+						convolveRowHorizontal(&horizontalA[y*_width], &i1[y*_width], _width, nextDist);
+				}
+			});
 		}
 		
-		for(size_t x=maxX[3]; x!=width; ++x)
-		{
-			outputPtr[x] = inputPtr[x + dist[2]] * h[2]
-				+ inputPtr[x + dist[1]] * h[1]
-				+ inputPtr[x + dist[0]] * h[0];
-		}
+		// i0 = i1
+		i0 = i1;
+		std::swap(i1, nextI1);
 	}
+	
+	// The coefficients of skipped scales are zeroed at the end, because the input
+	// might be stored in one of them
+	for(int scale=0; scale<std::min(minScale, scaleCount); ++scale)
+		_scales[scale].Coefficients().assign(size, 0.0);
+	
+	// The largest (residual) scale was stored in place. Do free the memory of the largest
+	// scale if it is not necessary:
+	if(!includeLargest)
+		ao::uvector<double>().swap(_scales.back().Coefficients());
 }
 
-// This version is not as fast as the one below.
-void IUWTDecomposition::convolveVerticalPartialFastFailed(double* output, const double* image, size_t width, size_t height, size_t startX, size_t endX, int scale)
+SIMD_TARGET_CLONES
+void IUWTDecomposition::convolveRowHorizontal(double* output, const double* input, size_t width, size_t dist)
 {
-	const size_t H_SIZE = 5;
-	const double h[H_SIZE] = { 1.0/16.0, 4.0/16.0, 6.0/16.0, 4.0/16.0, 1.0/16.0 };
-	int scaleDist = (1 << scale);
-	for(size_t y=0; y<height; ++y)
-	{
-		double* outputPtr = &output[y * width];
-		const double* inputPtr = &image[y * width];
-		for(size_t x=startX; x!=endX; ++x)
-			outputPtr[x] = inputPtr[x] * h[2];
-	}
-	for(int hIndex=0; hIndex!=H_SIZE; ++hIndex)
-	{
-		if(hIndex != 2)
-		{
-			int hShift = hIndex - H_SIZE / 2;
-			int dist = (scaleDist-1)*hShift;
-			size_t
-				minY = std::max<int>(0, -dist),
-				maxY = std::min<int>(height, height - dist);
-			for(size_t y=minY; y<maxY; ++y)
-			{
-				double* outputPtr = &output[y * width];
-				const double* inputPtr = &image[(y+dist) * width];
-				for(size_t x=startX; x!=endX; ++x)
-					outputPtr[x] += inputPtr[x] * h[hIndex];
-			}
-		}
-	}
-}
-	
-void IUWTDecomposition::convolveVerticalPartialFast(double* output, const double* image, size_t width, size_t height, size_t startX, size_t endX, int scale)
-{
-	const size_t H_SIZE = 5;
-	const double h[H_SIZE] = { 1.0/16.0, 4.0/16.0, 6.0/16.0, 4.0/16.0, 1.0/16.0 };
-	int scaleDist = (1 << scale);
-	int dist[H_SIZE];
-	size_t minY[H_SIZE], maxY[H_SIZE];
-	for(int hIndex=0; hIndex!=H_SIZE; ++hIndex)
-	{
-		int hShift = hIndex - H_SIZE / 2;
-		dist[hIndex] = (scaleDist-1)*hShift;
-		minY[hIndex] = std::max<int>(0, -dist[hIndex]);
-		maxY[hIndex] = std::min<int>(height, height - dist[hIndex]);
-	}
-	
-	for(size_t y=0; y!=minY[1]; ++y)
-	{
-		double* outputPtr = &output[y * width];
-		const double* inputPtr2 = &image[(y+dist[2]) * width];
-		const double* inputPtr3 = &image[(y+dist[3]) * width];
-		const double* inputPtr4 = &image[(y+dist[4]) * width];
-		for(size_t x=startX; x!=endX; ++x)
-		{
-			outputPtr[x] =
-				inputPtr2[x] * h[2] +
-				inputPtr3[x] * h[3] +
-				inputPtr4[x] * h[4];
-		}
-	}
-	
-	for(size_t y=minY[1]; y!=minY[0]; ++y)
+	// Interior part, where all five taps are inside the row. The kernel is symmetric,
+	// so the outer and inner pairs are added first.
+	const size_t
+		interiorStart = std::min(2*dist, width),
+		interiorEnd = std::max(interiorStart, width > 2*dist ? width - 2*dist : 0);
+	for(size_t x=interiorStart; x < interiorEnd; ++x)
 	{
-		double* outputPtr = &output[y * width];
-		const double* inputPtr1 = &image[(y+dist[1]) * width];
-		const double* inputPtr2 = &image[(y+dist[2]) * width];
-		const double* inputPtr3 = &image[(y+dist[3]) * width];
-		const double* inputPtr4 = &image[(y+dist[4]) * width];
-		for(size_t x=startX; x!=endX; ++x)
-		{
-			outputPtr[x] =
-				inputPtr1[x] * h[1] +
-				inputPtr2[x] * h[2] +
-				inputPtr3[x] * h[3] +
-				inputPtr4[x] * h[4];
-		}
+		const double* in = &input[x];
+		output[x] = in[0] * bSpline[2]
+			+ (in[-2*long(dist)] + in[2*dist]) * bSpline[0]
+			+ (in[-long(dist)] + in[dist]) * bSpline[1];
 	}
 	
-	for(size_t y=minY[0]; y!=maxY[4]; ++y)
+	// Borders, where some of the taps fall outside the row
+	auto border = [&](size_t x)
 	{
-		double* outputPtr = &output[y * width];
-		const double* inputPtr0 = &image[(y+dist[0]) * width];
-		const double* inputPtr1 = &image[(y+dist[1]) * width];
-		const double* inputPtr2 = &image[(y+dist[2]) * width];
-		const double* inputPtr3 = &image[(y+dist[3]) * width];
-		const double* inputPtr4 = &image[(y+dist[4]) * width];
-		for(size_t x=startX; x!=endX; ++x)
+		double sum = input[x] * bSpline[2];
+		for(int k=0; k!=5; ++k)
 		{
-			outputPtr[x] =
-				inputPtr0[x] * h[0] +
-				inputPtr1[x] * h[1] +
-				inputPtr2[x] * h[2] +
-				inputPtr3[x] * h[3] +
-				inputPtr4[x] * h[4];
+			const long inX = long(x) + (k-2)*long(dist);
+			if(k != 2 && inX >= 0 && inX < long(width))
+				sum += input[inX] * bSpline[k];
 		}
-	}
+		output[x] = sum;
+	};
+	for(size_t bx=0; bx!=interiorStart; ++bx)
+		border(bx);
+	for(size_t bx=interiorEnd; bx!=width; ++bx)
+		border(bx);
+}
 
-	for(size_t y=maxY[4]; y!=maxY[3]; ++y)
+SIMD_TARGET_CLONES
+void IUWTDecomposition::convolveRowVertical(double* output, const double* const* rows, const double* lhs, size_t width)
+{
+	const double
+		*r0 = rows[0], *r1 = rows[1], *r2 = rows[2], *r3 = rows[3], *r4 = rows[4];
+	if(lhs)
 	{
-		double* outputPtr = &output[y * width];
-		const double* inputPtr0 = &image[(y+dist[0]) * width];
-		const double* inputPtr1 = &image[(y+dist[1]) * width];
-		const double* inputPtr2 = &image[(y+dist[2]) * width];
-		const double* inputPtr3 = &image[(y+dist[3]) * width];
-		for(size_t x=startX; x!=endX; ++x)
-		{
-			outputPtr[x] =
-				inputPtr0[x] * h[0] +
-				inputPtr1[x] * h[1] +
-				inputPtr2[x] * h[2] +
-				inputPtr3[x] * h[3];
-		}
+		for(size_t x=0; x!=width; ++x)
+			output[x] = lhs[x] - (r2[x] * bSpline[2] + (r0[x] + r4[x]) * bSpline[0] + (r1[x] + r3[x]) * bSpline[1]);
 	}
-	
-	for(size_t y=maxY[3]; y!=height; ++y)
-	{
-		double* outputPtr = &output[y * width];
-		const double* inputPtr0 = &image[(y+dist[0]) * width];
-		const double* inputPtr1 = &image[(y+dist[1]) * width];
-		const double* inputPtr2 = &image[(y+dist[2]) * width];
-		for(size_t x=startX; x!=endX; ++x)
-		{
-			outputPtr[x] =
-				inputPtr0[x] * h[0] +
-				inputPtr1[x] * h[1] +
-				inputPtr2[x] * h[2];
-		}
+	else {
+		for(size_t x=0; x!=width; ++x)
+			output[x] = r2[x] * bSpline[2] + (r0[x] + r4[x]) * bSpline[0] + (r1[x] + r3[x]) * bSpline[1];
 	}
-	
 }
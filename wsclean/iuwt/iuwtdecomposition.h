@@ -75,12 +75,25 @@ public:
 		}
 	}
 	
-	void Decompose(class ThreadPool& pool, const double* input, double* scratch, bool includeLargest)
+	void Decompose(class ThreadPool& pool, const double* input, double* scratch, bool includeLargest, int minScale = 0)
 	{
-		DecomposeMT(pool, input, scratch, includeLargest);
+		DecomposeMT(pool, input, scratch, includeLargest, minScale);
 	}
 	
-	void DecomposeMT(class ThreadPool& pool, const double* input, double* scratch, bool includeLargest);
+	/**
+	 * Multi-threaded decomposition, with the same result as DecomposeST(). The horizontal
+	 * convolution, vertical convolution and difference steps are fused per row,
+	 * such that each row is processed while it is still in cache, and the rows
+	 * are divided over the threads once per pass instead of once per step.
+	 *
+	 * Coefficients of scales below @p minScale are not calculated and are set to
+	 * zero. This is useful when a mask will be applied that only selects scales from
+	 * minScale onwards. The input may point to the scratch buffer or to the
+	 * coefficients of one of the scales of this decomposition, except the largest.
+	 * The other intermediate images are kept by this decomposition and reused by
+	 * later calls.
+	 */
+	void DecomposeMT(class ThreadPool& pool, const double* input, double* scratch, bool includeLargest, int minScale = 0);
 	
 	void DecomposeST(const double* input, double* scratch)
 	{
@@ -267,27 +280,6 @@ private:
 		}
 	}
 
-	static void convolveMT(class ThreadPool& threadPool, double* output, const double* image, double* scratch, size_t width, size_t height, int scale);
-	
-	static void convolveHorizontalPartial(double* output, const double* image, size_t width, size_t startY, size_t endY, int scale)
-	{
-		size_t startIndex = startY * width;
-		convolveHorizontalFast(&output[startIndex], &image[startIndex], width, endY-startY, scale);
-	}
-	
-	struct ConvolveHorizontalPartialFunc
-	{
-		void operator()() {
-			convolveHorizontalPartial(_output, _image, _width, _startY, _endY, _scale);
-		}
-		double* _output;
-		const double* _image;
-		size_t _width;
-		size_t _startY;
-		size_t _endY;
-		int _scale;
-	};
-
 	static void convolveHorizontal(double* output, const double* image, size_t width, size_t height, int scale)
 	{
 		for(size_t i=0; i!=width*height; ++i)
@@ -302,8 +294,6 @@ private:
 		}
 	}
 	
-	static void convolveHorizontalFast(double* output, const double* image, size_t width, size_t height, int scale);
-	
 	static void convolveVerticalPartial(double* output, const double* image, size_t width, size_t height, size_t startX, size_t endX, int scale)
 	{
 		for(size_t i=0; i!=width*height; ++i)
@@ -318,44 +308,24 @@ private:
 		}
 	}
 	
-	static void convolveVerticalPartialFast(double* output, const double* image, size_t width, size_t height, size_t startX, size_t endX, int scale);
-
-	static void convolveVerticalPartialFastFailed(double* output, const double* image, size_t width, size_t height, size_t startX, size_t endX, int scale);
+	/**
+	 * Distance between the taps of the B3 spline kernel at a given scale (as used in
+	 * the convolve() functions).
+	 */
+	static size_t tapDistance(int scale) { return (size_t(1) << scale) - 1; }
 	
-	struct ConvolveVerticalPartialFunc
-	{
-		void operator()() {
-			convolveVerticalPartialFast(_output, _image, _width, _height, _startX, _endX, _scale);
-		}
-		double* _output;
-		const double* _image;
-		size_t _width;
-		size_t _height;
-		size_t _startX;
-		size_t _endX;
-		int _scale;
-	};
-
-	static void differencePartial(double* dest, const double* lhs, const double* rhs, size_t width, size_t startY, size_t endY)
-	{
-		size_t startIndex = startY * width;
-		difference(&dest[startIndex], &lhs[startIndex], &rhs[startIndex], width, endY-startY);
-	}
+	/**
+	 * Convolves one row horizontally with the 5-tap B3 spline kernel.
+	 */
+	static void convolveRowHorizontal(double* output, const double* input, size_t width, size_t dist);
 	
-	struct DifferencePartialFunc
-	{
-		void operator()() {
-			differencePartial(_dest, _lhs, _rhs, _width, _startY, _endY);
-		}
-		double* _dest;
-		const double* _lhs;
-		const double* _rhs;
-		size_t _width;
-		size_t _startY;
-		size_t _endY;
-	};
-
-	static void differenceMT(class ThreadPool& threadPool, double* dest, const double* lhs, const double* rhs, size_t width, size_t height);
+	/**
+	 * Calculates one row of the vertical convolution with the B3 spline kernel,
+	 * i.e. output = sum_k h[k] rows[k]. Missing rows at the image border are
+	 * passed as a row of zeros. When lhs is non-null, the difference lhs - convolution
+	 * is stored instead.
+	 */
+	static void convolveRowVertical(double* output, const double* const* rows, const double* lhs, size_t width);
 	
 	static void difference(double* dest, const double* lhs, const double* rhs, size_t width, size_t height)
 	{
@@ -381,8 +351,22 @@ private:
 	}
 
 private:
+	/**
+	 * Intermediate images of DecomposeMT(). They only live across calls to avoid
+	 * reallocating them, so a copy of the decomposition starts without them.
+	 */
+	struct WorkBuffers
+	{
+		WorkBuffers() = default;
+		WorkBuffers(const WorkBuffers&) { }
+		WorkBuffers& operator=(const WorkBuffers&) { return *this; }
+		
+		ao::uvector<double> other, horizontalA, horizontalB, zeroRow;
+	};
+	
 	std::vector<IUWTDecompositionScale> _scales;
 	size_t _scaleCount, _width, _height;
+	WorkBuffers _work;
 };
 
 #endif
@@ -369,7 +369,7 @@ double IUWTDeconvolutionAlgorithm::rms(const ao::uvector<double>& image)
 	return sqrt(sum/image.size());
 }
 
-bool IUWTDeconvolutionAlgorithm::runConjugateGradient(IUWTDecomposition& iuwt, const IUWTMask& mask, ao::uvector<double>& maskedDirty, ao::uvector<double>& structureModel, ao::uvector<double>& scratch, const ao::uvector<double>& psfKernel, size_t width, size_t height)
+bool IUWTDeconvolutionAlgorithm::runConjugateGradient(IUWTDecomposition& iuwt, const IUWTMask& mask, ao::uvector<double>& maskedDirty, ao::uvector<double>& structureModel, ao::uvector<double>& scratch, const ao::uvector<double>& psfKernel, size_t width, size_t height, size_t minScale)
 {
 	ao::uvector<double> gradient = maskedDirty;
 	double modelSNR = 0.0;
@@ -382,8 +382,9 @@ bool IUWTDeconvolutionAlgorithm::runConjugateGradient(IUWTDecomposition& iuwt, c
 		scratch = gradient;
 		FFTConvolver::ConvolveSameSize(_fftwManager, scratch.data(), psfKernel.data(), width, height);
 		
-		// calc: IUWT gradient (x) psf
-		iuwt.Decompose(*_threadPool, scratch.data(), scratch.data(), false);
+		// calc: IUWT gradient (x) psf. Scales below minScale are not calculated, because
+		// the mask does not select them.
+		iuwt.Decompose(*_threadPool, scratch.data(), scratch.data(), false, minScale);
 		
 		// calc: mask IUWT gradient (x) psf
 		iuwt.ApplyMask(mask);
@@ -427,7 +428,7 @@ bool IUWTDeconvolutionAlgorithm::runConjugateGradient(IUWTDecomposition& iuwt, c
 		// scratch = mask IUWT PSF (x) model
 		scratch = structureModel;
 		FFTConvolver::ConvolveSameSize(_fftwManager, scratch.data(), psfKernel.data(), width, height);
-		iuwt.Decompose(*_threadPool, scratch.data(), scratch.data(), false);
+		iuwt.Decompose(*_threadPool, scratch.data(), scratch.data(), false, minScale);
 		iuwt.ApplyMask(mask);
 		
 		double previousSNR = modelSNR;
@@ -726,7 +727,7 @@ bool IUWTDeconvolutionAlgorithm::fillAndDeconvolveStructure(IUWTDecomposition& i
 		}
 		
 		// get undeconvolved dirty
-		iuwt.Decompose(*_threadPool, dirty.data(), scratch.data(), false);
+		iuwt.Decompose(*_threadPool, dirty.data(), scratch.data(), false, curMinScale);
 		
 		iuwt.ApplyMask(mask);
 		iuwt.Recompose(scratch, false);
@@ -734,7 +735,7 @@ bool IUWTDeconvolutionAlgorithm::fillAndDeconvolveStructure(IUWTDecomposition& i
 		ao::uvector<double> maskedDirty = scratch;
 		
 		ao::uvector<double> structureModel(width*height, 0.0);
-		bool success = runConjugateGradient(iuwt, mask, maskedDirty, structureModel, scratch, psfKernel, width, height);
+		bool success = runConjugateGradient(iuwt, mask, maskedDirty, structureModel, scratch, psfKernel, width, height, curMinScale);
 		if(!success) return false;
 		
 		double rmsBefore = rms(dirty);
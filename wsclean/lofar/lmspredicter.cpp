@@ -22,6 +22,8 @@ void LMSPredicter::InitializeInput(const Model& model)
 	BandData band(_ms.spectralWindow());
 	
 	_dftInput.InitializeFromModel(model, ra, dec, band);
+	if(_isModelApparent)
+		_dftInput.ConvertApparentToAbsolute(_ms, _threadCount, _beamTimeInterval);
 }
 
 void LMSPredicter::clearBuffers()
@@ -53,17 +55,13 @@ void LMSPredicter::Start()
 		casacore::MEpoch::ROScalarColumn timeColumn(_ms, _ms.columnName(casacore::MSMainEnums::TIME));
 		casacore::MEpoch startTime = timeColumn(_startRow);
 		size_t antennaCount = _ms.antenna().nrow();
-		_dftInput.InitializeBeamBuffers(antennaCount, _bandData.ChannelCount());
-		_predicter.reset(new DFTPredictionAlgorithm(_dftInput, _bandData));
+		_predicter.reset(new DFTPredictionAlgorithm(_dftInput, _bandData, antennaCount));
 		if(_applyBeam)
 		{
 			_beamEvaluator.reset(new LBeamEvaluator(_ms));
 			_beamEvaluator->SetTime(startTime);
 			_predicter->UpdateBeam(*_beamEvaluator, _startChannel, _endChannel);
 		}
-		else {
-			_dftInput.SetUnitaryBeam();
-		}
 	}
 	
 	// Create buffers
@@ -202,15 +200,10 @@ void LMSPredicter::ReadThreadFunc()
 void LMSPredicter::PredictThreadFunc()
 {
 	RowData rowData;
+	DFTPredictionAlgorithm::RowScratch scratch;
 	while(_workLane.read(rowData))
 	{
-		MC2x2 *valIter = rowData.modelData;
-		for(size_t ch=_startChannel; ch!=_endChannel; ++ch)
-		{
-			double lambda = _bandData.ChannelWavelength(ch);
-			_predicter->Predict(*valIter, rowData.u/lambda, rowData.v/lambda, rowData.w/lambda, ch, rowData.a1, rowData.a2);
-			++valIter;
-		}
+		_predicter->PredictRow(rowData.modelData, rowData.u, rowData.v, rowData.w, _startChannel, _endChannel, rowData.a1, rowData.a2, scratch);
 		_outputLane.write(rowData);
 	}
 	_barrier.wait();
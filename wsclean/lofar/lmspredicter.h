@@ -37,6 +37,8 @@ public:
 		_endChannel(0),
 		_applyBeam(false),
 		_useModelColumn(false),
+		_isModelApparent(false),
+		_beamTimeInterval(0.0),
 		_dftInput(),
 		_barrier(threadCount+1),
 		_laneSize(threadCount*16),
@@ -74,6 +76,16 @@ public:
 	void SetStartRow(size_t startRow) { _startRow = startRow; }
 	void SetEndRow(size_t endRow) { _endRow = endRow; }
 	void SetUseModelColumn(bool useModelColumn) { _useModelColumn = useModelColumn; }
+	/**
+	 * When set, the fluxes of the model given to InitializeInput() are apparent fluxes. They
+	 * are then converted to absolute fluxes with the time-averaged array beam, which is
+	 * evaluated at timesteps that are at least beamTimeInterval seconds apart.
+	 */
+	void SetModelIsApparent(bool isModelApparent, double beamTimeInterval = 0.0)
+	{
+		_isModelApparent = isModelApparent;
+		_beamTimeInterval = beamTimeInterval;
+	}
 	void SetChannelRange(size_t startChannel, size_t endChannel)
 	{
 		_startChannel = startChannel;
@@ -88,7 +100,8 @@ private:
 	casacore::MeasurementSet &_ms;
 	std::unique_ptr<LBeamEvaluator> _beamEvaluator;
 	size_t _startChannel, _endChannel;
-	bool _applyBeam, _useModelColumn;
+	bool _applyBeam, _useModelColumn, _isModelApparent;
+	double _beamTimeInterval;
 	
 	DFTPredictionInput _dftInput;
 	std::mutex _mutex;
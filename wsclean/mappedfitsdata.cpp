@@ -0,0 +1,112 @@
+#include "mappedfitsdata.h"
+
+#include "system.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+	inline uint32_t fromBigEndian(uint32_t value)
+	{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		return __builtin_bswap32(value);
+#else
+		return value;
+#endif
+	}
+
+	inline uint64_t fromBigEndian(uint64_t value)
+	{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		return __builtin_bswap64(value);
+#else
+		return value;
+#endif
+	}
+
+	/**
+	 * Converts count big-endian values of type FileType to NumType. The loop has
+	 * no dependencies and only uses memcpy for the type punning, so that the
+	 * compiler vectorizes the byte swap.
+	 */
+	template<typename FileType, typename IntType, typename NumType>
+	void convert(NumType* __restrict destination, const char* __restrict source, size_t count)
+	{
+		static_assert(sizeof(FileType) == sizeof(IntType), "Integer type should have same size as file type");
+		for(size_t i=0; i!=count; ++i)
+		{
+			IntType value;
+			std::memcpy(&value, source + i*sizeof(IntType), sizeof(IntType));
+			value = fromBigEndian(value);
+			FileType pixel;
+			std::memcpy(&pixel, &value, sizeof(FileType));
+			destination[i] = pixel;
+		}
+	}
+}
+
+MappedFitsData::MappedFitsData(const std::string& filename, size_t dataOffset, size_t pixelCount, int bitPix) :
+	_pixelCount(pixelCount),
+	_bitPix(bitPix),
+	_mapLength(0),
+	_map(nullptr),
+	_data(nullptr)
+{
+	if(!IsSupported(bitPix))
+		throw std::runtime_error("Can not map FITS file " + filename + ": only floating point images are supported");
+	const size_t dataLength = pixelCount * (bitPix == -32 ? sizeof(float) : sizeof(double));
+	_mapLength = dataOffset + dataLength;
+	if(dataLength == 0)
+		return;
+	
+	int fd = open(filename.c_str(), O_RDONLY);
+	if(fd == -1)
+		throw std::runtime_error("Error opening FITS file " + filename + ": " + System::StrError(errno));
+	struct stat fileStat;
+	if(fstat(fd, &fileStat) != 0 || size_t(fileStat.st_size) < _mapLength)
+	{
+		close(fd);
+		throw std::runtime_error("FITS file " + filename + " is shorter than its header specifies");
+	}
+	void* map = mmap(nullptr, _mapLength, PROT_READ, MAP_SHARED, fd, 0);
+	// The mapping remains valid after the file is closed
+	close(fd);
+	if(map == MAP_FAILED)
+		throw std::runtime_error("Error creating memory map to FITS file " + filename + ": mmap() returned MAP_FAILED with error message: " + System::StrError(errno));
+	_map = reinterpret_cast<char*>(map);
+	_data = _map + dataOffset;
+}
+
+MappedFitsData::~MappedFitsData()
+{
+	if(_map != nullptr)
+		munmap(_map, _mapLength);
+}
+
+template<typename NumType>
+void MappedFitsData::read(NumType* destination, size_t offset, size_t count) const
+{
+	if(offset + count > _pixelCount)
+		throw std::runtime_error("Read beyond the end of a mapped FITS file");
+	if(_bitPix == -32)
+		convert<float, uint32_t>(destination, _data + offset * sizeof(float), count);
+	else
+		convert<double, uint64_t>(destination, _data + offset * sizeof(double), count);
+}
+
+void MappedFitsData::Read(float* destination, size_t offset, size_t count) const
+{
+	read(destination, offset, count);
+}
+
+void MappedFitsData::Read(double* destination, size_t offset, size_t count) const
+{
+	read(destination, offset, count);
+}
@@ -0,0 +1,66 @@
+#ifndef MAPPED_FITS_DATA_H
+#define MAPPED_FITS_DATA_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Read-only memory map of the data unit of an uncompressed FITS image with
+ * floating point pixels (BITPIX -32 or -64). The kernel only reads the pages
+ * that are accessed, so that reading one plane of a large cube, or a part of
+ * a plane, does not read the rest of the file. Pixels are converted from the
+ * big-endian file format while they are copied into the destination buffer,
+ * without intermediate buffers.
+ *
+ * This is used by @ref FitsReader for the files it can map. Other files
+ * (tile-compressed, gzipped, integer or scaled images) are read with cfitsio.
+ */
+class MappedFitsData
+{
+public:
+	/**
+	 * Maps the file.
+	 * @param dataOffset Offset of the first pixel in the file, in bytes.
+	 * @param pixelCount Number of pixels in the data unit.
+	 * @param bitPix BITPIX of the image, which should be -32 or -64.
+	 */
+	MappedFitsData(const std::string& filename, size_t dataOffset, size_t pixelCount, int bitPix);
+
+	~MappedFitsData();
+
+	static bool IsSupported(int bitPix) { return bitPix == -32 || bitPix == -64; }
+
+	size_t PixelCount() const { return _pixelCount; }
+
+	/**
+	 * Copies the pixels [offset, offset+count) of the data unit, in file order.
+	 */
+	void Read(float* destination, size_t offset, size_t count) const;
+	void Read(double* destination, size_t offset, size_t count) const;
+
+	/**
+	 * Copies a box of width x height pixels from an image with the given (full)
+	 * width. The box starts at pixel offset of the data unit.
+	 */
+	template<typename NumType>
+	void ReadBox(NumType* destination, size_t offset, size_t imageWidth, size_t width, size_t height) const
+	{
+		for(size_t y=0; y!=height; ++y)
+			Read(destination + y*width, offset + y*imageWidth, width);
+	}
+
+private:
+	MappedFitsData(const MappedFitsData&) = delete;
+	MappedFitsData& operator=(const MappedFitsData&) = delete;
+
+	template<typename NumType>
+	void read(NumType* destination, size_t offset, size_t count) const;
+
+	size_t _pixelCount;
+	int _bitPix;
+	size_t _mapLength;
+	char* _map;
+	const char* _data;
+};
+
+#endif
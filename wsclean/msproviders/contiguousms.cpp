@@ -227,7 +227,7 @@ void ContiguousMS::ReadModel(std::complex<float>* buffer)
 	copyData(buffer,  startChannel, endChannel, _inputPolarizations, _modelArray, _polOut);
 }
 
-void ContiguousMS::WriteModel(size_t rowId, std::complex<float>* buffer)
+void ContiguousMS::WriteModel(size_t rowId, std::complex<float>* buffer, const double* /*uvw*/)
 {
 	if(!_isModelColumnPrepared)
 		prepareModelColumn();
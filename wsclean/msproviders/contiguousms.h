@@ -42,7 +42,7 @@ public:
 	
 	void ReadModel(std::complex<float>* buffer) final override;
 	
-	void WriteModel(size_t rowId, std::complex<float>* buffer) final override;
+	void WriteModel(size_t rowId, std::complex<float>* buffer, const double* uvw) final override;
 	
 	void ReadWeights(std::complex<float>* buffer) final override;
 	
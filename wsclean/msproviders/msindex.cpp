@@ -0,0 +1,341 @@
+#include "msindex.h"
+
+#include "../wsclean/logger.h"
+
+#include <casacore/ms/MeasurementSets/MeasurementSet.h>
+#include <casacore/tables/Tables/ScalarColumn.h>
+
+#include "../msselection.h"
+
+#include <boost/filesystem/path.hpp>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+namespace {
+	constexpr uint64_t MAGIC = 0x5844494e49535357; // "WSSINIDX"
+	constexpr uint32_t VERSION = 2;
+
+	template<typename T>
+	void writeValue(std::ostream& stream, T value)
+	{
+		stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template<typename T>
+	T readValue(std::istream& stream)
+	{
+		T value = T();
+		stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+		return value;
+	}
+
+	/**
+	 * Number of bytes from the read position to the end of the stream, used to reject
+	 * counts of a corrupted file before they are allocated.
+	 */
+	size_t remainingBytes(std::istream& stream)
+	{
+		const std::istream::pos_type position = stream.tellg();
+		stream.seekg(0, std::ios::end);
+		const std::istream::pos_type end = stream.tellg();
+		stream.seekg(position);
+		if(position == std::istream::pos_type(-1) || end < position)
+			return 0;
+		return end - position;
+	}
+
+	int64_t modificationTime(const std::string& msPath)
+	{
+		// The main table file changes when rows or columns are added or removed, but
+		// not when visibilities are written.
+		struct stat info;
+		if(stat((msPath + "/table.dat").c_str(), &info) != 0)
+			return 0;
+		return int64_t(info.st_mtime) * 1000000000 + int64_t(info.st_mtim.tv_nsec);
+	}
+
+	struct Registered
+	{
+		int64_t modificationTime;
+		size_t rowCount;
+		std::shared_ptr<const MSIndex> index;
+	};
+
+	std::mutex registryMutex;
+	std::map<std::string, Registered> registry;
+	std::string storageDirectory;
+}
+
+void MSIndex::SetStorageDirectory(const std::string& directory)
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	storageDirectory = directory;
+}
+
+std::shared_ptr<const MSIndex> MSIndex::Get(casacore::MeasurementSet& ms)
+{
+	std::string msPath = ms.tableName();
+	while(!msPath.empty() && *msPath.rbegin() == '/')
+		msPath.resize(msPath.size()-1);
+	const int64_t mTime = modificationTime(msPath);
+	const size_t rowCount = ms.nrow();
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+	Registered& registered = registry[msPath];
+	if(registered.index != nullptr && registered.modificationTime == mTime && registered.rowCount == rowCount)
+		return registered.index;
+
+	std::unique_ptr<MSIndex> index(new MSIndex());
+	const std::string filename = storageDirectory.empty() ? std::string() : storageFilename(storageDirectory, msPath);
+	bool isRead = false;
+	if(!filename.empty())
+	{
+		std::ifstream file(filename, std::ios::binary);
+		if(file && index->Read(file, msPath, mTime) && index->RowCount() == rowCount)
+		{
+			Logger::Debug << "Using measurement set index " << filename << '\n';
+			isRead = true;
+		}
+	}
+	if(!isRead)
+	{
+		index = scan(ms);
+		if(!filename.empty())
+		{
+			// Write to a temporary file first, so that concurrent runs never see half an index
+			std::ostringstream tmpFilename;
+			tmpFilename << filename << '.' << getpid() << ".tmp";
+			bool isWritten;
+			{
+				std::ofstream file(tmpFilename.str(), std::ios::binary);
+				if(file)
+					index->Write(file, msPath, mTime);
+				isWritten = bool(file);
+			}
+			if(isWritten && std::rename(tmpFilename.str().c_str(), filename.c_str()) == 0)
+				Logger::Debug << "Stored measurement set index in " << filename << '\n';
+			else {
+				std::remove(tmpFilename.str().c_str());
+				Logger::Warn << "Could not store the measurement set index of " << msPath << " in " << filename << "; it will be recalculated next run.\n";
+			}
+		}
+	}
+	registered.modificationTime = mTime;
+	registered.rowCount = rowCount;
+	registered.index = std::move(index);
+	return registered.index;
+}
+
+std::unique_ptr<MSIndex> MSIndex::scan(casacore::MeasurementSet& ms)
+{
+	Logger::Info << "Indexing measurement set rows... ";
+	Logger::Info.Flush();
+	std::unique_ptr<MSIndex> index(new MSIndex());
+	casacore::ScalarColumn<double> timeColumn(ms, casacore::MS::columnName(casacore::MSMainEnums::TIME));
+	casacore::ScalarColumn<int> antenna1Column(ms, casacore::MS::columnName(casacore::MSMainEnums::ANTENNA1));
+	casacore::ScalarColumn<int> antenna2Column(ms, casacore::MS::columnName(casacore::MSMainEnums::ANTENNA2));
+	casacore::ScalarColumn<int> fieldIdColumn(ms, casacore::MS::columnName(casacore::MSMainEnums::FIELD_ID));
+	casacore::ScalarColumn<int> dataDescIdColumn(ms, casacore::MS::columnName(casacore::MSMainEnums::DATA_DESC_ID));
+	// Read the columns in blocks, which is much faster than reading them per row
+	const size_t nRow = ms.nrow(), blockSize = 65536;
+	casacore::Vector<double> times;
+	casacore::Vector<int> antenna1s, antenna2s, fieldIds, dataDescIds;
+	for(size_t blockStart = 0; blockStart < nRow; blockStart += blockSize)
+	{
+		const size_t n = std::min(blockSize, nRow - blockStart);
+		casacore::Slicer slicer(casacore::IPosition(1, blockStart), casacore::IPosition(1, n));
+		timeColumn.getColumnRange(slicer, times, true);
+		antenna1Column.getColumnRange(slicer, antenna1s, true);
+		antenna2Column.getColumnRange(slicer, antenna2s, true);
+		fieldIdColumn.getColumnRange(slicer, fieldIds, true);
+		dataDescIdColumn.getColumnRange(slicer, dataDescIds, true);
+		for(size_t i=0; i!=n; ++i)
+			index->AddRow(times[i], dataDescIds[i], fieldIds[i], antenna1s[i] == antenna2s[i]);
+	}
+	Logger::Info << "DONE (" << index->TimestepCount() << " timesteps)\n";
+	return index;
+}
+
+std::string MSIndex::storageFilename(const std::string& directory, const std::string& msPath)
+{
+	// The path is hashed into the name, because sets in different directories
+	// often have the same name. The header holds the full path to rule out collisions.
+	std::ostringstream name;
+	name << boost::filesystem::path(msPath).filename().string() << '-' << std::hex << std::hash<std::string>()(msPath) << ".wsindex";
+	return (boost::filesystem::path(directory) / name.str()).string();
+}
+
+void MSIndex::AddRow(double time, size_t dataDescId, size_t fieldId, bool isAutoCorrelation)
+{
+	const size_t row = RowCount();
+	if(_times.empty() || time != _lastTime)
+	{
+		// The end of the last timestep becomes the start of a new one
+		_times.push_back(time);
+		_timestepStarts.push_back(row);
+		_lastTime = time;
+	}
+	++_timestepStarts.back();
+
+	// Rows typically cycle through very few groups, so a linear search is fine
+	std::vector<RowGroup>::iterator group = std::find_if(_groups.begin(), _groups.end(),
+		[&](const RowGroup& g) { return g.dataDescId == dataDescId && g.fieldId == fieldId && g.isAutoCorrelation == isAutoCorrelation; });
+	if(group == _groups.end())
+	{
+		_groups.emplace_back();
+		group = _groups.end() - 1;
+		group->dataDescId = dataDescId;
+		group->fieldId = fieldId;
+		group->isAutoCorrelation = isAutoCorrelation;
+	}
+	if(!group->ranges.empty() && group->ranges.back().end == row)
+		++group->ranges.back().end;
+	else
+		group->ranges.emplace_back(RowRange{row, row+1});
+}
+
+size_t MSIndex::TimestepOfRow(size_t row) const
+{
+	// _timestepStarts[0] is always zero; the timestep is the last start <= row.
+	return std::upper_bound(_timestepStarts.begin() + 1, _timestepStarts.end() - 1, row) - _timestepStarts.begin() - 1;
+}
+
+void MSIndex::GetRowRange(const MSSelection& selection, size_t& startRow, size_t& endRow) const
+{
+	startRow = 0;
+	endRow = RowCount();
+	if(selection.HasInterval())
+	{
+		startRow = TimestepStartRow(std::min(selection.IntervalStart(), TimestepCount()));
+		endRow = TimestepStartRow(std::min(selection.IntervalEnd(), TimestepCount()));
+	}
+}
+
+void MSIndex::GetSelectedRows(const MSSelection& selection, const std::set<size_t>& dataDescIds, size_t startRow, size_t endRow, std::vector<size_t>& rows) const
+{
+	const size_t previousSize = rows.size();
+	size_t selectedGroupCount = 0;
+	for(const RowGroup& group : _groups)
+	{
+		if(dataDescIds.count(group.dataDescId) == 0 || !selection.IsFieldSelected(group.fieldId))
+			continue;
+		// The antennas are only used to check for auto-correlations
+		const size_t antenna2 = group.isAutoCorrelation ? 0 : 1;
+		// First range that ends after startRow
+		std::vector<RowRange>::const_iterator range = std::upper_bound(group.ranges.begin(), group.ranges.end(), startRow,
+			[](size_t row, const RowRange& r) { return row < r.end; });
+		if(range == group.ranges.end() || range->start >= endRow)
+			continue;
+		size_t timestep = TimestepOfRow(std::max(range->start, startRow));
+		for(; range != group.ranges.end() && range->start < endRow; ++range)
+		{
+			const size_t rangeEnd = std::min(range->end, endRow);
+			for(size_t row = std::max(range->start, startRow); row != rangeEnd; ++row)
+			{
+				while(row >= _timestepStarts[timestep+1])
+					++timestep;
+				if(selection.IsSelected(group.fieldId, timestep, 0, antenna2, 0.0))
+					rows.push_back(row);
+			}
+		}
+		++selectedGroupCount;
+	}
+	if(selectedGroupCount > 1)
+		std::sort(rows.begin() + previousSize, rows.end());
+}
+
+void MSIndex::Write(std::ostream& stream, const std::string& msPath, int64_t modificationTime) const
+{
+	writeValue<uint64_t>(stream, MAGIC);
+	writeValue<uint32_t>(stream, VERSION);
+	writeValue<int64_t>(stream, modificationTime);
+	writeValue<uint32_t>(stream, msPath.size());
+	stream.write(msPath.data(), msPath.size());
+
+	writeValue<uint64_t>(stream, TimestepCount());
+	for(size_t t=0; t!=TimestepCount(); ++t)
+	{
+		writeValue<double>(stream, _times[t]);
+		writeValue<uint64_t>(stream, _timestepStarts[t+1]);
+	}
+	writeValue<uint64_t>(stream, _groups.size());
+	for(const RowGroup& group : _groups)
+	{
+		writeValue<uint32_t>(stream, group.dataDescId);
+		writeValue<uint32_t>(stream, group.fieldId);
+		writeValue<uint8_t>(stream, group.isAutoCorrelation);
+		writeValue<uint64_t>(stream, group.ranges.size());
+		for(const RowRange& range : group.ranges)
+		{
+			writeValue<uint64_t>(stream, range.start);
+			writeValue<uint64_t>(stream, range.end);
+		}
+	}
+}
+
+bool MSIndex::Read(std::istream& stream, const std::string& msPath, int64_t modificationTime)
+{
+	if(readValue<uint64_t>(stream) != MAGIC || readValue<uint32_t>(stream) != VERSION ||
+		readValue<int64_t>(stream) != modificationTime)
+		return false;
+	const size_t pathLength = readValue<uint32_t>(stream);
+	if(!stream || pathLength != msPath.size())
+		return false;
+	std::string path(pathLength, '\0');
+	stream.read(&path[0], path.size());
+	if(!stream || path != msPath)
+		return false;
+
+	const size_t timestepCount = readValue<uint64_t>(stream);
+	if(!stream || timestepCount > remainingBytes(stream) / (sizeof(double) + sizeof(uint64_t)))
+		return false;
+	std::vector<double> times(timestepCount);
+	std::vector<size_t> timestepStarts(timestepCount+1, 0);
+	for(size_t t=0; t!=timestepCount; ++t)
+	{
+		times[t] = readValue<double>(stream);
+		timestepStarts[t+1] = readValue<uint64_t>(stream);
+		if(timestepStarts[t+1] <= timestepStarts[t])
+			return false;
+	}
+	const size_t rowCount = timestepStarts.back();
+	const size_t groupCount = readValue<uint64_t>(stream);
+	if(!stream || groupCount > rowCount)
+		return false;
+	std::vector<RowGroup> groups(groupCount);
+	for(RowGroup& group : groups)
+	{
+		group.dataDescId = readValue<uint32_t>(stream);
+		group.fieldId = readValue<uint32_t>(stream);
+		group.isAutoCorrelation = readValue<uint8_t>(stream) != 0;
+		const size_t rangeCount = readValue<uint64_t>(stream);
+		if(!stream || rangeCount > rowCount || rangeCount > remainingBytes(stream) / (2 * sizeof(uint64_t)))
+			return false;
+		group.ranges.resize(rangeCount);
+		size_t previousEnd = 0;
+		for(RowRange& range : group.ranges)
+		{
+			range.start = readValue<uint64_t>(stream);
+			range.end = readValue<uint64_t>(stream);
+			if(range.start < previousEnd || range.end <= range.start || range.end > rowCount)
+				return false;
+			previousEnd = range.end;
+		}
+	}
+	if(!stream)
+		return false;
+	_times = std::move(times);
+	_timestepStarts = std::move(timestepStarts);
+	_groups = std::move(groups);
+	_lastTime = _times.empty() ? 0.0 : _times.back();
+	return true;
+}
@@ -0,0 +1,151 @@
+#ifndef MSPROVIDERS_MS_INDEX_H
+#define MSPROVIDERS_MS_INDEX_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace casacore {
+	class MeasurementSet;
+}
+class MSSelection;
+
+/**
+ * Index of the rows of a measurement set: at which row each timestep starts, and which
+ * rows belong to which data description id and field. With it, the row range of a
+ * timestep interval and the rows that match a selection can be found without
+ * scanning the TIME, FIELD_ID, DATA_DESC_ID and ANTENNA columns. This matters most
+ * when many intervals are imaged (-intervals-out), since every interval used to
+ * scan the full set again.
+ *
+ * Building the index requires one scan over the measurement set. Within a run, the index
+ * is kept in memory. When a storage directory is set (-temp-dir), the index is also
+ * written to a file in that directory ("<ms name>-<hash>.wsindex"), and is reused by later
+ * runs as long as the number of rows and the modification time of the main table have not
+ * changed. Nothing is written next to the measurement set.
+ *
+ * Like the existing row scans, a new timestep starts whenever the time of a row differs
+ * from the time of the previous row.
+ */
+class MSIndex
+{
+public:
+	/**
+	 * The consecutive rows [start, end).
+	 */
+	struct RowRange
+	{
+		size_t start, end;
+	};
+
+	struct RowGroup
+	{
+		size_t dataDescId, fieldId;
+		bool isAutoCorrelation;
+		/**
+		 * Sorted, non-adjacent row ranges of this group. Rows of a group are mostly
+		 * consecutive, so this takes much less space than a list of rows.
+		 */
+		std::vector<RowRange> ranges;
+	};
+
+	/**
+	 * Creates an empty index. Rows can be added with @ref AddRow().
+	 */
+	MSIndex() : _lastTime(0.0), _timestepStarts(1, 0) { }
+
+	/**
+	 * Returns the index of the given measurement set. It is taken from memory or
+	 * from the storage directory when available, and is otherwise built and stored.
+	 */
+	static std::shared_ptr<const MSIndex> Get(casacore::MeasurementSet& ms);
+
+	/**
+	 * Sets the directory in which indices are stored between runs. When empty (the
+	 * default), indices are only kept in memory.
+	 */
+	static void SetStorageDirectory(const std::string& directory);
+
+	/**
+	 * Add the next row of the measurement set to the index. Rows should be added
+	 * in the order of the measurement set.
+	 */
+	void AddRow(double time, size_t dataDescId, size_t fieldId, bool isAutoCorrelation);
+
+	size_t RowCount() const
+	{
+		return _timestepStarts.back();
+	}
+
+	size_t TimestepCount() const
+	{
+		return _times.size();
+	}
+
+	/**
+	 * First row of the given timestep. For timestep == @ref TimestepCount(), the
+	 * total number of rows is returned, such that the rows of timestep t are
+	 * [ TimestepStartRow(t), TimestepStartRow(t+1) ).
+	 */
+	size_t TimestepStartRow(size_t timestep) const
+	{
+		return _timestepStarts[timestep];
+	}
+
+	double TimestepTime(size_t timestep) const
+	{
+		return _times[timestep];
+	}
+
+	/**
+	 * Index of the timestep that contains the given row.
+	 */
+	size_t TimestepOfRow(size_t row) const;
+
+	const std::vector<RowGroup>& RowGroups() const { return _groups; }
+
+	/**
+	 * Determine the row range of the interval of the selection, in the same way as
+	 * MSProvider::getRowRange() did by scanning: when the selection has no interval,
+	 * the range covers all rows.
+	 */
+	void GetRowRange(const MSSelection& selection, size_t& startRow, size_t& endRow) const;
+
+	/**
+	 * Collect the rows in [startRow, endRow) that are selected by the selection and that
+	 * have one of the given data description ids, in increasing order. Because the index
+	 * does not hold the uvws, this can only be used for selections without a uvw range.
+	 */
+	void GetSelectedRows(const MSSelection& selection, const std::set<size_t>& dataDescIds, size_t startRow, size_t endRow, std::vector<size_t>& rows) const;
+
+	/**
+	 * Writes the index, preceded by a header that identifies the measurement set
+	 * (path and modification time) for which it was made.
+	 */
+	void Write(std::ostream& stream, const std::string& msPath, int64_t modificationTime) const;
+
+	/**
+	 * Reads an index written with @ref Write().
+	 * @returns @c false if the stream does not hold a valid index for the given measurement
+	 * set, in which case this index is not changed.
+	 */
+	bool Read(std::istream& stream, const std::string& msPath, int64_t modificationTime);
+
+private:
+	static std::unique_ptr<MSIndex> scan(casacore::MeasurementSet& ms);
+	static std::string storageFilename(const std::string& directory, const std::string& msPath);
+
+	double _lastTime;
+	/**
+	 * Start rows of the timesteps, followed by the total number of rows. Hence, it
+	 * is never empty.
+	 */
+	std::vector<size_t> _timestepStarts;
+	std::vector<double> _times;
+	std::vector<RowGroup> _groups;
+};
+
+#endif
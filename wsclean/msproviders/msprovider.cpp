@@ -1,4 +1,5 @@
 #include "msprovider.h"
+#include "msindex.h"
 
 #include "../wsclean/logger.h"
 
@@ -550,66 +551,38 @@ void MSProvider::getRowRange(casacore::MeasurementSet& ms, const MSSelection& se
 	endRow = ms.nrow();
 	if(selection.HasInterval())
 	{
-		Logger::Info << "Determining first and last row index... ";
-		Logger::Info.Flush();
-		casacore::ROScalarColumn<double> timeColumn(ms, casacore::MS::columnName(casacore::MSMainEnums::TIME));
-		double time = timeColumn(0);
-		size_t timestepIndex = 0;
-		for(size_t row = 0; row!=ms.nrow(); ++row)
-		{
-			if(time != timeColumn(row))
-			{
-				++timestepIndex;
-				if(timestepIndex == selection.IntervalStart())
-					startRow = row;
-				if(timestepIndex == selection.IntervalEnd())
-				{
-					endRow = row;
-					break;
-				}
-				time = timeColumn(row);
-			}
-		}
-		Logger::Info << "DONE (" << startRow << '-' << endRow << ")\n";
+		MSIndex::Get(ms)->GetRowRange(selection, startRow, endRow);
+		Logger::Debug << "Selected rows " << startRow << '-' << endRow << '\n';
 	}
 }
 
 void MSProvider::getRowRangeAndIDMap(casacore::MeasurementSet& ms, const MSSelection& selection, size_t& startRow, size_t& endRow, const std::set<size_t>& dataDescIds, std::vector<size_t>& idToMSRow)
 {
-	startRow = 0;
-	endRow = ms.nrow();
+	std::shared_ptr<const MSIndex> index = MSIndex::Get(ms);
+	index->GetRowRange(selection, startRow, endRow);
 	
 	Logger::Info << "Mapping measurement set rows... ";
 	Logger::Info.Flush();
-	casacore::ArrayColumn<double> uvwColumn(ms, casacore::MS::columnName(casacore::MSMainEnums::UVW));
-	casacore::ScalarColumn<int> antenna1Column(ms, casacore::MS::columnName(casacore::MSMainEnums::ANTENNA1));
-	casacore::ScalarColumn<int> antenna2Column(ms, casacore::MS::columnName(casacore::MSMainEnums::ANTENNA2));
-	casacore::ScalarColumn<int> fieldIdColumn(ms, casacore::MS::columnName(casacore::MSMainEnums::FIELD_ID));
-	casacore::ScalarColumn<double> timeColumn(ms, casacore::MS::columnName(casacore::MSMainEnums::TIME));
-	casacore::ScalarColumn<int> dataDescIdColumn(ms, ms.columnName(casacore::MSMainEnums::DATA_DESC_ID));
-	double time = timeColumn(0);
-	size_t timestepIndex = 0;
-	bool timeStepSelected = !selection.HasInterval() || timestepIndex == selection.IntervalStart();
-	for(size_t row = 0; row!=ms.nrow(); ++row)
+	if(!selection.HasMinUVWInM() && !selection.HasMaxUVWInM())
 	{
-		if(time != timeColumn(row))
-		{
-			++timestepIndex;
-			if(selection.HasInterval() && timestepIndex == selection.IntervalStart())
-			{
-				startRow = row;
-				timeStepSelected = true;
-			}
-			if(timestepIndex == selection.IntervalEnd())
-			{
-				if(selection.HasInterval())
-					endRow = row;
-				break;
-			}
-			time = timeColumn(row);
-		}
-		if(timeStepSelected)
+		// Without a uvw range, the selection is fully determined by the index
+		index->GetSelectedRows(selection, dataDescIds, startRow, endRow, idToMSRow);
+	}
+	else {
+		// The selection is made on the length of the stored uvws. A RephasingMSProvider
+		// (-shift) wraps this provider and rotates the uvws after they are read, but since
+		// the rotation does not change the uvw length, the same rows are selected as when
+		// the set would have been rotated with chgcentre.
+		casacore::ArrayColumn<double> uvwColumn(ms, casacore::MS::columnName(casacore::MSMainEnums::UVW));
+		casacore::ScalarColumn<int> antenna1Column(ms, casacore::MS::columnName(casacore::MSMainEnums::ANTENNA1));
+		casacore::ScalarColumn<int> antenna2Column(ms, casacore::MS::columnName(casacore::MSMainEnums::ANTENNA2));
+		casacore::ScalarColumn<int> fieldIdColumn(ms, casacore::MS::columnName(casacore::MSMainEnums::FIELD_ID));
+		casacore::ScalarColumn<int> dataDescIdColumn(ms, ms.columnName(casacore::MSMainEnums::DATA_DESC_ID));
+		size_t timestepIndex = startRow == endRow ? 0 : index->TimestepOfRow(startRow);
+		for(size_t row = startRow; row!=endRow; ++row)
 		{
+			while(row >= index->TimestepStartRow(timestepIndex+1))
+				++timestepIndex;
 			const int
 				a1 = antenna1Column(row), a2 = antenna2Column(row),
 				fieldId = fieldIdColumn(row), dataDescId = dataDescIdColumn(row);
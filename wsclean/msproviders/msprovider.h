@@ -60,7 +60,13 @@ public:
 	
 	virtual void ReadModel(std::complex<float>* buffer) = 0;
 	
-	virtual void WriteModel(size_t rowId, std::complex<float>* buffer) = 0;
+	/**
+	 * Write the predicted visibilities of a row. @p uvw is the uvw (in metres) of the row as
+	 * it was read with ReadMeta(). It allows providers that change the uvws, such as the
+	 * RephasingMSProvider, to process the row without storing the meta data of every row that
+	 * was read.
+	 */
+	virtual void WriteModel(size_t rowId, std::complex<float>* buffer, const double* uvw) = 0;
 	
 	virtual void WriteImagingWeights(size_t rowId, const float* buffer) = 0;
 	
@@ -196,7 +196,7 @@ void PartitionedMS::ReadModel(std::complex<float>* buffer)
 	memcpy(reinterpret_cast<char*>(buffer), _modelFileMap + rowLength*_currentRow, rowLength);
 }
 
-void PartitionedMS::WriteModel(size_t rowId, std::complex<float>* buffer)
+void PartitionedMS::WriteModel(size_t rowId, std::complex<float>* buffer, const double* /*uvw*/)
 {
 #ifdef REDUNDANT_VALIDATION
 	if(!_partHeader.hasModel)
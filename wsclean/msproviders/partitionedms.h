@@ -64,7 +64,7 @@ public:
 	
 	void ReadModel(std::complex<float>* buffer) override;
 	
-	void WriteModel(size_t rowId, std::complex<float>* buffer) override;
+	void WriteModel(size_t rowId, std::complex<float>* buffer, const double* uvw) override;
 	
 	void WriteImagingWeights(size_t rowId, const float* buffer) override;
 	
@@ -0,0 +1,134 @@
+#include "rephasingmsprovider.h"
+
+#include <cmath>
+#include <vector>
+
+namespace {
+	/**
+	 * Fills the rows of a row-major 3x3 matrix with the unit vectors of the u, v and w axes
+	 * for a phase direction, in the same coordinates as the J2000 baseline vectors.
+	 */
+	void uvwAxes(double ra, double dec, double* m)
+	{
+		const double
+			sinRA = std::sin(ra), cosRA = std::cos(ra),
+			sinDec = std::sin(dec), cosDec = std::cos(dec);
+		m[0] = -sinRA;          m[1] = cosRA;           m[2] = 0.0;
+		m[3] = -sinDec * cosRA; m[4] = -sinDec * sinRA; m[5] = cosDec;
+		m[6] = cosDec * cosRA;  m[7] = cosDec * sinRA;  m[8] = sinDec;
+	}
+}
+
+RephasingMSProvider::RephasingMSProvider(std::unique_ptr<MSProvider> msProvider, const BandData& band, double oldRA, double oldDec, double oldDL, double oldDM, double newRA, double newDec) :
+	_msProvider(std::move(msProvider)),
+	_band(band),
+	_oldDL(oldDL), _oldDM(oldDM),
+	_hasCurrentShift(false),
+	_currentShift(0.0)
+{
+	// The old uvw axes are orthonormal, so the baseline vector is the transpose of the old
+	// axes applied to the old uvw. Hence, new uvw = newAxes * oldAxes^T * old uvw.
+	double oldAxes[9], newAxes[9];
+	uvwAxes(oldRA, oldDec, oldAxes);
+	uvwAxes(newRA, newDec, newAxes);
+	for(size_t row=0; row!=3; ++row)
+	{
+		for(size_t col=0; col!=3; ++col)
+		{
+			double sum = 0.0;
+			for(size_t i=0; i!=3; ++i)
+				sum += newAxes[row*3 + i] * oldAxes[col*3 + i];
+			_rotation[row*3 + col] = sum;
+		}
+	}
+}
+
+void RephasingMSProvider::Rephase(const double* oldUVW, double* newUVW, double& shiftFactor) const
+{
+	for(size_t i=0; i!=3; ++i)
+		newUVW[i] = _rotation[i*3] * oldUVW[0] + _rotation[i*3+1] * oldUVW[1] + _rotation[i*3+2] * oldUVW[2];
+	// Same as in chgcentre: the new set has no denormal shift, while the shift of the
+	// original set is removed.
+	shiftFactor = -2.0*M_PI * (newUVW[2] - oldUVW[2]);
+	shiftFactor += 2.0*M_PI * (oldUVW[0]*_oldDL + oldUVW[1]*_oldDM);
+}
+
+void RephasingMSProvider::ReadMeta(double& u, double& v, double& w, size_t& dataDescId)
+{
+	double oldUVW[3], newUVW[3];
+	_msProvider->ReadMeta(oldUVW[0], oldUVW[1], oldUVW[2], dataDescId);
+	double shiftFactor;
+	Rephase(oldUVW, newUVW, shiftFactor);
+	u = newUVW[0];
+	v = newUVW[1];
+	w = newUVW[2];
+	_currentShift = shiftFactor;
+	_hasCurrentShift = true;
+}
+
+void RephasingMSProvider::ReadMeta(MSProvider::MetaData& metaData)
+{
+	_msProvider->ReadMeta(metaData);
+	const double oldUVW[3] = { metaData.uInM, metaData.vInM, metaData.wInM };
+	double newUVW[3], shiftFactor;
+	Rephase(oldUVW, newUVW, shiftFactor);
+	metaData.uInM = newUVW[0];
+	metaData.vInM = newUVW[1];
+	metaData.wInM = newUVW[2];
+	_currentShift = shiftFactor;
+	_hasCurrentShift = true;
+}
+
+double RephasingMSProvider::currentShift()
+{
+	if(!_hasCurrentShift)
+	{
+		double u, v, w;
+		size_t dataDescId;
+		ReadMeta(u, v, w, dataDescId);
+	}
+	return _currentShift;
+}
+
+void RephasingMSProvider::ReadData(std::complex<float>* buffer)
+{
+	_msProvider->ReadData(buffer);
+	rotate(buffer, currentShift());
+}
+
+void RephasingMSProvider::ReadModel(std::complex<float>* buffer)
+{
+	_msProvider->ReadModel(buffer);
+	rotate(buffer, currentShift());
+}
+
+void RephasingMSProvider::WriteModel(size_t rowId, std::complex<float>* buffer, const double* uvw)
+{
+	// The rotation is orthonormal, so its transpose turns the rephased uvw back into the
+	// uvw of the measurement set.
+	double oldUVW[3], newUVW[3], shiftFactor;
+	for(size_t i=0; i!=3; ++i)
+		oldUVW[i] = _rotation[i] * uvw[0] + _rotation[3+i] * uvw[1] + _rotation[6+i] * uvw[2];
+	Rephase(oldUVW, newUVW, shiftFactor);
+	// The caller's buffer is left unchanged
+	std::vector<std::complex<float>> rotated(buffer, buffer + _band.ChannelCount() * NPolarizations());
+	rotate(rotated.data(), -shiftFactor);
+	_msProvider->WriteModel(rowId, rotated.data(), oldUVW);
+}
+
+void RephasingMSProvider::rotate(std::complex<float>* buffer, double shiftFactor) const
+{
+	const size_t polarizationCount = _msProvider->NPolarizations();
+	for(size_t ch=0; ch!=_band.ChannelCount(); ++ch)
+	{
+		const double wShiftRad = shiftFactor / _band.ChannelWavelength(ch);
+		double rotSin, rotCos;
+		sincos(wShiftRad, &rotSin, &rotCos);
+		const std::complex<float> rotation(rotCos, rotSin);
+		for(size_t p=0; p!=polarizationCount; ++p)
+		{
+			*buffer *= rotation;
+			++buffer;
+		}
+	}
+}
@@ -0,0 +1,126 @@
+#ifndef MSPROVIDERS_REPHASING_MS_PROVIDER_H
+#define MSPROVIDERS_REPHASING_MS_PROVIDER_H
+
+#include "msprovider.h"
+
+#include "../banddata.h"
+
+#include <memory>
+
+/**
+ * This class wraps any MSProvider to make it provide the data as if the phase centre of the
+ * measurement set was at a different direction. The uvws and visibilities are re-phased
+ * while they are read, and predicted visibilities are phased back to the original phase
+ * centre when they are written. This makes it possible to image a different direction
+ * without rewriting the measurement set with chgcentre.
+ *
+ * Because the uvws of a J2000 measurement set are the baseline vectors projected on the
+ * axes of the phase direction, the new uvws follow from the old uvws with a fixed 3x3
+ * rotation. Therefore, neither antenna positions nor per-timestep conversions are needed.
+ * The visibilities are rotated in the same way as chgcentre does, including the removal of
+ * a denormal phase centre shift (dl, dm) of the original set. The rotation preserves the
+ * length of the uvws, so a selection on uvw length by the wrapped provider selects the
+ * same rows as it would on the rephased uvws. When a prediction is written, the shift of
+ * the row is recalculated from its uvw, so no meta data is stored per row.
+ */
+class RephasingMSProvider final : public MSProvider
+{
+public:
+	/**
+	 * @param msProvider The provider to wrap.
+	 * @param band The channels that @p msProvider provides.
+	 * @param oldRA, oldDec, oldDL, oldDM The phase centre of the measurement set.
+	 * @param newRA, newDec The new phase centre (J2000, radians).
+	 */
+	RephasingMSProvider(std::unique_ptr<MSProvider> msProvider, const BandData& band, double oldRA, double oldDec, double oldDL, double oldDM, double newRA, double newDec);
+
+	SynchronizedMS MS() override
+	{ return _msProvider->MS(); }
+
+	const std::string& DataColumnName() override
+	{ return _msProvider->DataColumnName(); }
+
+	size_t RowId() const override
+	{ return _msProvider->RowId(); }
+
+	bool CurrentRowAvailable() override
+	{ return _msProvider->CurrentRowAvailable(); }
+
+	void NextRow() override
+	{
+		_msProvider->NextRow();
+		_hasCurrentShift = false;
+	}
+
+	void Reset() override
+	{
+		_msProvider->Reset();
+		_hasCurrentShift = false;
+	}
+
+	void ReadMeta(double& u, double& v, double& w, size_t& dataDescId) override;
+
+	void ReadMeta(MSProvider::MetaData& metaData) override;
+
+	void ReadData(std::complex<float>* buffer) override;
+
+	void ReadModel(std::complex<float>* buffer) override;
+
+	void WriteModel(size_t rowId, std::complex<float>* buffer, const double* uvw) override;
+
+	void WriteImagingWeights(size_t rowId, const float* buffer) override
+	{ _msProvider->WriteImagingWeights(rowId, buffer); }
+
+	void ReadWeights(float* buffer) override
+	{ _msProvider->ReadWeights(buffer); }
+
+	void ReadWeights(std::complex<float>* buffer) override
+	{ _msProvider->ReadWeights(buffer); }
+
+	void ReopenRW() override
+	{ _msProvider->ReopenRW(); }
+
+	double StartTime() override
+	{ return _msProvider->StartTime(); }
+
+	void MakeIdToMSRowMapping(std::vector<size_t>& idToMSRow) override
+	{ _msProvider->MakeIdToMSRowMapping(idToMSRow); }
+
+	PolarizationEnum Polarization() override
+	{ return _msProvider->Polarization(); }
+
+	size_t NChannels() override
+	{ return _msProvider->NChannels(); }
+
+	size_t NAntennas() override
+	{ return _msProvider->NAntennas(); }
+
+	size_t NPolarizations() override
+	{ return _msProvider->NPolarizations(); }
+
+	/**
+	 * Calculate the uvw of a baseline towards the new phase centre, and the shift factor
+	 * (in radians times metres) with which its visibilities are rotated.
+	 */
+	void Rephase(const double* oldUVW, double* newUVW, double& shiftFactor) const;
+
+private:
+	/**
+	 * Calculates the shift of the current row, if it was not yet calculated by reading the
+	 * meta data of the row.
+	 */
+	double currentShift();
+
+	void rotate(std::complex<float>* buffer, double shiftFactor) const;
+
+	std::unique_ptr<MSProvider> _msProvider;
+	BandData _band;
+	double _oldDL, _oldDM;
+	/** Row-major 3x3 matrix that rotates the old uvws to the new uvws. */
+	double _rotation[9];
+
+	bool _hasCurrentShift;
+	double _currentShift;
+};
+
+#endif
@@ -74,8 +74,8 @@ public:
 		std::copy(_buffer[_bufferPosition].model.begin(), _buffer[_bufferPosition].model.end(), buffer);
 	}
 	
-	virtual void WriteModel(size_t rowId, std::complex<float>* buffer) override
-	{ _msProvider->WriteModel(rowId, buffer); }
+	virtual void WriteModel(size_t rowId, std::complex<float>* buffer, const double* uvw) override
+	{ _msProvider->WriteModel(rowId, buffer, uvw); }
 	
 	virtual void WriteImagingWeights(size_t rowId, const float* buffer) override
 	{ _msProvider->WriteImagingWeights(rowId, buffer); }
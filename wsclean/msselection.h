@@ -1,6 +1,7 @@
 #ifndef MS_SELECTION
 #define MS_SELECTION
 
+#include <algorithm>
 #include <cstring>
 #include <limits>
 
@@ -41,6 +42,8 @@ public:
 	double MinUVWInM() const { return _minUVWInM; }
 	double MaxUVWInM() const { return _maxUVWInM; }
 	
+	EvenOddSelection EvenOrOddTimesteps() const { return _evenOddSelection; }
+	
 	bool IsSelected(size_t fieldId, size_t timestep, size_t antenna1, size_t antenna2, const casacore::Vector<double>& uvw) const
 	{
 		if(HasMinUVWInM() || HasMaxUVWInM())
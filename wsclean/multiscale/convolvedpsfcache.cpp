@@ -0,0 +1,376 @@
+#include "convolvedpsfcache.h"
+
+#include "../fftwmanager.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+	const char fileMagic[8] = { 'W', 'S', 'C', 'P', 'S', 'F', 'C', '1' };
+	
+	void writeValue(std::ostream& stream, uint64_t value)
+	{
+		stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+	
+	void writeArray(std::ostream& stream, const ao::uvector<double>& values)
+	{
+		stream.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(double));
+	}
+	
+	uint64_t readValue(std::istream& stream)
+	{
+		uint64_t value;
+		stream.read(reinterpret_cast<char*>(&value), sizeof(value));
+		return value;
+	}
+	
+	void readArray(std::istream& stream, ao::uvector<double>& values, size_t size)
+	{
+		values.resize(size);
+		stream.read(reinterpret_cast<char*>(values.data()), size * sizeof(double));
+	}
+}
+
+const double* ConvolvedPSFCache::Entry::DoubleConvolvedPSF(size_t psfIndex, size_t scaleIndex) const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	const std::vector<ao::uvector<double>>& psfs = _doubleConvolvedPSFs[scaleIndex];
+	if(psfs.empty())
+		return nullptr;
+	else
+		return psfs[selectPSF(psfIndex)].data();
+}
+
+void ConvolvedPSFCache::Entry::StoreDoubleConvolvedPSFs(size_t scaleIndex, std::vector<ao::uvector<double>>&& psfs)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(_doubleConvolvedPSFs[scaleIndex].empty())
+	{
+		_doubleConvolvedPSFs[scaleIndex] = std::move(psfs);
+		_memorySize = calculateMemorySize();
+	}
+}
+
+size_t ConvolvedPSFCache::Entry::calculateMemorySize() const
+{
+	size_t count = _scales.size() + _input.size() + _psfPeaks.size();
+	for(const std::vector<std::vector<ao::uvector<double>>>* list : { &_convolvedPSFs, &_doubleConvolvedPSFs })
+	{
+		for(const std::vector<ao::uvector<double>>& psfs : *list)
+		{
+			for(const ao::uvector<double>& psf : psfs)
+				count += psf.size();
+		}
+	}
+	return count * sizeof(double);
+}
+
+bool ConvolvedPSFCache::Entry::matches(const double* integratedPSF, const ao::uvector<const double*>& psfs, size_t width, size_t height, const ao::uvector<double>& scales, MultiScaleTransforms::Shape shape) const
+{
+	const size_t
+		imageSize = width * height,
+		inputCount = (psfs.size() > 1) ? psfs.size()+1 : 1;
+	if(width != _width || height != _height || shape != _shape || scales != _scales || _input.size() != imageSize * inputCount)
+		return false;
+	if(!std::equal(integratedPSF, integratedPSF + imageSize, _input.begin()))
+		return false;
+	for(size_t i=0; i!=psfs.size() && psfs.size() > 1; ++i)
+	{
+		if(!std::equal(psfs[i], psfs[i] + imageSize, _input.begin() + imageSize*(i+1)))
+			return false;
+	}
+	return true;
+}
+
+void ConvolvedPSFCache::Entry::calculate(FFTWManager& fftwManager, const double* integratedPSF, const ao::uvector<const double*>& psfs)
+{
+	const size_t imageSize = _width * _height;
+	MultiScaleTransforms msTransforms(fftwManager, _width, _height, _shape);
+	ao::uvector<double> scratch(imageSize);
+	
+	// If there's only one, the integrated equals the first, so the individual PSFs are not stored
+	_convolvedPSFs.resize(psfs.size() > 1 ? psfs.size() : 1);
+	for(size_t psfIndex=0; psfIndex!=_convolvedPSFs.size(); ++psfIndex)
+	{
+		const double* psf = (psfs.size() > 1) ? psfs[psfIndex] : integratedPSF;
+		_convolvedPSFs[psfIndex].resize(_scales.size());
+		for(size_t scaleIndex=0; scaleIndex!=_scales.size(); ++scaleIndex)
+		{
+			ao::uvector<double>& convolved = _convolvedPSFs[psfIndex][scaleIndex];
+			convolved.assign(psf, psf + imageSize);
+			if(_scales[scaleIndex] != 0.0)
+				msTransforms.Transform(convolved.data(), scratch.data(), _scales[scaleIndex]);
+		}
+	}
+	
+	// The peak of the convolved integrated PSF only requires the convolution of the central pixel
+	const size_t centre = _width/2 + (_height/2)*_width;
+	_psfPeaks.resize(_scales.size());
+	for(size_t scaleIndex=0; scaleIndex!=_scales.size(); ++scaleIndex)
+	{
+		if(_convolvedPSFs.size() == 1)
+			_psfPeaks[scaleIndex] = _convolvedPSFs[0][scaleIndex][centre];
+		else if(_scales[scaleIndex] == 0.0)
+			_psfPeaks[scaleIndex] = integratedPSF[centre];
+		else {
+			ao::uvector<double> kernel;
+			size_t n;
+			msTransforms.MakeShapeFunction(_scales[scaleIndex], kernel, n);
+			double peak = 0.0;
+			for(size_t ky=0; ky!=n; ++ky)
+			{
+				const size_t y = (_height/2 + _height*n + n/2 - ky) % _height;
+				for(size_t kx=0; kx!=n; ++kx)
+				{
+					const size_t x = (_width/2 + _width*n + n/2 - kx) % _width;
+					peak += kernel[ky*n + kx] * integratedPSF[y*_width + x];
+				}
+			}
+			_psfPeaks[scaleIndex] = peak;
+		}
+	}
+	
+	_doubleConvolvedPSFs.assign(_scales.size(), std::vector<ao::uvector<double>>());
+	_memorySize = calculateMemorySize();
+}
+
+std::shared_ptr<ConvolvedPSFCache::Entry> ConvolvedPSFCache::Get(FFTWManager& fftwManager, const double* integratedPSF, const ao::uvector<const double*>& psfs, size_t width, size_t height, const ao::uvector<double>& scales, MultiScaleTransforms::Shape shape)
+{
+	std::shared_ptr<Entry> entry;
+	std::unique_lock<std::mutex> entryLock;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for(const std::shared_ptr<Entry>& e : _entries)
+		{
+			if(e->matches(integratedPSF, psfs, width, height, scales, shape))
+			{
+				entry = e;
+				break;
+			}
+		}
+		if(entry == nullptr)
+		{
+			// The description of the entry is filled in while holding the cache lock, so that
+			// other threads can match it. The convolution is done while holding only the lock
+			// of the entry.
+			entry.reset(new Entry());
+			entry->_width = width;
+			entry->_height = height;
+			entry->_scales = scales;
+			entry->_shape = shape;
+			const size_t imageSize = width * height;
+			entry->_input.assign(integratedPSF, integratedPSF + imageSize);
+			for(size_t i=0; i!=psfs.size() && psfs.size() > 1; ++i)
+				entry->_input.insert(entry->_input.end(), psfs[i], psfs[i] + imageSize);
+			entryLock = std::unique_lock<std::mutex>(entry->_mutex);
+			_entries.push_back(entry);
+		}
+		entry->_isUsed = true;
+		entry->_lastUse = ++_useCounter;
+	}
+	if(entryLock.owns_lock())
+	{
+		try {
+			entry->calculate(fftwManager, integratedPSF, psfs);
+		} catch(...) {
+			// A half-calculated entry is marked by having no convolved PSFs. It is removed, so that
+			// later requests calculate it again. The entry lock is released first, because other
+			// methods take the entry lock while holding the cache lock.
+			entry->_convolvedPSFs.clear();
+			entryLock.unlock();
+			removeEntry(entry.get());
+			throw;
+		}
+		entryLock.unlock();
+		std::lock_guard<std::mutex> lock(_mutex);
+		removeLeastRecentlyUsed(entry.get());
+	}
+	else {
+		// Wait until a possible calculation by another thread has finished
+		std::unique_lock<std::mutex> lock(entry->_mutex);
+		if(entry->_convolvedPSFs.empty())
+		{
+			// The calculation failed in the other thread
+			lock.unlock();
+			removeEntry(entry.get());
+			return Get(fftwManager, integratedPSF, psfs, width, height, scales, shape);
+		}
+	}
+	return entry;
+}
+
+void ConvolvedPSFCache::removeEntry(const Entry* entry)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_entries.erase(std::remove_if(_entries.begin(), _entries.end(),
+		[entry](const std::shared_ptr<Entry>& e) { return e.get() == entry; }),
+		_entries.end());
+}
+
+void ConvolvedPSFCache::removeLeastRecentlyUsed(const Entry* keep)
+{
+	if(_memoryLimit == 0)
+		return;
+	size_t memorySize = 0;
+	for(const std::shared_ptr<Entry>& entry : _entries)
+		memorySize += entry->_memorySize;
+	// Entries that are still being used by an algorithm are only freed once it releases them
+	while(memorySize > _memoryLimit)
+	{
+		std::vector<std::shared_ptr<Entry>>::iterator oldest = _entries.end();
+		for(std::vector<std::shared_ptr<Entry>>::iterator i = _entries.begin(); i != _entries.end(); ++i)
+		{
+			if(i->get() != keep && (oldest == _entries.end() || (*i)->_lastUse < (*oldest)->_lastUse))
+				oldest = i;
+		}
+		if(oldest == _entries.end())
+			break;
+		memorySize -= (*oldest)->_memorySize;
+		_entries.erase(oldest);
+	}
+}
+
+size_t ConvolvedPSFCache::MemorySize() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	size_t memorySize = 0;
+	for(const std::shared_ptr<Entry>& entry : _entries)
+		memorySize += entry->_memorySize;
+	return memorySize;
+}
+
+void ConvolvedPSFCache::RemoveUnused()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_entries.erase(std::remove_if(_entries.begin(), _entries.end(),
+		[](const std::shared_ptr<Entry>& entry) { return !entry->_isUsed; }),
+		_entries.end());
+	for(std::shared_ptr<Entry>& entry : _entries)
+		entry->_isUsed = false;
+}
+
+void ConvolvedPSFCache::Save(const std::string& filename) const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	std::ofstream file(filename, std::ios::binary);
+	if(!file)
+		throw std::runtime_error("Could not open " + filename + " for writing");
+	file.write(fileMagic, sizeof(fileMagic));
+	writeValue(file, _entries.size());
+	for(const std::shared_ptr<Entry>& entry : _entries)
+	{
+		std::lock_guard<std::mutex> entryLock(entry->_mutex);
+		writeValue(file, entry->_width);
+		writeValue(file, entry->_height);
+		writeValue(file, entry->_shape);
+		writeValue(file, entry->_scales.size());
+		writeValue(file, entry->_input.size());
+		writeValue(file, entry->_convolvedPSFs.size());
+		writeArray(file, entry->_scales);
+		writeArray(file, entry->_input);
+		writeArray(file, entry->_psfPeaks);
+		for(const std::vector<ao::uvector<double>>& psfs : entry->_convolvedPSFs)
+		{
+			for(const ao::uvector<double>& psf : psfs)
+				writeArray(file, psf);
+		}
+		for(const std::vector<ao::uvector<double>>& psfs : entry->_doubleConvolvedPSFs)
+		{
+			writeValue(file, psfs.empty() ? 0 : 1);
+			for(const ao::uvector<double>& psf : psfs)
+				writeArray(file, psf);
+		}
+	}
+	if(!file)
+		throw std::runtime_error("Error writing " + filename);
+}
+
+void ConvolvedPSFCache::Load(const std::string& filename, size_t maxWidth, size_t maxHeight, size_t maxPSFCount)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if(!file)
+		throw std::runtime_error("Could not open " + filename + " for reading");
+	file.seekg(0, std::ios::end);
+	const uint64_t fileSize = file.tellg();
+	file.seekg(0, std::ios::beg);
+	char magic[sizeof(fileMagic)];
+	file.read(magic, sizeof(magic));
+	if(!file || memcmp(magic, fileMagic, sizeof(fileMagic)) != 0)
+		throw std::runtime_error(filename + " is not a convolved PSF file");
+	
+	// Sizes are checked against the remaining length of the file before anything is allocated,
+	// so that a damaged or unrelated file can not cause huge allocations.
+	const uint64_t entryHeaderSize = 6 * sizeof(uint64_t);
+	const uint64_t entryCount = readValue(file);
+	if(!file || entryCount > (fileSize - file.tellg()) / entryHeaderSize)
+		throw std::runtime_error("Error reading " + filename + ": invalid number of entries");
+	std::vector<std::shared_ptr<Entry>> entries(entryCount);
+	for(std::shared_ptr<Entry>& entry : entries)
+	{
+		entry.reset(new Entry());
+		const uint64_t
+			width = readValue(file),
+			height = readValue(file),
+			shape = readValue(file),
+			scaleCount = readValue(file),
+			inputSize = readValue(file),
+			psfCount = readValue(file);
+		if(!file)
+			break;
+		if(width == 0 || height == 0 || width > maxWidth || height > maxHeight)
+			throw std::runtime_error("Convolved PSFs in " + filename + " do not match the image size");
+		if(psfCount == 0 || psfCount > maxPSFCount)
+			throw std::runtime_error("Convolved PSFs in " + filename + " do not match the number of deconvolution channels");
+		if(shape != MultiScaleTransforms::TaperedQuadraticShape && shape != MultiScaleTransforms::GaussianShape)
+			throw std::runtime_error("Error reading " + filename + ": invalid shape function");
+		const uint64_t
+			imageSize = width * height,
+			inputCount = (psfCount > 1) ? psfCount+1 : 1,
+			remaining = (fileSize - file.tellg()) / sizeof(double);
+		// Each scale has a scale value, a peak value and a convolved PSF per psf
+		if(inputSize != imageSize * inputCount || inputSize > remaining ||
+			scaleCount == 0 || scaleCount > (remaining - inputSize) / (2 + psfCount * imageSize))
+			throw std::runtime_error("Error reading " + filename + ": entry sizes are inconsistent with the file size");
+		entry->_width = width;
+		entry->_height = height;
+		entry->_shape = MultiScaleTransforms::Shape(shape);
+		readArray(file, entry->_scales, scaleCount);
+		readArray(file, entry->_input, inputSize);
+		readArray(file, entry->_psfPeaks, scaleCount);
+		entry->_convolvedPSFs.resize(psfCount);
+		for(std::vector<ao::uvector<double>>& psfs : entry->_convolvedPSFs)
+		{
+			psfs.resize(scaleCount);
+			for(ao::uvector<double>& psf : psfs)
+				readArray(file, psf, imageSize);
+		}
+		entry->_doubleConvolvedPSFs.resize(scaleCount);
+		for(std::vector<ao::uvector<double>>& psfs : entry->_doubleConvolvedPSFs)
+		{
+			const uint64_t hasPSFs = readValue(file);
+			if(!file)
+				break;
+			if(hasPSFs != 0)
+			{
+				if(psfCount * imageSize > (fileSize - file.tellg()) / sizeof(double))
+					throw std::runtime_error("Error reading " + filename + ": file is truncated");
+				psfs.resize(psfCount);
+				for(ao::uvector<double>& psf : psfs)
+					readArray(file, psf, imageSize);
+			}
+		}
+		entry->_memorySize = entry->calculateMemorySize();
+	}
+	if(!file)
+		throw std::runtime_error("Error reading " + filename + ": file is truncated");
+	
+	std::lock_guard<std::mutex> lock(_mutex);
+	for(std::shared_ptr<Entry>& entry : entries)
+		entry->_lastUse = ++_useCounter;
+	_entries.insert(_entries.end(), entries.begin(), entries.end());
+	removeLeastRecentlyUsed(nullptr);
+}
@@ -0,0 +1,171 @@
+#ifndef CONVOLVED_PSF_CACHE_H
+#define CONVOLVED_PSF_CACHE_H
+
+#include "multiscaletransforms.h"
+
+#include "../uvector.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Stores the scale-convolved and double-convolved PSFs that are used by the multi-scale
+ * algorithm. The PSFs do not change between major iterations, and with parallel
+ * deconvolution all sub-images of the same size use the same trimmed PSFs. This cache makes
+ * sure that these are calculated only once. It is owned by the @ref Deconvolution object and
+ * shared by all multi-scale algorithms of a run.
+ *
+ * Entries are identified by the PSFs themselves, the scales and the shape function, so an
+ * entry can never be used for the wrong PSF. When a memory limit is set, the least recently
+ * used entries are removed once the entries together use more memory than the limit. All
+ * methods are thread safe.
+ */
+class ConvolvedPSFCache
+{
+public:
+	class Entry
+	{
+	public:
+		size_t Width() const { return _width; }
+		size_t Height() const { return _height; }
+		size_t ScaleCount() const { return _scales.size(); }
+		
+		/**
+		 * The PSF convolved with the given scale. When the entry was made from a single PSF,
+		 * only psfIndex 0 is available.
+		 */
+		const double* ConvolvedPSF(size_t psfIndex, size_t scaleIndex) const
+		{
+			return _convolvedPSFs[selectPSF(psfIndex)][scaleIndex].data();
+		}
+		
+		/**
+		 * Central value of the integrated PSF after convolution with the given scale.
+		 */
+		double PSFPeak(size_t scaleIndex) const { return _psfPeaks[scaleIndex]; }
+		
+		/**
+		 * The PSF convolved twice with the given scale, or nullptr when these have not yet been
+		 * stored for this scale.
+		 */
+		const double* DoubleConvolvedPSF(size_t psfIndex, size_t scaleIndex) const;
+		
+		/**
+		 * Store the double-convolved PSFs (one per PSF) of a scale. If another thread already stored
+		 * them, the call is ignored.
+		 */
+		void StoreDoubleConvolvedPSFs(size_t scaleIndex, std::vector<ao::uvector<double>>&& psfs);
+		
+	private:
+		friend class ConvolvedPSFCache;
+		
+		Entry() : _width(0), _height(0), _shape(MultiScaleTransforms::TaperedQuadraticShape), _isUsed(true), _lastUse(0), _memorySize(0) { }
+		
+		size_t selectPSF(size_t psfIndex) const
+		{
+			return _convolvedPSFs.size() == 1 ? 0 : psfIndex;
+		}
+		
+		bool matches(const double* integratedPSF, const ao::uvector<const double*>& psfs, size_t width, size_t height, const ao::uvector<double>& scales, MultiScaleTransforms::Shape shape) const;
+		
+		void calculate(class FFTWManager& fftwManager, const double* integratedPSF, const ao::uvector<const double*>& psfs);
+		
+		size_t calculateMemorySize() const;
+		
+		size_t _width, _height;
+		ao::uvector<double> _scales;
+		MultiScaleTransforms::Shape _shape;
+		// The integrated PSF, followed by the individual PSFs when there is more than one
+		ao::uvector<double> _input;
+		// Indexed by [psf][scale]
+		std::vector<std::vector<ao::uvector<double>>> _convolvedPSFs;
+		ao::uvector<double> _psfPeaks;
+		// Indexed by [scale][psf]
+		std::vector<std::vector<ao::uvector<double>>> _doubleConvolvedPSFs;
+		bool _isUsed;
+		// Value of the use counter of the cache when the entry was last requested
+		size_t _lastUse;
+		// Number of bytes of all arrays, updated when PSFs are added. It can be read without
+		// holding the lock of the entry.
+		std::atomic<size_t> _memorySize;
+		// Held while calculating, and while accessing the double-convolved PSFs.
+		mutable std::mutex _mutex;
+	};
+	
+	ConvolvedPSFCache() : _memoryLimit(0), _useCounter(0) { }
+	
+	/**
+	 * Returns the entry for the given PSFs and scales. If it is not in the cache, the convolved
+	 * PSFs are calculated. When multiple threads request the same entry at the same time, only
+	 * one thread calculates it while the others wait for the result. When the calculation
+	 * throws, the entry is removed from the cache and the exception is passed on.
+	 */
+	std::shared_ptr<Entry> Get(class FFTWManager& fftwManager, const double* integratedPSF, const ao::uvector<const double*>& psfs, size_t width, size_t height, const ao::uvector<double>& scales, MultiScaleTransforms::Shape shape);
+	
+	/**
+	 * Removes the entries that have not been requested since the last call. Sub-image sizes of
+	 * parallel deconvolution change between major iterations, and this makes sure that the cache
+	 * does not keep growing.
+	 */
+	void RemoveUnused();
+	
+	/**
+	 * Limit the total memory of the entries. Zero, the default, means no limit. The entry
+	 * that was requested last is never removed, even if it is larger than the limit.
+	 */
+	void SetMemoryLimit(size_t memoryLimit)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_memoryLimit = memoryLimit;
+	}
+	
+	size_t MemoryLimit() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _memoryLimit;
+	}
+	
+	/**
+	 * Number of bytes used by the entries in the cache.
+	 */
+	size_t MemorySize() const;
+	
+	void Clear()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_entries.clear();
+	}
+	
+	size_t Size() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _entries.size();
+	}
+	
+	/**
+	 * Write all entries to a file, so that a continued run can read them with @ref Load().
+	 */
+	void Save(const std::string& filename) const;
+	
+	/**
+	 * Adds the entries from a file that was written with @ref Save(). The file is rejected with
+	 * an exception when one of its entries does not fit the current deconvolution, i.e. when it
+	 * is larger than the given image size or was made from more PSFs, or when the file is shorter
+	 * than its header says. Nothing is added in that case.
+	 */
+	void Load(const std::string& filename, size_t maxWidth, size_t maxHeight, size_t maxPSFCount);
+	
+private:
+	void removeLeastRecentlyUsed(const Entry* keep);
+	
+	void removeEntry(const Entry* entry);
+	
+	std::vector<std::shared_ptr<Entry>> _entries;
+	size_t _memoryLimit, _useCounter;
+	mutable std::mutex _mutex;
+};
+
+#endif
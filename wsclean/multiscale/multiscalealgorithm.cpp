@@ -24,7 +24,8 @@ MultiScaleAlgorithm::MultiScaleAlgorithm(ImageBufferAllocator& allocator, FFTWMa
 	_scaleShape(MultiScaleTransforms::TaperedQuadraticShape),
 	_maxScales(0),
 	_trackPerScaleMasks(false), _usePerScaleMasks(false),
-	_fastSubMinorLoop(true), _trackComponents(false)
+	_fastSubMinorLoop(true), _trackComponents(false),
+	_psfCache(std::make_shared<ConvolvedPSFCache>())
 {
 	if(_beamSizeInPixels<=0.0)
 		_beamSizeInPixels = 1;
@@ -112,19 +113,8 @@ double MultiScaleAlgorithm::ExecuteMajorIteration(ImageSet& dirtySet, ImageSet&
 	_allocator.Allocate(scratchWidth*scratchHeight, scratch);
 	_allocator.Allocate(scratchWidth*scratchHeight, scratchB);
 	_allocator.Allocate(_width*_height, integratedScratch);
-	std::unique_ptr<std::unique_ptr<ImageBufferAllocator::Ptr[]>[]> convolvedPSFs(
-		new std::unique_ptr<ImageBufferAllocator::Ptr[]>[dirtySet.PSFCount()]);
 	dirtySet.GetIntegratedPSF(integratedScratch.data(), psfs);
-	convolvePSFs(convolvedPSFs[0], integratedScratch.data(), scratch.data(), true);
-
-	// If there's only one, the integrated equals the first, so we can skip this
-	if(dirtySet.PSFCount() > 1)
-	{
-		for(size_t i=0; i!=dirtySet.PSFCount(); ++i)
-		{
-			convolvePSFs(convolvedPSFs[i], psfs[i], scratch.data(), false);
-		}
-	}
+	updateConvolvedPSFs(integratedScratch.data(), psfs);
 	
 	MultiScaleTransforms msTransforms(_fftwManager, _width, _height, _scaleShape);
 	
@@ -154,12 +144,7 @@ double MultiScaleAlgorithm::ExecuteMajorIteration(ImageSet& dirtySet, ImageSet&
 		_logReceiver->Info << " (final)";
 	_logReceiver->Info << '\n';
 	
-	std::unique_ptr<ImageBufferAllocator::Ptr[]> doubleConvolvedPSFs(
-		new ImageBufferAllocator::Ptr[dirtySet.PSFCount()]);
-	for(size_t i=0; i!=dirtySet.PSFCount(); ++i)
-	{
-		_allocator.Allocate(_width*_height, doubleConvolvedPSFs[i]);
-	}
+	ao::uvector<const double*> doubleConvolvedPSFs(dirtySet.PSFCount());
 	
 	ImageSet individualConvolvedImages(&dirtySet.Table(), dirtySet.Allocator(), dirtySet.Settings(), _width, _height);
 	
@@ -173,22 +158,37 @@ double MultiScaleAlgorithm::ExecuteMajorIteration(ImageSet& dirtySet, ImageSet&
 		thresholdCountdown > 0)
 	{
 		// Create double-convolved PSFs & individually convolved images for this scale
-		ao::uvector<double*> transformList;
-		for(size_t i=0; i!=dirtySet.PSFCount(); ++i)
+		if(_convolvedPSFs->DoubleConvolvedPSF(0, scaleWithPeak) == nullptr)
 		{
-			double* psf = getConvolvedPSF(i, scaleWithPeak, convolvedPSFs);
-			memcpy(doubleConvolvedPSFs[i].data(), psf, _width*_height*sizeof(double));
-			transformList.push_back(doubleConvolvedPSFs[i].data());
+			std::vector<ao::uvector<double>> psfVectors(dirtySet.PSFCount());
+			ao::uvector<double*> psfTransformList;
+			for(size_t i=0; i!=dirtySet.PSFCount(); ++i)
+			{
+				const double* psf = getConvolvedPSF(i, scaleWithPeak);
+				psfVectors[i].assign(psf, psf + _width*_height);
+				psfTransformList.push_back(psfVectors[i].data());
+			}
+			if(_scaleInfos[scaleWithPeak].scale != 0.0)
+				tools->MultiScaleTransform(&msTransforms, psfTransformList, scratch.data(), _scaleInfos[scaleWithPeak].scale);
+			_convolvedPSFs->StoreDoubleConvolvedPSFs(scaleWithPeak, std::move(psfVectors));
 		}
+		for(size_t i=0; i!=dirtySet.PSFCount(); ++i)
+			doubleConvolvedPSFs[i] = _convolvedPSFs->DoubleConvolvedPSF(i, scaleWithPeak);
+		
+		ao::uvector<double*> imageTransformList;
 		for(size_t i=0; i!=dirtySet.size(); ++i)
 		{
 			memcpy(individualConvolvedImages[i], dirtySet[i], _width*_height*sizeof(double));
-			transformList.push_back(individualConvolvedImages[i]);
+			imageTransformList.push_back(individualConvolvedImages[i]);
 		}
 		if(_scaleInfos[scaleWithPeak].scale != 0.0)
 		{
-			tools->MultiScaleTransform(&msTransforms, transformList, scratch.data(), _scaleInfos[scaleWithPeak].scale);
-			//msTransforms.Transform(transformList, scratch.data(), _scaleInfos[scaleWithPeak].scale);
+			// Of the convolved images, only the region in which peaks are searched is used.
+			size_t x1, y1, x2, y2;
+			getCleanRegion(getMask(scaleWithPeak), x1, y1, x2, y2);
+			MultiScaleTransforms regionTransforms(msTransforms);
+			regionTransforms.SetOutputRegion(x1, y1, x2, y2);
+			tools->MultiScaleTransform(&regionTransforms, imageTransformList, scratch.data(), _scaleInfos[scaleWithPeak].scale);
 		}
 		
 		//
@@ -230,17 +230,23 @@ double MultiScaleAlgorithm::ExecuteMajorIteration(ImageSet& dirtySet, ImageSet&
 			subLoop.SetCleanBorders(horBorderSize, vertBorderSize);
 			if(!_rmsFactorImage.empty())
 				subLoop.SetRMSFactorImage(_rmsFactorImage);
-			if(_usePerScaleMasks)
-				subLoop.SetMask(_scaleMasks[scaleWithPeak].data());
-			else if(_cleanMask)
-				subLoop.SetMask(_cleanMask);
+			if(getMask(scaleWithPeak))
+				subLoop.SetMask(getMask(scaleWithPeak));
 			subLoop.SetSpectralFitter(&Fitter());
 			
-			ao::uvector<const double*> subPSFs(dirtySet.PSFCount());
-			for(size_t psfIndex=0; psfIndex!=subPSFs.size(); ++psfIndex)
-				subPSFs[psfIndex] = doubleConvolvedPSFs[psfIndex].data();
+			// Components can only be found inside the clean region, hence the convolved model is
+			// zero outside the clean region extended by the kernel size.
+			MultiScaleTransforms modelTransforms(msTransforms);
+			if(_scaleInfos[scaleWithPeak].scale != 0.0)
+			{
+				size_t x1, y1, x2, y2;
+				getCleanRegion(getMask(scaleWithPeak), x1, y1, x2, y2);
+				const size_t kernelBorder = modelTransforms.KernelSize(_scaleInfos[scaleWithPeak].scale) / 2;
+				if(x1 < x2 && y1 < y2 && x1 >= kernelBorder && y1 >= kernelBorder && x2 + kernelBorder <= _width && y2 + kernelBorder <= _height)
+					modelTransforms.SetOutputRegion(x1 - kernelBorder, y1 - kernelBorder, x2 + kernelBorder, y2 + kernelBorder);
+			}
 			
-			subLoop.Run(individualConvolvedImages, subPSFs);
+			subLoop.Run(individualConvolvedImages, doubleConvolvedPSFs);
 			
 			_iterationNumber = subLoop.CurrentIteration();
 			_scaleInfos[scaleWithPeak].nComponentsCleaned += (_iterationNumber - subMinorStartIteration);
@@ -249,7 +255,7 @@ double MultiScaleAlgorithm::ExecuteMajorIteration(ImageSet& dirtySet, ImageSet&
 			for(size_t imageIndex=0; imageIndex!=dirtySet.size(); ++imageIndex)
 			{
 				// TODO this can be multi-threaded if each thread has its own temporaries
-				double *psf = getConvolvedPSF(dirtySet.PSFIndex(imageIndex), scaleWithPeak, convolvedPSFs);
+				const double *psf = getConvolvedPSF(dirtySet.PSFIndex(imageIndex), scaleWithPeak);
 				subLoop.CorrectResidualDirty(_fftwManager, scratch.data(), scratchB.data(), integratedScratch.data(), imageIndex, dirtySet[imageIndex],  psf);
 				
 				subLoop.GetFullIndividualModel(imageIndex, scratch.data());
@@ -261,7 +267,7 @@ double MultiScaleAlgorithm::ExecuteMajorIteration(ImageSet& dirtySet, ImageSet&
 						subLoop.UpdateComponentList(*_componentList, scaleWithPeak);
 				}
 				if(_scaleInfos[scaleWithPeak].scale != 0.0)
-					tools->MultiScaleTransform(&msTransforms, ao::uvector<double*>{scratch.data()}, integratedScratch.data(), _scaleInfos[scaleWithPeak].scale);
+					tools->MultiScaleTransform(&modelTransforms, ao::uvector<double*>{scratch.data()}, integratedScratch.data(), _scaleInfos[scaleWithPeak].scale);
 				double* model = modelSet[imageIndex];
 				for(size_t i=0; i!=_width*_height; ++i)
 					model[i] += scratch.data()[i];
@@ -284,11 +290,11 @@ double MultiScaleAlgorithm::ExecuteMajorIteration(ImageSet& dirtySet, ImageSet&
 					// Subtract component from individual, non-deconvolved images
 					componentValues[imgIndex] = componentValues[imgIndex] * maxScaleInfo.gain;
 					
-					double* psf = getConvolvedPSF(dirtySet.PSFIndex(imgIndex), scaleWithPeak, convolvedPSFs);
+					const double* psf = getConvolvedPSF(dirtySet.PSFIndex(imgIndex), scaleWithPeak);
 					tools->SubtractImage(dirtySet[imgIndex], psf, _width, _height, maxScaleInfo.maxImageValueX, maxScaleInfo.maxImageValueY, componentValues[imgIndex]);
 					
 					// Subtract double convolved PSFs from convolved images
-					tools->SubtractImage(individualConvolvedImages[imgIndex], doubleConvolvedPSFs[dirtySet.PSFIndex(imgIndex)].data(), _width, _height, maxScaleInfo.maxImageValueX, maxScaleInfo.maxImageValueY, componentValues[imgIndex]);
+					tools->SubtractImage(individualConvolvedImages[imgIndex], doubleConvolvedPSFs[dirtySet.PSFIndex(imgIndex)], _width, _height, maxScaleInfo.maxImageValueX, maxScaleInfo.maxImageValueY, componentValues[imgIndex]);
 					// TODO this is incorrect, but why is the residual without Cotton-Schwab still OK ?
 					// Should test
 					//tools->SubtractImage(individualConvolvedImages[imgIndex], psf, _width, _height, maxScaleInfo.maxImageValueX, maxScaleInfo.maxImageValueY, componentValues[imgIndex]);
@@ -387,53 +393,41 @@ void MultiScaleAlgorithm::initializeScaleInfo()
 	}
 }
 
-void MultiScaleAlgorithm::convolvePSFs(std::unique_ptr<ImageBufferAllocator::Ptr[]>& convolvedPSFs, const double* psf, double* tmp, bool isIntegrated)
+void MultiScaleAlgorithm::updateConvolvedPSFs(const double* integratedPSF, const ao::uvector<const double*>& psfs)
 {
-	MultiScaleTransforms msTransforms(_fftwManager, _width, _height, _scaleShape);
-	convolvedPSFs.reset(new ImageBufferAllocator::Ptr[_scaleInfos.size()]);
-	if(isIntegrated)
-		_logReceiver->Info << "Scale info:\n";
+	// The PSFs normally do not change between major iterations, in which case the cache
+	// returns the convolved PSFs of the previous major iteration.
+	ao::uvector<double> scales(_scaleInfos.size());
+	for(size_t scaleIndex=0; scaleIndex!=_scaleInfos.size(); ++scaleIndex)
+		scales[scaleIndex] = _scaleInfos[scaleIndex].scale;
+	_convolvedPSFs = _psfCache->Get(_fftwManager, integratedPSF, psfs, _width, _height, scales, _scaleShape);
+	
+	_logReceiver->Info << "Scale info:\n";
 	const double firstAutoScaleSize = _beamSizeInPixels * 2.0;
 	for(size_t scaleIndex=0; scaleIndex!=_scaleInfos.size(); ++scaleIndex)
 	{
 		ScaleInfo& scaleEntry = _scaleInfos[scaleIndex];
 		
-		_allocator.Allocate(_width*_height, convolvedPSFs[scaleIndex]);
-		memcpy(convolvedPSFs[scaleIndex].data(), psf, _width*_height*sizeof(double));
+		scaleEntry.psfPeak = _convolvedPSFs->PSFPeak(scaleIndex);
+		// We normalize this factor to 1 for scale 0, so:
+		// factor = (psf / kernel) / (psf0 / kernel0) = psf * kernel0 / (kernel * psf0)
+		//scaleEntry.biasFactor = std::max(1.0,
+		//	scaleEntry.psfPeak * scaleInfos[0].kernelPeak /
+		//	(scaleEntry.kernelPeak * scaleInfos[0].psfPeak));
+		double expTerm;
+		if(scaleEntry.scale == 0.0 || _scaleInfos.size() < 2)
+			expTerm = 0.0;
+		else
+			expTerm = log2(scaleEntry.scale / firstAutoScaleSize);
+		scaleEntry.biasFactor = pow(_multiscaleScaleBias, -double(expTerm)) * 1.0;
 		
-		if(isIntegrated)
-		{
-			if(scaleEntry.scale != 0.0)
-				msTransforms.Transform(convolvedPSFs[scaleIndex].data(), tmp, scaleEntry.scale);
-			
-			scaleEntry.psfPeak = convolvedPSFs[scaleIndex][_width/2 + (_height/2)*_width];
-			// We normalize this factor to 1 for scale 0, so:
-			// factor = (psf / kernel) / (psf0 / kernel0) = psf * kernel0 / (kernel * psf0)
-			//scaleEntry.biasFactor = std::max(1.0,
-			//	scaleEntry.psfPeak * scaleInfos[0].kernelPeak /
-			//	(scaleEntry.kernelPeak * scaleInfos[0].psfPeak));
-			double expTerm;
-			if(scaleEntry.scale == 0.0 || _scaleInfos.size() < 2)
-				expTerm = 0.0;
-			else
-				expTerm = log2(scaleEntry.scale / firstAutoScaleSize);
-			scaleEntry.biasFactor = pow(_multiscaleScaleBias, -double(expTerm)) * 1.0;
-			
-			// I tried this, but wasn't perfect:
-			// _gain * _scaleInfos[0].kernelPeak / scaleEntry.kernelPeak;
-			scaleEntry.gain = _gain / scaleEntry.psfPeak;
-			
-			scaleEntry.isActive = true;
-			
-			if(scaleEntry.scale == 0.0)
-				memcpy(convolvedPSFs[scaleIndex].data(), psf, _width*_height*sizeof(double));
-			
-			_logReceiver->Info << "- Scale " << round(scaleEntry.scale) << ", bias factor=" << round(scaleEntry.biasFactor*10.0)/10.0 << ", psfpeak=" << scaleEntry.psfPeak << ", gain=" << scaleEntry.gain << ", kernel peak=" << scaleEntry.kernelPeak << '\n';
-		}
-		else {
-			if(scaleEntry.scale != 0.0)
-				msTransforms.Transform(convolvedPSFs[scaleIndex].data(), tmp, scaleEntry.scale);
-		}
+		// I tried this, but wasn't perfect:
+		// _gain * _scaleInfos[0].kernelPeak / scaleEntry.kernelPeak;
+		scaleEntry.gain = _gain / scaleEntry.psfPeak;
+		
+		scaleEntry.isActive = true;
+		
+		_logReceiver->Info << "- Scale " << round(scaleEntry.scale) << ", bias factor=" << round(scaleEntry.biasFactor*10.0)/10.0 << ", psfpeak=" << scaleEntry.psfPeak << ", gain=" << scaleEntry.gain << ", kernel peak=" << scaleEntry.kernelPeak << '\n';
 	}
 }
 
@@ -467,6 +461,22 @@ void MultiScaleAlgorithm::findActiveScaleConvolvedMaxima(const ImageSet& imageSe
 	}
 	std::vector<ThreadedDeconvolutionTools::PeakData> results;
 	
+	if(!reportRMS)
+	{
+		// When the RMS is not needed, only the region in which peaks are searched has to be transformed
+		size_t x1 = _width, y1 = _height, x2 = 0, y2 = 0;
+		for(size_t i=0; i!=transformIndices.size(); ++i)
+		{
+			size_t rx1, ry1, rx2, ry2;
+			getCleanRegion(getMask(transformIndices[i]), rx1, ry1, rx2, ry2);
+			if(rx1 < rx2 && ry1 < ry2)
+			{
+				x1 = std::min(x1, rx1); y1 = std::min(y1, ry1);
+				x2 = std::max(x2, rx2); y2 = std::max(y2, ry2);
+			}
+		}
+		msTransforms.SetOutputRegion(x1, y1, x2, y2);
+	}
 	tools->FindMultiScalePeak(&msTransforms, &_allocator, integratedScratch, transformScales, results, _allowNegativeComponents, _cleanMask, transformScaleMasks, _cleanBorderRatio, _rmsFactorImage, reportRMS);
 	
 	for(size_t i=0; i!=results.size(); ++i)
@@ -571,9 +581,53 @@ void MultiScaleAlgorithm::addComponentToModel(double* model, size_t scaleWithPea
 	}
 }
 
-double* MultiScaleAlgorithm::getConvolvedPSF(size_t psfIndex, size_t scaleIndex, const std::unique_ptr<std::unique_ptr<ImageBufferAllocator::Ptr[]>[]>& convolvedPSFs)
+const double* MultiScaleAlgorithm::getConvolvedPSF(size_t psfIndex, size_t scaleIndex) const
 {
-	return convolvedPSFs[psfIndex][scaleIndex].data();
+	return _convolvedPSFs->ConvolvedPSF(psfIndex, scaleIndex);
+}
+
+const bool* MultiScaleAlgorithm::getMask(size_t scaleIndex) const
+{
+	if(_usePerScaleMasks)
+		return _scaleMasks[scaleIndex].data();
+	else
+		return _cleanMask;
+}
+
+void MultiScaleAlgorithm::getCleanRegion(const bool* mask, size_t& x1, size_t& y1, size_t& x2, size_t& y2) const
+{
+	const size_t
+		horBorderSize = round(_width*_cleanBorderRatio),
+		vertBorderSize = round(_height*_cleanBorderRatio);
+	x1 = horBorderSize;
+	y1 = vertBorderSize;
+	x2 = std::max(_width - horBorderSize, x1);
+	y2 = std::max(_height - vertBorderSize, y1);
+	if(mask != nullptr)
+	{
+		size_t maskX1 = x2, maskY1 = y2, maskX2 = x1, maskY2 = y1;
+		for(size_t y=y1; y!=y2; ++y)
+		{
+			const bool* maskRow = &mask[y*_width];
+			for(size_t x=x1; x!=x2; ++x)
+			{
+				if(maskRow[x])
+				{
+					maskX1 = std::min(maskX1, x); maskX2 = std::max(maskX2, x+1);
+					maskY1 = std::min(maskY1, y); maskY2 = y+1;
+				}
+			}
+		}
+		if(maskX1 < maskX2)
+		{
+			x1 = maskX1; y1 = maskY1;
+			x2 = maskX2; y2 = maskY2;
+		}
+		else {
+			x2 = x1;
+			y2 = y1;
+		}
+	}
 }
 
 void MultiScaleAlgorithm::findPeakDirect(const double* image, double* scratch, size_t scaleIndex)
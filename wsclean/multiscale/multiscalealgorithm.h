@@ -2,8 +2,10 @@
 #define MULTISCALE_ALGORITHM_H
 
 #include <cstring>
+#include <memory>
 #include <vector>
 
+#include "convolvedpsfcache.h"
 #include "threadeddeconvolutiontools.h"
 
 #include "../uvector.h"
@@ -95,6 +97,13 @@ public:
 	{
 		_maxScales = maxScales;
 	}
+	/**
+	 * Use the given cache for the convolved PSFs. Clones of this algorithm share the cache.
+	 */
+	void SetConvolvedPSFCache(std::shared_ptr<ConvolvedPSFCache> cache)
+	{
+		_psfCache = std::move(cache);
+	}
 private:
 	class ImageBufferAllocator& _allocator;
 	FFTWManager& _fftwManager;
@@ -142,9 +151,12 @@ private:
 	bool _trackPerScaleMasks, _usePerScaleMasks, _fastSubMinorLoop, _trackComponents;
 	std::vector<ao::uvector<bool>> _scaleMasks;
 	ao::cloned_ptr<ComponentList> _componentList;
+	// Shared between clones, such that sub-images of the same size share their convolved PSFs
+	std::shared_ptr<ConvolvedPSFCache> _psfCache;
+	std::shared_ptr<ConvolvedPSFCache::Entry> _convolvedPSFs;
 
 	void initializeScaleInfo();
-	void convolvePSFs(std::unique_ptr<ImageBufferAllocator::Ptr[]>& convolvedPSFs, const double* psf, double* tmp, bool isIntegrated);
+	void updateConvolvedPSFs(const double* integratedPSF, const ao::uvector<const double*>& psfs);
 	void findActiveScaleConvolvedMaxima(const ImageSet& imageSet, double* integratedScratch, double* scratch, bool reportRMS, ThreadedDeconvolutionTools* tools);
 	bool selectMaximumScale(size_t& scaleWithPeak);
 	void activateScales(size_t scaleWithLastPeak);
@@ -153,7 +165,9 @@ private:
 	
 	void findPeakDirect(const double *image, double* scratch, size_t scaleIndex);
 	
-	double* getConvolvedPSF(size_t psfIndex, size_t scaleIndex, const std::unique_ptr<std::unique_ptr<ImageBufferAllocator::Ptr[]>[]>& convolvedPSFs);
+	const double* getConvolvedPSF(size_t psfIndex, size_t scaleIndex) const;
+	const bool* getMask(size_t scaleIndex) const;
+	void getCleanRegion(const bool* mask, size_t& x1, size_t& y1, size_t& x2, size_t& y2) const;
 	void getConvolutionDimensions(size_t scaleIndex, size_t& width, size_t& height) const;
 };
 
@@ -1,5 +1,6 @@
 #include "multiscaletransforms.h"
 
+#include "../directconvolver.h"
 #include "../fftconvolver.h"
 
 void MultiScaleTransforms::Transform(const ao::uvector<double*>& images, double* scratch, double scale)
@@ -8,25 +9,60 @@ void MultiScaleTransforms::Transform(const ao::uvector<double*>& images, double*
 	size_t kernelSize;
 	MakeShapeFunction(scale, shape, kernelSize);
 	
-	std::fill_n(scratch, _width*_height, 0.0);
-	
-	FFTConvolver::PrepareSmallKernel(scratch, _width, _height, shape.data(), kernelSize);
-	for(double*const* imageIter = images.begin(); imageIter!=images.end(); ++imageIter)
-		FFTConvolver::ConvolveSameSize(_fftwManager, *imageIter, scratch, _width, _height);
+	if(useDirectConvolution(kernelSize))
+	{
+		ao::uvector<double> kernel1D;
+		if(_shape == GaussianShape)
+			makeSeparableKernel(shape, kernelSize, kernel1D);
+		for(double*const* imageIter = images.begin(); imageIter!=images.end(); ++imageIter)
+			convolveDirectly(*imageIter, shape, kernel1D, kernelSize);
+	}
+	else {
+		std::fill_n(scratch, _width*_height, 0.0);
+		
+		FFTConvolver::PrepareSmallKernel(scratch, _width, _height, shape.data(), kernelSize);
+		for(double*const* imageIter = images.begin(); imageIter!=images.end(); ++imageIter)
+			FFTConvolver::ConvolveSameSize(_fftwManager, *imageIter, scratch, _width, _height);
+	}
 }
 
 void MultiScaleTransforms::PrepareTransform(double* kernel, double scale)
 {
-	ao::uvector<double> shape;
-	size_t kernelSize;
-	MakeShapeFunction(scale, shape, kernelSize);
-	
-	std::fill_n(kernel, _width*_height, 0.0);
+	MakeShapeFunction(scale, _directKernel, _directKernelSize);
 	
-	FFTConvolver::PrepareSmallKernel(kernel, _width, _height, shape.data(), kernelSize);
+	_useDirectKernel = useDirectConvolution(_directKernelSize);
+	if(_useDirectKernel)
+	{
+		if(_shape == GaussianShape)
+			makeSeparableKernel(_directKernel, _directKernelSize, _directKernel1D);
+		else
+			_directKernel1D.clear();
+	}
+	else {
+		std::fill_n(kernel, _width*_height, 0.0);
+		
+		FFTConvolver::PrepareSmallKernel(kernel, _width, _height, _directKernel.data(), _directKernelSize);
+	}
 }
 
 void MultiScaleTransforms::FinishTransform(double* image, const double* kernel)
 {
-	FFTConvolver::ConvolveSameSize(_fftwManager, image, kernel, _width, _height);
+	if(_useDirectKernel)
+		convolveDirectly(image, _directKernel, _directKernel1D, _directKernelSize);
+	else
+		FFTConvolver::ConvolveSameSize(_fftwManager, image, kernel, _width, _height);
+}
+
+bool MultiScaleTransforms::useDirectConvolution(size_t kernelSize) const
+{
+	return kernelSize <= _width && kernelSize <= _height &&
+		DirectConvolver::IsFasterThanFFT(kernelSize, _shape == GaussianShape, _regionX2 - _regionX1, _regionY2 - _regionY1, _width, _height);
+}
+
+void MultiScaleTransforms::convolveDirectly(double* image, const ao::uvector<double>& kernel, const ao::uvector<double>& kernel1D, size_t kernelSize) const
+{
+	if(kernel1D.empty())
+		DirectConvolver::Convolve(image, _width, _height, kernel.data(), kernelSize, _regionX1, _regionY1, _regionX2, _regionY2);
+	else
+		DirectConvolver::ConvolveSeparable(image, _width, _height, kernel1D.data(), kernelSize, _regionX1, _regionY1, _regionX2, _regionY2);
 }
@@ -1,6 +1,7 @@
 #ifndef MULTI_SCALE_TRANSFORMS_H
 #define MULTI_SCALE_TRANSFORMS_H
 
+#include <algorithm>
 #include <cmath>
 #include <initializer_list>
 
@@ -13,9 +14,29 @@ public:
 	
 	MultiScaleTransforms(class FFTWManager& fftwManager, size_t width, size_t height, Shape shape) :
 	_fftwManager(fftwManager),
-	_width(width), _height(height), _shape(shape)
+	_width(width), _height(height),
+	_regionX1(0), _regionY1(0), _regionX2(width), _regionY2(height),
+	_shape(shape),
+	_useDirectKernel(false), _directKernelSize(0)
 	{ }
 	
+	/**
+	 * Restrict the transforms to the box [x1, x2) x [y1, y2). Values outside this box are
+	 * undefined after a transform. Restricting the output allows the transform to convolve
+	 * small kernels directly in the image domain, which is often faster than using FFTs
+	 * when only part of the image (e.g. a masked region) is of interest.
+	 */
+	void SetOutputRegion(size_t x1, size_t y1, size_t x2, size_t y2)
+	{
+		_regionX1 = x1; _regionY1 = y1;
+		_regionX2 = std::max(x1, x2); _regionY2 = std::max(y1, y2);
+	}
+	
+	void ResetOutputRegion()
+	{
+		SetOutputRegion(0, 0, _width, _height);
+	}
+	
 	void PrepareTransform(double* kernel, double scale);
 	void FinishTransform(double* image, const double* kernel);
 	
@@ -30,6 +51,17 @@ public:
 	size_t Width() const { return _width; }
 	size_t Height() const { return _height; }
 	
+	/**
+	 * Size of the (square) kernel that is used for the given scale.
+	 */
+	size_t KernelSize(double scale)
+	{
+		ao::uvector<double> shape;
+		size_t n;
+		MakeShapeFunction(scale, shape, n);
+		return n;
+	}
+	
 	static double KernelIntegratedValue(double scaleInPixels, size_t maxN, Shape shape)
 	{
 		size_t n;
@@ -106,8 +138,33 @@ public:
 private:
 	class FFTWManager& _fftwManager;
 	size_t _width, _height;
+	size_t _regionX1, _regionY1, _regionX2, _regionY2;
 	enum Shape _shape;
 	
+	// Kernel that is used by FinishTransform() when PrepareTransform() decided to
+	// convolve directly.
+	bool _useDirectKernel;
+	ao::uvector<double> _directKernel, _directKernel1D;
+	size_t _directKernelSize;
+	
+	bool useDirectConvolution(size_t kernelSize) const;
+	
+	void convolveDirectly(double* image, const ao::uvector<double>& kernel, const ao::uvector<double>& kernel1D, size_t kernelSize) const;
+	
+	/**
+	 * The Gaussian kernel is separable. Because the 2D kernel is normalized, the 1D
+	 * kernel is given by summing over one dimension.
+	 */
+	static void makeSeparableKernel(const ao::uvector<double>& kernel, size_t kernelSize, ao::uvector<double>& kernel1D)
+	{
+		kernel1D.assign(kernelSize, 0.0);
+		for(size_t y=0; y!=kernelSize; ++y)
+		{
+			for(size_t x=0; x!=kernelSize; ++x)
+				kernel1D[x] += kernel[y*kernelSize + x];
+		}
+	}
+	
 	static size_t taperedQuadraticKernelSize(double scaleInPixels)
 	{
 		return size_t(ceil(scaleInPixels*0.5)*2.0)+1;
@@ -36,10 +36,21 @@ ThreadedDeconvolutionTools::~ThreadedDeconvolutionTools()
 }
 
 void ThreadedDeconvolutionTools::SubtractImage(double* image, const double* psf, size_t width, size_t height, size_t x, size_t y, double factor)
+{
+	subtractImage(image, psf, width, height, x, y, factor);
+}
+
+void ThreadedDeconvolutionTools::SubtractImage(float* image, const double* psf, size_t width, size_t height, size_t x, size_t y, double factor)
+{
+	subtractImage(image, psf, width, height, x, y, factor);
+}
+
+template<typename NumT>
+void ThreadedDeconvolutionTools::subtractImage(NumT* image, const double* psf, size_t width, size_t height, size_t x, size_t y, double factor)
 {
 	for(size_t thr=0; thr!=_threadCount; ++thr)
 	{
-		SubtractionTask* task = new SubtractionTask();
+		SubtractionTask<NumT>* task = new SubtractionTask<NumT>();
 		task->image = image;
 		task->psf = psf;
 		task->width = width;
@@ -66,7 +77,8 @@ void ThreadedDeconvolutionTools::SubtractImage(double* image, const double* psf,
 	}
 }
 
-ThreadedDeconvolutionTools::ThreadResult* ThreadedDeconvolutionTools::SubtractionTask::operator()()
+template<typename NumT>
+ThreadedDeconvolutionTools::ThreadResult* ThreadedDeconvolutionTools::SubtractionTask<NumT>::operator()()
 {
 	SimpleClean::PartialSubtractImage(image, psf, width, height, x, y, factor, startY, endY);
 	return 0;
@@ -27,6 +27,8 @@ public:
 	
 	void SubtractImage(double *image, const double *psf, size_t width, size_t height, size_t x, size_t y, double factor);
 	
+	void SubtractImage(float *image, const double *psf, size_t width, size_t height, size_t x, size_t y, double factor);
+	
 	// This one is for many transforms of the same scale
 	void MultiScaleTransform(class MultiScaleTransforms* msTransforms, const ao::uvector<double*>& images, double* scratch, double scale);
 	
@@ -56,10 +58,11 @@ private:
 		virtual ThreadResult* operator()() = 0;
 		virtual ~ThreadTask() { }
 	};
+	template<typename NumT>
 	struct SubtractionTask : public ThreadTask {
 		virtual ThreadResult* operator()();
 		
-		double *image;
+		NumT *image;
 		const double *psf;
 		size_t width, height, x, y;
 		double factor;
@@ -94,6 +97,9 @@ private:
 		const Image *rmsFactorImage;
 	};
 	
+	template<typename NumT>
+	void subtractImage(NumT *image, const double *psf, size_t width, size_t height, size_t x, size_t y, double factor);
+	
 	std::vector<ao::lane<ThreadTask*>*> _taskLanes;
 	std::vector<ao::lane<ThreadResult*>*> _resultLanes;
 	size_t _threadCount;
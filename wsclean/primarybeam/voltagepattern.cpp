@@ -1,5 +1,7 @@
 #include "voltagepattern.h"
 
+#include "../aocommon/parallelfor.h"
+
 #include "../wsclean/logger.h"
 #include "../wsclean/primarybeamimageset.h"
 
@@ -100,7 +102,7 @@ void VoltagePattern::Render(PrimaryBeamImageSet& beamImages,
 	double phaseCentreRA, double phaseCentreDec,
 	double pointingRA, double pointingDec,
 	double phaseCentreDL, double phaseCentreDM,
-	double frequencyHz) const
+	double frequencyHz, size_t threadCount) const
 {
 	size_t
 		width = beamImages.Width(),
@@ -114,9 +116,11 @@ void VoltagePattern::Render(PrimaryBeamImageSet& beamImages,
 	double l0, m0;
 	ImageCoordinates::RaDecToLM(pointingRA, pointingDec, phaseCentreRA, phaseCentreDec, l0, m0);
 	l0 += phaseCentreDL; m0 += phaseCentreDM;
-	size_t imgIndex = 0;
 	Logger::Debug << "Interpolating 1D voltage pattern to output image...\n";
-	for(size_t iy=0; iy!=height; ++iy) {
+	ao::ParallelFor<size_t> loop(threadCount);
+	loop.Run(0, height, [&](size_t iy, size_t)
+	{
+		size_t imgIndex = iy * width;
 		for(size_t ix=0; ix!=width; ++ix) {
 			double l, m, ra, dec;
 			ImageCoordinates::XYToLM(ix, iy, pixelScaleX, pixelScaleY, width, height, l, m);
@@ -145,7 +149,7 @@ void VoltagePattern::Render(PrimaryBeamImageSet& beamImages,
 			beamImages[7][imgIndex] = 0.0;
 			++imgIndex;
 		}
-	}
+	});
 }
 
 void VoltagePattern::Render(std::complex<float>* aterm,
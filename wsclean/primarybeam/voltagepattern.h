@@ -29,7 +29,7 @@ struct VoltagePattern
 		double phaseCentreRA, double phaseCentreDec,
 		double pointingRA, double pointingDec,
 		double phaseCentreDL, double phaseCentreDM,
-		double frequencyHz) const;
+		double frequencyHz, size_t threadCount) const;
 	
 	void Render(std::complex<float>* aterm,
 		size_t width, size_t height,
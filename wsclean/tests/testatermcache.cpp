@@ -0,0 +1,71 @@
+#include <boost/test/unit_test.hpp>
+
+#include "../aterms/cache.h"
+
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(aterm_cache)
+
+BOOST_AUTO_TEST_CASE( store_and_get )
+{
+	Cache cache(3, 4);
+	const std::complex<float> a[3] = { 1.0f, 2.0f, 3.0f }, b[3] = { 4.0f, 5.0f, 6.0f };
+	cache.Store(0, 150e6, a);
+	cache.Store(1, 150e6, b);
+	std::complex<float> result[3];
+	BOOST_CHECK(cache.Get(0, 150e6, result));
+	BOOST_CHECK_EQUAL(result[2], a[2]);
+	BOOST_CHECK(cache.Get(1, 150e6, result));
+	BOOST_CHECK_EQUAL(result[0], b[0]);
+	BOOST_CHECK(!cache.Get(0, 160e6, result));
+	BOOST_CHECK(!cache.Get(2, 150e6, result));
+
+	// Overwriting an entry does not add an entry
+	cache.Store(0, 150e6, b);
+	BOOST_CHECK_EQUAL(cache.EntryCount(), 2);
+	BOOST_CHECK(cache.Get(0, 150e6, result));
+	BOOST_CHECK_EQUAL(result[1], b[1]);
+}
+
+BOOST_AUTO_TEST_CASE( least_recently_used_is_replaced )
+{
+	Cache cache(1, 3);
+	for(size_t t=0; t!=3; ++t)
+	{
+		std::complex<float> value(t);
+		cache.Store(t, 150e6, &value);
+	}
+	std::complex<float> result;
+	// Use entry 0, such that entry 1 is the least recently used
+	BOOST_CHECK(cache.Get(0, 150e6, &result));
+	std::complex<float> value(3.0f);
+	cache.Store(3, 150e6, &value);
+	BOOST_CHECK_EQUAL(cache.EntryCount(), 3);
+	BOOST_CHECK(!cache.Contains(1, 150e6));
+	BOOST_CHECK(cache.Contains(0, 150e6));
+	BOOST_CHECK(cache.Contains(2, 150e6));
+	BOOST_CHECK(cache.Get(3, 150e6, &result));
+	BOOST_CHECK_EQUAL(result, std::complex<float>(3.0f));
+}
+
+BOOST_AUTO_TEST_CASE( shared )
+{
+	std::shared_ptr<Cache>
+		a = Cache::GetShared("test-a", 2, 5),
+		b = Cache::GetShared("test-b", 2, 5);
+	BOOST_CHECK(a != b);
+	const std::complex<float> value[2] = { 1.0f, 2.0f };
+	a->Store(0, 150e6, value);
+	a.reset();
+	// The cache survives when it is no longer used
+	std::shared_ptr<Cache> aAgain = Cache::GetShared("test-a", 2, 5);
+	BOOST_CHECK(aAgain->Contains(0, 150e6));
+
+	Cache::ClearShared();
+	BOOST_CHECK(aAgain->Contains(0, 150e6));
+	std::shared_ptr<Cache> aCleared = Cache::GetShared("test-a", 2, 5);
+	BOOST_CHECK(aCleared != aAgain);
+	BOOST_CHECK_EQUAL(aCleared->EntryCount(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
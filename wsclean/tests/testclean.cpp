@@ -10,7 +10,6 @@ BOOST_AUTO_TEST_SUITE(clean_algorithms)
 
 const size_t nRepeats = 3; /* This should be set to 100 to assert the performance */
 
-#if defined __AVX__ && !defined FORCE_NON_AVX
 struct CleanTestFixture
 {
 	size_t x, y;
@@ -22,10 +21,9 @@ struct CleanTestFixture
 	{	}
 	void findPeak(size_t width=4, size_t height=2, size_t ystart=0, size_t yend=2)
 	{
-		SimpleClean::FindPeakAVX(img.data(), width, height, x, y, true, ystart, yend, 0, 0);
+		SimpleClean::FindPeak(img.data(), width, height, x, y, true, ystart, yend, size_t(0), size_t(0));
 	}
 };
-#endif
 
 struct NoiseFixture
 {
@@ -48,8 +46,7 @@ struct NoiseFixture
 	std::normal_distribution<double> normal_dist;
 };
 
-#if defined __AVX__ && !defined FORCE_NON_AVX
-BOOST_AUTO_TEST_CASE( findPeakAVX1 )
+BOOST_AUTO_TEST_CASE( findPeak1 )
 {
 	CleanTestFixture f;
 	f.img[0] = 1;
@@ -58,7 +55,7 @@ BOOST_AUTO_TEST_CASE( findPeakAVX1 )
 	BOOST_CHECK_EQUAL(f.y, 0);
 }
 
-BOOST_AUTO_TEST_CASE( findPeakAVX2 )
+BOOST_AUTO_TEST_CASE( findPeak2 )
 {
 	CleanTestFixture f;
 	f.img[0] = 1;
@@ -68,7 +65,7 @@ BOOST_AUTO_TEST_CASE( findPeakAVX2 )
 	BOOST_CHECK_EQUAL(f.y, 0);
 }
 
-BOOST_AUTO_TEST_CASE( findPeakAVX3 )
+BOOST_AUTO_TEST_CASE( findPeak3 )
 {
 	CleanTestFixture f;
 	f.img[0] = 1;
@@ -79,7 +76,7 @@ BOOST_AUTO_TEST_CASE( findPeakAVX3 )
 	BOOST_CHECK_EQUAL(f.y, 1);
 }
 
-BOOST_AUTO_TEST_CASE( findPeakAVX4 )
+BOOST_AUTO_TEST_CASE( findPeak4 )
 {
 	CleanTestFixture f;
 	f.img[0] = 1;
@@ -91,7 +88,7 @@ BOOST_AUTO_TEST_CASE( findPeakAVX4 )
 	BOOST_CHECK_EQUAL(f.y, 1);
 }
 
-BOOST_AUTO_TEST_CASE( findPeakAVX5 )
+BOOST_AUTO_TEST_CASE( findPeak5 )
 {
 	CleanTestFixture f;
 	f.img[0] = 1;
@@ -104,7 +101,7 @@ BOOST_AUTO_TEST_CASE( findPeakAVX5 )
 	BOOST_CHECK_EQUAL(f.y, 3);
 }
 
-BOOST_AUTO_TEST_CASE( findPeakAVX6 )
+BOOST_AUTO_TEST_CASE( findPeak6 )
 {
 	CleanTestFixture f;
 	f.img[0] = 1;
@@ -117,7 +114,6 @@ BOOST_AUTO_TEST_CASE( findPeakAVX6 )
 	BOOST_CHECK_EQUAL(f.x, 2);
 	BOOST_CHECK_EQUAL(f.y, 4);
 }
-#endif
 
 BOOST_AUTO_TEST_CASE( findPeakPerformance )
 {
@@ -141,19 +137,6 @@ BOOST_AUTO_TEST_CASE( findPeakSimplePerformance )
 	BOOST_CHECK(true);
 }
 	
-#if defined __AVX__ && !defined FORCE_NON_AVX
-BOOST_AUTO_TEST_CASE( findPeakAVXPerformance )
-{
-	NoiseFixture f;
-	for(size_t repeat=0; repeat!=nRepeats; ++repeat)
-	{
-		size_t x, y;
-		SimpleClean::FindPeakAVX(f.img.data(), f.n, f.n, x, y, true, 0, f.n/2, 0, 0);
-	}
-	BOOST_CHECK(true);
-}
-#endif
-	
 BOOST_AUTO_TEST_CASE( partialSubtractImagePerformance )
 {
 	NoiseFixture f;
@@ -162,16 +145,5 @@ BOOST_AUTO_TEST_CASE( partialSubtractImagePerformance )
 		SimpleClean::PartialSubtractImage(f.img.data(), f.n, f.n, f.psf.data(), f.n, f.n, x, y, 0.5, 0, f.n/2);
 	BOOST_CHECK(true);
 }
-	
-#if defined __AVX__ && !defined FORCE_NON_AVX
-BOOST_AUTO_TEST_CASE( partialSubtractImageAVXPerformance )
-{
-	NoiseFixture f;
-	size_t x=f.n/2, y=f.n/2;
-	for(size_t repeat=0; repeat!=nRepeats; ++repeat)
-		SimpleClean::PartialSubtractImageAVX(f.img.data(), f.n, f.n, f.psf.data(), f.n, f.n, x, y, 0.5, 0, f.n/2);
-	BOOST_CHECK(true);
-}
-#endif
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,150 @@
+#include <boost/test/unit_test.hpp>
+
+#include "../multiscale/convolvedpsfcache.h"
+
+#include "../fftwmanager.h"
+
+#include <boost/filesystem/operations.hpp>
+
+#include <random>
+
+BOOST_AUTO_TEST_SUITE(convolved_psf_cache)
+
+static ao::uvector<double> makePSF(size_t width, size_t height, unsigned seed)
+{
+	std::mt19937 rnd(seed);
+	std::uniform_real_distribution<double> dist(0.0, 0.1);
+	ao::uvector<double> psf(width*height);
+	for(double& v : psf)
+		v = dist(rnd);
+	psf[width/2 + (height/2)*width] = 1.0;
+	return psf;
+}
+
+BOOST_AUTO_TEST_CASE( reuse )
+{
+	FFTWManager fftwManager;
+	ConvolvedPSFCache cache;
+	const size_t width = 32, height = 24;
+	ao::uvector<double> psf = makePSF(width, height, 1), scales{0.0, 4.0, 8.0};
+	ao::uvector<const double*> psfs(1, psf.data());
+	
+	std::shared_ptr<ConvolvedPSFCache::Entry> a = cache.Get(fftwManager, psf.data(), psfs, width, height, scales, MultiScaleTransforms::GaussianShape);
+	std::shared_ptr<ConvolvedPSFCache::Entry> b = cache.Get(fftwManager, psf.data(), psfs, width, height, scales, MultiScaleTransforms::GaussianShape);
+	BOOST_CHECK_EQUAL(a.get(), b.get());
+	BOOST_CHECK_EQUAL(cache.Size(), 1);
+	BOOST_CHECK_EQUAL(a->ScaleCount(), 3);
+	
+	// Scale 0 is not convolved
+	for(size_t i=0; i!=width*height; ++i)
+		BOOST_CHECK_EQUAL(a->ConvolvedPSF(0, 0)[i], psf[i]);
+	for(size_t scaleIndex=0; scaleIndex!=scales.size(); ++scaleIndex)
+		BOOST_CHECK_CLOSE_FRACTION(a->PSFPeak(scaleIndex), a->ConvolvedPSF(0, scaleIndex)[width/2 + (height/2)*width], 1e-8);
+	
+	// A different shape or PSF should give a new entry
+	std::shared_ptr<ConvolvedPSFCache::Entry> c = cache.Get(fftwManager, psf.data(), psfs, width, height, scales, MultiScaleTransforms::TaperedQuadraticShape);
+	BOOST_CHECK_NE(a.get(), c.get());
+	psf[0] = 0.5;
+	std::shared_ptr<ConvolvedPSFCache::Entry> d = cache.Get(fftwManager, psf.data(), psfs, width, height, scales, MultiScaleTransforms::GaussianShape);
+	BOOST_CHECK_NE(a.get(), d.get());
+	BOOST_CHECK_EQUAL(cache.Size(), 3);
+	
+	cache.RemoveUnused();
+	BOOST_CHECK_EQUAL(cache.Size(), 3);
+	cache.Get(fftwManager, psf.data(), psfs, width, height, scales, MultiScaleTransforms::GaussianShape);
+	cache.RemoveUnused();
+	BOOST_CHECK_EQUAL(cache.Size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( multiple_psfs )
+{
+	FFTWManager fftwManager;
+	ConvolvedPSFCache cache;
+	const size_t width = 32, height = 32;
+	ao::uvector<double> psfA = makePSF(width, height, 1), psfB = makePSF(width, height, 2), integrated(width*height), scales{0.0, 6.0};
+	for(size_t i=0; i!=width*height; ++i)
+		integrated[i] = 0.5 * (psfA[i] + psfB[i]);
+	ao::uvector<const double*> psfs{psfA.data(), psfB.data()};
+	
+	std::shared_ptr<ConvolvedPSFCache::Entry> entry = cache.Get(fftwManager, integrated.data(), psfs, width, height, scales, MultiScaleTransforms::TaperedQuadraticShape);
+	std::shared_ptr<ConvolvedPSFCache::Entry> integratedEntry = cache.Get(fftwManager, integrated.data(), ao::uvector<const double*>(1, integrated.data()), width, height, scales, MultiScaleTransforms::TaperedQuadraticShape);
+	BOOST_CHECK_NE(entry.get(), integratedEntry.get());
+	for(size_t scaleIndex=0; scaleIndex!=scales.size(); ++scaleIndex)
+		BOOST_CHECK_CLOSE_FRACTION(entry->PSFPeak(scaleIndex), integratedEntry->PSFPeak(scaleIndex), 1e-8);
+	BOOST_CHECK_EQUAL(entry->ConvolvedPSF(1, 0)[0], psfB[0]);
+	
+	BOOST_CHECK(entry->DoubleConvolvedPSF(1, 1) == nullptr);
+	std::vector<ao::uvector<double>> doubleConvolved{ao::uvector<double>(width*height, 1.0), ao::uvector<double>(width*height, 2.0)};
+	entry->StoreDoubleConvolvedPSFs(1, std::move(doubleConvolved));
+	BOOST_CHECK_EQUAL(entry->DoubleConvolvedPSF(1, 1)[0], 2.0);
+	BOOST_CHECK(entry->DoubleConvolvedPSF(1, 0) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE( save_and_load )
+{
+	FFTWManager fftwManager;
+	ConvolvedPSFCache cache;
+	const size_t width = 16, height = 16;
+	ao::uvector<double> psf = makePSF(width, height, 3), scales{0.0, 4.0};
+	ao::uvector<const double*> psfs(1, psf.data());
+	std::shared_ptr<ConvolvedPSFCache::Entry> entry = cache.Get(fftwManager, psf.data(), psfs, width, height, scales, MultiScaleTransforms::TaperedQuadraticShape);
+	std::vector<ao::uvector<double>> doubleConvolved{ao::uvector<double>(width*height, 3.0)};
+	entry->StoreDoubleConvolvedPSFs(1, std::move(doubleConvolved));
+	
+	const std::string filename = "test-convolved-psf-cache.tmp";
+	cache.Save(filename);
+	ConvolvedPSFCache loadedCache;
+	// Entries that are larger than the image or made from more PSFs are rejected
+	BOOST_CHECK_THROW(loadedCache.Load(filename, width/2, height, 1), std::runtime_error);
+	BOOST_CHECK_THROW(loadedCache.Load(filename, width, height, 0), std::runtime_error);
+	BOOST_CHECK_EQUAL(loadedCache.Size(), 0);
+	// A truncated file is rejected
+	boost::filesystem::resize_file(filename, boost::filesystem::file_size(filename) - sizeof(double));
+	BOOST_CHECK_THROW(loadedCache.Load(filename, width, height, 1), std::runtime_error);
+	BOOST_CHECK_EQUAL(loadedCache.Size(), 0);
+	cache.Save(filename);
+	loadedCache.Load(filename, width, height, 1);
+	boost::filesystem::remove(filename);
+	
+	BOOST_CHECK_EQUAL(loadedCache.Size(), 1);
+	std::shared_ptr<ConvolvedPSFCache::Entry> loaded = loadedCache.Get(fftwManager, psf.data(), psfs, width, height, scales, MultiScaleTransforms::TaperedQuadraticShape);
+	BOOST_CHECK_EQUAL(loadedCache.Size(), 1);
+	BOOST_CHECK_EQUAL(loaded->PSFPeak(1), entry->PSFPeak(1));
+	for(size_t i=0; i!=width*height; ++i)
+		BOOST_CHECK_EQUAL(loaded->ConvolvedPSF(0, 1)[i], entry->ConvolvedPSF(0, 1)[i]);
+	BOOST_CHECK(loaded->DoubleConvolvedPSF(0, 0) == nullptr);
+	BOOST_CHECK_EQUAL(loaded->DoubleConvolvedPSF(0, 1)[0], 3.0);
+}
+
+BOOST_AUTO_TEST_CASE( memory_limit )
+{
+	FFTWManager fftwManager;
+	ConvolvedPSFCache cache;
+	const size_t width = 16, height = 16;
+	ao::uvector<double> psfA = makePSF(width, height, 4), psfB = makePSF(width, height, 5), psfC = makePSF(width, height, 6);
+	ao::uvector<double> scales{0.0, 4.0};
+	ao::uvector<const double*> psfsA(1, psfA.data()), psfsB(1, psfB.data()), psfsC(1, psfC.data());
+	cache.Get(fftwManager, psfA.data(), psfsA, width, height, scales, MultiScaleTransforms::TaperedQuadraticShape);
+	const size_t entrySize = cache.MemorySize();
+	BOOST_CHECK_GT(entrySize, width*height*sizeof(double));
+	
+	// Room for two entries
+	cache.SetMemoryLimit(entrySize * 2);
+	cache.Get(fftwManager, psfB.data(), psfsB, width, height, scales, MultiScaleTransforms::TaperedQuadraticShape);
+	BOOST_CHECK_EQUAL(cache.Size(), 2);
+	// Using A makes B the least recently used entry
+	cache.Get(fftwManager, psfA.data(), psfsA, width, height, scales, MultiScaleTransforms::TaperedQuadraticShape);
+	cache.Get(fftwManager, psfC.data(), psfsC, width, height, scales, MultiScaleTransforms::TaperedQuadraticShape);
+	BOOST_CHECK_EQUAL(cache.Size(), 2);
+	BOOST_CHECK_EQUAL(cache.MemorySize(), entrySize * 2);
+	// A is still in the cache, so requesting it does not add an entry
+	cache.Get(fftwManager, psfA.data(), psfsA, width, height, scales, MultiScaleTransforms::TaperedQuadraticShape);
+	BOOST_CHECK_EQUAL(cache.Size(), 2);
+	
+	// An entry larger than the limit is kept while it is the most recent one
+	cache.SetMemoryLimit(entrySize / 2);
+	cache.Get(fftwManager, psfB.data(), psfsB, width, height, scales, MultiScaleTransforms::TaperedQuadraticShape);
+	BOOST_CHECK_EQUAL(cache.Size(), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
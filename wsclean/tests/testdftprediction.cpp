@@ -0,0 +1,192 @@
+#include <boost/test/unit_test.hpp>
+
+#include "../dftpredictionalgorithm.h"
+
+#include <random>
+
+BOOST_AUTO_TEST_SUITE(dftprediction)
+
+namespace {
+	/**
+	 * Straightforward evaluation of the DFT of one component, with the uvw in
+	 * wavelengths.
+	 */
+	MC2x2 referencePrediction(const DFTPredictionComponent& component, double u, double v, double w, size_t channel)
+	{
+		double angle = 2.0*M_PI*(u*component.L() + v*component.M() + w*(component.LMSqrt()-1.0));
+		std::complex<double> phasor(std::cos(angle), std::sin(angle));
+		if(component.IsGaussian())
+		{
+			const double* gausTrans = component.GausTransformationMatrix();
+			double
+				uT = u*gausTrans[0] + v*gausTrans[1],
+				vT = u*gausTrans[2] + v*gausTrans[3];
+			phasor *= std::exp(-uT*uT - vT*vT);
+		}
+		MC2x2 result;
+		for(size_t p=0; p!=4; ++p)
+			result[p] = component.LinearFlux(channel)[p] * phasor;
+		return result;
+	}
+
+	void makeInput(DFTPredictionInput& input, size_t channelCount)
+	{
+		std::mt19937 rnd(42);
+		std::uniform_real_distribution<double> lm(-0.05, 0.05), flux(-1.0, 1.0);
+		for(size_t i=0; i!=13; ++i)
+		{
+			DFTPredictionComponent& component = input.AddComponent();
+			component.SetPosition(0.0, 0.0, lm(rnd), lm(rnd));
+			// Mix the Gaussians in between the point sources
+			if(i%3 == 1)
+				component.SetGaussianInfo(0.3*i, 1e-4*(i+1), 5e-5*(i+1));
+			std::vector<MC2x2> fluxes(channelCount);
+			for(MC2x2& f : fluxes)
+			{
+				for(size_t p=0; p!=4; ++p)
+					f[p] = std::complex<double>(flux(rnd), flux(rnd));
+			}
+			component.SetFlux(fluxes);
+		}
+	}
+
+	void checkRow(const BandData& band, size_t startChannel, size_t endChannel)
+	{
+		DFTPredictionInput input;
+		makeInput(input, band.ChannelCount());
+		DFTPredictionAlgorithm algorithm(input, band, 2);
+		const double u = 2500.0, v = -1300.0, w = 80.0;
+		std::vector<MC2x2> row(endChannel - startChannel), otherRow(band.ChannelCount());
+		// Predict another row first, to check that reusing the scratch does not matter
+		DFTPredictionAlgorithm::RowScratch scratch;
+		algorithm.PredictRow(otherRow.data(), -u, 2.0*v, w, 0, band.ChannelCount(), 0, 1, scratch);
+		algorithm.PredictRow(row.data(), u, v, w, startChannel, endChannel, 0, 1, scratch);
+		for(size_t ch=startChannel; ch!=endChannel; ++ch)
+		{
+			const double lambda = band.ChannelWavelength(ch);
+			MC2x2 expected = MC2x2::Zero();
+			for(const DFTPredictionComponent& component : input)
+				expected += referencePrediction(component, u/lambda, v/lambda, w/lambda, ch);
+			for(size_t p=0; p!=4; ++p)
+			{
+				BOOST_CHECK_SMALL(std::abs(row[ch - startChannel][p] - expected[p]), 1e-8);
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( regular_band )
+{
+	std::vector<ChannelInfo> channels;
+	for(size_t ch=0; ch!=150; ++ch)
+		channels.emplace_back(120e6 + ch*195e3, 195e3);
+	BandData band(channels);
+	checkRow(band, 0, band.ChannelCount());
+	checkRow(band, 7, 100);
+}
+
+BOOST_AUTO_TEST_CASE( irregular_band )
+{
+	std::vector<ChannelInfo> channels;
+	for(size_t ch=0; ch!=10; ++ch)
+		channels.emplace_back(120e6 + ch*ch*1e6, 1e6);
+	BandData band(channels);
+	checkRow(band, 0, band.ChannelCount());
+}
+
+BOOST_AUTO_TEST_CASE( single_visibility )
+{
+	std::vector<ChannelInfo> channels;
+	for(size_t ch=0; ch!=4; ++ch)
+		channels.emplace_back(150e6 + ch*1e6, 1e6);
+	BandData band(channels);
+	DFTPredictionInput input;
+	makeInput(input, band.ChannelCount());
+	DFTPredictionAlgorithm algorithm(input, band, 2);
+	const double lambda = band.ChannelWavelength(2);
+	MC2x2 value;
+	algorithm.Predict(value, 100.0/lambda, 200.0/lambda, 10.0/lambda, 2, 0, 1);
+	MC2x2 expected = MC2x2::Zero();
+	for(const DFTPredictionComponent& component : input)
+		expected += referencePrediction(component, 100.0/lambda, 200.0/lambda, 10.0/lambda, 2);
+	for(size_t p=0; p!=4; ++p)
+		BOOST_CHECK_SMALL(std::abs(value[p] - expected[p]), 1e-8);
+}
+
+BOOST_AUTO_TEST_CASE( apparent_flux )
+{
+	std::vector<ChannelInfo> channels;
+	for(size_t ch=0; ch!=70; ++ch)
+		channels.emplace_back(120e6 + ch*195e3, 195e3);
+	BandData band(channels);
+	const size_t antennaCount = 3;
+	DFTPredictionInput input;
+	makeInput(input, band.ChannelCount());
+	DFTPredictionAlgorithm algorithm(input, band, antennaCount);
+	
+	// Non-trivial Jones matrices per component, antenna and channel
+	std::mt19937 rnd(7);
+	std::uniform_real_distribution<double> beamValue(-1.0, 1.0);
+	std::vector<MC2x2> beams(input.ComponentCount() * antennaCount * band.ChannelCount());
+	for(size_t c=0; c!=input.ComponentCount(); ++c)
+	{
+		for(size_t a=0; a!=antennaCount; ++a)
+		{
+			for(size_t ch=0; ch!=band.ChannelCount(); ++ch)
+			{
+				MC2x2& beam = beams[(c*antennaCount + a)*band.ChannelCount() + ch];
+				for(size_t p=0; p!=4; ++p)
+					beam[p] = std::complex<double>(beamValue(rnd), beamValue(rnd));
+				algorithm.SetBeamValue(c, a, ch, beam);
+			}
+		}
+	}
+	
+	const double u = 2500.0, v = -1300.0, w = 80.0;
+	const size_t a1 = 2, a2 = 0;
+	std::vector<MC2x2> row(band.ChannelCount());
+	algorithm.PredictRow(row.data(), u, v, w, 0, band.ChannelCount(), a1, a2);
+	for(size_t ch=0; ch!=band.ChannelCount(); ++ch)
+	{
+		// Per-component evaluation of B1 x flux x B2^H
+		const double lambda = band.ChannelWavelength(ch);
+		MC2x2 expected = MC2x2::Zero();
+		for(size_t c=0; c!=input.ComponentCount(); ++c)
+		{
+			const MC2x2
+				value = referencePrediction(*(input.begin() + c), u/lambda, v/lambda, w/lambda, ch),
+				&beam1 = beams[(c*antennaCount + a1)*band.ChannelCount() + ch],
+				&beam2 = beams[(c*antennaCount + a2)*band.ChannelCount() + ch];
+			MC2x2 temp, apparent;
+			MC2x2::ATimesB(temp, beam1, value);
+			MC2x2::ATimesHermB(apparent, temp, beam2);
+			expected += apparent;
+		}
+		for(size_t p=0; p!=4; ++p)
+			BOOST_CHECK_SMALL(std::abs(row[ch][p] - expected[p]), 1e-8);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( select_timestep_rows )
+{
+	// Three baselines per timestep, with the last timestep stored before the others
+	const double times[] = { 40.0, 40.0, 40.0, 10.0, 10.0, 10.0, 20.0, 20.0, 20.0, 25.0, 25.0, 25.0 };
+	const size_t rowCount = sizeof(times) / sizeof(times[0]);
+	
+	std::vector<size_t> rows = DFTPredictionInput::SelectTimestepRows(times, rowCount, 0.0);
+	const size_t allRows[] = { 3, 6, 9, 0 };
+	BOOST_CHECK_EQUAL_COLLECTIONS(rows.begin(), rows.end(), std::begin(allRows), std::end(allRows));
+	
+	// 25 is skipped because it is too close to 20, but 40 is far enough from 20
+	rows = DFTPredictionInput::SelectTimestepRows(times, rowCount, 10.0);
+	const size_t coarseRows[] = { 3, 6, 0 };
+	BOOST_CHECK_EQUAL_COLLECTIONS(rows.begin(), rows.end(), std::begin(coarseRows), std::end(coarseRows));
+	
+	rows = DFTPredictionInput::SelectTimestepRows(times, rowCount, 100.0);
+	BOOST_REQUIRE_EQUAL(rows.size(), 1u);
+	BOOST_CHECK_EQUAL(rows[0], 3u);
+	
+	BOOST_CHECK(DFTPredictionInput::SelectTimestepRows(times, 0, 0.0).empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
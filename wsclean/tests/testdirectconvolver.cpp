@@ -0,0 +1,120 @@
+#include <boost/test/unit_test.hpp>
+
+#include "../directconvolver.h"
+#include "../uvector.h"
+
+#include <random>
+
+BOOST_AUTO_TEST_SUITE(direct_convolver)
+
+static void cyclicConvolve(ao::uvector<double>& output, const ao::uvector<double>& image, size_t width, size_t height, const ao::uvector<double>& kernel, size_t n)
+{
+	output.assign(width*height, 0.0);
+	for(size_t y=0; y!=height; ++y)
+	{
+		for(size_t x=0; x!=width; ++x)
+		{
+			double sum = 0.0;
+			for(size_t ky=0; ky!=n; ++ky)
+			{
+				for(size_t kx=0; kx!=n; ++kx)
+				{
+					size_t
+						sx = (x + width*n + n/2 - kx) % width,
+						sy = (y + height*n + n/2 - ky) % height;
+					sum += kernel[ky*n + kx] * image[sy*width + sx];
+				}
+			}
+			output[y*width + x] = sum;
+		}
+	}
+}
+
+static void makeInput(ao::uvector<double>& image, size_t size, ao::uvector<double>& kernel1D, ao::uvector<double>& kernel, size_t n)
+{
+	std::mt19937 rnd;
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+	image.resize(size);
+	for(double& v : image)
+		v = dist(rnd);
+	kernel1D.resize(n);
+	for(double& v : kernel1D)
+		v = dist(rnd);
+	kernel.resize(n*n);
+	for(size_t y=0; y!=n; ++y)
+	{
+		for(size_t x=0; x!=n; ++x)
+			kernel[y*n + x] = kernel1D[x] * kernel1D[y];
+	}
+}
+
+static void checkBox(const ao::uvector<double>& result, const ao::uvector<double>& expected, const ao::uvector<double>& input, size_t width, size_t height, size_t x1, size_t y1, size_t x2, size_t y2)
+{
+	for(size_t y=0; y!=height; ++y)
+	{
+		for(size_t x=0; x!=width; ++x)
+		{
+			size_t i = y*width + x;
+			if(x >= x1 && x < x2 && y >= y1 && y < y2)
+				BOOST_CHECK_CLOSE_FRACTION(result[i], expected[i], 1e-8);
+			else
+				BOOST_CHECK_EQUAL(result[i], input[i]);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( full_image )
+{
+	const size_t width = 16, height = 12, n = 5;
+	ao::uvector<double> image, kernel1D, kernel, expected;
+	makeInput(image, width*height, kernel1D, kernel, n);
+	cyclicConvolve(expected, image, width, height, kernel, n);
+	
+	ao::uvector<double> result(image);
+	DirectConvolver::Convolve(result.data(), width, height, kernel.data(), n, 0, 0, width, height);
+	checkBox(result, expected, image, width, height, 0, 0, width, height);
+	
+	result = image;
+	DirectConvolver::ConvolveSeparable(result.data(), width, height, kernel1D.data(), n, 0, 0, width, height);
+	checkBox(result, expected, image, width, height, 0, 0, width, height);
+}
+
+BOOST_AUTO_TEST_CASE( sub_box )
+{
+	const size_t width = 20, height = 18, n = 7;
+	ao::uvector<double> image, kernel1D, kernel, expected;
+	makeInput(image, width*height, kernel1D, kernel, n);
+	cyclicConvolve(expected, image, width, height, kernel, n);
+	
+	// Boxes in the middle and touching the edges
+	const size_t boxes[3][4] = { {5, 4, 12, 9}, {0, 0, 3, 17}, {15, 10, 20, 18} };
+	for(const size_t* box : boxes)
+	{
+		ao::uvector<double> result(image);
+		DirectConvolver::Convolve(result.data(), width, height, kernel.data(), n, box[0], box[1], box[2], box[3]);
+		checkBox(result, expected, image, width, height, box[0], box[1], box[2], box[3]);
+		
+		result = image;
+		DirectConvolver::ConvolveSeparable(result.data(), width, height, kernel1D.data(), n, box[0], box[1], box[2], box[3]);
+		checkBox(result, expected, image, width, height, box[0], box[1], box[2], box[3]);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( large_kernel )
+{
+	// Kernel as large as the image, such that the border wraps around several times
+	const size_t width = 9, height = 9, n = 9;
+	ao::uvector<double> image, kernel1D, kernel, expected;
+	makeInput(image, width*height, kernel1D, kernel, n);
+	cyclicConvolve(expected, image, width, height, kernel, n);
+	
+	ao::uvector<double> result(image);
+	DirectConvolver::Convolve(result.data(), width, height, kernel.data(), n, 2, 3, 6, 5);
+	checkBox(result, expected, image, width, height, 2, 3, 6, 5);
+	
+	result = image;
+	DirectConvolver::ConvolveSeparable(result.data(), width, height, kernel1D.data(), n, 2, 3, 6, 5);
+	checkBox(result, expected, image, width, height, 2, 3, 6, 5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,72 @@
+#include <boost/test/unit_test.hpp>
+
+#include "../wsclean/fitsoutputqueue.h"
+
+#include "../fitsreader.h"
+#include "../fitswriter.h"
+#include "../uvector.h"
+
+#include <cstdio>
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(fits_output_queue)
+
+namespace {
+	void checkImage(const std::string& filename, const ao::uvector<double>& expected)
+	{
+		FitsReader reader(filename);
+		BOOST_REQUIRE_EQUAL(reader.ImageWidth() * reader.ImageHeight(), expected.size());
+		ao::uvector<double> image(expected.size());
+		reader.Read(image.data());
+		// The images are written in single precision
+		for(size_t i=0; i!=expected.size(); ++i)
+			BOOST_CHECK_CLOSE_FRACTION(image[i], expected[i], 1e-6);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( write )
+{
+	const size_t width = 7, height = 5, imageCount = 10;
+	ImageBufferAllocator allocator;
+	FitsWriter writer;
+	writer.SetImageDimensions(width, height);
+	std::vector<ao::uvector<double>> expected(imageCount, ao::uvector<double>(width * height));
+	FitsOutputQueue queue(3);
+	for(size_t i=0; i!=imageCount; ++i)
+	{
+		ImageBufferAllocator::Ptr image;
+		allocator.Allocate(width * height, image);
+		for(size_t p=0; p!=width * height; ++p)
+		{
+			expected[i][p] = double(p) / 3.0 + i;
+			image[p] = expected[i][p];
+		}
+		// Every other image is compressed
+		writer.SetTileCompression(i%2 == 1);
+		queue.Write(writer, "wsctest-queue-" + std::to_string(i) + ".fits", std::move(image));
+	}
+	queue.Flush();
+	for(size_t i=0; i!=imageCount; ++i)
+	{
+		const std::string filename = "wsctest-queue-" + std::to_string(i) + ".fits";
+		checkImage(filename, expected[i]);
+		std::remove(filename.c_str());
+	}
+	BOOST_CHECK_EQUAL(allocator.UsedMemory(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( error )
+{
+	ImageBufferAllocator allocator;
+	FitsWriter writer;
+	writer.SetImageDimensions(2, 2);
+	FitsOutputQueue queue(2);
+	ImageBufferAllocator::Ptr image;
+	allocator.Allocate(4, image);
+	queue.Write(writer, "nonexisting-directory/wsctest-queue.fits", std::move(image));
+	BOOST_CHECK_THROW(queue.Flush(), std::exception);
+	// The error is only reported once
+	queue.Flush();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -61,5 +61,83 @@ BOOST_AUTO_TEST_CASE( combination )
 	a.Free(z);
 }
 
+BOOST_AUTO_TEST_CASE( alignment )
+{
+	ImageBufferAllocator a;
+	ImageBufferAllocator::Ptr x, y, z;
+	a.Allocate(1, x);
+	a.Allocate(1001, y);
+	a.Allocate(1024*1024, z);
+	BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(x.data()) % 64, 0);
+	BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(y.data()) % 64, 0);
+	BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(z.data()) % 64, 0);
+	// Buffers of at least 2 MB start on a huge page
+	BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(z.data()) % (2*1024*1024), 0);
+	z[1024*1024-1] = 1.0;
+	BOOST_CHECK_EQUAL(z[1024*1024-1], 1.0);
+}
+
+BOOST_AUTO_TEST_CASE( reuse_alternating_sizes )
+{
+	ImageBufferAllocator a;
+	double* small = a.Allocate(1000);
+	double* large = a.Allocate(100000);
+	a.Free(small);
+	a.Free(large);
+	const size_t cached = a.CachedMemory();
+	for(size_t i=0; i!=10; ++i)
+	{
+		// Alternating sizes are served from the free lists
+		double* x = a.Allocate(1000);
+		BOOST_CHECK_EQUAL(x, small);
+		a.Free(x);
+		double* y = a.Allocate(100000);
+		BOOST_CHECK_EQUAL(y, large);
+		a.Free(y);
+	}
+	BOOST_CHECK_EQUAL(a.CachedMemory(), cached);
+	BOOST_CHECK_EQUAL(a.UsedMemory(), 0);
+	a.FreeUnused();
+	BOOST_CHECK_EQUAL(a.CachedMemory(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( cache_limit )
+{
+	ImageBufferAllocator a;
+	a.SetCacheLimit(1000000);
+	double* x = a.Allocate(50000);
+	double* y = a.Allocate(80000);
+	a.Free(x);
+	BOOST_CHECK_GE(a.CachedMemory(), 400000);
+	// The cache would exceed the limit, so the largest cached buffer is released
+	a.Free(y);
+	BOOST_CHECK_LE(a.CachedMemory(), 1000000);
+	BOOST_CHECK_GE(a.CachedMemory(), 400000);
+	BOOST_CHECK_EQUAL(a.UsedMemory(), 0);
+	double* z = a.Allocate(50000);
+	BOOST_CHECK_EQUAL(z, x);
+	a.Free(z);
+}
+
+BOOST_AUTO_TEST_CASE( first_touch )
+{
+	ImageBufferAllocator a;
+	a.SetFirstTouchThreadCount(4);
+	// Large enough to be initialized by multiple threads
+	const size_t size = 3*1024*1024;
+	ImageBufferAllocator::Ptr x;
+	a.Allocate(size, x);
+	BOOST_CHECK_EQUAL(x[0], 0.0);
+	BOOST_CHECK_EQUAL(x[size-1], 0.0);
+}
+
+BOOST_AUTO_TEST_CASE( double_free )
+{
+	ImageBufferAllocator a;
+	double* x = a.Allocate(1000);
+	a.Free(x);
+	BOOST_CHECK_THROW(a.Free(x), std::runtime_error);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
@@ -24,14 +24,16 @@ struct ImageSetFixtureBase
 		e.imageWeight = imageWeight;
 	}
 	
-	void checkLinearValue(size_t index, double value, const ImageSet& dset)
+	template<typename NumT>
+	void checkLinearValue(size_t index, double value, const TImageSet<NumT>& dset)
 	{
 		Image dest(2, 2, 1.0, allocator);
 		dset.GetLinearIntegrated(dest.data());
 		BOOST_CHECK_CLOSE_FRACTION(dest[index], value, 1e-6);
 	}
 	
-	void checkSquaredValue(size_t index, double value, const ImageSet& dset)
+	template<typename NumT>
+	void checkSquaredValue(size_t index, double value, const TImageSet<NumT>& dset)
 	{
 		Image dest(2, 2, 1.0, allocator), scratch(2, 2, allocator);
 		dset.GetSquareIntegrated(dest.data(), scratch.data());
@@ -144,6 +146,23 @@ BOOST_FIXTURE_TEST_CASE( interpolateAndStore , AdvImageSetFixture)
 	BOOST_CHECK_CLOSE_FRACTION(dset[1][0],-1.0, 1e-8);
 }
 
+BOOST_FIXTURE_TEST_CASE( singlePrecision , AdvImageSetFixture)
+{
+	FloatImageSet dset(&table, allocator, settings, 2, 2);
+	dset.LoadAndAverage(cSet);
+	BOOST_CHECK_CLOSE_FRACTION(dset[0][0], 0.5*( 2.0 + 20.0), 1e-6);
+	BOOST_CHECK_CLOSE_FRACTION(dset[1][0], 0.5*(-1.0 - 10.0), 1e-6);
+	checkLinearValue(0, (11.0 - 5.5) * 0.5, dset);
+	checkSquaredValue(0, sqrt((11.0*11.0 + 5.5*5.5) * 0.5), dset);
+	
+	dset[0][0] = 3.0;
+	dset.AssignAndStore(cSet);
+	cSet.Load(image.data(), Polarization::XX, 1, false);
+	BOOST_CHECK_EQUAL(image[0], 3.0);
+	cSet.Load(image.data(), Polarization::YY, 0, false);
+	BOOST_CHECK_CLOSE_FRACTION(image[0], -5.5, 1e-6);
+}
+
 BOOST_FIXTURE_TEST_CASE( xxNormalization , ImageSetFixtureBase )
 {
 	settings.linkedPolarizations = std::set<PolarizationEnum>{ Polarization::XX };
@@ -408,6 +427,38 @@ BOOST_FIXTURE_TEST_CASE( deconvchannels_divisor , ImageSetFixtureBase )
 	BOOST_CHECK_EQUAL(dset.PSFIndex(2), 2);
 }
 
+BOOST_FIXTURE_TEST_CASE( outOfCoreNormalization , ImageSetFixtureBase )
+{
+	addToImageSet(table, 0, 0, 0, 0, Polarization::XX, 100);
+	addToImageSet(table, 1, 0, 0, 0, Polarization::YY, 100);
+	table.Update();
+	settings.linkedPolarizations = std::set<PolarizationEnum>{ Polarization::XX, Polarization::YY };
+	settings.deconvolutionOutOfCore = true;
+	// Large enough to span several integration tiles
+	const size_t width = 200, height = 200, n = width * height;
+	ImageSet dset(&table, allocator, settings, width, height);
+	for(size_t i=0; i!=n; ++i)
+	{
+		dset[0][i] = double(i % 13);
+		dset[1][i] = -double(i % 7);
+	}
+	Image linear(width, height, allocator), squared(width, height, allocator), scratch(width, height, allocator);
+	dset.GetLinearIntegrated(linear.data());
+	dset.GetSquareIntegrated(squared.data(), scratch.data());
+	for(size_t i=0; i!=n; ++i)
+	{
+		double a = double(i % 13), b = -double(i % 7);
+		BOOST_CHECK_CLOSE_FRACTION(linear[i], 0.5 * (a + b), 1e-6);
+		BOOST_CHECK_CLOSE_FRACTION(squared[i], sqrt((a*a + b*b) * 0.5), 1e-6);
+	}
+	
+	// Sub-images, as made by parallel deconvolution, are kept in memory
+	std::unique_ptr<ImageSet> trimmed = dset.Trim(10, 20, 30, 50, width);
+	BOOST_CHECK_EQUAL(trimmed->size(), 2);
+	BOOST_CHECK_EQUAL((*trimmed)[0][0], dset[0][20*width + 10]);
+	BOOST_CHECK_EQUAL((*trimmed)[1][29*20 + 19], dset[1][49*width + 29]);
+}
+
 BOOST_FIXTURE_TEST_CASE( psfindex , ImageSetFixtureBase )
 {
 	for(size_t ch=0; ch!=4; ++ch)
@@ -0,0 +1,73 @@
+#include <boost/test/unit_test.hpp>
+
+#include "../wsclean/imageweightcache.h"
+
+#include "../msproviders/msprovider.h"
+
+#include <boost/filesystem/operations.hpp>
+
+BOOST_AUTO_TEST_SUITE(image_weight_cache)
+
+namespace {
+	typedef std::vector<std::pair<std::unique_ptr<MSProvider>, MSSelection>> MSList;
+
+	std::unique_ptr<ImageWeightCache> makeCache()
+	{
+		return std::unique_ptr<ImageWeightCache>(new ImageWeightCache(
+			WeightMode(WeightMode::UniformWeighted), 64, 64, 0.01, 0.01, 0.0, 0.0, 0.0, 16, false));
+	}
+}
+
+BOOST_AUTO_TEST_CASE( keeps_weights_within_budget )
+{
+	std::unique_ptr<ImageWeightCache> cache = makeCache();
+	const size_t weightSize = cache->MakeEmptyWeights()->GridSizeInBytes();
+	cache->SetMemoryBudget(weightSize * 2);
+	MSList msList;
+	std::shared_ptr<ImageWeights>
+		channel0 = cache->Get(msList, 0, 0),
+		channel1 = cache->Get(msList, 1, 0);
+	BOOST_CHECK_EQUAL(cache->EntryCount(), 2);
+	// Alternating between channels does not recalculate the weights
+	BOOST_CHECK_EQUAL(cache->Get(msList, 0, 0), channel0);
+	BOOST_CHECK_EQUAL(cache->Get(msList, 1, 0), channel1);
+	BOOST_CHECK(channel0 != channel1);
+
+	// Channel 0 is the least recently used and is removed
+	cache->Get(msList, 2, 0);
+	BOOST_CHECK_EQUAL(cache->EntryCount(), 2);
+	BOOST_CHECK_EQUAL(cache->Get(msList, 1, 0), channel1);
+	BOOST_CHECK(cache->Get(msList, 0, 0) != channel0);
+
+	// The last weights are always kept
+	cache->SetMemoryBudget(0);
+	BOOST_CHECK_EQUAL(cache->EntryCount(), 1);
+	BOOST_CHECK_EQUAL(cache->Get(msList, 0, 0), cache->Get(msList, 0, 0));
+}
+
+BOOST_AUTO_TEST_CASE( disk_cache )
+{
+	boost::filesystem::path directory = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+	boost::filesystem::create_directories(directory);
+	MSList msList;
+
+	std::unique_ptr<ImageWeightCache> cache = makeCache();
+	cache->SetDiskCache(directory.string(), "test");
+	std::shared_ptr<ImageWeights> weights = cache->Get(msList, 0, 0);
+	BOOST_CHECK(!boost::filesystem::is_empty(directory));
+
+	// A new cache, as in a later run, finds the weights on disk
+	std::unique_ptr<ImageWeightCache> laterCache = makeCache();
+	laterCache->SetDiskCache(directory.string(), "test");
+	std::shared_ptr<ImageWeights> readWeights = laterCache->Get(msList, 0, 0);
+	std::vector<double>
+		grid(weights->Width() * weights->Height()),
+		readGrid(readWeights->Width() * readWeights->Height());
+	weights->GetGrid(grid.data());
+	readWeights->GetGrid(readGrid.data());
+	BOOST_CHECK_EQUAL_COLLECTIONS(grid.begin(), grid.end(), readGrid.begin(), readGrid.end());
+
+	boost::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
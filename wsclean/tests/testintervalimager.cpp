@@ -0,0 +1,124 @@
+#include <boost/test/unit_test.hpp>
+
+#include "../wsclean/intervalimager.h"
+
+#include "../imageweights.h"
+
+#include "../msproviders/msindex.h"
+
+BOOST_AUTO_TEST_SUITE(interval_imager)
+
+namespace {
+	const double frequency = 150e6, wavelength = 299792458.0 / frequency;
+
+	/**
+	 * Makes a single-channel chunk with visibilities of one. The first two rows fall in
+	 * the same uv cell, the third row in another cell and the last row is flagged.
+	 */
+	IntervalImager::Chunk makeChunk()
+	{
+		IntervalImager::Chunk chunk;
+		chunk.band = BandData(std::vector<ChannelInfo>{ ChannelInfo(frequency, 1e6) });
+		const double uvws[4][3] = {
+			{ 10.0, 20.0, 1.0 },
+			{ 10.1, 20.1, 1.0 },
+			{ -30.0, 40.0, 2.0 },
+			{ 50.0, 10.0, 0.0 }
+		};
+		const float weights[4] = { 1.0, 3.0, 2.0, 0.0 };
+		for(size_t row=0; row!=4; ++row)
+		{
+			chunk.uvws.push_back(uvws[row][0]);
+			chunk.uvws.push_back(uvws[row][1]);
+			chunk.uvws.push_back(uvws[row][2]);
+			chunk.data.push_back(std::complex<float>(1.0, 0.0));
+			chunk.weights.push_back(weights[row]);
+		}
+		return chunk;
+	}
+
+	std::unique_ptr<ImageWeights> makeUniformWeights(const IntervalImager::Chunk& chunk)
+	{
+		std::unique_ptr<ImageWeights> imageWeights(new ImageWeights(
+			WeightMode(WeightMode::UniformWeighted), 64, 64, 0.01, 0.01, false, 1.0));
+		IntervalImager::GridImagingWeights(chunk, *imageWeights, false);
+		imageWeights->FinishGridding();
+		return imageWeights;
+	}
+}
+
+BOOST_AUTO_TEST_CASE( interval_of_time )
+{
+	const std::vector<double> startTimes{ 100.0, 200.0, 300.0 };
+	BOOST_CHECK_EQUAL(IntervalImager::IntervalOfTime(startTimes, 50.0), 0);
+	BOOST_CHECK_EQUAL(IntervalImager::IntervalOfTime(startTimes, 100.0), 0);
+	BOOST_CHECK_EQUAL(IntervalImager::IntervalOfTime(startTimes, 199.0), 0);
+	BOOST_CHECK_EQUAL(IntervalImager::IntervalOfTime(startTimes, 200.0), 1);
+	BOOST_CHECK_EQUAL(IntervalImager::IntervalOfTime(startTimes, 300.0), 2);
+	BOOST_CHECK_EQUAL(IntervalImager::IntervalOfTime(startTimes, 1e9), 2);
+}
+
+BOOST_AUTO_TEST_CASE( count_interval_rows )
+{
+	MSIndex index;
+	const size_t rowsPerTimestep[5] = { 2, 3, 1, 4, 2 };
+	for(size_t t=0; t!=5; ++t)
+	{
+		for(size_t row=0; row!=rowsPerTimestep[t]; ++row)
+			index.AddRow(100.0 + 50.0*t, 0, 0, false);
+	}
+	// Timesteps 1 to 4 (times 150 to 300) are imaged in intervals starting at 150, 200 and 300
+	const std::vector<size_t> rowCounts =
+		IntervalImager::CountIntervalRows(index, 1, 5, std::vector<double>{ 150.0, 200.0, 300.0 });
+	const std::vector<size_t> expected{ 3, 5, 2 };
+	BOOST_CHECK_EQUAL_COLLECTIONS(rowCounts.begin(), rowCounts.end(), expected.begin(), expected.end());
+
+	BOOST_CHECK_EQUAL(IntervalImager::IntervalBytes(10, 4, false), 10 * (24 + 4 * 12));
+	BOOST_CHECK_EQUAL(IntervalImager::IntervalBytes(10, 4, true), 10 * (24 + 4 * 20));
+}
+
+BOOST_AUTO_TEST_CASE( uniform_weighting )
+{
+	IntervalImager::Chunk chunk = makeChunk();
+	std::unique_ptr<ImageWeights> imageWeights = makeUniformWeights(chunk);
+	IntervalImager::WeightSums sums;
+	IntervalImager::WeightChunk(chunk, *imageWeights, MeasurementSetGridder::NormalVisibilityWeighting, true, sums);
+
+	// The first cell has a weight sum of 4, the second of 2
+	const double expected[4] = { 0.25, 0.75, 1.0, 0.0 };
+	for(size_t row=0; row!=4; ++row)
+	{
+		BOOST_CHECK_CLOSE_FRACTION(chunk.data[row].real(), expected[row], 1e-6);
+		BOOST_CHECK_EQUAL(chunk.data[row].imag(), 0.0);
+		BOOST_CHECK_CLOSE_FRACTION(chunk.psfData[row].real(), expected[row], 1e-6);
+	}
+	BOOST_CHECK_CLOSE_FRACTION(sums.totalWeight, 2.0, 1e-6);
+	BOOST_CHECK_CLOSE_FRACTION(sums.visibilityWeightSum, 6.0, 1e-6);
+	BOOST_CHECK_EQUAL(sums.visibilityCount, 3);
+	BOOST_CHECK_CLOSE_FRACTION(sums.NormalizationFactor(), 0.5, 1e-6);
+	BOOST_CHECK_CLOSE_FRACTION(sums.maxBaseline, std::sqrt(30.0*30.0 + 40.0*40.0 + 2.0*2.0) / wavelength, 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE( visibility_weighting_modes )
+{
+	IntervalImager::Chunk chunk = makeChunk();
+	std::unique_ptr<ImageWeights> imageWeights = makeUniformWeights(chunk);
+	IntervalImager::WeightSums squaredSums;
+	IntervalImager::WeightChunk(chunk, *imageWeights, MeasurementSetGridder::SquaredVisibilityWeighting, false, squaredSums);
+	BOOST_CHECK(chunk.psfData.empty());
+	BOOST_CHECK_CLOSE_FRACTION(chunk.data[1].real(), 9.0 * 0.25, 1e-6);
+	BOOST_CHECK_CLOSE_FRACTION(squaredSums.totalWeight, 0.25 + 2.25 + 2.0, 1e-6);
+	BOOST_CHECK_CLOSE_FRACTION(squaredSums.visibilityWeightSum, 14.0, 1e-6);
+
+	chunk = makeChunk();
+	IntervalImager::WeightSums unitSums;
+	IntervalImager::WeightChunk(chunk, *imageWeights, MeasurementSetGridder::UnitVisibilityWeighting, false, unitSums);
+	BOOST_CHECK_CLOSE_FRACTION(unitSums.totalWeight, 1.0, 1e-6);
+	BOOST_CHECK_EQUAL(unitSums.visibilityCount, 3);
+
+	// Without weights, the image is not normalized
+	IntervalImager::WeightSums emptySums;
+	BOOST_CHECK_EQUAL(emptySums.NormalizationFactor(), 0.0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,78 @@
+#include <boost/test/unit_test.hpp>
+
+#include "../iuwt/iuwtdecomposition.h"
+
+#include "../threadpool.h"
+#include "../uvector.h"
+
+#include <random>
+
+BOOST_AUTO_TEST_SUITE(iuwt_decomposition)
+
+static void checkEqualToSingleThreaded(size_t width, size_t height, int scaleCount, int minScale)
+{
+	std::mt19937 rnd(42);
+	std::normal_distribution<double> dist(0.0, 1.0);
+	ao::uvector<double> image(width * height), scratch(width * height);
+	for(double& v : image)
+		v = dist(rnd);
+	
+	IUWTDecomposition reference(scaleCount, width, height);
+	reference.DecomposeST(image.data(), scratch.data());
+	
+	ThreadPool pool;
+	IUWTDecomposition fused(scaleCount, width, height);
+	fused.DecomposeMT(pool, image.data(), scratch.data(), true, minScale);
+	
+	for(int scale=0; scale!=scaleCount+1; ++scale)
+	{
+		const bool isSkipped = scale < minScale;
+		BOOST_REQUIRE_EQUAL(fused[scale].Coefficients().size(), width * height);
+		for(size_t i=0; i!=width*height; ++i)
+		{
+			const double expected = isSkipped ? 0.0 : reference[scale][i];
+			BOOST_CHECK_SMALL(fused[scale][i] - expected, 1e-10);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( fused_equals_single_threaded )
+{
+	checkEqualToSingleThreaded(64, 64, 3, 0);
+}
+
+BOOST_AUTO_TEST_CASE( fused_unaligned_size )
+{
+	// Width is not a multiple of the vector size
+	checkEqualToSingleThreaded(67, 45, 3, 0);
+}
+
+BOOST_AUTO_TEST_CASE( fused_min_scale )
+{
+	checkEqualToSingleThreaded(64, 48, 4, 2);
+}
+
+BOOST_AUTO_TEST_CASE( input_in_scratch )
+{
+	const size_t width = 40, height = 32;
+	std::mt19937 rnd(42);
+	std::normal_distribution<double> dist(0.0, 1.0);
+	ao::uvector<double> image(width * height), scratch(width * height);
+	for(double& v : image)
+		v = dist(rnd);
+	
+	IUWTDecomposition reference(3, width, height);
+	reference.DecomposeST(image.data(), scratch.data());
+	
+	ThreadPool pool;
+	IUWTDecomposition fused(3, width, height);
+	fused.DecomposeMT(pool, image.data(), image.data(), false);
+	BOOST_CHECK(fused[3].Coefficients().empty());
+	for(int scale=0; scale!=3; ++scale)
+	{
+		for(size_t i=0; i!=width*height; ++i)
+			BOOST_CHECK_SMALL(fused[scale][i] - reference[scale][i], 1e-10);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,94 @@
+#include <boost/test/unit_test.hpp>
+
+#include "../mappedfitsdata.h"
+
+#include "../uvector.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(mapped_fits_data)
+
+namespace {
+	const size_t headerSize = 2880;
+
+	/**
+	 * Writes a file with an (empty) header followed by the values in big-endian
+	 * order, like the data unit of a FITS file.
+	 */
+	template<typename FileType>
+	void writeFile(const std::string& filename, const ao::uvector<double>& values)
+	{
+		std::ofstream file(filename, std::ios::binary);
+		std::string header(headerSize, ' ');
+		file.write(header.data(), header.size());
+		for(double value : values)
+		{
+			const FileType fileValue = value;
+			char bytes[sizeof(FileType)];
+			std::memcpy(bytes, &fileValue, sizeof(FileType));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			std::reverse(bytes, bytes + sizeof(FileType));
+#endif
+			file.write(bytes, sizeof(FileType));
+		}
+	}
+
+	template<typename FileType, typename NumType>
+	void checkRead(int bitPix)
+	{
+		const std::string filename = "wsctest-mapped.fits";
+		const size_t width = 5, height = 4, planeCount = 3, imageSize = width * height;
+		ao::uvector<double> values(imageSize * planeCount);
+		for(size_t i=0; i!=values.size(); ++i)
+			values[i] = double(i) * 0.25 - 3.0;
+		writeFile<FileType>(filename, values);
+
+		MappedFitsData data(filename, headerSize, values.size(), bitPix);
+		BOOST_CHECK_EQUAL(data.PixelCount(), values.size());
+
+		ao::uvector<NumType> plane(imageSize);
+		data.Read(plane.data(), imageSize, imageSize);
+		for(size_t i=0; i!=imageSize; ++i)
+			BOOST_CHECK_EQUAL(plane[i], NumType(values[imageSize + i]));
+
+		// A 2 x 3 box with its corner at (2, 1) from the last plane
+		ao::uvector<NumType> box(6);
+		data.ReadBox(box.data(), imageSize * 2 + width + 2, width, 2, 3);
+		for(size_t y=0; y!=3; ++y)
+		{
+			for(size_t x=0; x!=2; ++x)
+				BOOST_CHECK_EQUAL(box[y*2 + x], NumType(values[imageSize * 2 + (y + 1) * width + x + 2]));
+		}
+
+		BOOST_CHECK_THROW(data.Read(plane.data(), imageSize * 2 + 1, imageSize), std::runtime_error);
+		std::remove(filename.c_str());
+	}
+}
+
+BOOST_AUTO_TEST_CASE( float_file )
+{
+	checkRead<float, float>(-32);
+	checkRead<float, double>(-32);
+}
+
+BOOST_AUTO_TEST_CASE( double_file )
+{
+	checkRead<double, double>(-64);
+	checkRead<double, float>(-64);
+}
+
+BOOST_AUTO_TEST_CASE( short_file )
+{
+	const std::string filename = "wsctest-mapped-short.fits";
+	writeFile<float>(filename, ao::uvector<double>(10, 1.0));
+	BOOST_CHECK_THROW(MappedFitsData(filename, headerSize, 11, -32), std::runtime_error);
+	BOOST_CHECK_THROW(MappedFitsData(filename, headerSize, 10, 16), std::runtime_error);
+	std::remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
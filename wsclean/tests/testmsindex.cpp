@@ -0,0 +1,172 @@
+#include <boost/test/unit_test.hpp>
+
+#include "../msproviders/msindex.h"
+
+#include "../msselection.h"
+
+#include <sstream>
+
+BOOST_AUTO_TEST_SUITE(ms_index)
+
+namespace {
+	/**
+	 * Makes an index of 5 timesteps with 3 rows per timestep: one auto-correlation
+	 * and one cross-correlation of field 0, and a cross-correlation of field 1.
+	 * Data description ids alternate per timestep.
+	 */
+	MSIndex makeIndex()
+	{
+		MSIndex index;
+		for(size_t t=0; t!=5; ++t)
+		{
+			const double time = 1000.0 + t*10.0;
+			index.AddRow(time, t%2, 0, true);
+			index.AddRow(time, t%2, 0, false);
+			index.AddRow(time, t%2, 1, false);
+		}
+		return index;
+	}
+}
+
+BOOST_AUTO_TEST_CASE( timesteps )
+{
+	MSIndex index = makeIndex();
+	BOOST_CHECK_EQUAL(index.RowCount(), 15);
+	BOOST_CHECK_EQUAL(index.TimestepCount(), 5);
+	BOOST_CHECK_EQUAL(index.TimestepStartRow(0), 0);
+	BOOST_CHECK_EQUAL(index.TimestepStartRow(2), 6);
+	BOOST_CHECK_EQUAL(index.TimestepStartRow(5), 15);
+	BOOST_CHECK_EQUAL(index.TimestepTime(3), 1030.0);
+	BOOST_CHECK_EQUAL(index.TimestepOfRow(0), 0);
+	BOOST_CHECK_EQUAL(index.TimestepOfRow(5), 1);
+	BOOST_CHECK_EQUAL(index.TimestepOfRow(6), 2);
+	BOOST_CHECK_EQUAL(index.TimestepOfRow(14), 4);
+	BOOST_CHECK_EQUAL(index.RowGroups().size(), 6);
+
+	MSSelection selection;
+	size_t startRow, endRow;
+	index.GetRowRange(selection, startRow, endRow);
+	BOOST_CHECK_EQUAL(startRow, 0);
+	BOOST_CHECK_EQUAL(endRow, 15);
+	selection.SetInterval(1, 3);
+	index.GetRowRange(selection, startRow, endRow);
+	BOOST_CHECK_EQUAL(startRow, 3);
+	BOOST_CHECK_EQUAL(endRow, 9);
+}
+
+BOOST_AUTO_TEST_CASE( selected_rows )
+{
+	MSIndex index = makeIndex();
+	MSSelection selection;
+	std::vector<size_t> rows;
+	// Default selection: field 0 without auto-correlations
+	index.GetSelectedRows(selection, std::set<size_t>{0, 1}, 0, 15, rows);
+	const std::vector<size_t> expectedField0{1, 4, 7, 10, 13};
+	BOOST_CHECK_EQUAL_COLLECTIONS(rows.begin(), rows.end(), expectedField0.begin(), expectedField0.end());
+
+	selection.SetFieldIds(std::vector<size_t>{MSSelection::ALL_FIELDS});
+	selection.SetInterval(1, 4);
+	selection.SetEvenOrOddTimesteps(MSSelection::OddTimesteps);
+	size_t startRow, endRow;
+	index.GetRowRange(selection, startRow, endRow);
+	rows.clear();
+	index.GetSelectedRows(selection, std::set<size_t>{1}, startRow, endRow, rows);
+	const std::vector<size_t> expected{4, 5, 10, 11};
+	BOOST_CHECK_EQUAL_COLLECTIONS(rows.begin(), rows.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE( write_and_read )
+{
+	MSIndex index = makeIndex();
+	std::stringstream stream;
+	index.Write(stream, "/data/test.ms", 42);
+
+	MSIndex readIndex;
+	BOOST_CHECK(readIndex.Read(stream, "/data/test.ms", 42));
+	BOOST_CHECK_EQUAL(readIndex.RowCount(), 15);
+	BOOST_CHECK_EQUAL(readIndex.TimestepCount(), 5);
+	BOOST_CHECK_EQUAL(readIndex.TimestepStartRow(4), 12);
+	BOOST_CHECK_EQUAL(readIndex.TimestepTime(4), 1040.0);
+	BOOST_REQUIRE_EQUAL(readIndex.RowGroups().size(), 6);
+	BOOST_CHECK_EQUAL(readIndex.RowGroups()[5].fieldId, 1);
+	BOOST_CHECK_EQUAL(readIndex.RowGroups()[5].dataDescId, 1);
+	BOOST_REQUIRE_EQUAL(readIndex.RowGroups()[5].ranges.size(), index.RowGroups()[5].ranges.size());
+	for(size_t i=0; i!=index.RowGroups()[5].ranges.size(); ++i)
+	{
+		BOOST_CHECK_EQUAL(readIndex.RowGroups()[5].ranges[i].start, index.RowGroups()[5].ranges[i].start);
+		BOOST_CHECK_EQUAL(readIndex.RowGroups()[5].ranges[i].end, index.RowGroups()[5].ranges[i].end);
+	}
+
+	// An index of another set or of a modified set is not accepted
+	stream.clear();
+	stream.seekg(0);
+	BOOST_CHECK(!readIndex.Read(stream, "/data/other.ms", 42));
+	stream.clear();
+	stream.seekg(0);
+	BOOST_CHECK(!readIndex.Read(stream, "/data/test.ms", 43));
+	BOOST_CHECK_EQUAL(readIndex.RowCount(), 15);
+}
+
+BOOST_AUTO_TEST_CASE( row_ranges )
+{
+	MSIndex index;
+	for(size_t row=0; row!=10; ++row)
+		index.AddRow(1000.0 + (row/4)*10.0, 0, row>=7 ? 1 : 0, false);
+	BOOST_REQUIRE_EQUAL(index.RowGroups().size(), 2);
+	BOOST_REQUIRE_EQUAL(index.RowGroups()[0].ranges.size(), 1);
+	BOOST_CHECK_EQUAL(index.RowGroups()[0].ranges[0].start, 0);
+	BOOST_CHECK_EQUAL(index.RowGroups()[0].ranges[0].end, 7);
+
+	MSSelection selection;
+	selection.SetInterval(1, 2);
+	size_t startRow, endRow;
+	index.GetRowRange(selection, startRow, endRow);
+	std::vector<size_t> rows;
+	index.GetSelectedRows(selection, std::set<size_t>{0}, startRow, endRow, rows);
+	const std::vector<size_t> expected{4, 5, 6};
+	BOOST_CHECK_EQUAL_COLLECTIONS(rows.begin(), rows.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE( empty )
+{
+	MSIndex index;
+	BOOST_CHECK_EQUAL(index.RowCount(), 0);
+	BOOST_CHECK_EQUAL(index.TimestepCount(), 0);
+	MSSelection selection;
+	selection.SetInterval(2, 5);
+	size_t startRow, endRow;
+	index.GetRowRange(selection, startRow, endRow);
+	BOOST_CHECK_EQUAL(startRow, 0);
+	BOOST_CHECK_EQUAL(endRow, 0);
+
+	std::stringstream stream;
+	index.Write(stream, "/data/empty.ms", 42);
+	MSIndex readIndex = makeIndex();
+	BOOST_CHECK(readIndex.Read(stream, "/data/empty.ms", 42));
+	BOOST_CHECK_EQUAL(readIndex.RowCount(), 0);
+	BOOST_CHECK(readIndex.RowGroups().empty());
+}
+
+BOOST_AUTO_TEST_CASE( corrupted )
+{
+	MSIndex index = makeIndex();
+	std::stringstream stream;
+	index.Write(stream, "/data/test.ms", 42);
+	const std::string data = stream.str();
+
+	// A huge timestep count should be rejected rather than allocated
+	std::string corrupted = data;
+	const size_t countPosition = 8 + 4 + 8 + 4 + std::string("/data/test.ms").size();
+	std::fill_n(&corrupted[countPosition], 8, char(0x7f));
+	std::istringstream corruptedStream(corrupted);
+	MSIndex readIndex;
+	BOOST_CHECK(!readIndex.Read(corruptedStream, "/data/test.ms", 42));
+	BOOST_CHECK_EQUAL(readIndex.RowCount(), 0);
+
+	// A truncated file should be rejected too
+	std::istringstream truncatedStream(data.substr(0, data.size() - 5));
+	BOOST_CHECK(!readIndex.Read(truncatedStream, "/data/test.ms", 42));
+	BOOST_CHECK_EQUAL(readIndex.RowCount(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,114 @@
+#include <boost/test/unit_test.hpp>
+
+#include "../deconvolution/peakpyramid.h"
+#include "../deconvolution/simpleclean.h"
+
+#include "../uvector.h"
+
+#include <random>
+
+BOOST_AUTO_TEST_SUITE(peak_pyramid)
+
+static void checkPeak(const PeakPyramid& pyramid, const ao::uvector<double>& image, size_t width, size_t height, bool allowNegatives, size_t border, const bool* mask)
+{
+	size_t x, y, expectedX, expectedY;
+	boost::optional<double> peak = pyramid.FindPeak(x, y), expected;
+	if(mask)
+		expected = SimpleClean::FindPeakWithMask(image.data(), width, height, expectedX, expectedY, allowNegatives, 0, height, mask, border, border);
+	else
+		expected = SimpleClean::FindPeakSimple(image.data(), width, height, expectedX, expectedY, allowNegatives, 0, height, border, border);
+	BOOST_REQUIRE_EQUAL(bool(peak), bool(expected));
+	if(peak)
+	{
+		BOOST_CHECK_EQUAL(x, expectedX);
+		BOOST_CHECK_EQUAL(y, expectedY);
+		BOOST_CHECK_EQUAL(*peak, *expected);
+	}
+}
+
+static void testUpdates(size_t width, size_t height, bool allowNegatives, size_t border, bool useMask)
+{
+	std::mt19937 rnd(42);
+	std::normal_distribution<double> dist(0.0, 1.0);
+	ao::uvector<double> image(width*height);
+	ao::uvector<bool> mask(width*height, true);
+	for(size_t i=0; i!=width*height; ++i)
+	{
+		image[i] = dist(rnd);
+		if(useMask)
+			mask[i] = (rnd() % 3) != 0;
+	}
+	const bool* maskPtr = useMask ? mask.data() : nullptr;
+	PeakPyramid pyramid(width, height, border, border, width-border, height-border, allowNegatives, 8);
+	pyramid.SetMask(maskPtr);
+	pyramid.Initialize(image.data());
+	checkPeak(pyramid, image, width, height, allowNegatives, border, maskPtr);
+
+	// Subtract boxes around the peak, as in a clean
+	for(size_t iteration=0; iteration!=50; ++iteration)
+	{
+		size_t x, y;
+		pyramid.FindPeak(x, y);
+		if(x == width)
+			break;
+		const size_t
+			x1 = x > 10 ? x - 10 : 0, x2 = std::min(x + 10, width),
+			y1 = y > 7 ? y - 7 : 0, y2 = std::min(y + 7, height);
+		for(size_t yi=y1; yi!=y2; ++yi)
+		{
+			for(size_t xi=x1; xi!=x2; ++xi)
+				image[yi*width + xi] -= 0.5 * image[y*width + x] + 0.1 * dist(rnd);
+		}
+		pyramid.Update(image.data(), x1, y1, x2, y2);
+		checkPeak(pyramid, image, width, height, allowNegatives, border, maskPtr);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( updates )
+{
+	testUpdates(64, 48, false, 0, false);
+}
+
+BOOST_AUTO_TEST_CASE( updates_negatives )
+{
+	testUpdates(64, 48, true, 0, false);
+}
+
+BOOST_AUTO_TEST_CASE( updates_border_uneven_tiles )
+{
+	testUpdates(67, 51, true, 5, false);
+}
+
+BOOST_AUTO_TEST_CASE( updates_mask )
+{
+	testUpdates(67, 51, true, 3, true);
+}
+
+BOOST_AUTO_TEST_CASE( equal_values )
+{
+	// With equal values, the first pixel in row-major order should be found
+	ao::uvector<double> image(40*40, 0.0);
+	image[30*40 + 2] = 1.0;
+	image[20*40 + 35] = 1.0;
+	PeakPyramid pyramid(40, 40, 0, 0, 40, 40, false, 16);
+	pyramid.Initialize(image.data());
+	size_t x, y;
+	BOOST_CHECK_EQUAL(*pyramid.FindPeak(x, y), 1.0);
+	BOOST_CHECK_EQUAL(x, 35);
+	BOOST_CHECK_EQUAL(y, 20);
+}
+
+BOOST_AUTO_TEST_CASE( no_peak )
+{
+	ao::uvector<double> image(16*16, -1.0);
+	PeakPyramid pyramid(16, 16, 0, 0, 16, 16, false);
+	pyramid.Initialize(image.data());
+	size_t x, y;
+	BOOST_CHECK(!pyramid.FindPeak(x, y));
+
+	PeakPyramid emptyRegion(16, 16, 8, 8, 8, 8, true);
+	emptyRegion.Initialize(image.data());
+	BOOST_CHECK(!emptyRegion.FindPeak(x, y));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
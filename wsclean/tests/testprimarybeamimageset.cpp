@@ -0,0 +1,119 @@
+#include <boost/test/unit_test.hpp>
+
+#include "../wsclean/primarybeamimageset.h"
+
+#include "../uvector.h"
+
+#include <cmath>
+
+BOOST_AUTO_TEST_SUITE(primary_beam_image_set)
+
+namespace {
+	const size_t width = 7, height = 5, size = width * height;
+
+	PrimaryBeamImageSet makeBeam(ImageBufferAllocator& allocator)
+	{
+		PrimaryBeamImageSet beam(width, height, allocator, 8);
+		for(size_t i=0; i!=8; ++i)
+		{
+			for(size_t j=0; j!=size; ++j)
+				beam[i][j] = std::sin(double(j + 1) * (i + 1) * 0.37) + ((i == 0 || i == 6) ? 2.0 : 0.0);
+		}
+		// A singular beam value
+		for(size_t i=0; i!=8; ++i)
+			beam[i][3] = 0.0;
+		return beam;
+	}
+
+	void checkEqual(const double* a, const double* b)
+	{
+		for(size_t j=0; j!=size; ++j)
+		{
+			if(std::isnan(b[j]))
+				BOOST_CHECK(std::isnan(a[j]));
+			else
+				BOOST_CHECK_CLOSE_FRACTION(a[j], b[j], 1e-10);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( stokes_i )
+{
+	ImageBufferAllocator allocator;
+	PrimaryBeamImageSet beam = makeBeam(allocator);
+	ao::uvector<double> image(size), expected(size);
+	for(size_t j=0; j!=size; ++j)
+	{
+		image[j] = double(j) - 10.0;
+		// Direct evaluation of Ic = Iu * 0.5 * trace((B B^*)^-1)
+		MC2x2 val, squared;
+		val[0] = std::complex<double>(beam[0][j], beam[1][j]);
+		val[1] = std::complex<double>(beam[2][j], beam[3][j]);
+		val[2] = std::complex<double>(beam[4][j], beam[5][j]);
+		val[3] = std::complex<double>(beam[6][j], beam[7][j]);
+		MC2x2::ATimesHermB(squared, val, val);
+		if(squared.Invert())
+			expected[j] = image[j] * 0.5 * (squared[0].real() + squared[3].real());
+		else
+			expected[j] = std::numeric_limits<double>::quiet_NaN();
+		if(j != 3)
+			BOOST_CHECK_CLOSE_FRACTION(beam.GetUnpolarizedCorrectionFactor(j%width, j/width) * image[j], expected[j], 1e-10);
+	}
+	BOOST_CHECK(std::isnan(beam.GetUnpolarizedCorrectionFactor(3, 0)));
+
+	ao::uvector<double> parallelImage(image);
+	beam.ApplyStokesI(image.data());
+	checkEqual(image.data(), expected.data());
+	beam.ApplyStokesI(parallelImage.data(), 3);
+	checkEqual(parallelImage.data(), expected.data());
+}
+
+BOOST_AUTO_TEST_CASE( full_stokes_threads )
+{
+	ImageBufferAllocator allocator;
+	PrimaryBeamImageSet beam = makeBeam(allocator);
+	ao::uvector<double> single[4], parallel[4];
+	for(size_t p=0; p!=4; ++p)
+	{
+		single[p].resize(size);
+		for(size_t j=0; j!=size; ++j)
+			single[p][j] = std::cos(double(j) * (p + 2));
+		parallel[p] = single[p];
+	}
+	double* singlePtrs[4] = { single[0].data(), single[1].data(), single[2].data(), single[3].data() };
+	double* parallelPtrs[4] = { parallel[0].data(), parallel[1].data(), parallel[2].data(), parallel[3].data() };
+	beam.ApplyFullStokes(singlePtrs);
+	beam.ApplyFullStokes(parallelPtrs, 4);
+	for(size_t p=0; p!=4; ++p)
+	{
+		BOOST_CHECK(std::isnan(single[p][3]));
+		checkEqual(parallel[p].data(), single[p].data());
+	}
+}
+
+BOOST_AUTO_TEST_CASE( full_stokes_mueller )
+{
+	// A Mueller matrix that scales all correlations by 1/4 should scale all
+	// Stokes parameters by 4 after correction. The diagonal of the packed
+	// Hermitian matrix is stored at indices 0, 3, 8 and 15.
+	ImageBufferAllocator allocator;
+	PrimaryBeamImageSet beam(width, height, allocator, 16);
+	beam.SetToZero();
+	for(size_t i : { 0u, 3u, 8u, 15u })
+	{
+		for(size_t j=0; j!=size; ++j)
+			beam[i][j] = 0.25;
+	}
+	ao::uvector<double> images[4];
+	for(size_t p=0; p!=4; ++p)
+		images[p].assign(size, double(p + 1));
+	double* imagePtrs[4] = { images[0].data(), images[1].data(), images[2].data(), images[3].data() };
+	beam.ApplyFullStokes(imagePtrs, 2);
+	for(size_t p=0; p!=4; ++p)
+	{
+		for(size_t j=0; j!=size; ++j)
+			BOOST_CHECK_CLOSE_FRACTION(images[p][j], 4.0 * (p + 1), 1e-10);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,159 @@
+#include <boost/test/unit_test.hpp>
+
+#include "../msproviders/rephasingmsprovider.h"
+
+#include "../banddata.h"
+
+#include <cmath>
+
+BOOST_AUTO_TEST_SUITE(rephasing_ms_provider)
+
+namespace {
+	const size_t channelCount = 16, polarizationCount = 2;
+
+	/**
+	 * Provides a single row with a fixed uvw and fixed visibilities.
+	 */
+	class SingleRowMSProvider final : public MSProvider
+	{
+	public:
+		SingleRowMSProvider(const double* uvw, const std::vector<std::complex<float>>& data) :
+			_uvw{uvw[0], uvw[1], uvw[2]}, _data(data), _written(data.size()), _columnName("DATA")
+		{ }
+
+		SynchronizedMS MS() override { return SynchronizedMS(); }
+		const std::string& DataColumnName() override { return _columnName; }
+		size_t RowId() const override { return 0; }
+		bool CurrentRowAvailable() override { return true; }
+		void NextRow() override { }
+		void Reset() override { }
+		void ReadMeta(double& u, double& v, double& w, size_t& dataDescId) override
+		{
+			u = _uvw[0]; v = _uvw[1]; w = _uvw[2];
+			dataDescId = 0;
+		}
+		void ReadMeta(MetaData& metaData) override
+		{
+			metaData.uInM = _uvw[0]; metaData.vInM = _uvw[1]; metaData.wInM = _uvw[2];
+		}
+		void ReadData(std::complex<float>* buffer) override { std::copy(_data.begin(), _data.end(), buffer); }
+		void ReadModel(std::complex<float>* buffer) override { ReadData(buffer); }
+		void WriteModel(size_t, std::complex<float>* buffer, const double* uvw) override
+		{
+			std::copy_n(buffer, _written.size(), _written.begin());
+			std::copy_n(uvw, 3, _writtenUVW);
+		}
+		void WriteImagingWeights(size_t, const float*) override { }
+		void ReadWeights(float*) override { }
+		void ReadWeights(std::complex<float>*) override { }
+		void ReopenRW() override { }
+		double StartTime() override { return 0.0; }
+		void MakeIdToMSRowMapping(std::vector<size_t>& idToMSRow) override { idToMSRow.assign(1, 0); }
+		PolarizationEnum Polarization() override { return Polarization::XX; }
+		size_t NChannels() override { return channelCount; }
+		size_t NAntennas() override { return 2; }
+		size_t NPolarizations() override { return polarizationCount; }
+
+		const std::vector<std::complex<float>>& Written() const { return _written; }
+		const double* WrittenUVW() const { return _writtenUVW; }
+
+	private:
+		double _uvw[3], _writtenUVW[3];
+		std::vector<std::complex<float>> _data, _written;
+		std::string _columnName;
+	};
+
+	/**
+	 * Direct computation of the uvw of a J2000 baseline vector towards a direction: the
+	 * w axis points to the direction, u points east and v = w x u.
+	 */
+	void directUVW(const double* baseline, double ra, double dec, double* uvw)
+	{
+		const double
+			w[3] = { std::cos(dec)*std::cos(ra), std::cos(dec)*std::sin(ra), std::sin(dec) },
+			u[3] = { -std::sin(ra), std::cos(ra), 0.0 },
+			v[3] = { w[1]*u[2] - w[2]*u[1], w[2]*u[0] - w[0]*u[2], w[0]*u[1] - w[1]*u[0] };
+		uvw[0] = u[0]*baseline[0] + u[1]*baseline[1] + u[2]*baseline[2];
+		uvw[1] = v[0]*baseline[0] + v[1]*baseline[1] + v[2]*baseline[2];
+		uvw[2] = w[0]*baseline[0] + w[1]*baseline[1] + w[2]*baseline[2];
+	}
+
+	BandData makeBand()
+	{
+		std::vector<ChannelInfo> channels;
+		for(size_t ch=0; ch!=channelCount; ++ch)
+			channels.emplace_back(120e6 + ch*1e6, 1e6);
+		return BandData(channels);
+	}
+
+	const double
+		baseline[3] = { 1520.0, -2380.0, 810.0 },
+		oldRA = 1.2, oldDec = 0.7, newRA = 1.25, newDec = 0.62;
+}
+
+BOOST_AUTO_TEST_CASE( rotated_uvw )
+{
+	double oldUVW[3], expected[3];
+	directUVW(baseline, oldRA, oldDec, oldUVW);
+	directUVW(baseline, newRA, newDec, expected);
+	RephasingMSProvider provider(
+		std::unique_ptr<MSProvider>(new SingleRowMSProvider(oldUVW, std::vector<std::complex<float>>(channelCount*polarizationCount))),
+		makeBand(), oldRA, oldDec, 0.0, 0.0, newRA, newDec);
+	double u, v, w;
+	size_t dataDescId;
+	provider.ReadMeta(u, v, w, dataDescId);
+	BOOST_CHECK_SMALL(u - expected[0], 1e-8);
+	BOOST_CHECK_SMALL(v - expected[1], 1e-8);
+	BOOST_CHECK_SMALL(w - expected[2], 1e-8);
+
+	// The rephasing rotates the uvw axes, so it does not change the uvw length on which
+	// the -minuvw-m and -maxuvw-m selection is made.
+	BOOST_CHECK_CLOSE_FRACTION(
+		std::sqrt(u*u + v*v + w*w),
+		std::sqrt(oldUVW[0]*oldUVW[0] + oldUVW[1]*oldUVW[1] + oldUVW[2]*oldUVW[2]), 1e-12);
+}
+
+BOOST_AUTO_TEST_CASE( phase_of_source_at_new_centre )
+{
+	// A unit point source at the new phase centre has, relative to the old phase centre,
+	// visibilities exp(2 pi i (u l + v m + w (n-1)) / lambda) = exp(2 pi i (w_new - w_old) / lambda).
+	// After rephasing, it is at the phase centre, so its visibilities are real and equal to one.
+	double oldUVW[3], newUVW[3];
+	directUVW(baseline, oldRA, oldDec, oldUVW);
+	directUVW(baseline, newRA, newDec, newUVW);
+	const BandData band = makeBand();
+	std::vector<std::complex<float>> data;
+	for(size_t ch=0; ch!=channelCount; ++ch)
+	{
+		const double phase = 2.0 * M_PI * (newUVW[2] - oldUVW[2]) / band.ChannelWavelength(ch);
+		for(size_t p=0; p!=polarizationCount; ++p)
+			data.emplace_back(std::cos(phase), std::sin(phase));
+	}
+	SingleRowMSProvider* wrapped = new SingleRowMSProvider(oldUVW, data);
+	RephasingMSProvider provider(std::unique_ptr<MSProvider>(wrapped), band, oldRA, oldDec, 0.0, 0.0, newRA, newDec);
+	provider.ReopenRW();
+
+	std::vector<std::complex<float>> buffer(data.size());
+	provider.ReadData(buffer.data());
+	for(const std::complex<float>& value : buffer)
+	{
+		BOOST_CHECK_SMALL(value.real() - 1.0f, 1e-4f);
+		BOOST_CHECK_SMALL(value.imag(), 1e-4f);
+	}
+
+	// A prediction is phased back to the original phase centre, using only the uvw of the row
+	double uvw[3];
+	size_t dataDescId;
+	provider.ReadMeta(uvw[0], uvw[1], uvw[2], dataDescId);
+	provider.Reset();
+	provider.WriteModel(provider.RowId(), buffer.data(), uvw);
+	for(size_t i=0; i!=data.size(); ++i)
+	{
+		BOOST_CHECK_SMALL(wrapped->Written()[i].real() - data[i].real(), 1e-4f);
+		BOOST_CHECK_SMALL(wrapped->Written()[i].imag() - data[i].imag(), 1e-4f);
+	}
+	for(size_t i=0; i!=3; ++i)
+		BOOST_CHECK_CLOSE_FRACTION(wrapped->WrittenUVW()[i], oldUVW[i], 1e-10);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,163 @@
+#include <boost/test/unit_test.hpp>
+
+#include "../deconvolution/simdkernels.h"
+#include "../deconvolution/simpleclean.h"
+
+#include "../uvector.h"
+
+#include <random>
+
+BOOST_AUTO_TEST_SUITE(simd_kernels)
+
+namespace {
+	ao::uvector<double> makeNoise(size_t n, unsigned seed)
+	{
+		std::mt19937 mt(seed);
+		std::normal_distribution<double> dist(0.0, 1.0);
+		ao::uvector<double> values(n);
+		for(double& v : values)
+			v = dist(mt);
+		return values;
+	}
+}
+
+BOOST_AUTO_TEST_CASE( find_peak )
+{
+	// Odd sizes, to test the remainders of the vectorized loops
+	const size_t width = 37, height = 23;
+	ao::uvector<double> image = makeNoise(width * height, 42);
+	for(bool allowNegatives : { false, true })
+	{
+		for(size_t border : { 0, 3 })
+		{
+			size_t x, y, xSimple, ySimple;
+			boost::optional<double> peak = SimdKernels::FindPeak(image.data(), width, height, x, y, allowNegatives, 2, 20, border, border);
+			boost::optional<double> peakSimple = SimpleClean::FindPeakSimple(image.data(), width, height, xSimple, ySimple, allowNegatives, 2, 20, border, border);
+			BOOST_REQUIRE(peak);
+			BOOST_CHECK_EQUAL(*peak, *peakSimple);
+			BOOST_CHECK_EQUAL(x, xSimple);
+			BOOST_CHECK_EQUAL(y, ySimple);
+		}
+	}
+
+	// Equal values select the first
+	ao::uvector<double> flat(width * height, 0.0);
+	flat[5*width + 7] = -2.0;
+	flat[8*width + 1] = 2.0;
+	size_t x, y;
+	BOOST_CHECK_EQUAL(*SimdKernels::FindPeak(flat.data(), width, height, x, y, true, 0, height, 0, 0), -2.0);
+	BOOST_CHECK_EQUAL(x, 7);
+	BOOST_CHECK_EQUAL(y, 5);
+
+	// Without positive values, no peak is found
+	ao::uvector<double> negative(width * height, -1.0);
+	BOOST_CHECK(!SimdKernels::FindPeak(negative.data(), width, height, x, y, false, 0, height, 0, 0));
+}
+
+BOOST_AUTO_TEST_CASE( max_index )
+{
+	ao::uvector<double> values = makeNoise(1001, 1);
+	values[700] = -10.0;
+	values[900] = 5.0;
+	BOOST_CHECK_EQUAL(SimdKernels::MaxIndex(values.data(), values.size(), true), 700);
+	BOOST_CHECK_EQUAL(SimdKernels::MaxIndex(values.data(), values.size(), false), 900);
+	values[800] = 10.0;
+	BOOST_CHECK_EQUAL(SimdKernels::MaxIndex(values.data(), values.size(), true), 700);
+	BOOST_CHECK_EQUAL(SimdKernels::MaxIndex(values.data(), 1, true), 0);
+}
+
+BOOST_AUTO_TEST_CASE( arithmetic )
+{
+	const size_t n = 99;
+	ao::uvector<double>
+		lhs = makeNoise(n, 2),
+		rhs = makeNoise(n, 3),
+		expected(n);
+
+	for(size_t i=0; i!=n; ++i)
+		expected[i] = lhs[i] + rhs[i] * 0.5;
+	SimdKernels::AddFactor(lhs.data(), rhs.data(), 0.5, n);
+	for(size_t i=0; i!=n; ++i)
+		BOOST_CHECK_CLOSE_FRACTION(lhs[i], expected[i], 1e-12);
+
+	for(size_t i=0; i!=n; ++i)
+		expected[i] = lhs[i] + rhs[i] * rhs[i];
+	SimdKernels::AddSquared(lhs.data(), rhs.data(), n);
+	for(size_t i=0; i!=n; ++i)
+		BOOST_CHECK_CLOSE_FRACTION(lhs[i], expected[i], 1e-12);
+
+	for(size_t i=0; i!=n; ++i)
+	{
+		lhs[i] = std::fabs(lhs[i]);
+		expected[i] = std::sqrt(lhs[i]) * 3.0;
+	}
+	SimdKernels::SquareRootMultiply(lhs.data(), 3.0, n);
+	for(size_t i=0; i!=n; ++i)
+		BOOST_CHECK_CLOSE_FRACTION(lhs[i], expected[i], 1e-12);
+}
+
+BOOST_AUTO_TEST_CASE( partial_subtract_image )
+{
+	const size_t width = 31, height = 17;
+	const ao::uvector<double> psf = makeNoise(width * height, 4);
+	for(size_t x : { 0, 3, 15, 30 })
+	{
+		ao::uvector<double> image(width * height, 0.0), expected(width * height, 0.0);
+		const size_t y = 10;
+		SimdKernels::PartialSubtractImage(image.data(), width, psf.data(), width, height, x, y, 0.5, 2, 15);
+		const int offsetX = int(x) - int(width/2), offsetY = int(y) - int(height/2);
+		for(size_t yi=std::max(2, offsetY); yi<std::min(y + height/2, size_t(15)); ++yi)
+		{
+			for(size_t xi=std::max(0, offsetX); xi<std::min(x + width/2, width); ++xi)
+				expected[xi + yi*width] = -0.5 * psf[(xi - offsetX) + (yi - offsetY)*width];
+		}
+		BOOST_CHECK_EQUAL_COLLECTIONS(image.begin(), image.end(), expected.begin(), expected.end());
+	}
+}
+
+BOOST_AUTO_TEST_CASE( single_precision )
+{
+	const size_t width = 31, height = 17, n = width * height;
+	const ao::uvector<double> psf = makeNoise(n, 6), noise = makeNoise(n, 7);
+	ao::uvector<double> image(noise), sum(n, 1.0), expectedSum(n, 1.0);
+	ao::uvector<float> imageF(noise.begin(), noise.end()), sumF(n, 1.0);
+	SimdKernels::PartialSubtractImage(image.data(), width, psf.data(), width, height, 20, 7, 0.5, 0, height);
+	SimdKernels::PartialSubtractImage(imageF.data(), width, psf.data(), width, height, 20, 7, 0.5, 0, height);
+	for(size_t i=0; i!=n; ++i)
+		BOOST_CHECK_CLOSE_FRACTION(imageF[i], image[i], 1e-6);
+	
+	SimdKernels::AddFactor(sum.data(), imageF.data(), 2.0, n);
+	SimdKernels::AddSquared(sum.data(), imageF.data(), n);
+	SimdKernels::AddFactor(sumF.data(), imageF.data(), 2.0, n);
+	for(size_t i=0; i!=n; ++i)
+	{
+		expectedSum[i] += double(imageF[i]) * 2.0;
+		BOOST_CHECK_CLOSE_FRACTION(sumF[i], expectedSum[i], 1e-6);
+		expectedSum[i] += double(imageF[i]) * double(imageF[i]);
+		BOOST_CHECK_CLOSE_FRACTION(sum[i], expectedSum[i], 1e-12);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( subtract_psf_at_positions )
+{
+	const size_t width = 16, height = 12;
+	const ao::uvector<double> psf = makeNoise(width * height, 5);
+	const ao::uvector<size_t>
+		xs = { 0, 3, 8, 15, 8, 15, 0 },
+		ys = { 0, 4, 6, 11, 0, 0, 11 };
+	ao::uvector<double> values(xs.size(), 1.0);
+	const size_t x = 12, y = 2;
+	SimdKernels::SubtractPSFAtPositions(values.data(), xs.data(), ys.data(), xs.size(), psf.data(), width, height, x, y, 2.0);
+	for(size_t i=0; i!=xs.size(); ++i)
+	{
+		const int
+			psfX = int(xs[i]) - int(x) + int(width/2),
+			psfY = int(ys[i]) - int(y) + int(height/2);
+		if(psfX >= 0 && psfX < int(width) && psfY >= 0 && psfY < int(height))
+			BOOST_CHECK_CLOSE_FRACTION(values[i], 1.0 - psf[psfX + psfY*width] * 2.0, 1e-12);
+		else
+			BOOST_CHECK_EQUAL(values[i], 1.0);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
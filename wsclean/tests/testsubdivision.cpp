@@ -0,0 +1,132 @@
+#include <boost/test/unit_test.hpp>
+
+#include "../deconvolution/subdivision.h"
+
+#include "../uvector.h"
+
+#include <random>
+
+BOOST_AUTO_TEST_SUITE(subdivision)
+
+BOOST_AUTO_TEST_CASE( vertical_line_avoids_flux )
+{
+	const size_t width = 40, height = 30;
+	ao::uvector<double> image(width * height, 1.0);
+	// A zero-flux path that zigzags between columns 18 and 22
+	for(size_t y=0; y!=height; ++y)
+		image[y*width + ((y/5)%2==0 ? 18 : 22)] = 0.0;
+	Subdivision divisor(width, height);
+	ao::uvector<size_t> line = divisor.DivideVertically(image.data(), 15, 25);
+	ao::uvector<bool> rows(height, false);
+	double cost = 0.0;
+	for(size_t index : line)
+	{
+		size_t x = index % width;
+		BOOST_CHECK(x >= 15 && x < 25);
+		rows[index / width] = true;
+		cost += image[index];
+	}
+	for(size_t y=0; y!=height; ++y)
+		BOOST_CHECK(rows[y]);
+	// The path has to step horizontally between the zero columns, which costs 3 pixels per step
+	BOOST_CHECK_LT(cost, 3.0 * 6.0);
+}
+
+BOOST_AUTO_TEST_CASE( horizontal_line_covers_columns )
+{
+	const size_t width = 32, height = 24;
+	std::mt19937 rnd(42);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+	ao::uvector<double> image(width * height);
+	for(double& v : image)
+		v = dist(rnd);
+	Subdivision divisor(width, height);
+	ao::uvector<size_t> line = divisor.DivideHorizontally(image.data(), 8, 16);
+	ao::uvector<bool> columns(width, false);
+	for(size_t index : line)
+	{
+		size_t y = index / width;
+		BOOST_CHECK(y >= 8 && y < 16);
+		columns[index % width] = true;
+	}
+	for(size_t x=0; x!=width; ++x)
+		BOOST_CHECK(columns[x]);
+}
+
+BOOST_AUTO_TEST_CASE( labels_partition_image )
+{
+	const size_t width = 64, height = 48;
+	std::mt19937 rnd(42);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+	ao::uvector<double> image(width * height);
+	for(double& v : image)
+		v = dist(rnd);
+	Subdivision divisor(width, height);
+	ao::uvector<double> lines(width * height, 0.0);
+	for(size_t index : divisor.DivideVertically(image.data(), 24, 40))
+		lines[index] = 1.0;
+	for(size_t index : divisor.DivideHorizontally(image.data(), 18, 30))
+		lines[index] = 1.0;
+
+	ao::uvector<uint32_t> labels(width * height, 0);
+	size_t x[4], y[4], w[4], h[4];
+	for(size_t i=0; i!=4; ++i)
+	{
+		size_t midX = (i%2) * width / 2 + width / 4, midY = (i/2) * height / 2 + height / 4;
+		divisor.LabelSubImage(lines.data(), midX, midY, i+1, labels.data(), x[i], y[i], w[i], h[i]);
+		BOOST_CHECK_EQUAL(w[i] % 2, 0);
+		BOOST_CHECK_EQUAL(h[i] % 2, 0);
+	}
+	size_t count[5] = { 0, 0, 0, 0, 0 };
+	for(uint32_t label : labels)
+		++count[label];
+	// Only small pockets enclosed by the crossing lines can remain unlabelled
+	BOOST_CHECK_LT(count[0], 10);
+	for(size_t i=0; i!=4; ++i)
+	{
+		BOOST_CHECK_GT(count[i+1], 0);
+		ao::uvector<bool> mask(w[i] * h[i]);
+		divisor.GetSubImageMask(labels.data(), i+1, x[i], y[i], w[i], h[i], mask.data());
+		size_t maskCount = 0;
+		for(bool m : mask)
+			maskCount += m ? 1 : 0;
+		BOOST_CHECK_LE(maskCount, count[i+1]);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( relative_line_flux )
+{
+	const size_t width = 10, height = 10;
+	ao::uvector<double> image(width * height, 2.0);
+	ao::uvector<size_t> line;
+	for(size_t y=0; y!=height; ++y)
+	{
+		line.push_back(y*width + 5);
+		image[y*width + 5] = 1.0;
+	}
+	image[3] = -20.0;
+	double mean, peak;
+	Subdivision::AbsoluteStatistics(image.data(), image.size(), mean, peak);
+	BOOST_CHECK_CLOSE_FRACTION(mean, (89.0 * 2.0 + 10.0 * 1.0 + 20.0) / 100.0, 1e-10);
+	BOOST_CHECK_EQUAL(peak, 20.0);
+	Subdivision::LineFlux flux = Subdivision::RelativeLineFlux(image.data(), line, mean, peak);
+	BOOST_CHECK_CLOSE_FRACTION(flux.meanFraction, 1.0 / mean, 1e-10);
+	BOOST_CHECK_CLOSE_FRACTION(flux.peakFraction, 1.0 / 20.0, 1e-10);
+	
+	// Scaling the image, as cleaning roughly does, does not change the relative flux
+	for(double& value : image)
+		value *= 0.1;
+	Subdivision::AbsoluteStatistics(image.data(), image.size(), mean, peak);
+	Subdivision::LineFlux scaled = Subdivision::RelativeLineFlux(image.data(), line, mean, peak);
+	BOOST_CHECK_CLOSE_FRACTION(scaled.meanFraction, flux.meanFraction, 1e-10);
+	BOOST_CHECK_CLOSE_FRACTION(scaled.peakFraction, flux.peakFraction, 1e-10);
+	
+	// A source on the line
+	image[5*width + 5] = 5.0;
+	Subdivision::AbsoluteStatistics(image.data(), image.size(), mean, peak);
+	Subdivision::LineFlux withSource = Subdivision::RelativeLineFlux(image.data(), line, mean, peak);
+	BOOST_CHECK_EQUAL(withSource.peakFraction, 1.0);
+	BOOST_CHECK_GT(withSource.meanFraction, flux.meanFraction);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
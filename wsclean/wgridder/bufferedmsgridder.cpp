@@ -158,7 +158,7 @@ void BufferedMSGridder::predictMeasurementSet(MSData &msData)
 			Logger::Info << "Writing...\n";
 			for(size_t row=0; row!=nRows; ++row)
 			{
-				msData.msProvider->WriteModel(row + totalNRows, &visBuffer[row * band.ChannelCount()]);
+				msData.msProvider->WriteModel(row + totalNRows, &visBuffer[row * band.ChannelCount()], &uvwBuffer[row * 3]);
 			}
 			totalNRows += nRows;
 		} // end of chunk
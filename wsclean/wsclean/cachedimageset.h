@@ -26,7 +26,7 @@ public:
 	
 	void Initialize(const FitsWriter& writer, size_t polCount, size_t freqCount, const std::string& prefix, ImageBufferAllocator& allocator)
 	{
-		_writer = writer;
+		SetFitsWriter(writer);
 		_polCount = polCount;
 		_freqCount = freqCount;
 		_prefix = prefix;
@@ -37,6 +37,8 @@ public:
 	void SetFitsWriter(const FitsWriter& writer)
 	{
 		_writer = writer;
+		// Uncompressed files are written and read faster, and are read through a memory map
+		_writer.SetTileCompression(false);
 	}
 	
 	void Load(double* image, PolarizationEnum polarization, size_t freqIndex, bool isImaginary) const
@@ -4,6 +4,7 @@
 
 #include "../units/angle.h"
 #include "../units/fluxdensity.h"
+#include "../units/radeccoord.h"
 
 #include "../numberlist.h"
 
@@ -35,6 +36,9 @@ void CommandLine::printHelp()
 		"   but will increase memory usage. \n"
 		"-parallel-reordering <n>\n"
 		"   Process the reordering with multipliple threads. \n"
+		"-parallel-writing <n>\n"
+		"   Number of output images that are written simultaneously. Images are written in the background\n"
+		"   while wsclean continues. Default: 4.\n"
 		"-mem <percentage>\n"
 		"   Limit memory usage to the given fraction of the total system memory. This is an approximate value.\n"
 		"   Default: 100.\n"
@@ -55,7 +59,9 @@ void CommandLine::printHelp()
 		"   be iterated several times, such as with many major iterations or in channel imaging mode.\n"
 		"   Default: only reorder when in channel imaging mode.\n"
 		"-temp-dir <directory>\n"
-		"   Set the temporary directory used when reordering files. Default: same directory as input measurement set.\n"
+		"   Set the temporary directory used when reordering files and for MoreSane. Default: same directory as\n"
+		"   input measurement set for reordered files, and /dev/shm (when available) for MoreSane.\n"
+		"   When given, the row indices of the measurement sets are also stored here, to be reused by later runs.\n"
 		"-update-model-required (default), and\n"
 		"-no-update-model-required\n"
 		"   These two options specify wether the model data column is required to\n"
@@ -70,6 +76,9 @@ void CommandLine::printHelp()
 		"-save-uv\n"
 		"   Save the gridded uv plane, i.e., the FFT of the residual image. The UV plane is complex, hence\n"
 		"   two images will be output: <prefix>-uv-real.fits and <prefix>-uv-imag.fits.\n"
+		"-fits-compression\n"
+		"   Write the output images as tile-compressed fits files. The images are compressed losslessly with gzip\n"
+		"   and stored in the first extension, which not all fits software supports. Default: off.\n"
 		"-reuse-psf <prefix>\n"
 		"   Load the psf(s) from the given prefix and skip the inversion for the psf image.\n"
 		"-reuse-dirty <prefix>\n"
@@ -130,6 +139,11 @@ void CommandLine::printHelp()
 		"   This has the effect that e.g. uniform weighting can be modified by increasing\n"
 		"   the visibility weight of certain baselines. Without this option, uniform imaging\n"
 		"   weights absorb the visibility weight to make the weighting truly uniform.\n"
+		"-weights-cache <directory>\n"
+		"   Store the imaging weights in the given directory, and reuse them in later runs that use the\n"
+		"   same measurement sets, selection, weighting and image size. This saves a pass over the data\n"
+		"   per channel and interval in e.g. self-calibration loops. Changes to the flags or visibility\n"
+		"   weights of a measurement set are not detected: remove the directory's files when they change.\n"
 		"-store-imaging-weights\n"
 		"   Will store the imaging weights in a column named 'IMAGING_WEIGHT_SPECTRUM'.\n"
 		"\n"
@@ -239,6 +253,11 @@ void CommandLine::printHelp()
 		"   Default: image all time steps.\n"
 		"-intervals-out <count>\n"
 		"   Number of intervals to image inside the selected global interval. Default: 1\n"
+		"-single-pass-intervals\n"
+		"   Make the dirty images of all intervals from a single pass over the data, instead of\n"
+		"   processing the data once per interval. This is much faster when many short intervals\n"
+		"   are imaged. It uses the w-gridder and only supports imaging without cleaning, with one\n"
+		"   output channel and one polarization.\n"
 		"-even-timesteps\n"
 		"   Only select even timesteps. Can be used together with -odd-timesteps to determine noise values.\n"
 		"-odd-timesteps\n"
@@ -250,6 +269,10 @@ void CommandLine::printHelp()
 		"   Image the given field id(s). A comma-separated list of field ids can be provided. When multiple\n"
 		"   fields are given, all fields should have the same phase centre. Specifying '-field all' will image\n"
 		"   all fields in the measurement set. Default: first field (id 0).\n"
+		"-shift <ra> <dec>\n"
+		"   Image the given direction as if it was the phase centre, e.g. '-shift 08h13m36.0s 48d13m03s'.\n"
+		"   The visibilities are rephased on the fly while reading, and predicted visibilities are\n"
+		"   rotated back to the phase centre of the measurement set. This avoids running chgcentre.\n"
 		"-spws <list>\n"
 		"   Selects only the spws given in the list. list should be a comma-separated list of integers. Default: all spws.\n"
 		"-data-column <columnname>\n"
@@ -330,6 +353,9 @@ void CommandLine::printHelp()
 		"-no-multiscale-fast-subminor\n"
 		"   Disable the 'fast subminor loop' optimization, that will only search a part of the\n"
 		"   image during the multi-scale subminor loop. The optimization is on by default.\n"
+		"-save-multiscale-psfs\n"
+		"   Save the scale-convolved PSFs of multi-scale cleaning to <prefix>-multiscale-psfs-<group>.bin.\n"
+		"   A later run with -reuse-psf and the same prefix will read these instead of recalculating them.\n"
 		"-iuwt\n"
 		"   Use the IUWT deconvolution algorithm.\n"
 		"-iuwt-snr-test / -no-iuwt-snr-test\n"
@@ -337,12 +363,17 @@ void CommandLine::printHelp()
 		"   occasionally also stop the algorithm too early. Default: no SNR test.\n"
 		"-moresane-ext <location>\n"
 		"   Use the MoreSane deconvolution algorithm, installed at the specified location.\n"
+		"   Images are passed to MoreSane through /dev/shm when available (or -temp-dir when given).\n"
+		"   The -iuwt option provides a similar algorithm that runs inside WSClean.\n"
 		"-moresane-arg <arguments>\n"
 		"   Pass the specified arguments to moresane. Note that multiple parameters have to be\n"
 		"   enclosed in quotes.\n"
 		"-moresane-sl <sl1,sl2,...>\n"
 		"   MoreSane --sigmalevel setting for each major loop iteration. Useful to start at high\n"
 		"   levels and go down with subsequent loops, e.g. 20,10,5\n"
+		"-moresane-parallel <count>\n"
+		"   Number of MoreSane processes that run at the same time, each on a different channel.\n"
+		"   The threads (-j) are divided over the processes. Default: 1.\n"
 		"-save-source-list\n"
 		"   Saves the found clean components as a BBS/NDPPP text sky model. This parameter \n"
 		"   enables Gaussian shapes during multi-scale cleaning (-multiscale-shape gaussian).\n"
@@ -371,6 +402,13 @@ void CommandLine::printHelp()
 		"   Decrease the number of channels as specified by -channels-out to the given number for\n"
 		"   deconvolution. Only possible in combination with one of the -fit-spectral options.\n"
 		"   Proper residuals/restored images will only be returned when mgain < 1.\n"
+		"-out-of-core-deconvolution\n"
+		"   Store the deconvolution images in memory-mapped temporary files (in the -temp-dir directory)\n"
+		"   instead of in memory. This allows deconvolving many channels of large images with limited memory.\n"
+		"-single-precision-deconvolution\n"
+		"   Store the residual and model images in single precision during deconvolution. This halves\n"
+		"   their memory use and speeds up the minor iterations. Only supported by the default clean\n"
+		"   algorithm (i.e., not with -multiscale, -iuwt or -moresane).\n"
 		"-squared-channel-joining\n"
 		"   Use with -join-channels to perform peak finding in the sum of squared values over\n"
 		"   channels, instead of the normal sum. This is useful for imaging QU polarizations\n"
@@ -761,6 +799,11 @@ bool CommandLine::Parse(WSClean& wsclean, int argc, char* argv[])
 			++argi;
 			settings.moreSaneSigmaLevels = NumberList::ParseDoubleList(argv[argi]);
 		}
+		else if(param == "moresane-parallel")
+		{
+			++argi;
+			settings.moreSaneParallelRuns = parse_size_t(argv[argi], "moresane-parallel");
+		}
 		else if(param == "make-psf")
 		{
 			settings.makePSF = true;
@@ -823,6 +866,10 @@ bool CommandLine::Parse(WSClean& wsclean, int argc, char* argv[])
 			if(param == "intervalsout")
 				deprecated(param, "intervals-out");
 		}
+		else if(param == "single-pass-intervals")
+		{
+			settings.singlePassIntervals = true;
+		}
 		else if(param == "even-timesteps")
 		{
 			settings.evenOddTimesteps = MSSelection::EvenTimesteps;
@@ -924,6 +971,11 @@ bool CommandLine::Parse(WSClean& wsclean, int argc, char* argv[])
 		{
 			settings.useWeightsAsTaper = true;
 		}
+		else if(param == "weights-cache")
+		{
+			++argi;
+			settings.weightsCacheDirectory = argv[argi];
+		}
 		else if(param == "store-imaging-weights")
 		{
 			settings.writeImagingWeightSpectrumColumn = true;
@@ -971,6 +1023,10 @@ bool CommandLine::Parse(WSClean& wsclean, int argc, char* argv[])
 			++argi;
 			settings.multiscaleConvolutionPadding = parse_double(argv[argi], 1.0, "multiscale-convolution-padding");
 		}
+		else if(param == "save-multiscale-psfs")
+		{
+			settings.saveMultiscalePSFs = true;
+		}
 		else if(param == "no-multiscale-fast-subminor")
 		{
 			settings.multiscaleFastSubMinorLoop = false;
@@ -1034,6 +1090,14 @@ bool CommandLine::Parse(WSClean& wsclean, int argc, char* argv[])
 			++argi;
 			settings.deconvolutionChannelCount = parse_size_t(argv[argi], "deconvolution-channels");
 		}
+		else if(param == "out-of-core-deconvolution")
+		{
+			settings.deconvolutionOutOfCore = true;
+		}
+		else if(param == "single-precision-deconvolution")
+		{
+			settings.deconvolutionSinglePrecision = true;
+		}
 		else if(param == "squared-channel-joining")
 		{
 			settings.squaredJoins = true;
@@ -1187,6 +1251,11 @@ bool CommandLine::Parse(WSClean& wsclean, int argc, char* argv[])
 			++argi;
 			settings.parallelReordering = parse_size_t(argv[argi], "parallel-reordering");
 		}
+		else if(param == "parallel-writing")
+		{
+			++argi;
+			settings.parallelWriting = parse_size_t(argv[argi], "parallel-writing");
+		}
 		else if(param == "parallel-gridding")
 		{
 			++argi;
@@ -1234,6 +1303,13 @@ bool CommandLine::Parse(WSClean& wsclean, int argc, char* argv[])
 			++argi;
 			settings.wLimit = parse_double(argv[argi], 0.0, "maxw");
 		}
+		else if(param == "shift")
+		{
+			settings.hasShift = true;
+			settings.shiftRA = RaDecCoord::ParseRA(argv[argi+1]);
+			settings.shiftDec = RaDecCoord::ParseDec(argv[argi+2]);
+			argi += 2;
+		}
 		else if(param == "baseline-averaging")
 		{
 			++argi;
@@ -1337,6 +1413,10 @@ bool CommandLine::Parse(WSClean& wsclean, int argc, char* argv[])
 		{
 			settings.isFirstResidualSaved = true;
 		}
+		else if(param == "fits-compression")
+		{
+			settings.fitsTileCompression = true;
+		}
 		else {
 			throw std::runtime_error("Unknown parameter: " + param);
 		}
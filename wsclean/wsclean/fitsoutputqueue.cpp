@@ -0,0 +1,76 @@
+#include "fitsoutputqueue.h"
+
+#include "logger.h"
+
+#include "../uvector.h"
+
+#include <fitsio.h>
+
+#include <algorithm>
+
+FitsOutputQueue::FitsOutputQueue(size_t threadCount) :
+	// Without the reentrant build of cfitsio, only one file may be open at a time
+	_threadCount(fits_is_reentrant() ? std::max<size_t>(threadCount, 1) : 1),
+	_lane(_threadCount)
+{ }
+
+FitsOutputQueue::~FitsOutputQueue()
+{
+	try {
+		Flush();
+	} catch(std::exception& e) {
+		Logger::Error << "Error while writing image: " << e.what() << '\n';
+	}
+}
+
+void FitsOutputQueue::start()
+{
+	for(size_t i=0; i!=_threadCount; ++i)
+		_threads.emplace_back(&FitsOutputQueue::writerThread, this);
+}
+
+void FitsOutputQueue::Write(const FitsWriter& writer, const std::string& filename, ImageBufferAllocator::Ptr&& image)
+{
+	if(_threads.empty())
+		start();
+	std::unique_ptr<Task> task(new Task{writer, filename, std::move(image)});
+	_lane.write(std::move(task));
+}
+
+void FitsOutputQueue::Flush()
+{
+	if(!_threads.empty())
+	{
+		_lane.write_end();
+		for(std::thread& thread : _threads)
+			thread.join();
+		_threads.clear();
+		_lane.clear();
+	}
+	if(_error)
+	{
+		std::exception_ptr error = _error;
+		_error = std::exception_ptr();
+		std::rethrow_exception(error);
+	}
+}
+
+void FitsOutputQueue::writerThread()
+{
+	std::unique_ptr<Task> task;
+	while(_lane.read(task))
+	{
+		try {
+			const size_t size = task->writer.Width() * task->writer.Height();
+			ao::uvector<float> floatImage(task->image.data(), task->image.data() + size);
+			// The image is no longer needed while the file is written
+			task->image.reset();
+			task->writer.Write(task->filename, floatImage.data());
+		} catch(...) {
+			std::lock_guard<std::mutex> lock(_errorMutex);
+			if(!_error)
+				_error = std::current_exception();
+		}
+		task.reset();
+	}
+}
@@ -0,0 +1,72 @@
+#ifndef FITS_OUTPUT_QUEUE_H
+#define FITS_OUTPUT_QUEUE_H
+
+#include "imagebufferallocator.h"
+
+#include "../fitswriter.h"
+#include "../lane.h"
+
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Writes FITS images in the background. The main thread hands over an image
+ * together with a copy of the writer that holds its metadata, and continues
+ * while writer threads convert the image to single precision and write it.
+ * Several files are written concurrently when cfitsio is built thread safe;
+ * otherwise a single writer thread is used.
+ *
+ * The queue holds a limited number of images, after which @ref Write() waits.
+ * Files are only guaranteed to be on disk after @ref Flush(), which should be
+ * called before the files are read or written again.
+ */
+class FitsOutputQueue
+{
+public:
+	/**
+	 * @param threadCount Maximum number of files that are written at the same time.
+	 */
+	explicit FitsOutputQueue(size_t threadCount);
+
+	/**
+	 * Waits for the queued images to be written. Errors are only reported
+	 * by @ref Flush().
+	 */
+	~FitsOutputQueue();
+
+	/**
+	 * Queues an image for writing. The image is freed after it has been written.
+	 */
+	void Write(const FitsWriter& writer, const std::string& filename, ImageBufferAllocator::Ptr&& image);
+
+	/**
+	 * Waits until all queued images are written. If writing one of them failed,
+	 * the first error is rethrown.
+	 */
+	void Flush();
+
+	size_t ThreadCount() const { return _threadCount; }
+
+private:
+	struct Task
+	{
+		FitsWriter writer;
+		std::string filename;
+		ImageBufferAllocator::Ptr image;
+	};
+
+	void start();
+	void writerThread();
+
+	size_t _threadCount;
+	ao::lane<std::unique_ptr<Task>> _lane;
+	std::vector<std::thread> _threads;
+	std::mutex _errorMutex;
+	std::exception_ptr _error;
+};
+
+#endif
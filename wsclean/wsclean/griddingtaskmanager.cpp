@@ -180,6 +180,8 @@ void GriddingTaskManager::prepareGridder(MSGridderBase& gridder)
 	gridder.SetWeighting(_settings.weightMode);
 	gridder.SetWLimit(_settings.wLimit/100.0);
 	gridder.SetSmallInversion(_settings.smallInversion);
+	if(_settings.hasShift)
+		gridder.SetRephaseDirection(_settings.shiftRA, _settings.shiftDec);
 	gridder.SetVisibilityWeightingMode(_settings.visibilityWeightingMode);
 }
 
@@ -0,0 +1,277 @@
+#include "imagebufferallocator.h"
+
+#include "../system.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+ImageBufferAllocator::ImageBufferAllocator(bool direct) :
+	_nReal(0), _nComplex(0), _nRealMax(0), _nComplexMax(0),
+	_usedBytes(0), _usedBytesMax(0), _allocatedBytes(0), _allocatedBytesMax(0),
+	_newBlockCount(0), _reusedBlockCount(0),
+	_cacheLimit(0),
+	_firstTouchThreadCount(1),
+	_direct(direct)
+{
+	const size_t shardCount = std::min<size_t>(std::max<size_t>(System::ProcessorCount(), 1), 64);
+	for(size_t i=0; i!=shardCount; ++i)
+		_shards.emplace_back(new Shard());
+}
+
+ImageBufferAllocator& ImageBufferAllocator::operator=(ImageBufferAllocator&& source)
+{
+	clear();
+	std::swap(_shards, source._shards);
+	std::atomic<size_t>* counters[] = { &_nReal, &_nComplex, &_nRealMax, &_nComplexMax,
+		&_usedBytes, &_usedBytesMax, &_allocatedBytes, &_allocatedBytesMax, &_newBlockCount, &_reusedBlockCount };
+	std::atomic<size_t>* sourceCounters[] = { &source._nReal, &source._nComplex, &source._nRealMax, &source._nComplexMax,
+		&source._usedBytes, &source._usedBytesMax, &source._allocatedBytes, &source._allocatedBytesMax, &source._newBlockCount, &source._reusedBlockCount };
+	for(size_t i=0; i!=sizeof(counters)/sizeof(counters[0]); ++i)
+		*counters[i] = sourceCounters[i]->exchange(*counters[i]);
+	std::swap(_cacheLimit, source._cacheLimit);
+	std::swap(_firstTouchThreadCount, source._firstTouchThreadCount);
+	std::swap(_direct, source._direct);
+	return *this;
+}
+
+void ImageBufferAllocator::ReportStatistics() const
+{
+	Logger::Info << "Image buf alloc stats:\n"
+		"         max alloc'd images = " << _nRealMax << " real + " << _nComplexMax << " complex\n"
+		"              max used mem  = " << round(double(_usedBytesMax)/1e8)/10.0 << " GB\n"
+		"         max allocated mem  = " << round(double(_allocatedBytesMax)/1e8)/10.0 << " GB\n"
+		"      current allocated mem = " << round(double(_allocatedBytes)/1e8)/10.0 << " GB\n"
+		"   new / reused allocations = " << _newBlockCount << " / " << _reusedBlockCount << '\n';
+}
+
+size_t ImageBufferAllocator::sizeClass(size_t bytes)
+{
+	// Small buffers are rounded to cache lines, large buffers to pages. Buffers
+	// of the same image size thereby always share a class.
+	const size_t granularity = bytes < 65536 ? ALIGNMENT : 4096;
+	return std::max<size_t>((bytes + granularity - 1) / granularity, 1) * granularity;
+}
+
+ImageBufferAllocator::Shard& ImageBufferAllocator::localShard()
+{
+	return *_shards[std::hash<std::thread::id>()(std::this_thread::get_id()) % _shards.size()];
+}
+
+void* ImageBufferAllocator::allocateBlock(size_t bytes)
+{
+	const size_t sClass = sizeClass(bytes);
+	BlockHeader* block = nullptr;
+	if(!_direct)
+	{
+		// Try the shard of this thread first, and then the others
+		const size_t firstShard = &localShard() - _shards.front().get();
+		for(size_t i=0; i!=_shards.size() && block == nullptr; ++i)
+		{
+			Shard& shard = *_shards[(firstShard + i) % _shards.size()];
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			std::map<size_t, std::vector<BlockHeader*>>::iterator freeList = shard.freeLists.find(sClass);
+			if(freeList != shard.freeLists.end() && !freeList->second.empty())
+			{
+				block = freeList->second.back();
+				freeList->second.pop_back();
+			}
+		}
+		if(block != nullptr)
+			++_reusedBlockCount;
+	}
+	if(block == nullptr)
+	{
+		block = allocateNewBlock(sClass);
+		firstTouch(block);
+	}
+	block->isUsed = 1;
+	updateCount(_usedBytes, _usedBytesMax, sClass);
+	return blockData(block);
+}
+
+void ImageBufferAllocator::freeBlock(void* buffer, const char* functionName)
+{
+	BlockHeader* block = reinterpret_cast<BlockHeader*>(static_cast<char*>(buffer) - ALIGNMENT);
+	if(block->magic != MAGIC || !block->isUsed)
+	{
+		std::ostringstream msg;
+		msg << "Invalid or double call to ImageBufferAllocator::" << functionName << '.';
+		std::cerr << msg.str() << '\n';
+		throw std::runtime_error(msg.str());
+	}
+	block->isUsed = 0;
+	_usedBytes -= block->sizeClass;
+	if(_direct)
+		releaseBlock(block);
+	else {
+		{
+			Shard& shard = localShard();
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			shard.freeLists[block->sizeClass].push_back(block);
+		}
+		trimCache();
+	}
+}
+
+ImageBufferAllocator::BlockHeader* ImageBufferAllocator::allocateNewBlock(size_t sizeClass)
+{
+	// The header directly precedes the data. For huge-page buffers, the data starts on
+	// the first huge page boundary after the header. The skipped part is never written,
+	// except for the page that holds the header, so it costs address space but no memory.
+	const bool isHuge = sizeClass >= HUGE_PAGE_SIZE;
+	const size_t totalSize = isHuge ? sizeClass + HUGE_PAGE_SIZE : sizeClass + ALIGNMENT;
+	void* ptr;
+	int errVal = posix_memalign(&ptr, ALIGNMENT, totalSize);
+	if(errVal != 0)
+	{
+		std::ostringstream msg;
+		msg << "posix_memalign() failed when allocating " << totalSize << " bytes: ";
+		switch(errVal)
+		{
+		case EINVAL:
+			msg << "the alignment argument was not a power of two, or was not a multiple of sizeof(void *)";
+			break;
+		case ENOMEM:
+			msg << "there was insufficient memory to fulfill the allocation request.";
+			break;
+		default:
+			msg << "an unknown error value was returned";
+			break;
+		}
+		throw std::runtime_error(msg.str());
+	}
+	char* data = static_cast<char*>(ptr) + ALIGNMENT;
+	if(isHuge)
+	{
+		const uintptr_t address = reinterpret_cast<uintptr_t>(data);
+		data += (HUGE_PAGE_SIZE - address % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+#ifdef MADV_HUGEPAGE
+		// Only an advice: failure (e.g. when transparent huge pages are disabled) is harmless
+		madvise(data, (sizeClass / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE, MADV_HUGEPAGE);
+#endif
+	}
+	BlockHeader* block = reinterpret_cast<BlockHeader*>(data - ALIGNMENT);
+	block->allocation = ptr;
+	block->sizeClass = sizeClass;
+	block->magic = MAGIC;
+	block->isUsed = 0;
+	updateCount(_allocatedBytes, _allocatedBytesMax, sizeClass);
+	++_newBlockCount;
+	return block;
+}
+
+void ImageBufferAllocator::releaseBlock(BlockHeader* block)
+{
+	_allocatedBytes -= block->sizeClass;
+	block->magic = 0;
+	free(block->allocation);
+}
+
+void ImageBufferAllocator::firstTouch(BlockHeader* block)
+{
+	if(_firstTouchThreadCount > 1 && block->sizeClass >= FIRST_TOUCH_MIN_SIZE)
+	{
+		char* data = blockData(block);
+		const size_t
+			threadCount = _firstTouchThreadCount,
+			size = block->sizeClass;
+#ifndef __APPLE__
+		// A page is placed on the node of the CPU that first writes it, so each thread is
+		// pinned to a different CPU, spread evenly over the CPUs this process may use.
+		cpu_set_t allowedSet;
+		CPU_ZERO(&allowedSet);
+		std::vector<int> cpus;
+		if(sched_getaffinity(0, sizeof allowedSet, &allowedSet) == 0)
+		{
+			for(int cpu=0; cpu!=CPU_SETSIZE; ++cpu)
+			{
+				if(CPU_ISSET(cpu, &allowedSet))
+					cpus.push_back(cpu);
+			}
+		}
+#endif
+		std::vector<std::thread> threads;
+		for(size_t t=0; t!=threadCount; ++t)
+		{
+			threads.emplace_back([&, t]() {
+#ifndef __APPLE__
+				if(!cpus.empty())
+				{
+					cpu_set_t cpuSet;
+					CPU_ZERO(&cpuSet);
+					CPU_SET(cpus[t * cpus.size() / threadCount], &cpuSet);
+					// If pinning fails, the buffer is still initialized, just not spread
+					pthread_setaffinity_np(pthread_self(), sizeof cpuSet, &cpuSet);
+				}
+#endif
+				const size_t start = size * t / threadCount, end = size * (t+1) / threadCount;
+				std::memset(data + start, 0, end - start);
+			});
+		}
+		for(std::thread& thread : threads)
+			thread.join();
+	}
+}
+
+void ImageBufferAllocator::trimCache()
+{
+	if(_cacheLimit == 0 || CachedMemory() <= _cacheLimit)
+		return;
+	for(std::unique_ptr<Shard>& shard : _shards)
+	{
+		std::lock_guard<std::mutex> lock(shard->mutex);
+		// Release the largest buffers first, to release the memory with the fewest calls
+		std::map<size_t, std::vector<BlockHeader*>>::reverse_iterator freeList = shard->freeLists.rbegin();
+		while(CachedMemory() > _cacheLimit && freeList != shard->freeLists.rend())
+		{
+			if(freeList->second.empty())
+				++freeList;
+			else {
+				releaseBlock(freeList->second.back());
+				freeList->second.pop_back();
+			}
+		}
+		if(CachedMemory() <= _cacheLimit)
+			break;
+	}
+}
+
+void ImageBufferAllocator::FreeUnused()
+{
+	size_t unusedCount = 0;
+	for(std::unique_ptr<Shard>& shard : _shards)
+	{
+		std::lock_guard<std::mutex> lock(shard->mutex);
+		for(std::pair<const size_t, std::vector<BlockHeader*>>& freeList : shard->freeLists)
+		{
+			for(BlockHeader* block : freeList.second)
+				releaseBlock(block);
+			unusedCount += freeList.second.size();
+		}
+		shard->freeLists.clear();
+	}
+	if(unusedCount != 0)
+	{
+		Logger::Debug << "Freed " << unusedCount << " image buffer(s).\n";
+	}
+}
+
+void ImageBufferAllocator::clear()
+{
+	FreeUnused();
+	// Buffers that are still in use are not released, so that e.g. valgrind can diagnose the leak as well.
+	const size_t usedCount = _nReal + _nComplex;
+	if(usedCount != 0)
+	{
+		std::cerr << usedCount << " image buffer(s) were still in use when image buffer allocator was destroyed!\n";
+	}
+}
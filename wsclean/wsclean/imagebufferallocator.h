@@ -1,11 +1,18 @@
 #ifndef IMAGE_BUFFER_ALLOCATOR_H
 #define IMAGE_BUFFER_ALLOCATOR_H
 
+#include <algorithm>
+#include <atomic>
 #include <complex>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
-#include <vector>
-#include <stdexcept>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <stdexcept>
+#include <vector>
+
 #include "logger.h"
 
 //#define USE_DIRECT_ALLOCATOR
@@ -19,6 +26,12 @@
  * memory than it had allocated, which was due to iteratively freeing and allocating
  * large chunks, but because of intermediate small allocations the large chunks no longer
  * fitted, and new memory was returned.
+ * 
+ * Free'd buffers are kept in per-size-class free lists and reused by later allocations of
+ * the same size class, such that alternating sizes (e.g. sub-images and full images in
+ * parallel deconvolution) are served without new allocations. The free lists are
+ * sharded over threads. Buffers are aligned to 64 bytes, and buffers of at least 2 MB start
+ * on a huge page boundary and are advised to use huge pages. All methods are thread safe.
  */
 class ImageBufferAllocator
 {
@@ -169,47 +182,40 @@ public:
 		ImageBufferAllocator* _allocator;
 	};
 	
-	ImageBufferAllocator() : _buffers(), _nReal(0), _nComplex(0), _nRealMax(0), _nComplexMax(0), _previousSize(0), _direct(false)
+	ImageBufferAllocator() : ImageBufferAllocator(false)
 	{ }
 	
-	ImageBufferAllocator(bool direct) : _buffers(), _nReal(0), _nComplex(0), _nRealMax(0), _nComplexMax(0), _previousSize(0), _direct(direct)
-	{ }
+	ImageBufferAllocator(bool direct);
 	
 	ImageBufferAllocator(const ImageBufferAllocator& source) = delete;
 	
 	ImageBufferAllocator& operator=(const ImageBufferAllocator& source) = delete;
 	
-	ImageBufferAllocator& operator=(ImageBufferAllocator&& source)
-	{
-		clear();
-		std::swap(_buffers, source._buffers);
-		std::swap(_nReal, source._nReal);
-		std::swap(_nComplex, source._nComplex);
-		std::swap(_nRealMax, source._nRealMax);
-		std::swap(_nComplexMax, source._nComplexMax);
-		std::swap(_previousSize, source._previousSize);
-		std::swap(_direct, source._direct);
-		return *this;
-	}
+	ImageBufferAllocator& operator=(ImageBufferAllocator&& source);
 	
 	~ImageBufferAllocator()
 	{
 		clear();
 	}
 	
-	void ReportStatistics() const
-	{
-		std::lock_guard<std::mutex> guard(_mutex);
-		double totalSize = 0.0;
-		for(const Buffer& buffer : _buffers)
-		{
-			totalSize += double(buffer.size) * double(sizeof(double)*2);
-		}
-		Logger::Info << "Image buf alloc stats:\n"
-			"         max alloc'd images = " << _nRealMax << " real + " << _nComplexMax << " complex\n"
-			"       max allocated chunks = " << _buffers.size() << "\n"
-			"      current allocated mem = " << round(totalSize/1e8)/10.0 << " GB \n";
-	}
+	/**
+	 * Limit the memory that cached buffers (those that are free'd but not released) may
+	 * occupy, in bytes. When a free makes the cache exceed the limit, the largest cached
+	 * buffers are released. Zero, the default, means no limit.
+	 */
+	void SetCacheLimit(size_t cacheLimit) { _cacheLimit = cacheLimit; }
+	
+	/**
+	 * Number of threads that initialize new buffers of at least FIRST_TOUCH_MIN_SIZE bytes.
+	 * On NUMA systems, a page is placed on the node of the thread that first writes it.
+	 * The initializing threads are pinned to CPUs spread over the CPUs of the process,
+	 * and each writes one contiguous part of the buffer, which spreads the buffer over
+	 * the nodes such that parallel loops use the memory bandwidth of all nodes.
+	 * Default: 1.
+	 */
+	void SetFirstTouchThreadCount(size_t threadCount) { _firstTouchThreadCount = std::max<size_t>(threadCount, 1); }
+	
+	void ReportStatistics() const;
 	
 	void Allocate(size_t size, Ptr& ptr)
 	{
@@ -226,41 +232,9 @@ public:
 	
 	double* Allocate(size_t size)
 	{
-		if(_direct)
-			return directAllocate(size);
-		else {
-			if(size == 0) size=2;
-			else if(size%2==1) ++size;
-			std::lock_guard<std::mutex> guard(_mutex);
-			
-			if(size != _previousSize)
-			{
-				FreeUnused();
-				_previousSize = size;
-			}
-			
-			++_nReal;
-			if(_nReal > _nRealMax) _nRealMax = _nReal;
-			for(std::vector<Buffer>::iterator i=_buffers.begin(); i!=_buffers.end(); ++i)
-			{
-				if(i->size == size)
-				{
-					if(!i->isFirstHalfUsed)
-					{
-						i->isFirstHalfUsed = true;
-						return i->ptr;
-					}
-					if(!i->isSecondHalfUsed)
-					{
-						i->isSecondHalfUsed = true;
-						return i->ptr + size;
-					}
-				}
-			}
-			Buffer* newBuffer = allocateNewBuffer(size);
-			newBuffer->isFirstHalfUsed = true;
-			return newBuffer->ptr;
-		}
+		double* buffer = static_cast<double*>(allocateBlock(size * sizeof(double)));
+		updateCount(_nReal, _nRealMax, 1);
+		return buffer;
 	}
 	
 	template<typename NumT>
@@ -268,38 +242,9 @@ public:
 	
 	std::complex<double>* AllocateComplex(size_t size)
 	{
-		if(_direct)
-			return reinterpret_cast<std::complex<double>*>(directAllocate(size*2));
-		else {
-			if(size == 0) size=2;
-			else if(size%2==1) ++size;
-			std::lock_guard<std::mutex> guard(_mutex);
-			
-			if(size != _previousSize)
-			{
-				FreeUnused();
-				_previousSize = size;
-			}
-			
-			++_nComplex;
-			if(_nComplex > _nComplexMax) _nComplexMax = _nComplex;
-			for(std::vector<Buffer>::iterator i=_buffers.begin(); i!=_buffers.end(); ++i)
-			{
-				if(i->size == size)
-				{
-					if(!i->isFirstHalfUsed && !i->isSecondHalfUsed)
-					{
-						i->isFirstHalfUsed = true;
-						i->isSecondHalfUsed = true;
-						return reinterpret_cast<std::complex<double>*>(i->ptr);
-					}
-				}
-			}
-			Buffer* newBuffer = allocateNewBuffer(size);
-			newBuffer->isFirstHalfUsed = true;
-			newBuffer->isSecondHalfUsed = true;
-			return reinterpret_cast<std::complex<double>*>(newBuffer->ptr);
-		}
+		std::complex<double>* buffer = static_cast<std::complex<double>*>(allocateBlock(size * sizeof(std::complex<double>)));
+		updateCount(_nComplex, _nComplexMax, 1);
+		return buffer;
 	}
 	
 	void Free(float* buffer)
@@ -309,33 +254,10 @@ public:
 	
 	void Free(double* buffer)
 	{
-		if(_direct)
-			free(buffer);
-		else if(buffer != nullptr)
+		if(buffer != nullptr)
 		{
-			std::lock_guard<std::mutex> guard(_mutex);
-			bool found = false;
-			for(std::vector<Buffer>::iterator i=_buffers.begin(); i!=_buffers.end(); ++i)
-			{
-				if(i->ptr == buffer)
-				{
-					found = true;
-					i->isFirstHalfUsed = false;
-					break;
-				}
-				else if(i->ptr + i->size == buffer)
-				{
-					found = true;
-					i->isSecondHalfUsed = false;
-					break;
-				}
-			}
-			if(!found)
-			{
-				std::cerr << "Invalid or double call to ImageBufferAllocator::Free(double*).\n";
-				throw std::runtime_error("Invalid or double call to ImageBufferAllocator::Free(double*).");
-			}
-			--_nReal;
+			freeBlock(buffer, "Free(double*)");
+			updateCount(_nReal, _nRealMax, -1);
 		}
 	}
 	
@@ -344,128 +266,101 @@ public:
 	
 	void Free(std::complex<double>* buffer)
 	{
-		if(_direct)
-			free(buffer);
-		else if(buffer != nullptr)
+		if(buffer != nullptr)
 		{
-			std::lock_guard<std::mutex> guard(_mutex);
-			bool found = false;
-			for(std::vector<Buffer>::iterator i=_buffers.begin(); i!=_buffers.end(); ++i)
-			{
-				if(i->ptr == reinterpret_cast<double*>(buffer))
-				{
-					found = true;
-					i->isFirstHalfUsed = false;
-					i->isSecondHalfUsed = false;
-					break;
-				}
-			}
-			if(!found)
-			{
-				std::cerr << "Invalid or double call to ImageBufferAllocator::Free(std::complex<double>*).\n";
-				throw std::runtime_error("Invalid or double call to ImageBufferAllocator::Free(std::complex<double>*).");
-			}
-			--_nComplex;
+			freeBlock(buffer, "Free(std::complex<double>*)");
+			updateCount(_nComplex, _nComplexMax, -1);
 		}
 	}
 	
-	void FreeUnused()
-	{
-		size_t unusedCount = 0;
-		std::vector<Buffer>::iterator i=_buffers.begin();
-		while(i!=_buffers.end())
-		{
-			if(!i->isFirstHalfUsed && !i->isSecondHalfUsed)
-			{
-				free(i->ptr);
-				_buffers.erase(i);
-				i = _buffers.begin();
-				++unusedCount;
-			} else {
-				++i;
-			}
-		}
-		if(unusedCount != 0)
-		{
-			Logger::Debug << "Freed " << unusedCount << " image buffer(s).\n";
-		}
-	}
+	/**
+	 * Release all cached buffers that are not in use.
+	 */
+	void FreeUnused();
+	
+	/** Number of bytes in buffers that are in use. */
+	size_t UsedMemory() const { return _usedBytes; }
+	
+	/** Number of bytes in buffers that are cached for reuse. */
+	size_t CachedMemory() const { return _allocatedBytes - _usedBytes; }
 	
 private:
-	struct Buffer
+	/**
+	 * The data of a buffer is directly preceded by a header of ALIGNMENT bytes, such that
+	 * the returned data is aligned as well. It records the size class, such that a free'd
+	 * buffer can be returned to the right list without a global lookup, and the start of
+	 * the allocation, which lies before the header for huge-page buffers.
+	 */
+	struct BlockHeader
 	{
-		double* ptr;
-		size_t size;
-		bool isFirstHalfUsed, isSecondHalfUsed;
+		void* allocation;
+		size_t sizeClass;
+		uint32_t magic;
+		uint32_t isUsed;
 	};
 	
-	Buffer* allocateNewBuffer(size_t size)
+	/**
+	 * Free buffers per size class. Each thread returns and takes buffers from the shard
+	 * that belongs to the thread, such that threads rarely wait for each other.
+	 */
+	struct Shard
 	{
-		_buffers.push_back(Buffer());
-		Buffer* buffer = &_buffers.back();
-		buffer->ptr = directAllocate(size*2);
-		buffer->size = size;
-		buffer->isFirstHalfUsed = false;
-		buffer->isSecondHalfUsed = false;
-		return buffer;
-	}
+		std::mutex mutex;
+		std::map<size_t, std::vector<BlockHeader*>> freeLists;
+	};
+	
+	/** Aligned for AVX-512 loads and cache lines, and sufficient for FFTW's SIMD. */
+	static constexpr size_t ALIGNMENT = 64;
+	/** Buffers of at least this size start on a huge page boundary and are advised to use huge pages. */
+	static constexpr size_t HUGE_PAGE_SIZE = 2*1024*1024;
+	/** Smaller buffers are initialized by one thread, which is cheaper than starting threads. */
+	static constexpr size_t FIRST_TOUCH_MIN_SIZE = 16*1024*1024;
+	static constexpr uint32_t MAGIC = 0x1b0f0a11;
+	
+	static size_t sizeClass(size_t bytes);
+	
+	void* allocateBlock(size_t bytes);
+	
+	void freeBlock(void* buffer, const char* functionName);
 	
-	double* directAllocate(size_t size)
+	BlockHeader* allocateNewBlock(size_t sizeClass);
+	
+	void releaseBlock(BlockHeader* block);
+	
+	void firstTouch(BlockHeader* block);
+	
+	static char* blockData(BlockHeader* block)
 	{
-		double* ptr;
-		int errVal = posix_memalign(reinterpret_cast<void**>(&ptr), sizeof(double), size*sizeof(double));
-		if(errVal != 0)
-		{
-			std::ostringstream msg;
-			msg << "posix_memalign() failed when allocating " << size*sizeof(double) * 2 << " bytes: ";
-			switch(errVal)
-			{
-			case EINVAL:
-				msg << "the alignment argument was not a power of two, or was not a multiple of sizeof(void *)";
-				break;
-			case ENOMEM:
-				msg << "there was insufficient memory to fulfill the allocation request.";
-				break;
-			default:
-				msg << "an unknown error value was returned";
-				break;
-			}
-			throw std::runtime_error(msg.str());
-		}
-		return ptr;
+		return reinterpret_cast<char*>(block) + ALIGNMENT;
 	}
 	
-	void clear()
+	Shard& localShard();
+	
+	/**
+	 * Release cached buffers until the cache fits in the cache limit.
+	 */
+	void trimCache();
+	
+	void clear();
+	
+	/**
+	 * Add @p change to the count and update the maximum. A negative change wraps around,
+	 * which gives the right result with unsigned arithmetic.
+	 */
+	static void updateCount(std::atomic<size_t>& count, std::atomic<size_t>& max, std::ptrdiff_t change)
 	{
-		std::lock_guard<std::mutex> guard(_mutex);
-		size_t usedCount = 0;
-		std::ostringstream str;
-		for(Buffer& buffer : _buffers)
-		{
-			if(buffer.isFirstHalfUsed) {
-				++usedCount;
-				str << "Still used: buffer of " << buffer.size << '\n';
-				buffer.isFirstHalfUsed = false;
-			}
-			if(buffer.isSecondHalfUsed) {
-				++usedCount;
-				str << "Still used: buffer of " << buffer.size << '\n';
-				buffer.isSecondHalfUsed = false;
-			}
-			// In case of leak, leave this allocated so that e.g. valgrind can diagnose it as well.
-			if(!buffer.isFirstHalfUsed && !buffer.isSecondHalfUsed)
-				free(buffer.ptr);
-		}
-		if(usedCount != 0)
-		{
-			std::cerr << usedCount << " image buffer(s) were still in use when image buffer allocator was destroyed!\n" << str.str();
-		}
+		size_t newCount = (count += change);
+		size_t currentMax = max;
+		while(newCount > currentMax && !max.compare_exchange_weak(currentMax, newCount))
+		{ }
 	}
 	
-	std::vector<Buffer> _buffers;
-	size_t _nReal, _nComplex, _nRealMax, _nComplexMax, _previousSize;
+	std::vector<std::unique_ptr<Shard>> _shards;
+	std::atomic<size_t> _nReal, _nComplex, _nRealMax, _nComplexMax;
+	std::atomic<size_t> _usedBytes, _usedBytesMax, _allocatedBytes, _allocatedBytesMax;
+	std::atomic<size_t> _newBlockCount, _reusedBlockCount;
+	size_t _cacheLimit, _firstTouchThreadCount;
 	bool _direct;
-	mutable std::mutex _mutex;
 };
 
 template<>
@@ -0,0 +1,196 @@
+#include "imageweightcache.h"
+
+#include "../msproviders/msprovider.h"
+
+#include <boost/filesystem/path.hpp>
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+
+std::shared_ptr<ImageWeights> ImageWeightCache::Get(const std::vector<std::pair<std::unique_ptr<MSProvider>, MSSelection>>& msList, size_t outChannelIndex, size_t outIntervalIndex)
+{
+	const Key key(outChannelIndex, outIntervalIndex);
+	std::unique_lock<std::mutex> lock(_mutex);
+	while(true)
+	{
+		for(std::list<Entry>::iterator entry = _entries.begin(); entry != _entries.end(); ++entry)
+		{
+			if(entry->key == key)
+			{
+				_entries.splice(_entries.begin(), _entries, entry);
+				return entry->weights;
+			}
+		}
+		if(_keysBeingCalculated.count(key) == 0)
+			break;
+		_calculationFinished.wait(lock);
+	}
+	_keysBeingCalculated.insert(key);
+	lock.unlock();
+
+	std::shared_ptr<ImageWeights> weights;
+	try {
+		if(_diskCacheDirectory.empty())
+			weights = recalculateWeights(msList);
+		else {
+			const std::string diskKey = diskCacheKey(msList, outChannelIndex, outIntervalIndex);
+			weights = readFromDisk(diskKey);
+			if(weights == nullptr)
+			{
+				weights = recalculateWeights(msList);
+				writeToDisk(diskKey, *weights);
+			}
+		}
+	} catch(...) {
+		lock.lock();
+		_keysBeingCalculated.erase(key);
+		_calculationFinished.notify_all();
+		throw;
+	}
+
+	lock.lock();
+	_keysBeingCalculated.erase(key);
+	_entries.emplace_front();
+	_entries.front().key = key;
+	_entries.front().weights = weights;
+	removeLeastRecentlyUsed();
+	_calculationFinished.notify_all();
+	return weights;
+}
+
+void ImageWeightCache::removeLeastRecentlyUsed()
+{
+	size_t totalSize = 0;
+	for(const Entry& entry : _entries)
+		totalSize += entry.weights->GridSizeInBytes();
+	while(_entries.size() > 1 && totalSize > _memoryBudget)
+	{
+		// Weights that are still in use are freed when they are no longer used
+		totalSize -= _entries.back().weights->GridSizeInBytes();
+		_entries.pop_back();
+	}
+}
+
+std::unique_ptr<ImageWeights> ImageWeightCache::recalculateWeights(const std::vector<std::pair<std::unique_ptr<MSProvider>, MSSelection>>& msList)
+{
+	Logger::Info << "Precalculating weights for " << _weightMode.ToString() << " weighting... ";
+	Logger::Info.Flush();
+	std::unique_ptr<ImageWeights> weights = MakeEmptyWeights();
+	for(size_t i=0; i!=msList.size(); ++i)
+	{
+		weights->Grid(*msList[i].first, msList[i].second);
+		if(msList.size() > 1)
+			(Logger::Info << i << ' ').Flush();
+	}
+	weights->FinishGridding();
+	InitializeWeightTapers(*weights);
+	Logger::Info << "DONE\n";
+	return weights;
+}
+
+void ImageWeightCache::InitializeWeightTapers(ImageWeights& weights) const
+{
+	if(_rankFilterLevel >= 1.0)
+		weights.RankFilter(_rankFilterLevel, _rankFilterSize);
+
+	if(_gaussianTaperBeamSize != 0.0)
+		weights.SetGaussianTaper(_gaussianTaperBeamSize);
+
+	if(_tukeyInnerTaperInLambda != 0.0)
+		weights.SetTukeyInnerTaper(_tukeyInnerTaperInLambda, _minUVInLambda);
+	else if(_minUVInLambda!=0.0)
+		weights.SetMinUVRange(_minUVInLambda);
+
+	if(_tukeyTaperInLambda != 0.0)
+		weights.SetTukeyTaper(_tukeyTaperInLambda, _maxUVInLambda);
+	else if(_maxUVInLambda!=0.0)
+		weights.SetMaxUVRange(_maxUVInLambda);
+
+	if(_edgeTukeyTaperInLambda != 0.0)
+		weights.SetEdgeTukeyTaper(_edgeTukeyTaperInLambda, _edgeTaperInLambda);
+	else if(_edgeTaperInLambda != 0.0)
+		weights.SetEdgeTaper(_edgeTaperInLambda);
+}
+
+std::string ImageWeightCache::diskCacheKey(const std::vector<std::pair<std::unique_ptr<MSProvider>, MSSelection>>& msList, size_t outChannelIndex, size_t outIntervalIndex) const
+{
+	std::ostringstream key;
+	key << std::setprecision(17)
+		<< "wsclean-image-weights 1\n"
+		<< _dataDescription << '\n'
+		<< _weightMode.Mode() << ' ' << _weightMode.BriggsRobustness() << ' ' << _weightMode.SuperWeight() << '\n'
+		<< _imageWidth << ' ' << _imageHeight << ' ' << _pixelScaleX << ' ' << _pixelScaleY << '\n'
+		<< _minUVInLambda << ' ' << _maxUVInLambda << ' ' << _rankFilterLevel << ' ' << _rankFilterSize << '\n'
+		<< _gaussianTaperBeamSize << ' ' << _tukeyTaperInLambda << ' ' << _tukeyInnerTaperInLambda << ' '
+		<< _edgeTaperInLambda << ' ' << _edgeTukeyTaperInLambda << ' ' << _weightsAsTaper << '\n'
+		<< outChannelIndex << ' ' << outIntervalIndex << '\n';
+	for(const std::pair<std::unique_ptr<MSProvider>, MSSelection>& ms : msList)
+	{
+		const MSSelection& selection = ms.second;
+		key << ms.first->Polarization() << ' '
+			<< selection.ChannelRangeStart() << ' ' << selection.ChannelRangeEnd() << ' '
+			<< selection.IntervalStart() << ' ' << selection.IntervalEnd() << ' '
+			<< selection.MinUVWInM() << ' ' << selection.MaxUVWInM() << ' '
+			<< selection.EvenOrOddTimesteps();
+		for(size_t fieldId : selection.FieldIds())
+			key << ' ' << fieldId;
+		key << '\n';
+	}
+	return key.str();
+}
+
+std::string ImageWeightCache::diskCacheFilename(const std::string& key) const
+{
+	std::ostringstream name;
+	name << "weights-" << std::hex << std::hash<std::string>()(key) << ".bin";
+	return (boost::filesystem::path(_diskCacheDirectory) / name.str()).string();
+}
+
+std::unique_ptr<ImageWeights> ImageWeightCache::readFromDisk(const std::string& key) const
+{
+	const std::string filename = diskCacheFilename(key);
+	std::ifstream file(filename, std::ios::binary);
+	if(!file)
+		return nullptr;
+	// The file starts with the full key, to rule out hash collisions
+	uint64_t keyLength = 0;
+	file.read(reinterpret_cast<char*>(&keyLength), sizeof(keyLength));
+	if(!file || keyLength != key.size())
+		return nullptr;
+	std::string storedKey(keyLength, '\0');
+	file.read(&storedKey[0], keyLength);
+	std::unique_ptr<ImageWeights> weights = MakeEmptyWeights();
+	if(!file || storedKey != key || !weights->Unserialize(file))
+		return nullptr;
+	Logger::Info << "Read imaging weights from " << filename << '\n';
+	return weights;
+}
+
+void ImageWeightCache::writeToDisk(const std::string& key, const ImageWeights& weights) const
+{
+	const std::string filename = diskCacheFilename(key);
+	// Write to a temporary file first, so that concurrent runs never read half a file
+	std::ostringstream tmpFilename;
+	tmpFilename << filename << '.' << getpid() << ".tmp";
+	bool isWritten;
+	{
+		std::ofstream file(tmpFilename.str(), std::ios::binary);
+		const uint64_t keyLength = key.size();
+		file.write(reinterpret_cast<const char*>(&keyLength), sizeof(keyLength));
+		file.write(key.data(), key.size());
+		weights.Serialize(file);
+		isWritten = bool(file);
+	}
+	if(isWritten && std::rename(tmpFilename.str().c_str(), filename.c_str()) == 0)
+		Logger::Debug << "Stored imaging weights in " << filename << '\n';
+	else {
+		std::remove(tmpFilename.str().c_str());
+		Logger::Warn << "Could not store imaging weights in " << filename << '\n';
+	}
+}
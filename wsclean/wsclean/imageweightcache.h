@@ -7,9 +7,25 @@
 #include "../imageweights.h"
 #include "../weightmode.h"
 
+#include <condition_variable>
 #include <limits>
+#include <list>
 #include <mutex>
+#include <set>
+#include <string>
 
+/**
+ * Keeps the imaging weights of the output channels and intervals. The weights of
+ * several channels and intervals are kept at the same time, such that the weights
+ * are not recalculated when channels are gridded out of order (e.g. with parallel
+ * gridding), or when the psf and the image of different channels alternate. When the
+ * weights use more memory than the memory budget, the least recently used weights
+ * are removed.
+ *
+ * Optionally, the weights can also be stored on disk with @ref SetDiskCache(), such
+ * that later runs with the same data, selection, weighting and image size can
+ * skip the calculation.
+ */
 class ImageWeightCache
 {
 public:
@@ -28,11 +44,10 @@ public:
 		_edgeTaperInLambda(0),
 		_edgeTukeyTaperInLambda(0),
 		_weightsAsTaper(weightsAsTaper),
-		_currentWeightChannel(std::numeric_limits<size_t>::max()),
-		_currentWeightInterval(std::numeric_limits<size_t>::max())
+		_memoryBudget(0)
 	{
 	}
-	
+
 	void SetTaperInfo(double gaussianTaperBeamSize, double tukeyTaperInLambda, double tukeyInnerTaperInLambda, double edgeTaperInLambda, double edgeTukeyTaperInLambda)
 	{
 		_gaussianTaperBeamSize = gaussianTaperBeamSize;
@@ -41,92 +56,106 @@ public:
 		_edgeTaperInLambda = edgeTaperInLambda;
 		_edgeTukeyTaperInLambda = edgeTukeyTaperInLambda;
 	}
-	
-	std::shared_ptr<ImageWeights> Get(const std::vector<std::pair<std::unique_ptr<MSProvider>, MSSelection>>& msList, size_t outChannelIndex, size_t outIntervalIndex)
+
+	/**
+	 * Set the maximum number of bytes that the kept weights may use. The most recently
+	 * used weights are always kept. The default of zero keeps only those.
+	 */
+	void SetMemoryBudget(size_t memoryBudget)
 	{
-		std::unique_lock<std::mutex> lock(_mutex);
-		if(outChannelIndex != _currentWeightChannel || outIntervalIndex != _currentWeightInterval)
-		{
-			lock.unlock();
-			std::unique_ptr<ImageWeights> weights = recalculateWeights(msList);
-			lock.lock();
-			_currentWeightChannel = outChannelIndex;
-			_currentWeightInterval = outIntervalIndex;
-			_cachedWeights = std::move(weights);
-		}
-		return _cachedWeights;
+		std::lock_guard<std::mutex> lock(_mutex);
+		_memoryBudget = memoryBudget;
+		removeLeastRecentlyUsed();
+	}
+
+	/**
+	 * Store calculated weights in the given directory, and look them up there before
+	 * calculating them.
+	 * @param dataDescription Describes the measurement sets that the weights are
+	 * calculated from. Weights are reused only when this description is the same. The
+	 * other settings and the selections are added to it by the cache.
+	 */
+	void SetDiskCache(const std::string& directory, const std::string& dataDescription)
+	{
+		_diskCacheDirectory = directory;
+		_dataDescription = dataDescription;
 	}
-	
+
+	/**
+	 * Get the weights for an output channel and interval. The weights are calculated
+	 * from the given measurement sets if they are not cached. This method is thread safe:
+	 * when the weights are being calculated by another thread, this call waits
+	 * for it instead of calculating them again.
+	 */
+	std::shared_ptr<ImageWeights> Get(const std::vector<std::pair<std::unique_ptr<MSProvider>, MSSelection>>& msList, size_t outChannelIndex, size_t outIntervalIndex);
+
 	std::shared_ptr<ImageWeights> Get(casacore::MeasurementSet& ms, MSSelection& selection)
 	{
 		std::unique_ptr<ImageWeights> weights = MakeEmptyWeights();
 		weights->Grid(ms, selection);
-		initializeWeightTapers(*weights);
+		InitializeWeightTapers(*weights);
 		return std::move(weights);
 	}
-	
+
 	std::unique_ptr<ImageWeights> MakeEmptyWeights() const
 	{
 		return std::unique_ptr<ImageWeights>(new ImageWeights(_weightMode, _imageWidth, _imageHeight, _pixelScaleX, _pixelScaleY, _weightsAsTaper, _weightMode.SuperWeight()));
 	};
-	
+
+	/**
+	 * Applies the uv-range limits, the rank filter and the tapers to weights that
+	 * have been gridded. This is done for all weights that the cache calculates.
+	 */
+	void InitializeWeightTapers(ImageWeights& weights) const;
+
 	std::shared_ptr<ImageWeights> GetMFWeights() const
 	{
-		return _cachedWeights;
+		return _mfWeights;
 	}
-	
+
 	void SetMFWeights(std::unique_ptr<ImageWeights> weights)
 	{
-		initializeWeightTapers(*weights);
+		InitializeWeightTapers(*weights);
 		std::unique_lock<std::mutex> lock(_mutex);
-		_cachedWeights = std::move(weights);
-		_currentWeightChannel = std::numeric_limits<size_t>::max();
-		_currentWeightInterval = std::numeric_limits<size_t>::max();
+		_mfWeights = std::move(weights);
 	}
-	
-private:
-	std::unique_ptr<ImageWeights> recalculateWeights(const std::vector<std::pair<std::unique_ptr<MSProvider>, MSSelection>>& msList)
+
+	/**
+	 * Number of channel/interval weights that are currently kept in memory.
+	 */
+	size_t EntryCount() const
 	{
-		Logger::Info << "Precalculating weights for " << _weightMode.ToString() << " weighting... ";
-		Logger::Info.Flush();
-		std::unique_ptr<ImageWeights> weights = MakeEmptyWeights();
-		for(size_t i=0; i!=msList.size(); ++i)
-		{
-			weights->Grid(*msList[i].first, msList[i].second);
-			if(msList.size() > 1)
-				(Logger::Info << i << ' ').Flush();
-		}
-		weights->FinishGridding();
-		initializeWeightTapers(*weights);
-		Logger::Info << "DONE\n";
-		return weights;
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _entries.size();
 	}
-	
-	void initializeWeightTapers(ImageWeights& weights)
+
+private:
+	typedef std::pair<size_t, size_t> Key;
+
+	struct Entry
 	{
-		if(_rankFilterLevel >= 1.0)
-			weights.RankFilter(_rankFilterLevel, _rankFilterSize);
-		
-		if(_gaussianTaperBeamSize != 0.0)
-			weights.SetGaussianTaper(_gaussianTaperBeamSize);
-		
-		if(_tukeyInnerTaperInLambda != 0.0)
-			weights.SetTukeyInnerTaper(_tukeyInnerTaperInLambda, _minUVInLambda);
-		else if(_minUVInLambda!=0.0)
-			weights.SetMinUVRange(_minUVInLambda);
-		
-		if(_tukeyTaperInLambda != 0.0)
-			weights.SetTukeyTaper(_tukeyTaperInLambda, _maxUVInLambda);
-		else if(_maxUVInLambda!=0.0)
-			weights.SetMaxUVRange(_maxUVInLambda);
-		
-		if(_edgeTukeyTaperInLambda != 0.0)
-			weights.SetEdgeTukeyTaper(_edgeTukeyTaperInLambda, _edgeTaperInLambda);
-		else if(_edgeTaperInLambda != 0.0)
-			weights.SetEdgeTaper(_edgeTaperInLambda);
-	}
+		Key key;
+		std::shared_ptr<ImageWeights> weights;
+	};
+
+	std::unique_ptr<ImageWeights> recalculateWeights(const std::vector<std::pair<std::unique_ptr<MSProvider>, MSSelection>>& msList);
 
-	std::shared_ptr<ImageWeights> _cachedWeights;
+	/**
+	 * Remove weights until the kept weights fit in the memory budget.
+	 * _mutex should be locked.
+	 */
+	void removeLeastRecentlyUsed();
+
+	/**
+	 * A string that describes everything the weights depend on, used to identify
+	 * weights on disk.
+	 */
+	std::string diskCacheKey(const std::vector<std::pair<std::unique_ptr<MSProvider>, MSSelection>>& msList, size_t outChannelIndex, size_t outIntervalIndex) const;
+	std::string diskCacheFilename(const std::string& key) const;
+	std::unique_ptr<ImageWeights> readFromDisk(const std::string& key) const;
+	void writeToDisk(const std::string& key, const ImageWeights& weights) const;
+
+	std::shared_ptr<ImageWeights> _mfWeights;
 	const WeightMode _weightMode;
 	size_t _imageWidth, _imageHeight;
 	double _pixelScaleX, _pixelScaleY;
@@ -138,9 +167,14 @@ private:
 	double _edgeTaperInLambda;
 	double _edgeTukeyTaperInLambda;
 	bool _weightsAsTaper;
-	std::mutex _mutex;
-	
-	size_t _currentWeightChannel, _currentWeightInterval;
+	size_t _memoryBudget;
+	std::string _diskCacheDirectory, _dataDescription;
+
+	mutable std::mutex _mutex;
+	std::condition_variable _calculationFinished;
+	// The most recently used weights are at the front
+	std::list<Entry> _entries;
+	std::set<Key> _keysBeingCalculated;
 };
 
 #endif
@@ -0,0 +1,276 @@
+#include "intervalimager.h"
+
+#include "imageweightcache.h"
+#include "logger.h"
+#include "wscleansettings.h"
+
+#include "../image.h"
+#include "../imageweights.h"
+#include "../multibanddata.h"
+
+#include "../msproviders/msindex.h"
+#include "../msproviders/msprovider.h"
+
+#include "../wgridder/wgriddinggridder_simple.h"
+
+#include <cmath>
+#include <thread>
+
+IntervalImager::IntervalImager(const WSCleanSettings& settings, ImageBufferAllocator& allocator, const ImageWeightCache& weightCache) :
+	_settings(settings),
+	_allocator(allocator),
+	_weightCache(weightCache)
+{ }
+
+void IntervalImager::Run(std::vector<std::pair<std::unique_ptr<MSProvider>, MSSelection>>& msList, const std::vector<double>& intervalStartTimes, const std::function<void(Result&)>& callback)
+{
+	_selectedBands.clear();
+	for(std::pair<std::unique_ptr<MSProvider>, MSSelection>& ms : msList)
+	{
+		SynchronizedMS synchronizedMS(ms.first->MS());
+		const MultiBandData bands(synchronizedMS->spectralWindow(), synchronizedMS->dataDescription());
+		const MSSelection& selection = ms.second;
+		if(selection.HasChannelRange())
+			_selectedBands.emplace_back(bands, selection.ChannelRangeStart(), selection.ChannelRangeEnd());
+		else
+			_selectedBands.emplace_back(bands);
+		synchronizedMS.Reset();
+		ms.first->Reset();
+	}
+
+	// Holds one interval, so that one interval is being read while another is imaged.
+	ao::lane<std::unique_ptr<Interval>> intervalLane(1);
+	std::exception_ptr imagingError;
+	std::thread imagingThread(&IntervalImager::imagingThread, this, &intervalLane, &callback, &imagingError);
+	try {
+		for(size_t i=0; i!=intervalStartTimes.size(); ++i)
+		{
+			std::unique_ptr<Interval> interval(new Interval());
+			interval->index = i;
+			interval->startTime = intervalStartTimes[i];
+			readInterval(msList, intervalStartTimes, *interval);
+			intervalLane.write(std::move(interval));
+		}
+	} catch(...) {
+		intervalLane.write_end();
+		imagingThread.join();
+		throw;
+	}
+	intervalLane.write_end();
+	imagingThread.join();
+	if(imagingError)
+		std::rethrow_exception(imagingError);
+}
+
+std::vector<size_t> IntervalImager::CountIntervalRows(const MSIndex& index, size_t startTimestep, size_t endTimestep, const std::vector<double>& intervalStartTimes)
+{
+	std::vector<size_t> rowCounts(intervalStartTimes.size(), 0);
+	endTimestep = std::min(endTimestep, index.TimestepCount());
+	if(!rowCounts.empty())
+	{
+		for(size_t t=startTimestep; t<endTimestep; ++t)
+		{
+			const size_t interval = IntervalOfTime(intervalStartTimes, index.TimestepTime(t));
+			rowCounts[interval] += index.TimestepStartRow(t+1) - index.TimestepStartRow(t);
+		}
+	}
+	return rowCounts;
+}
+
+void IntervalImager::GridImagingWeights(const Chunk& chunk, ImageWeights& imageWeights, bool useWeightsAsTaper)
+{
+	const size_t channelCount = chunk.band.ChannelCount();
+	for(size_t row=0; row!=chunk.RowCount(); ++row)
+	{
+		double
+			uInM = chunk.uvws[row*3],
+			vInM = chunk.uvws[row*3 + 1];
+		if(vInM < 0.0)
+		{
+			uInM = -uInM;
+			vInM = -vInM;
+		}
+		const float* weights = &chunk.weights[row*channelCount];
+		for(size_t ch=0; ch!=channelCount; ++ch)
+		{
+			const double wavelength = chunk.band.ChannelWavelength(ch);
+			const double weight = (useWeightsAsTaper && weights[ch] != 0.0) ? 1.0 : weights[ch];
+			imageWeights.Grid(uInM / wavelength, vInM / wavelength, weight);
+		}
+	}
+}
+
+void IntervalImager::WeightChunk(Chunk& chunk, const ImageWeights& imageWeights, enum MeasurementSetGridder::VisibilityWeightingMode visibilityWeightingMode, bool makePSF, WeightSums& sums)
+{
+	const size_t channelCount = chunk.band.ChannelCount();
+	if(makePSF)
+		chunk.psfData.resize(chunk.data.size());
+	for(size_t row=0; row!=chunk.RowCount(); ++row)
+	{
+		const double* uvw = &chunk.uvws[row*3];
+		const double baselineInM = std::sqrt(uvw[0]*uvw[0] + uvw[1]*uvw[1] + uvw[2]*uvw[2]);
+		for(size_t ch=0; ch!=channelCount; ++ch)
+		{
+			const size_t index = row*channelCount + ch;
+			float weight = chunk.weights[index];
+			switch(visibilityWeightingMode)
+			{
+			case MeasurementSetGridder::NormalVisibilityWeighting:
+				break;
+			case MeasurementSetGridder::SquaredVisibilityWeighting:
+				weight *= weight;
+				break;
+			case MeasurementSetGridder::UnitVisibilityWeighting:
+				if(weight != 0.0)
+					weight = 1.0;
+				break;
+			}
+			const double wavelength = chunk.band.ChannelWavelength(ch);
+			const double cumWeight = weight * imageWeights.GetWeight(uvw[0] / wavelength, uvw[1] / wavelength);
+			if(cumWeight != 0.0)
+			{
+				sums.visibilityWeightSum += weight;
+				sums.totalWeight += cumWeight;
+				++sums.visibilityCount;
+				sums.maxBaseline = std::max(sums.maxBaseline, baselineInM / wavelength);
+			}
+			chunk.data[index] *= cumWeight;
+			if(makePSF)
+				chunk.psfData[index] = cumWeight;
+		}
+	}
+}
+
+void IntervalImager::readInterval(std::vector<std::pair<std::unique_ptr<MSProvider>, MSSelection>>& msList, const std::vector<double>& intervalStartTimes, Interval& interval)
+{
+	for(size_t msIndex=0; msIndex!=msList.size(); ++msIndex)
+	{
+		MSProvider& msProvider = *msList[msIndex].first;
+		const MultiBandData& bands = _selectedBands[msIndex];
+		ao::uvector<std::complex<float>> modelBuffer(bands.MaxChannels());
+		Chunk* chunk = nullptr;
+		size_t chunkDataDescId = 0;
+		// The providers are not reset between intervals: each interval continues where
+		// the previous one stopped.
+		while(msProvider.CurrentRowAvailable())
+		{
+			MSProvider::MetaData metaData;
+			msProvider.ReadMeta(metaData);
+			if(IntervalOfTime(intervalStartTimes, metaData.time) > interval.index)
+				break;
+
+			if(chunk == nullptr || chunkDataDescId != metaData.dataDescId)
+			{
+				interval.chunks.emplace_back();
+				chunk = &interval.chunks.back();
+				chunk->band = bands[metaData.dataDescId];
+				chunkDataDescId = metaData.dataDescId;
+			}
+			const size_t channelCount = chunk->band.ChannelCount();
+			const size_t offset = chunk->data.size();
+			chunk->uvws.push_back(metaData.uInM);
+			chunk->uvws.push_back(metaData.vInM);
+			chunk->uvws.push_back(metaData.wInM);
+			chunk->data.push_back_uninitialized(channelCount);
+			msProvider.ReadData(&chunk->data[offset]);
+			if(_settings.subtractModel)
+			{
+				msProvider.ReadModel(modelBuffer.data());
+				for(size_t ch=0; ch!=channelCount; ++ch)
+					chunk->data[offset + ch] -= modelBuffer[ch];
+			}
+			chunk->weights.push_back_uninitialized(channelCount);
+			msProvider.ReadWeights(&chunk->weights[offset]);
+
+			msProvider.NextRow();
+		}
+	}
+}
+
+void IntervalImager::imagingThread(ao::lane<std::unique_ptr<Interval>>* intervalLane, const std::function<void(Result&)>* callback, std::exception_ptr* error)
+{
+	std::unique_ptr<Interval> interval;
+	try {
+		while(intervalLane->read(interval))
+		{
+			Result result;
+			imageInterval(*interval, result);
+			// Free the visibilities before the images are processed
+			interval.reset();
+			(*callback)(result);
+		}
+	} catch(...) {
+		*error = std::current_exception();
+		// Keep emptying the lane, so that reading does not wait forever
+		while(intervalLane->read(interval))
+		{ }
+	}
+}
+
+void IntervalImager::imageInterval(Interval& interval, Result& result)
+{
+	size_t rowCount = 0;
+	for(const Chunk& chunk : interval.chunks)
+		rowCount += chunk.RowCount();
+	Logger::Info << "Imaging interval " << interval.index << " (" << rowCount << " rows)...\n";
+
+	// The imaging weights depend on the uv-coverage of the interval, hence they are
+	// calculated from the rows of the interval.
+	std::unique_ptr<ImageWeights> imageWeights = _weightCache.MakeEmptyWeights();
+	if(_settings.weightMode.RequiresGridding())
+	{
+		for(const Chunk& chunk : interval.chunks)
+			GridImagingWeights(chunk, *imageWeights, _settings.useWeightsAsTaper);
+	}
+	imageWeights->FinishGridding();
+	_weightCache.InitializeWeightTapers(*imageWeights);
+
+	WeightSums sums;
+	const bool makePSF = _settings.makePSF;
+	for(Chunk& chunk : interval.chunks)
+		WeightChunk(chunk, *imageWeights, _settings.visibilityWeightingMode, makePSF, sums);
+
+	const double normalizationFactor = sums.NormalizationFactor();
+	result.intervalIndex = interval.index;
+	result.startTime = interval.startTime;
+	result.image = gridChunks(interval.chunks, false, normalizationFactor);
+	if(makePSF)
+		result.psf = gridChunks(interval.chunks, true, normalizationFactor);
+	result.imageWeight = sums.totalWeight;
+	result.visibilityWeightSum = sums.visibilityWeightSum;
+	result.visibilityCount = sums.visibilityCount;
+	result.beamSize = sums.maxBaseline == 0.0 ? 0.0 : 1.0 / sums.maxBaseline;
+}
+
+ImageBufferAllocator::Ptr IntervalImager::gridChunks(const std::vector<Chunk>& chunks, bool isPSF, double normalizationFactor)
+{
+	const size_t
+		width = _settings.paddedImageWidth,
+		height = _settings.paddedImageHeight,
+		trimmedWidth = _settings.trimmedImageWidth,
+		trimmedHeight = _settings.trimmedImageHeight;
+	WGriddingGridder_Simple gridder(width, height, trimmedWidth, trimmedHeight, _settings.pixelScaleX, _settings.pixelScaleY, _settings.threadCount);
+	gridder.InitializeInversion();
+	for(const Chunk& chunk : chunks)
+	{
+		if(chunk.RowCount() != 0)
+		{
+			ao::uvector<double> frequencies(chunk.band.ChannelCount());
+			for(size_t ch=0; ch!=frequencies.size(); ++ch)
+				frequencies[ch] = chunk.band.ChannelFrequency(ch);
+			gridder.AddInversionData(chunk.RowCount(), frequencies.size(), chunk.uvws.data(), frequencies.data(), isPSF ? chunk.psfData.data() : chunk.data.data());
+		}
+	}
+	gridder.FinalizeImage(normalizationFactor, false);
+
+	std::vector<float> imageFloat = gridder.RealImage();
+	ImageBufferAllocator::Ptr image = _allocator.AllocatePtr(width * height);
+	std::copy(imageFloat.begin(), imageFloat.end(), image.data());
+	if(trimmedWidth != width || trimmedHeight != height)
+	{
+		ImageBufferAllocator::Ptr trimmed = _allocator.AllocatePtr(trimmedWidth * trimmedHeight);
+		Image::Trim(trimmed.data(), trimmedWidth, trimmedHeight, image.data(), width, height);
+		image = std::move(trimmed);
+	}
+	return image;
+}
@@ -0,0 +1,165 @@
+#ifndef INTERVAL_IMAGER_H
+#define INTERVAL_IMAGER_H
+
+#include "imagebufferallocator.h"
+#include "measurementsetgridder.h"
+
+#include "../banddata.h"
+#include "../lane.h"
+#include "../msselection.h"
+#include "../multibanddata.h"
+#include "../uvector.h"
+
+#include <algorithm>
+#include <complex>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+class ImageWeights;
+class MSIndex;
+class MSProvider;
+
+/**
+ * Makes the dirty images of many consecutive time intervals with a single pass over
+ * the data. The measurement sets are read once in time order, and the rows of each
+ * interval are collected in memory. When all rows of an interval have been read, the
+ * interval is weighted and gridded with the w-gridder by an imaging thread, while
+ * the next interval is being read.
+ *
+ * This avoids that, for each interval, the data is reordered, the imaging weights and
+ * meta data are calculated and a full gridder is set up. When many short intervals are
+ * imaged (e.g. for transient searches), that makes the run time proportional to the
+ * amount of data instead of the number of intervals times the amount of data.
+ */
+class IntervalImager
+{
+public:
+	struct Result
+	{
+		size_t intervalIndex;
+		double startTime;
+		/**
+		 * Trimmed dirty image, normalized by the sum of weights. The PSF is only
+		 * made when requested in the settings.
+		 */
+		ImageBufferAllocator::Ptr image, psf;
+		double imageWeight, visibilityWeightSum, beamSize;
+		size_t visibilityCount;
+	};
+
+	/**
+	 * The rows of one interval from one provider and data description.
+	 */
+	struct Chunk
+	{
+		BandData band;
+		ao::uvector<double> uvws;
+		ao::uvector<std::complex<float>> data;
+		ao::uvector<float> weights;
+		// The imaging weights of the visibilities, used for gridding the PSF
+		ao::uvector<std::complex<float>> psfData;
+		size_t RowCount() const { return uvws.size() / 3; }
+	};
+
+	/**
+	 * Sums over the visibilities of an interval that are accumulated by @ref WeightChunk().
+	 */
+	struct WeightSums
+	{
+		WeightSums() : totalWeight(0.0), visibilityWeightSum(0.0), maxBaseline(0.0), visibilityCount(0) { }
+
+		/** Sum of the visibility weights times the imaging weights. */
+		double totalWeight;
+		/** Sum of the visibility weights of the visibilities with a non-zero imaging weight. */
+		double visibilityWeightSum;
+		/** Longest baseline with a non-zero weight, in wavelengths. */
+		double maxBaseline;
+		size_t visibilityCount;
+
+		/** Factor that normalizes the gridded image by the sum of weights. */
+		double NormalizationFactor() const
+		{
+			return totalWeight == 0.0 ? 0.0 : 1.0 / totalWeight;
+		}
+	};
+
+	IntervalImager(const class WSCleanSettings& settings, ImageBufferAllocator& allocator, const class ImageWeightCache& weightCache);
+
+	/**
+	 * Reads all data and images the intervals.
+	 * @param msList Providers for the combined time range of all intervals.
+	 * @param intervalStartTimes Start time of each interval, in increasing order. A row
+	 * belongs to the last interval that starts at or before the time of the row.
+	 * @param callback Is called with the images of each interval, in order of the
+	 * intervals. It is called from the imaging thread.
+	 */
+	void Run(std::vector<std::pair<std::unique_ptr<MSProvider>, MSSelection>>& msList, const std::vector<double>& intervalStartTimes, const std::function<void(Result&)>& callback);
+
+	/**
+	 * Index of the interval that a row with the given time belongs to: the last interval
+	 * that starts at or before the time. Rows before the first interval belong to
+	 * the first interval.
+	 */
+	static size_t IntervalOfTime(const std::vector<double>& intervalStartTimes, double time)
+	{
+		const size_t next = std::upper_bound(intervalStartTimes.begin(), intervalStartTimes.end(), time) - intervalStartTimes.begin();
+		return next == 0 ? 0 : next - 1;
+	}
+
+	/**
+	 * Counts the rows of each interval in the timesteps [startTimestep, endTimestep) of
+	 * a measurement set.
+	 */
+	static std::vector<size_t> CountIntervalRows(const MSIndex& index, size_t startTimestep, size_t endTimestep, const std::vector<double>& intervalStartTimes);
+
+	/**
+	 * Number of bytes that the buffered rows of an interval take, given the number of
+	 * rows and (an upper limit of) the number of channels per row. While one interval is
+	 * imaged, up to two others are buffered, so @ref Run() needs about three times this.
+	 */
+	static size_t IntervalBytes(size_t rowCount, size_t channelCount, bool makePSF)
+	{
+		const size_t bytesPerChannel = sizeof(std::complex<float>) + sizeof(float) + (makePSF ? sizeof(std::complex<float>) : 0);
+		return rowCount * (3 * sizeof(double) + channelCount * bytesPerChannel);
+	}
+
+	/**
+	 * Grids the visibility weights of a chunk onto the imaging weights, which is required
+	 * before @ref WeightChunk() is called for weighting modes that depend on the
+	 * uv-coverage.
+	 */
+	static void GridImagingWeights(const Chunk& chunk, ImageWeights& imageWeights, bool useWeightsAsTaper);
+
+	/**
+	 * Multiplies the visibilities of a chunk by their visibility weight (after the
+	 * weighting mode has been applied) times their imaging weight, and adds them to the
+	 * sums. When @p makePSF is set, the weights are stored in the psfData of the chunk.
+	 */
+	static void WeightChunk(Chunk& chunk, const ImageWeights& imageWeights, enum MeasurementSetGridder::VisibilityWeightingMode visibilityWeightingMode, bool makePSF, WeightSums& sums);
+
+private:
+	struct Interval
+	{
+		size_t index;
+		double startTime;
+		std::vector<Chunk> chunks;
+	};
+
+	void readInterval(std::vector<std::pair<std::unique_ptr<MSProvider>, MSSelection>>& msList, const std::vector<double>& intervalStartTimes, Interval& interval);
+
+	void imagingThread(ao::lane<std::unique_ptr<Interval>>* intervalLane, const std::function<void(Result&)>* callback, std::exception_ptr* error);
+
+	void imageInterval(Interval& interval, Result& result);
+
+	ImageBufferAllocator::Ptr gridChunks(const std::vector<Chunk>& chunks, bool isPSF, double normalizationFactor);
+
+	const class WSCleanSettings& _settings;
+	ImageBufferAllocator& _allocator;
+	const class ImageWeightCache& _weightCache;
+	std::vector<MultiBandData> _selectedBands;
+};
+
+#endif
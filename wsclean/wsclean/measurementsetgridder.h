@@ -45,6 +45,9 @@ class MeasurementSetGridder
 			_addToModel(false),
 			_smallInversion(false),
 			_wLimit(0.0),
+			_hasRephaseDirection(false),
+			_rephaseRA(0.0),
+			_rephaseDec(0.0),
 			_precalculatedWeightInfo(nullptr),
 			_polarization(Polarization::StokesI),
 			_isComplex(false),
@@ -93,6 +96,9 @@ class MeasurementSetGridder
 		size_t OverSamplingFactor() const { return _overSamplingFactor; }
 		bool HasWLimit() const { return _wLimit != 0.0; }
 		double WLimit() const { return _wLimit; }
+		bool HasRephaseDirection() const { return _hasRephaseDirection; }
+		double RephaseRA() const { return _rephaseRA; }
+		double RephaseDec() const { return _rephaseDec; }
 		enum VisibilityWeightingMode VisibilityWeightingMode() const { return _visibilityWeightingMode; }
 		bool StoreImagingWeights() const { return _storeImagingWeights; }
 		
@@ -176,6 +182,17 @@ class MeasurementSetGridder
 		{
 			_wLimit = wLimit;
 		}
+		/**
+		 * Set the phase centre of the image when the measurement set providers have been
+		 * rephased to another direction than the phase centre of the set (see
+		 * @ref RephasingMSProvider).
+		 */
+		void SetRephaseDirection(double ra, double dec)
+		{
+			_hasRephaseDirection = true;
+			_rephaseRA = ra;
+			_rephaseDec = dec;
+		}
 		void SetVisibilityWeightingMode(enum VisibilityWeightingMode mode)
 		{
 			_visibilityWeightingMode = mode;
@@ -246,6 +263,8 @@ class MeasurementSetGridder
 		std::string _dataColumnName;
 		bool _doImagePSF, _doSubtractModel, _addToModel, _smallInversion;
 		double _wLimit;
+		bool _hasRephaseDirection;
+		double _rephaseRA, _rephaseDec;
 		class ImageWeights *_precalculatedWeightInfo;
 		PolarizationEnum _polarization;
 		bool _isComplex;
@@ -107,6 +107,14 @@ void MSGridderBase::GetPhaseCentreInfo(casacore::MeasurementSet& ms, size_t fiel
 void MSGridderBase::initializePhaseCentre(casacore::MeasurementSet& ms, size_t fieldId)
 {
 	GetPhaseCentreInfo(ms, fieldId, _phaseCentreRA, _phaseCentreDec, _phaseCentreDL, _phaseCentreDM);
+	if(HasRephaseDirection())
+	{
+		// The providers have already been rephased to a normal phase centre at this direction
+		_phaseCentreRA = RephaseRA();
+		_phaseCentreDec = RephaseDec();
+		_phaseCentreDL = 0.0;
+		_phaseCentreDM = 0.0;
+	}
 	
 	_denormalPhaseCentre = _phaseCentreDL != 0.0 || _phaseCentreDM != 0.0;
 	if(_denormalPhaseCentre)
@@ -248,19 +256,33 @@ void MSGridderBase::initializeMSDataVector(std::vector<MSGridderBase::MSData>& m
 }
 
 void MSGridderBase::initializeMetaData(casacore::MeasurementSet& ms, size_t fieldId)
+{
+	readMetaData(ms, fieldId, _telescopeName, _observer, _fieldName);
+}
+
+void MSGridderBase::readMetaData(casacore::MeasurementSet& ms, size_t fieldId, std::string& telescopeName, std::string& observer, std::string& fieldName)
 {
 	casacore::MSObservation oTable = ms.observation();
 	size_t obsCount = oTable.nrow();
 	if(obsCount == 0) throw std::runtime_error("No observations in set");
 	casacore::ScalarColumn<casacore::String> telescopeNameColumn(oTable, oTable.columnName(casacore::MSObservation::TELESCOPE_NAME));
 	casacore::ScalarColumn<casacore::String> observerColumn(oTable, oTable.columnName(casacore::MSObservation::OBSERVER));
-	_telescopeName = telescopeNameColumn(0);
-	_observer = observerColumn(0);
+	telescopeName = telescopeNameColumn(0);
+	observer = observerColumn(0);
 	
 	casacore::MSField fTable = ms.field();
 	casacore::ScalarColumn<casacore::String> fieldNameColumn(fTable, fTable.columnName(casacore::MSField::NAME));
 	size_t fieldRow = (fieldId == MSSelection::ALL_FIELDS) ? 0 : fieldId;
-	_fieldName = fieldNameColumn(fieldRow);
+	fieldName = fieldNameColumn(fieldRow);
+}
+
+struct ObservationInfo MSGridderBase::GetObservationInfo(casacore::MeasurementSet& ms, size_t fieldId)
+{
+	struct ObservationInfo info;
+	GetPhaseCentreInfo(ms, fieldId, info.phaseCentreRA, info.phaseCentreDec, info.phaseCentreDL, info.phaseCentreDM);
+	info.hasDenormalPhaseCentre = info.phaseCentreDL != 0.0 || info.phaseCentreDM != 0.0;
+	readMetaData(ms, fieldId, info.telescopeName, info.observer, info.fieldName);
+	return info;
 }
 
 void MSGridderBase::initializeMeasurementSet(MSGridderBase::MSData& msData, MetaDataCache::Entry& cacheEntry, bool isCacheInitialized)
@@ -62,6 +62,12 @@ public:
 	
 	static void GetPhaseCentreInfo(casacore::MeasurementSet& ms, size_t fieldId, double& ra, double& dec, double& dl, double& dm);
 	
+	/**
+	 * Reads the phase centre and the names of the telescope, observer and field. The start time
+	 * is not set, because it depends on the selected data.
+	 */
+	static struct ObservationInfo GetObservationInfo(casacore::MeasurementSet& ms, size_t fieldId);
+	
 	const std::string& TelescopeName() const { return _telescopeName; }
 	
 	const std::string& Observer() const { return _observer; }
@@ -199,6 +205,8 @@ private:
 	void initializeBandData(casacore::MeasurementSet& ms, MSGridderBase::MSData& msData);
 	
 	void initializeMetaData(casacore::MeasurementSet& ms, size_t fieldId);
+	
+	static void readMetaData(casacore::MeasurementSet& ms, size_t fieldId, std::string& telescopeName, std::string& observer, std::string& fieldName);
 		
 	bool _hasFrequencies;
 	double _freqHigh, _freqLow;
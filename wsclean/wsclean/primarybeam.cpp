@@ -1,5 +1,7 @@
 #include "primarybeam.h"
 
+#include "fitsoutputqueue.h"
+
 #include "../fitswriter.h"
 #include "../matrix2x2.h"
 #include "../fitsreader.h"
@@ -78,6 +80,7 @@ void PrimaryBeam::MakeBeamImages(const ImageFilename& imageName, const ImagingTa
 			}
 		}
 		
+		FitsOutputQueue outputQueue(_settings.parallelWriting);
 		if(beamImages.NImages() == 8)
 		{
 			// Save the beam images as fits files
@@ -94,7 +97,7 @@ void PrimaryBeam::MakeBeamImages(const ImageFilename& imageName, const ImagingTa
 				polName.SetIsImaginary(i%2 != 0);
 				writer.SetPolarization(p);
 				writer.SetFrequency(entry.CentralFrequency(), entry.bandEndFrequency - entry.bandStartFrequency);
-				writer.Write<double>(polName.GetBeamPrefix(_settings) + ".fits", beamImages[i].data());
+				outputQueue.Write(writer, polName.GetBeamPrefix(_settings) + ".fits", beamImages.Release(i));
 			}
 		}
 		else {
@@ -105,68 +108,75 @@ void PrimaryBeam::MakeBeamImages(const ImageFilename& imageName, const ImagingTa
 			for(size_t i=0; i!=16; ++i)
 			{
 				writer.SetFrequency(entry.CentralFrequency(), entry.bandEndFrequency - entry.bandStartFrequency);
-				writer.Write<double>(imageName.GetBeamPrefix(_settings) + "-" + std::to_string(i) + ".fits", beamImages[i].data());
+				outputQueue.Write(writer, imageName.GetBeamPrefix(_settings) + "-" + std::to_string(i) + ".fits", beamImages.Release(i));
 			}
 		}
+		// The beam is read back for the correction and by the deconvolution
+		outputQueue.Flush();
 	}
 }
 
-void PrimaryBeam::CorrectImages(FitsWriter& writer, const ImageFilename& imageName, const std::string& filenameKind, ImageBufferAllocator& allocator)
+void PrimaryBeam::CorrectImages(const FitsWriter& writer, const ImageFilename& imageName, const std::vector<std::string>& filenameKinds, FitsOutputQueue& outputQueue, ImageBufferAllocator& allocator)
 {
+	if(filenameKinds.empty())
+		return;
 	PrimaryBeamImageSet beamImages = load(imageName, _settings, allocator);
-	if(_settings.polarizations.size() == 1 || filenameKind == "psf")
+	for(const std::string& filenameKind : filenameKinds)
 	{
-		PolarizationEnum pol = *_settings.polarizations.begin();
-		
-		if(pol == Polarization::StokesI)
+		if(_settings.polarizations.size() == 1 || filenameKind == "psf")
 		{
-			ImageFilename stokesIName(imageName);
-			stokesIName.SetPolarization(pol);
-			std::string prefix;
-			if(filenameKind == "psf")
-				prefix = stokesIName.GetPSFPrefix(_settings);
-			else
-				prefix = stokesIName.GetPrefix(_settings);
-			FitsReader reader(prefix + "-" + filenameKind + ".fits");
-			ImageBufferAllocator::Ptr image;
-			allocator.Allocate(reader.ImageWidth() * reader.ImageHeight(), image);
-			reader.Read(image.data());
+			PolarizationEnum pol = *_settings.polarizations.begin();
 			
-			beamImages.ApplyStokesI(image.data());
-			writer.Write(prefix + "-" + filenameKind + "-pb.fits", image.data());
-		}
-		else {
-			throw std::runtime_error("Primary beam correction is requested, but this is not supported when imaging a single polarization that is not Stokes I. Either image all four polarizations or turn off beam correction.");
+			if(pol == Polarization::StokesI)
+			{
+				ImageFilename stokesIName(imageName);
+				stokesIName.SetPolarization(pol);
+				std::string prefix;
+				if(filenameKind == "psf")
+					prefix = stokesIName.GetPSFPrefix(_settings);
+				else
+					prefix = stokesIName.GetPrefix(_settings);
+				FitsReader reader(prefix + "-" + filenameKind + ".fits");
+				ImageBufferAllocator::Ptr image;
+				allocator.Allocate(reader.ImageWidth() * reader.ImageHeight(), image);
+				reader.Read(image.data());
+				
+				beamImages.ApplyStokesI(image.data(), _settings.threadCount);
+				outputQueue.Write(writer, prefix + "-" + filenameKind + "-pb.fits", std::move(image));
+			}
+			else {
+				throw std::runtime_error("Primary beam correction is requested, but this is not supported when imaging a single polarization that is not Stokes I. Either image all four polarizations or turn off beam correction.");
+			}
 		}
-	}
-	else if(Polarization::HasFullStokesPolarization(_settings.polarizations))
-	{
-		ImageBufferAllocator::Ptr images[4];
-		std::unique_ptr<FitsReader> reader;
-		for(size_t polIndex = 0; polIndex != 4; ++polIndex)
+		else if(Polarization::HasFullStokesPolarization(_settings.polarizations))
 		{
-			PolarizationEnum pol = Polarization::IndexToStokes(polIndex);
-			ImageFilename name(imageName);
-			name.SetPolarization(pol);
-			reader.reset(new FitsReader(name.GetPrefix(_settings) + "-" + filenameKind + ".fits"));
-			allocator.Allocate(reader->ImageWidth() * reader->ImageHeight(), images[polIndex]);
-			reader->Read(images[polIndex].data());
+			ImageBufferAllocator::Ptr images[4];
+			for(size_t polIndex = 0; polIndex != 4; ++polIndex)
+			{
+				PolarizationEnum pol = Polarization::IndexToStokes(polIndex);
+				ImageFilename name(imageName);
+				name.SetPolarization(pol);
+				FitsReader reader(name.GetPrefix(_settings) + "-" + filenameKind + ".fits");
+				allocator.Allocate(reader.ImageWidth() * reader.ImageHeight(), images[polIndex]);
+				reader.Read(images[polIndex].data());
+			}
+			
+			double* imagePtrs[4] = { images[0].data(), images[1].data(), images[2].data(), images[3].data() };
+			beamImages.ApplyFullStokes(imagePtrs, _settings.threadCount);
+			FitsWriter polWriter(writer);
+			for(size_t polIndex = 0; polIndex != 4; ++polIndex)
+			{
+				PolarizationEnum pol = Polarization::IndexToStokes(polIndex);
+				ImageFilename name(imageName);
+				name.SetPolarization(pol);
+				polWriter.SetPolarization(pol);
+				outputQueue.Write(polWriter, name.GetPrefix(_settings) + "-" + filenameKind + "-pb.fits", std::move(images[polIndex]));
+			}
 		}
-		
-		double* imagePtrs[4] = { images[0].data(), images[1].data(), images[2].data(), images[3].data() };
-		beamImages.ApplyFullStokes(imagePtrs);
-		for(size_t polIndex = 0; polIndex != 4; ++polIndex)
-		{
-			PolarizationEnum pol = Polarization::IndexToStokes(polIndex);
-			ImageFilename name(imageName);
-			name.SetPolarization(pol);
-			writer.SetPolarization(pol);
-			writer.Write(name.GetPrefix(_settings) + "-" + filenameKind + "-pb.fits", images[polIndex].data());
+		else {
+			throw std::runtime_error("Primary beam correction can only be performed on Stokes I or when imaging all four polarizations.");
 		}
 	}
-	else {
-		throw std::runtime_error("Primary beam correction can only be performed on Stokes I or when imaging all four polarizations.");
-	}
 }
 
 PrimaryBeamImageSet PrimaryBeam::load(const ImageFilename& imageName, const WSCleanSettings& settings, ImageBufferAllocator& allocator)
@@ -259,7 +269,7 @@ void PrimaryBeam::makeFromVoltagePattern(PrimaryBeamImageSet& beamImages, const
 	casacore::Array<double> pDir = pointingDirCol(fieldRow);
 	double pDirRA = *pDir.cbegin();
 	double pDirDec = *(pDir.cbegin()+1);
-	vp.Render(beamImages, _settings.pixelScaleX, _settings.pixelScaleY, _phaseCentreRA, _phaseCentreDec, pDirRA, pDirDec, _phaseCentreDL, _phaseCentreDM, entry.CentralFrequency());
+	vp.Render(beamImages, _settings.pixelScaleX, _settings.pixelScaleY, _phaseCentreRA, _phaseCentreDec, pDirRA, pDirDec, _phaseCentreDL, _phaseCentreDM, entry.CentralFrequency(), _settings.threadCount);
 }
 
 void PrimaryBeam::makeATCAImage(PrimaryBeamImageSet& beamImages, const ImagingTableEntry& entry)
@@ -2,6 +2,7 @@
 #define PRIMARY_BEAM_H
 
 #include <string>
+#include <vector>
 
 #include "imagefilename.h"
 #include "imagingtable.h"
@@ -33,11 +34,11 @@ public:
 		PrimaryBeamImageSet beamImages = load(imageName, _settings, allocator);
 		if(_settings.polarizations.size() == 1 && *_settings.polarizations.begin() == Polarization::StokesI)
 		{
-			beamImages.ApplyStokesI(images[0]);
+			beamImages.ApplyStokesI(images[0], _settings.threadCount);
 		}
 		else if(_settings.polarizations.size() == 4 && Polarization::HasFullStokesPolarization(_settings.polarizations))
 		{
-			beamImages.ApplyFullStokes(images.data());
+			beamImages.ApplyFullStokes(images.data(), _settings.threadCount);
 		}
 	}
 	
@@ -53,7 +54,15 @@ public:
 	
 	void MakeBeamImages(const ImageFilename& imageName, const ImagingTableEntry& entry, std::shared_ptr<class ImageWeights> imageWeights, ImageBufferAllocator& allocator);
 	
-	void CorrectImages(class FitsWriter& writer, const ImageFilename& imageName, const std::string& filenameKind, ImageBufferAllocator& allocator);
+	/**
+	 * Corrects the images of one output channel for the primary beam and
+	 * writes the "-pb" images. The beam is loaded once for all given kinds
+	 * (e.g. "image", "residual"), and for all polarizations the
+	 * correction is applied in a single parallel pass. The corrected images
+	 * are handed over to the output queue, so that the next image is read and
+	 * corrected while the previous one is written.
+	 */
+	void CorrectImages(const class FitsWriter& writer, const ImageFilename& imageName, const std::vector<std::string>& filenameKinds, class FitsOutputQueue& outputQueue, ImageBufferAllocator& allocator);
 	
 private:
 	const WSCleanSettings& _settings;
@@ -1,10 +1,13 @@
 #ifndef PRIMARY_BEAM_IMAGE_SET
 #define PRIMARY_BEAM_IMAGE_SET
 
+#include <algorithm>
 #include <vector>
 
 #include <boost/filesystem/operations.hpp>
 
+#include "../aocommon/parallelfor.h"
+
 #include "../hmatrix4x4.h"
 #include "../matrix2x2.h"
 #include "../polarization.h"
@@ -105,30 +108,13 @@ public:
 		if(_beamImages.size() == 8)
 		{
 			size_t index = y * _width + x;
-			MC2x2 val, squared;
-			val[0] = std::complex<double>(_beamImages[0][index], _beamImages[1][index]);
-			val[1] = std::complex<double>(_beamImages[2][index], _beamImages[3][index]);
-			val[2] = std::complex<double>(_beamImages[4][index], _beamImages[5][index]);
-			val[3] = std::complex<double>(_beamImages[6][index], _beamImages[7][index]);
-			MC2x2::ATimesHermB(squared, val, val);
-			double value;
-			if(squared.Invert())
-				value = 0.5 * (squared[0].real() + squared[3].real());
-			else
-				value = std::numeric_limits<double>::quiet_NaN();
-			return value;
+			return stokesIFactor(
+				_beamImages[0][index], _beamImages[1][index], _beamImages[2][index], _beamImages[3][index],
+				_beamImages[4][index], _beamImages[5][index], _beamImages[6][index], _beamImages[7][index]);
 		}
 		else if(_beamImages.size() == 16)
 		{
-			size_t j = y * _width + x;
-			HMC4x4 beam = HMC4x4::FromData({
-				_beamImages[0][j], _beamImages[1][j], _beamImages[2][j], _beamImages[3][j],
-				_beamImages[4][j], _beamImages[5][j], _beamImages[6][j], _beamImages[7][j],
-				_beamImages[8][j], _beamImages[9][j], _beamImages[10][j], _beamImages[11][j],
-				_beamImages[12][j], _beamImages[13][j], _beamImages[14][j], _beamImages[15][j]
-			});
-			if(!beam.Invert())
-				beam = HMC4x4::Zero();
+			HMC4x4 beam = inverseMueller(y * _width + x);
 			Vector4 v{0.5, 0.0, 0.0, 0.5};
 			v = beam * v;
 			return v[0].real() + v[3].real();
@@ -165,7 +151,11 @@ public:
 		return *this;
 	}
 	
-	void ApplyStokesI(double* stokesI) const
+	/**
+	 * Corrects a Stokes I image for the beam. The image is processed in blocks
+	 * of rows by the given number of threads.
+	 */
+	void ApplyStokesI(double* stokesI, size_t threadCount = 1) const
 	{
 		if(_beamImages.size() == 8)
 		{
@@ -176,84 +166,160 @@ public:
 			// Ic = Iu (B B^*)^-1
 			// Since we have measured Iu_xx + Iu_yy, and want to know Ic_xx + Ic_yy, let B2 = (B B^*)^-1 and Iu_xx = Iu_yy :
 			// Ic_xx + Ic_yy = Iu_xx B2_xx + Iu_yy B2_yy = (Iu_xx + Iu_yy) (B2_xx + B2_yy)
-			
-			size_t size = _width * _height;
-			for(size_t j=0; j!=size; ++j)
+			const double* b[8];
+			for(size_t i=0; i!=8; ++i)
+				b[i] = _beamImages[i].data();
+			forEachRowBlock(threadCount, [&](size_t start, size_t end)
 			{
-				MC2x2 val, squared;
-				val[0] = std::complex<double>(_beamImages[0][j], _beamImages[1][j]);
-				val[1] = std::complex<double>(_beamImages[2][j], _beamImages[3][j]);
-				val[2] = std::complex<double>(_beamImages[4][j], _beamImages[5][j]);
-				val[3] = std::complex<double>(_beamImages[6][j], _beamImages[7][j]);
-				MC2x2::ATimesHermB(squared, val, val);
-				if(squared.Invert())
-					stokesI[j] = stokesI[j] * 0.5 * (squared[0].real() + squared[3].real());
-				else
-					stokesI[j] = std::numeric_limits<double>::quiet_NaN();
-			}
+				for(size_t j=start; j!=end; ++j)
+					stokesI[j] *= stokesIFactor(b[0][j], b[1][j], b[2][j], b[3][j], b[4][j], b[5][j], b[6][j], b[7][j]);
+			});
 		}
 		else if(_beamImages.size() == 16)
 		{
-			size_t size = _width * _height;
-			for(size_t j=0; j!=size; ++j)
+			forEachRowBlock(threadCount, [&](size_t start, size_t end)
 			{
-				HMC4x4 beam = HMC4x4::FromData({
-					_beamImages[0][j], _beamImages[1][j], _beamImages[2][j], _beamImages[3][j],
-					_beamImages[4][j], _beamImages[5][j], _beamImages[6][j], _beamImages[7][j],
-					_beamImages[8][j], _beamImages[9][j], _beamImages[10][j], _beamImages[11][j],
-					_beamImages[12][j], _beamImages[13][j], _beamImages[14][j], _beamImages[15][j]
-				});
-				if(!beam.Invert())
-					beam = HMC4x4::Zero();
-				Vector4 v{stokesI[j]*0.5, 0.0, 0.0, stokesI[j]*0.5};
-				v = beam * v;
-				stokesI[j] = v[0].real() + v[3].real();
-			}
+				for(size_t j=start; j!=end; ++j)
+				{
+					HMC4x4 beam = inverseMueller(j);
+					Vector4 v{stokesI[j]*0.5, 0.0, 0.0, stokesI[j]*0.5};
+					v = beam * v;
+					stokesI[j] = v[0].real() + v[3].real();
+				}
+			});
 		}
 		else {
 			throw std::runtime_error("PrimaryBeamImageSet::ApplyStokesI(): Not implemented");
 		}
 	}
 	
-	void ApplyFullStokes(double* images[4]) const
+	/**
+	 * Corrects the four Stokes images (IQUV) for the beam in a single pass
+	 * over the pixels. The image is processed in blocks of rows by the given
+	 * number of threads.
+	 */
+	void ApplyFullStokes(double* images[4], size_t threadCount = 1) const
 	{
 		if(_beamImages.size() == 8)
 		{
-			size_t size = _width * _height;
-			for(size_t j=0; j!=size; ++j)
+			forEachRowBlock(threadCount, [&](size_t start, size_t end)
+			{
+				for(size_t j=start; j!=end; ++j)
+				{
+					MC2x2 beamVal;
+					beamVal[0] = std::complex<double>(_beamImages[0][j], _beamImages[1][j]);
+					beamVal[1] = std::complex<double>(_beamImages[2][j], _beamImages[3][j]);
+					beamVal[2] = std::complex<double>(_beamImages[4][j], _beamImages[5][j]);
+					beamVal[3] = std::complex<double>(_beamImages[6][j], _beamImages[7][j]);
+					if(beamVal.Invert())
+					{
+						double stokesVal[4] = { images[0][j], images[1][j], images[2][j], images[3][j] };
+						MC2x2 linearVal, scratch;
+						Polarization::StokesToLinear(stokesVal, linearVal.Data());
+						MC2x2::ATimesB(scratch, beamVal, linearVal);
+						MC2x2::ATimesHermB(linearVal, scratch, beamVal);
+						Polarization::LinearToStokes(linearVal.Data(), stokesVal);
+						for(size_t p=0; p!=4; ++p)
+							images[p][j] = stokesVal[p];
+					}
+					else {
+						for(size_t p=0; p!=4; ++p)
+							images[p][j] = std::numeric_limits<double>::quiet_NaN();
+					}
+				}
+			});
+		}
+		else if(_beamImages.size() == 16)
+		{
+			forEachRowBlock(threadCount, [&](size_t start, size_t end)
 			{
-				MC2x2 beamVal;
-				beamVal[0] = std::complex<double>(_beamImages[0][j], _beamImages[1][j]);
-				beamVal[1] = std::complex<double>(_beamImages[2][j], _beamImages[3][j]);
-				beamVal[2] = std::complex<double>(_beamImages[4][j], _beamImages[5][j]);
-				beamVal[3] = std::complex<double>(_beamImages[6][j], _beamImages[7][j]);
-				if(beamVal.Invert())
+				for(size_t j=start; j!=end; ++j)
 				{
+					HMC4x4 beam = inverseMueller(j);
 					double stokesVal[4] = { images[0][j], images[1][j], images[2][j], images[3][j] };
-					MC2x2 linearVal, scratch;
-					Polarization::StokesToLinear(stokesVal, linearVal.Data());
-					MC2x2::ATimesB(scratch, beamVal, linearVal);
-					MC2x2::ATimesHermB(linearVal, scratch, beamVal);
-					Polarization::LinearToStokes(linearVal.Data(), stokesVal);
+					std::complex<double> linear[4];
+					Polarization::StokesToLinear(stokesVal, linear);
+					Vector4 v = beam * Vector4(linear[0], linear[1], linear[2], linear[3]);
 					for(size_t p=0; p!=4; ++p)
-						images[p][j] = stokesVal[p];
-				}
-				else {
+						linear[p] = v[p];
+					Polarization::LinearToStokes(linear, stokesVal);
 					for(size_t p=0; p!=4; ++p)
-						images[p][j] = std::numeric_limits<double>::quiet_NaN();
+						images[p][j] = stokesVal[p];
 				}
-			}
+			});
 		}
 		else {
-			throw std::runtime_error("Not implemented");
+			throw std::runtime_error("PrimaryBeamImageSet::ApplyFullStokes(): Not implemented");
 		}
 	}
 	
+	/**
+	 * Takes the buffer of one of the images out of the set, e.g. to hand it
+	 * over to a @ref FitsOutputQueue. The image can no longer be used afterwards.
+	 */
+	ImageBufferAllocator::Ptr Release(size_t index)
+	{
+		return std::move(_beamImages[index]);
+	}
+	
 	size_t NImages() const { return _beamImages.size(); }
 	size_t Width() const { return _width; }
 	size_t Height() const { return _height; }
 	
 private:
+	/**
+	 * Returns 0.5 (B2_xx + B2_yy), with B2 = (B B^*)^-1 and B the Jones matrix
+	 * given by its real and imaginary components, or NaN when B is singular.
+	 * Because det(B B^*) = |det B|^2 and the trace of B B^* is the squared norm of B,
+	 * this needs no complex arithmetic and no branches, which allows the compiler
+	 * to vectorize the loops that call it.
+	 */
+	static double stokesIFactor(double xxR, double xxI, double xyR, double xyI, double yxR, double yxI, double yyR, double yyI)
+	{
+		const double
+			detR = xxR*yyR - xxI*yyI - xyR*yxR + xyI*yxI,
+			detI = xxR*yyI + xxI*yyR - xyR*yxI - xyI*yxR,
+			normSq = detR*detR + detI*detI,
+			trace = xxR*xxR + xxI*xxI + xyR*xyR + xyI*xyI + yxR*yxR + yxI*yxI + yyR*yyR + yyI*yyI;
+		return normSq == 0.0 ? std::numeric_limits<double>::quiet_NaN() : 0.5 * trace / normSq;
+	}
+	
+	HMC4x4 inverseMueller(size_t j) const
+	{
+		HMC4x4 beam = HMC4x4::FromData({
+			_beamImages[0][j], _beamImages[1][j], _beamImages[2][j], _beamImages[3][j],
+			_beamImages[4][j], _beamImages[5][j], _beamImages[6][j], _beamImages[7][j],
+			_beamImages[8][j], _beamImages[9][j], _beamImages[10][j], _beamImages[11][j],
+			_beamImages[12][j], _beamImages[13][j], _beamImages[14][j], _beamImages[15][j]
+		});
+		if(!beam.Invert())
+			beam = HMC4x4::Zero();
+		return beam;
+	}
+	
+	/**
+	 * Calls function(start, end) for ranges of pixel indices that together
+	 * cover the image. Each range consists of whole rows.
+	 */
+	template<typename Function>
+	void forEachRowBlock(size_t threadCount, Function function) const
+	{
+		if(threadCount <= 1 || _height <= 1)
+			function(0, _width * _height);
+		else {
+			// Use a few blocks per thread to balance the load
+			const size_t blockCount = std::min(_height, threadCount * 4);
+			ao::ParallelFor<size_t> loop(std::min(threadCount, blockCount));
+			loop.Run(0, blockCount, [&](size_t block, size_t)
+			{
+				const size_t
+					startRow = _height * block / blockCount,
+					endRow = _height * (block + 1) / blockCount;
+				function(startRow * _width, endRow * _width);
+			});
+		}
+	}
+	
 	std::vector<ImageBufferAllocator::Ptr> _beamImages;
 	size_t _width, _height;
 };
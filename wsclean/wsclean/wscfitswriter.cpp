@@ -2,6 +2,7 @@
 
 #include <wscversion.h>
 
+#include "fitsoutputqueue.h"
 #include "imagefilename.h"
 #include "msgridderbase.h"
 
@@ -31,6 +32,7 @@ WSCFitsWriter::WSCFitsWriter(
 		setDeconvolutionResultKeywords(deconvolution.GetAlgorithm().IterationNumber(), majorIterationNr);
 	if(isModel)
 		_writer.SetUnit(FitsWriter::JanskyPerPixel);
+	_writer.SetTileCompression(settings.fitsTileCompression);
 }
 
 WSCFitsWriter::WSCFitsWriter(
@@ -54,6 +56,7 @@ WSCFitsWriter::WSCFitsWriter(
 		setDeconvolutionResultKeywords(deconvolution.GetAlgorithm().IterationNumber(), majorIterationNr);
 	if(isModel)
 		_writer.SetUnit(FitsWriter::JanskyPerPixel);
+	_writer.SetTileCompression(settings.fitsTileCompression);
 }
 
 WSCFitsWriter::WSCFitsWriter(FitsReader& templateReader) : _writer(templateReader)
@@ -164,6 +167,12 @@ void WSCFitsWriter::WriteImage(const std::string& suffix, const double* image)
 	_writer.Write(name, image);
 }
 
+void WSCFitsWriter::WriteImage(const std::string& suffix, ImageBufferAllocator::Ptr&& image, FitsOutputQueue& queue)
+{
+	std::string name = _filenamePrefix + '-' + suffix;
+	queue.Write(_writer, name, std::move(image));
+}
+
 void WSCFitsWriter::WriteUV(const std::string& suffix, const double* image)
 {
 	std::string name = _filenamePrefix + '-' + suffix;
@@ -1,6 +1,7 @@
 #ifndef WSC_FITS_WRITER_H
 #define WSC_FITS_WRITER_H
 
+#include "imagebufferallocator.h"
 #include "imagefilename.h"
 #include "imagingtable.h"
 #include "observationinfo.h"
@@ -46,6 +47,12 @@ public:
 	
 	void WriteImage(const std::string& suffix, const double* image);
 	
+	/**
+	 * Like WriteImage(), but hands the image over to the queue, which writes it in
+	 * the background.
+	 */
+	void WriteImage(const std::string& suffix, ImageBufferAllocator::Ptr&& image, class FitsOutputQueue& queue);
+	
 	void WriteUV(const std::string& suffix, const double* image);
 	
 	void WritePSF(const std::string& fullname, const double* image);
@@ -1,6 +1,7 @@
 #include "wsclean.h"
 
 #include "directmsgridder.h"
+#include "fitsoutputqueue.h"
 #include "imagefilename.h"
 #include "imageoperations.h"
 #include "imageweightcache.h"
@@ -22,12 +23,17 @@
 #include "../modelrenderer.h"
 #include "../msselection.h"
 #include "../msproviders/contiguousms.h"
+#include "../msproviders/msindex.h"
+#include "../msproviders/rephasingmsprovider.h"
 #include "../nlplfitter.h"
 #include "../progressbar.h"
+#include "../system.h"
 #include "../uvector.h"
 
 #include "../aocommon/parallelfor.h"
 
+#include "../aterms/cache.h"
+
 #include "../deconvolution/deconvolutionalgorithm.h"
 #include "../deconvolution/imageset.h"
 
@@ -37,7 +43,10 @@
 
 #include "../model/model.h"
 
+#include <boost/filesystem/operations.hpp>
+
 #include <iostream>
+#include <iomanip>
 #include <functional>
 #include <memory>
 
@@ -389,8 +398,9 @@ void WSClean::initializeMFSImageWeights()
 					if(hasSelection)
 					{
 						PolarizationEnum pol = _settings.useIDG ? Polarization::Instrumental : entry.polarization;
-						PartitionedMS msProvider(_partitionedMSHandles[msIndex], ms.bands[dataDescId].partIndex, pol, dataDescId);
-						weights->Grid(msProvider, partSelection);
+						std::unique_ptr<MSProvider> msProvider(new PartitionedMS(_partitionedMSHandles[msIndex], ms.bands[dataDescId].partIndex, pol, dataDescId));
+						msProvider = applyShift(std::move(msProvider), partSelection, msIndex, dataDescId);
+						weights->Grid(*msProvider, partSelection);
 					}
 				}
 			}
@@ -402,8 +412,9 @@ void WSClean::initializeMFSImageWeights()
 			for(size_t d=0; d!=_msBands[i].DataDescCount(); ++d)
 			{
 				PolarizationEnum pol = _settings.useIDG ? Polarization::Instrumental : *_settings.polarizations.begin();
-				ContiguousMS msProvider(_settings.filenames[i], _settings.dataColumnName, _globalSelection, pol, d);
-				weights->Grid(msProvider,  _globalSelection);
+				std::unique_ptr<MSProvider> msProvider(new ContiguousMS(_settings.filenames[i], _settings.dataColumnName, _globalSelection, pol, d));
+				msProvider = applyShift(std::move(msProvider), _globalSelection, i, d);
+				weights->Grid(*msProvider,  _globalSelection);
 				Logger::Info << '.';
 				Logger::Info.Flush();
 			}
@@ -483,12 +494,19 @@ void WSClean::RunClean()
 
 	_settings.Propogate();
 	
-	if(_settings.directAllocation)
-		_imageAllocator = ImageBufferAllocator(true);
+	MSIndex::SetStorageDirectory(_settings.temporaryDirectory);
+	initializeImageAllocator();
+	_outputQueue.reset(new FitsOutputQueue(_settings.parallelWriting));
 	
 	_globalSelection = _settings.GetMSSelection();
 	MSSelection fullSelection = _globalSelection;
 	
+	if(_settings.singlePassIntervals)
+	{
+		runSinglePassIntervals(fullSelection);
+		return;
+	}
+	
 	for(size_t intervalIndex=0; intervalIndex!=_settings.intervalsOut; ++intervalIndex)
 	{
 		makeImagingTable(intervalIndex);
@@ -518,6 +536,8 @@ void WSClean::RunClean()
 
 		// Needs to be destructed before image allocator, or image allocator will report error caused by leaked memory
 		_griddingTaskManager.reset();
+		// The a-terms are only reused between the gridding passes of an interval
+		Cache::ClearShared();
 	
 		if(_settings.channelsOut > 1)
 		{
@@ -585,6 +605,132 @@ void WSClean::RunClean()
 	}
 }
 
+void WSClean::runSinglePassIntervals(MSSelection& fullSelection)
+{
+	// Determines the full time range and stores it in fullSelection
+	selectInterval(fullSelection, 0);
+	_globalSelection = fullSelection;
+	
+	makeImagingTable(0);
+	_doReorder = false;
+	_infoPerChannel.assign(1, OutputChannelInfo());
+	_imageWeightCache = createWeightCache();
+	
+	std::vector<double> intervalStartTimes(_settings.intervalsOut);
+	{
+		casacore::MeasurementSet ms(_settings.filenames[0]);
+		std::shared_ptr<const MSIndex> index = MSIndex::Get(ms);
+		const size_t
+			tS = fullSelection.IntervalStart(),
+			tE = fullSelection.IntervalEnd();
+		for(size_t i=0; i!=_settings.intervalsOut; ++i)
+			intervalStartTimes[i] = index->TimestepTime(tS + (tE-tS) * i / _settings.intervalsOut);
+		
+		// While an interval is imaged, up to two others are buffered
+		std::vector<size_t> intervalBytes(_settings.intervalsOut, 0);
+		for(const std::string& filename : _settings.filenames)
+		{
+			casacore::MeasurementSet intervalMS(filename);
+			const MultiBandData bands(intervalMS.spectralWindow(), intervalMS.dataDescription());
+			size_t channelCount = bands.MaxChannels();
+			if(fullSelection.HasChannelRange())
+				channelCount = std::min(channelCount, fullSelection.ChannelRangeEnd() - fullSelection.ChannelRangeStart());
+			const std::vector<size_t> rowCounts =
+				IntervalImager::CountIntervalRows(*MSIndex::Get(intervalMS), tS, tE, intervalStartTimes);
+			for(size_t i=0; i!=_settings.intervalsOut; ++i)
+				intervalBytes[i] += IntervalImager::IntervalBytes(rowCounts[i], channelCount, _settings.makePSF);
+		}
+		const double requiredBytes = 3.0 * *std::max_element(intervalBytes.begin(), intervalBytes.end());
+		if(requiredBytes > _settings.MemoryLimit())
+		{
+			std::ostringstream msg;
+			msg << "Single-pass interval imaging needs to buffer about " << round(requiredBytes/1e8)/10.0
+				<< " GB of visibilities, which exceeds the memory limit of " << round(_settings.MemoryLimit()/1e8)/10.0
+				<< " GB. Image more intervals, increase the memory limit (-mem / -abs-mem) or image without -single-pass-intervals.";
+			throw std::runtime_error(msg.str());
+		}
+		
+		_observationInfo = MSGridderBase::GetObservationInfo(ms, _settings.fieldIds[0]);
+		if(_settings.hasShift)
+		{
+			// The providers are rephased to a normal phase centre at the shifted direction
+			_observationInfo.phaseCentreRA = _settings.shiftRA;
+			_observationInfo.phaseCentreDec = _settings.shiftDec;
+			_observationInfo.phaseCentreDL = 0.0;
+			_observationInfo.phaseCentreDM = 0.0;
+			_observationInfo.hasDenormalPhaseCentre = false;
+		}
+		else if(_observationInfo.hasDenormalPhaseCentre)
+			throw std::runtime_error("Single-pass interval imaging does not support sets with a denormal phase centre");
+	}
+	
+	ImagingTableEntry entry = _imagingTable[0];
+	GriddingTask task;
+	initializeCurMSProviders(entry, task);
+	
+	IntervalImager imager(_settings, _imageAllocator, *_imageWeightCache);
+	_inversionWatch.Start();
+	imager.Run(task.msList, intervalStartTimes, [&](IntervalImager::Result& result) {
+		saveIntervalImages(entry, result);
+	});
+	_inversionWatch.Pause();
+}
+
+void WSClean::saveIntervalImages(ImagingTableEntry& entry, IntervalImager::Result& result)
+{
+	entry.outputIntervalIndex = result.intervalIndex;
+	entry.imageWeight = result.imageWeight;
+	entry.normalizationFactor = 1.0;
+	_observationInfo.startTime = result.startTime;
+	
+	OutputChannelInfo& info = _infoPerChannel[entry.outputChannelIndex];
+	info = OutputChannelInfo();
+	info.weight = result.imageWeight;
+	info.normalizationFactor = entry.normalizationFactor;
+	info.visibilityCount = result.visibilityCount;
+	info.effectiveVisibilityCount = result.visibilityCount;
+	info.visibilityWeightSum = result.visibilityWeightSum;
+	info.theoreticBeamSize = result.beamSize;
+	
+	if(result.psf)
+	{
+		const size_t centralIndex = _settings.trimmedImageWidth/2 + (_settings.trimmedImageHeight/2) * _settings.trimmedImageWidth;
+		const double normFactor = result.psf.data()[centralIndex] != 0.0 ? 1.0/result.psf.data()[centralIndex] : 0.0;
+		info.psfNormalizationFactor = normFactor;
+		multiplyImage(normFactor * entry.siCorrection, result.psf);
+		DeconvolutionAlgorithm::RemoveNaNsInPSF(result.psf.data(), _settings.trimmedImageWidth, _settings.trimmedImageHeight);
+		
+		const double initialFitSize = std::max(result.beamSize, std::min(_settings.pixelScaleX, _settings.pixelScaleY));
+		double bTheoretical;
+		ImageOperations::DetermineBeamSize(_settings, info.beamMaj, info.beamMin, info.beamPA, bTheoretical, result.psf.data(), initialFitSize);
+		info.theoreticBeamSize = bTheoretical;
+		
+		const std::string name(ImageFilename::GetPSFPrefix(_settings, entry.outputChannelIndex, entry.outputIntervalIndex) + "-psf.fits");
+		createWSCFitsWriter(entry, false, false).WritePSF(name, result.psf.data());
+	}
+	else if(_settings.theoreticBeam) {
+		info.beamMaj = std::max(result.beamSize, _settings.gaussianTaperBeamSize);
+		info.beamMin = std::max(result.beamSize, _settings.gaussianTaperBeamSize);
+		info.beamPA = 0.0;
+	}
+	else if(_settings.manualBeamMajorSize != 0.0) {
+		info.beamMaj = _settings.manualBeamMajorSize;
+		info.beamMin = _settings.manualBeamMinorSize;
+		info.beamPA = _settings.manualBeamPA;
+	}
+	else {
+		info.beamMaj = std::numeric_limits<double>::quiet_NaN();
+		info.beamMin = std::numeric_limits<double>::quiet_NaN();
+		info.beamPA = std::numeric_limits<double>::quiet_NaN();
+	}
+	
+	multiplyImage(info.psfNormalizationFactor * entry.siCorrection, result.image);
+	WSCFitsWriter writer(createWSCFitsWriter(entry, false, false));
+	if(_settings.isDirtySaved)
+		writer.WriteImage("dirty.fits", result.image.data());
+	writer.WriteImage("image.fits", result.image.data());
+}
+
 std::unique_ptr<ImageWeightCache> WSClean::createWeightCache()
 {
 	std::unique_ptr<ImageWeightCache> cache(new ImageWeightCache(
@@ -598,9 +744,38 @@ std::unique_ptr<ImageWeightCache> WSClean::createWeightCache()
 		_settings.gaussianTaperBeamSize,
 		_settings.tukeyTaperInLambda, _settings.tukeyInnerTaperInLambda,
 		_settings.edgeTaperInLambda, _settings.edgeTukeyTaperInLambda);
+	// Weights of a few channels can be kept without affecting the memory available for gridding
+	cache->SetMemoryBudget(_settings.MemoryLimit() / 20.0);
+	if(!_settings.weightsCacheDirectory.empty())
+	{
+		std::ostringstream dataDescription;
+		dataDescription << std::setprecision(17);
+		for(const std::string& filename : _settings.filenames)
+		{
+			// The weights are not affected by writing visibilities, hence only the
+			// main table file is checked for changes.
+			dataDescription << boost::filesystem::absolute(filename).string() << ' '
+				<< boost::filesystem::last_write_time(boost::filesystem::path(filename) / "table.dat") << '\n';
+		}
+		for(size_t spw : _settings.spectralWindows)
+			dataDescription << spw << ' ';
+		dataDescription << _settings.hasShift << ' ' << _settings.shiftRA << ' ' << _settings.shiftDec << ' '
+			<< _settings.baselineDependentAveragingInWavelengths << ' ' << _settings.useIDG;
+		cache->SetDiskCache(_settings.weightsCacheDirectory, dataDescription.str());
+	}
 	return std::move(cache);
 }
 
+void WSClean::initializeImageAllocator()
+{
+	if(_settings.directAllocation)
+		_imageAllocator = ImageBufferAllocator(true);
+	// Free image buffers are kept for reuse, but may not take more than a small part of
+	// the memory limit. The cache is also emptied every major iteration.
+	_imageAllocator.SetCacheLimit(_settings.MemoryLimit() / 20.0);
+	_imageAllocator.SetFirstTouchThreadCount(_settings.threadCount);
+}
+
 void WSClean::RunPredict()
 {
 	if(_settings.joinedFrequencyCleaning)
@@ -612,6 +787,9 @@ void WSClean::RunPredict()
 	
 	_settings.Propogate();
 	
+	MSIndex::SetStorageDirectory(_settings.temporaryDirectory);
+	initializeImageAllocator();
+	
 	_globalSelection = _settings.GetMSSelection();
 	MSSelection fullSelection = _globalSelection;
 	
@@ -642,6 +820,8 @@ void WSClean::RunPredict()
 	
 		// Needs to be destructed before image allocator, or image allocator will report error caused by leaked memory
 		_griddingTaskManager.reset();
+		// The a-terms are only reused between the gridding passes of an interval
+		Cache::ClearShared();
 	}
 }
 
@@ -885,6 +1065,8 @@ void WSClean::runIndependentGroup(ImagingTable& groupTable, std::unique_ptr<Prim
     }
 	}
 	
+	_outputQueue->Flush();
+	
 	_deconvolution.FreeDeconvolutionAlgorithms();
 	
 	_imageAllocator.ReportStatistics();
@@ -904,17 +1086,26 @@ void WSClean::saveRestoredImagesForGroup(const ImagingTableEntry& tableEntry, st
 	{
 		bool isImaginary = (imageIter == 1);
 		WSCFitsWriter writer(createWSCFitsWriter(tableEntry, isImaginary, false));
-		double* restoredImage = _imageAllocator.Allocate(_settings.trimmedImageWidth*_settings.trimmedImageHeight);
-		_residualImages.Load(restoredImage, curPol, currentChannelIndex, isImaginary);
-		
-		if(_settings.deconvolutionIterationCount != 0)
-			writer.WriteImage("residual.fits", restoredImage);
+		const size_t imageSize = _settings.trimmedImageWidth*_settings.trimmedImageHeight;
+		ImageBufferAllocator::Ptr restoredImage;
+		_imageAllocator.Allocate(imageSize, restoredImage);
+		_residualImages.Load(restoredImage.data(), curPol, currentChannelIndex, isImaginary);
 		
 		if(_settings.isUVImageSaved)
-			saveUVImage(restoredImage, tableEntry, isImaginary, "uv");
+			saveUVImage(restoredImage.data(), tableEntry, isImaginary, "uv");
 		
-		double* modelImage = _imageAllocator.Allocate(_settings.trimmedImageWidth*_settings.trimmedImageHeight);
-		_modelImages.Load(modelImage, curPol, currentChannelIndex, isImaginary);
+		if(_settings.deconvolutionIterationCount != 0)
+		{
+			// The queue takes ownership of the image, hence the residual is written from a copy
+			ImageBufferAllocator::Ptr residualImage;
+			_imageAllocator.Allocate(imageSize, residualImage);
+			std::copy_n(restoredImage.data(), imageSize, residualImage.data());
+			writer.WriteImage("residual.fits", std::move(residualImage), *_outputQueue);
+		}
+		
+		ImageBufferAllocator::Ptr modelImage;
+		_imageAllocator.Allocate(imageSize, modelImage);
+		_modelImages.Load(modelImage.data(), curPol, currentChannelIndex, isImaginary);
 		double beamMaj = _infoPerChannel[currentChannelIndex].beamMaj;
 		double beamMin, beamPA;
 		std::string beamStr;
@@ -932,18 +1123,18 @@ void WSClean::saveRestoredImagesForGroup(const ImagingTableEntry& tableEntry, st
 		}
 		Logger::Info << "Rendering sources to restored image " + beamStr + "... ";
 		Logger::Info.Flush();
-		ModelRenderer::Restore(restoredImage, modelImage, _settings.trimmedImageWidth, _settings.trimmedImageHeight, beamMaj, beamMin, beamPA, _settings.pixelScaleX, _settings.pixelScaleY);
+		ModelRenderer::Restore(restoredImage.data(), modelImage.data(), _settings.trimmedImageWidth, _settings.trimmedImageHeight, beamMaj, beamMin, beamPA, _settings.pixelScaleX, _settings.pixelScaleY);
 		Logger::Info << "DONE\n";
-		_imageAllocator.Free(modelImage);
+		modelImage.reset();
 		
-		Logger::Info << "Writing restored image... ";
-		Logger::Info.Flush();
-		writer.WriteImage("image.fits", restoredImage);
-		Logger::Info << "DONE\n";
-		_imageAllocator.Free(restoredImage);
+		Logger::Info << "Writing restored image...\n";
+		writer.WriteImage("image.fits", std::move(restoredImage), *_outputQueue);
 		
 		if(curPol == *_settings.polarizations.rbegin())
 		{
+			// The primary-beam correction reads the images that were just queued
+			if(_settings.gridWithBeam || !_settings.atermConfigFilename.empty() || _settings.applyPrimaryBeam)
+				_outputQueue->Flush();
 			ImageFilename imageName = ImageFilename(currentChannelIndex, tableEntry.outputIntervalIndex);
 			if(_settings.gridWithBeam || !_settings.atermConfigFilename.empty())
 			{
@@ -959,14 +1150,15 @@ void WSClean::saveRestoredImagesForGroup(const ImagingTableEntry& tableEntry, st
 			}
 			else if(_settings.applyPrimaryBeam)
 			{
-				primaryBeam->CorrectImages(writer.Writer(), imageName, "image", _imageAllocator);
+				std::vector<std::string> kinds(1, "image");
 				if(_settings.savePsfPb)
-					primaryBeam->CorrectImages(writer.Writer(), imageName, "psf", _imageAllocator);
+					kinds.emplace_back("psf");
 				if(_settings.deconvolutionIterationCount != 0)
 				{
-					primaryBeam->CorrectImages(writer.Writer(), imageName, "residual", _imageAllocator);
-					primaryBeam->CorrectImages(writer.Writer(), imageName, "model", _imageAllocator);
+					kinds.emplace_back("residual");
+					kinds.emplace_back("model");
 				}
+				primaryBeam->CorrectImages(writer.Writer(), imageName, kinds, *_outputQueue, _imageAllocator);
 			}
 		}
 	}
@@ -975,21 +1167,21 @@ void WSClean::saveRestoredImagesForGroup(const ImagingTableEntry& tableEntry, st
 void WSClean::writeFirstResidualImages(const ImagingTable& groupTable) const
 {
 	Logger::Info << "Writing first iteration image(s)...\n";
-	ImageBufferAllocator::Ptr ptr;
-	_imageAllocator.Allocate(_settings.trimmedImageWidth*_settings.trimmedImageHeight, ptr);
 	for(size_t e=0; e!=groupTable.EntryCount(); ++e)
 	{
 		const ImagingTableEntry& entry = groupTable[e];
 		size_t ch = entry.outputChannelIndex;
+		ImageBufferAllocator::Ptr ptr;
+		_imageAllocator.Allocate(_settings.trimmedImageWidth*_settings.trimmedImageHeight, ptr);
 		if(entry.polarization == Polarization::YX) {
 			_residualImages.Load(ptr.data(), Polarization::XY, ch, true);
 			WSCFitsWriter writer(createWSCFitsWriter(entry, Polarization::XY, true, false));
-			writer.WriteImage("first-residual.fits", ptr.data());
+			writer.WriteImage("first-residual.fits", std::move(ptr), *_outputQueue);
 		}
 		else {
 			_residualImages.Load(ptr.data(), entry.polarization, ch, false);
 			WSCFitsWriter writer(createWSCFitsWriter(entry, false, false));
-			writer.WriteImage("first-residual.fits", ptr.data());
+			writer.WriteImage("first-residual.fits", std::move(ptr), *_outputQueue);
 		}
 	}
 }
@@ -997,21 +1189,23 @@ void WSClean::writeFirstResidualImages(const ImagingTable& groupTable) const
 void WSClean::writeModelImages(const ImagingTable& groupTable) const
 {
 	Logger::Info << "Writing model image...\n";
-	ImageBufferAllocator::Ptr ptr;
-	_imageAllocator.Allocate(_settings.trimmedImageWidth*_settings.trimmedImageHeight, ptr);
+	// The model images of the previous major iteration might still be queued
+	_outputQueue->Flush();
 	for(size_t e=0; e!=groupTable.EntryCount(); ++e)
 	{
 		const ImagingTableEntry& entry = groupTable[e];
 		size_t ch = entry.outputChannelIndex;
+		ImageBufferAllocator::Ptr ptr;
+		_imageAllocator.Allocate(_settings.trimmedImageWidth*_settings.trimmedImageHeight, ptr);
 		if(entry.polarization == Polarization::YX) {
 			_modelImages.Load(ptr.data(), Polarization::XY, ch, true);
 			WSCFitsWriter writer(createWSCFitsWriter(entry, Polarization::XY, true, true));
-			writer.WriteImage("model.fits", ptr.data());
+			writer.WriteImage("model.fits", std::move(ptr), *_outputQueue);
 		}
 		else {
 			_modelImages.Load(ptr.data(), entry.polarization, ch, false);
 			WSCFitsWriter writer(createWSCFitsWriter(entry, false, true));
-			writer.WriteImage("model.fits", ptr.data());
+			writer.WriteImage("model.fits", std::move(ptr), *_outputQueue);
 		}
 	}
 }
@@ -1120,10 +1314,27 @@ void WSClean::predictGroup(const ImagingTable& imagingGroup)
 std::unique_ptr<MSProvider> WSClean::initializeMSProvider(const ImagingTableEntry& entry, const MSSelection& selection, size_t filenameIndex, size_t dataDescId)
 {
 	PolarizationEnum pol = _settings.useIDG ? Polarization::Instrumental : entry.polarization;
+	std::unique_ptr<MSProvider> msProvider;
 	if(_doReorder)
-		return std::unique_ptr<MSProvider>(new PartitionedMS(_partitionedMSHandles[filenameIndex], entry.msData[filenameIndex].bands[dataDescId].partIndex, pol, dataDescId));
+		msProvider.reset(new PartitionedMS(_partitionedMSHandles[filenameIndex], entry.msData[filenameIndex].bands[dataDescId].partIndex, pol, dataDescId));
 	else
-		return std::unique_ptr<MSProvider>(new ContiguousMS(_settings.filenames[filenameIndex], _settings.dataColumnName, selection, pol, dataDescId));
+		msProvider.reset(new ContiguousMS(_settings.filenames[filenameIndex], _settings.dataColumnName, selection, pol, dataDescId));
+	return applyShift(std::move(msProvider), selection, filenameIndex, dataDescId);
+}
+
+std::unique_ptr<MSProvider> WSClean::applyShift(std::unique_ptr<MSProvider> msProvider, const MSSelection& selection, size_t filenameIndex, size_t dataDescId)
+{
+	if(!_settings.hasShift)
+		return msProvider;
+	double ra, dec, dl, dm;
+	SynchronizedMS ms(msProvider->MS());
+	MSGridderBase::GetPhaseCentreInfo(*ms, _settings.fieldIds[0], ra, dec, dl, dm);
+	ms.Reset();
+	const BandData& fullBand = _msBands[filenameIndex][dataDescId];
+	const BandData band = selection.HasChannelRange() ?
+		BandData(fullBand, selection.ChannelRangeStart(), selection.ChannelRangeEnd()) :
+		fullBand;
+	return std::unique_ptr<MSProvider>(new RephasingMSProvider(std::move(msProvider), band, ra, dec, dl, dm, _settings.shiftRA, _settings.shiftDec));
 }
 
 void WSClean::initializeCurMSProviders(const ImagingTableEntry& entry, GriddingTask& task)
@@ -1177,6 +1388,13 @@ void WSClean::runFirstInversion(ImagingTableEntry& entry, std::unique_ptr<class
 			SynchronizedMS ms(pbmsList.front().first->MS());
 			MSGridderBase::GetPhaseCentreInfo(*ms, _settings.fieldIds[0], ra, dec, dl, dm);
 			ms.Reset();
+			if(_settings.hasShift)
+			{
+				ra = _settings.shiftRA;
+				dec = _settings.shiftDec;
+				dl = 0.0;
+				dm = 0.0;
+			}
 			primaryBeam->SetPhaseCentre(ra, dec, dl, dm);
 			primaryBeam->MakeBeamImages(imageName, entry, std::move(weights), _imageAllocator);
 		}
@@ -1212,22 +1430,10 @@ MSSelection WSClean::selectInterval(MSSelection& fullSelection, size_t intervalI
 		}
 		else {
 			casacore::MeasurementSet ms(_settings.filenames[0]);
-			Logger::Info << "Counting number of scans... ";
-			Logger::Info.Flush();
-			casacore::ScalarColumn<double> timeColumn(ms, casacore::MS::columnName(casacore::MSMainEnums::TIME));
-			double time = timeColumn(0);
-			size_t timestepIndex = 1;
-			for(size_t row = 0; row!=ms.nrow(); ++row)
-			{
-				if(time != timeColumn(row))
-				{
-					++timestepIndex;
-					time = timeColumn(row);
-				}
-			}
-			Logger::Info << "DONE (" << timestepIndex << ")\n";
+			const size_t timestepCount = MSIndex::Get(ms)->TimestepCount();
+			Logger::Info << "Measurement set has " << timestepCount << " timesteps.\n";
 			tS = 0;
-			tE = timestepIndex;
+			tE = timestepCount;
 			// Store the full interval in the selection, so that it doesn't need to be determined again.
 			fullSelection.SetInterval(tS, tE);
 		}
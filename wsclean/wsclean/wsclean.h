@@ -15,6 +15,7 @@
 #include "griddingresult.h"
 #include "imagebufferallocator.h"
 #include "imagingtable.h"
+#include "intervalimager.h"
 #include "msgridderbase.h"
 #include "observationinfo.h"
 #include "outputchannelinfo.h"
@@ -49,6 +50,11 @@ private:
 	std::shared_ptr<ImageWeights> initializeImageWeights(const ImagingTableEntry& entry, std::vector<std::pair<std::unique_ptr<MSProvider>, MSSelection>>& msList);
 	void initializeMFSImageWeights();
 	std::unique_ptr<MSProvider> initializeMSProvider(const ImagingTableEntry& entry, const MSSelection& selection, size_t filenameIndex, size_t dataDescId);
+	/**
+	 * When a shift was requested, wraps the provider in a RephasingMSProvider. Otherwise,
+	 * returns the provider unchanged.
+	 */
+	std::unique_ptr<MSProvider> applyShift(std::unique_ptr<MSProvider> msProvider, const MSSelection& selection, size_t filenameIndex, size_t dataDescId);
 	void initializeCurMSProviders(const ImagingTableEntry& entry, class GriddingTask& task);
 	void initializeMSProvidersForPB(const ImagingTableEntry& entry, std::vector<std::pair<std::unique_ptr<MSProvider>, MSSelection>>& msList, class PrimaryBeam& pb);
 	void storeAndCombineXYandYX(CachedImageSet& dest, PolarizationEnum polarization, size_t joinedChannelIndex, bool isImaginary, const double* image);
@@ -61,6 +67,10 @@ private:
 	void makeImagingTableEntryChannelSettings(const std::vector<ChannelInfo>& channels, size_t outIntervalIndex, size_t outChannelIndex, size_t nOutChannels, ImagingTableEntry& entry);
 	void addPolarizationsToImagingTable(size_t& joinedGroupIndex, size_t& squaredGroupIndex, size_t outChannelIndex, const ImagingTableEntry& templateEntry);
 	std::unique_ptr<class ImageWeightCache> createWeightCache();
+	/**
+	 * Memory that wsclean may use according to -mem and -abs-mem, in bytes.
+	 */
+	void initializeImageAllocator();
 	
 	void multiplyImage(double factor, double* image) const;
 	void multiplyImage(double factor, ImageBufferAllocator::Ptr& image) const { multiplyImage(factor, image.data()); }
@@ -75,6 +85,13 @@ private:
 	void imageMain(ImagingTableEntry& entry, bool isFirstInversion, bool updateBeamInfo);
 	void imageMainCallback(ImagingTableEntry& entry, struct GriddingResult& result, bool updateBeamInfo, bool isInitialInversion);
 	
+	/**
+	 * Makes the dirty images of all intervals with a single pass over the data, for
+	 * -single-pass-intervals.
+	 */
+	void runSinglePassIntervals(MSSelection& fullSelection);
+	void saveIntervalImages(ImagingTableEntry& entry, IntervalImager::Result& result);
+	
 	void predict(const ImagingTableEntry& entry);
 	void predictCallback(const ImagingTableEntry& entry, struct GriddingResult& result);
 	
@@ -119,6 +136,7 @@ private:
 	
 	std::unique_ptr<class GriddingTaskManager> _griddingTaskManager;
 	std::unique_ptr<class ImageWeightCache> _imageWeightCache;
+	std::unique_ptr<class FitsOutputQueue> _outputQueue;
 	Stopwatch _inversionWatch, _predictingWatch, _deconvolutionWatch;
 	bool _isFirstInversion, _doReorder;
 	size_t _majorIterationNr;
@@ -69,6 +69,20 @@ void WSCleanSettings::Validate() const
 	if(channelsOut == 0)
 		throw std::runtime_error("You have specified 0 output channels -- at least one output channel is required.");
 	
+	if(singlePassIntervals)
+	{
+		if(intervalsOut == 1)
+			throw std::runtime_error("Single-pass interval imaging was requested, but only one interval is imaged. Did you forget -intervals-out?");
+		if(deconvolutionIterationCount != 0 || makePSFOnly)
+			throw std::runtime_error("Single-pass interval imaging only makes dirty images: it can not be combined with cleaning (-niter) or -make-psf-only.");
+		if(channelsOut != 1 || polarizations.size() != 1 || Polarization::IsComplex(*polarizations.begin()))
+			throw std::runtime_error("Single-pass interval imaging supports one output channel and one (non-complex) polarization.");
+		if(useIDG || applyPrimaryBeam || !atermConfigFilename.empty())
+			throw std::runtime_error("Single-pass interval imaging can not be combined with IDG or beam correction.");
+		if(baselineDependentAveragingInWavelengths != 0.0 || simulateNoise || mfWeighting)
+			throw std::runtime_error("Single-pass interval imaging can not be combined with baseline-dependent averaging, noise simulation or multi-frequency weighting.");
+	}
+	
 	if(joinedFrequencyCleaning && channelsOut == 1)
 		throw std::runtime_error("Joined frequency cleaning was requested, but only one output channel is being requested. Did you forget -channels-out?");
 	
@@ -87,6 +101,9 @@ void WSCleanSettings::Validate() const
 	if(saveSourceList && deconvolutionIterationCount==0)
 		throw std::runtime_error("A source list cannot be saved without cleaning.");
 	
+	if(deconvolutionSinglePrecision && (useMultiscale || useIUWTDeconvolution || useMoreSaneDeconvolution))
+		throw std::runtime_error("Single-precision deconvolution (-single-precision-deconvolution) is only supported by the default clean algorithm: it can not be combined with multi-scale, IUWT or MoreSane deconvolution.");
+	
 	checkPolarizations();
 }
 
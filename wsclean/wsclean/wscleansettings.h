@@ -10,6 +10,8 @@
 #include "../deconvolution/deconvolutionalgorithm.h"
 #include "../multiscale/multiscaletransforms.h"
 
+#include <algorithm>
+
 enum class DirectFTPrecision { Half, Float, Double, LongDouble };
 
 /**
@@ -27,6 +29,17 @@ public:
 	
 	void RecalculatePaddedDimensions();
 	
+	/**
+	 * Number of bytes that may be used, as given by -mem and -abs-mem.
+	 */
+	double MemoryLimit() const
+	{
+		double memory = double(System::TotalMemory()) * memFraction;
+		if(absMemLimit != 0.0)
+			memory = std::min(memory, absMemLimit * 1024.0*1024.0*1024.0);
+		return memory;
+	}
+	
 	std::vector<std::string> filenames;
 	enum Mode { ImagingMode, PredictMode, RestoreMode } mode;
 	size_t paddedImageWidth, paddedImageHeight;
@@ -34,6 +47,7 @@ public:
 	double imagePadding;
 	size_t widthForNWCalculation, heightForNWCalculation;
 	size_t channelsOut, intervalsOut;
+	bool singlePassIntervals;
 	enum MSSelection::EvenOddSelection evenOddTimesteps;
 	bool divideChannelsByGaps;
 	ao::uvector<double> divideChannelFrequencies;
@@ -46,12 +60,14 @@ public:
 	double memFraction, absMemLimit;
 	bool directAllocation;
 	double minUVWInMeters, maxUVWInMeters, minUVInLambda, maxUVInLambda, wLimit, rankFilterLevel;
+	bool hasShift;
+	double shiftRA, shiftDec;
 	size_t rankFilterSize;
 	double gaussianTaperBeamSize, tukeyTaperInLambda, tukeyInnerTaperInLambda, edgeTaperInLambda, edgeTukeyTaperInLambda;
 	bool useWeightsAsTaper;
 	size_t nWLayers;
 	double nWLayersFactor;
-	size_t antialiasingKernelSize, overSamplingFactor, threadCount, parallelReordering, parallelGridding;
+	size_t antialiasingKernelSize, overSamplingFactor, threadCount, parallelReordering, parallelGridding, parallelWriting;
 	bool useMPI;
 	std::vector<size_t> fieldIds;
 	size_t startTimestep, endTimestep;
@@ -65,11 +81,12 @@ public:
 	bool joinedPolarizationCleaning, joinedFrequencyCleaning;
 	std::set<PolarizationEnum> linkedPolarizations;
 	size_t parallelDeconvolutionMaxSize;
-	bool smallInversion, makePSF, makePSFOnly, isWeightImageSaved, isUVImageSaved, isDirtySaved, isFirstResidualSaved;
+	bool smallInversion, makePSF, makePSFOnly, isWeightImageSaved, isUVImageSaved, isDirtySaved, isFirstResidualSaved, fitsTileCompression;
 	bool reusePsf, reuseDirty;
 	std::string reusePsfPrefix, reuseDirtyPrefix;
 	bool writeImagingWeightSpectrumColumn;
 	std::string temporaryDirectory;
+	std::string weightsCacheDirectory;
 	bool forceReorder, forceNoReorder, subtractModel, modelUpdateRequired, mfWeighting;
 	size_t fullResOffset, fullResWidth, fullResPad;
 	bool applyPrimaryBeam, reusePrimaryBeam, useDifferentialLofarBeam, savePsfPb;
@@ -105,7 +122,7 @@ public:
 	bool useMultiscale, useSubMinorOptimization, squaredJoins;
 	double spectralCorrectionFrequency;
 	ao::uvector<double> spectralCorrection;
-	bool multiscaleFastSubMinorLoop;
+	bool multiscaleFastSubMinorLoop, saveMultiscalePSFs;
 	double multiscaleGain, multiscaleDeconvolutionScaleBias;
 	size_t multiscaleMaxScales;
 	double multiscaleConvolutionPadding;
@@ -120,6 +137,7 @@ public:
 	bool useMoreSaneDeconvolution, useIUWTDeconvolution, iuwtSNRTest;
 	std::string moreSaneLocation, moreSaneArgs;
 	ao::uvector<double> moreSaneSigmaLevels;
+	size_t moreSaneParallelRuns;
 	enum SpectralFittingMode spectralFittingMode;
 	size_t spectralFittingTerms;
 	/**
@@ -129,6 +147,15 @@ public:
 	 * It is 0 when all channels should be used.
 	 */
 	size_t deconvolutionChannelCount;
+	/**
+	 * Store the deconvolution images in memory-mapped files instead of in memory.
+	 */
+	bool deconvolutionOutOfCore;
+	/**
+	 * Store the residual and model images during deconvolution in single precision.
+	 * Only supported by the generic clean algorithm.
+	 */
+	bool deconvolutionSinglePrecision;
 	/**
 	 * @}
 	 */
@@ -160,6 +187,7 @@ inline WSCleanSettings::WSCleanSettings() :
 	imagePadding(1.2),
 	widthForNWCalculation(0), heightForNWCalculation(0),
 	channelsOut(1), intervalsOut(1),
+	singlePassIntervals(false),
 	evenOddTimesteps(MSSelection::AllTimesteps),
 	divideChannelsByGaps(false),
 	divideChannelFrequencies(),
@@ -173,7 +201,9 @@ inline WSCleanSettings::WSCleanSettings() :
 	directAllocation(false),
 	minUVWInMeters(0.0), maxUVWInMeters(0.0),
 	minUVInLambda(0.0), maxUVInLambda(0.0), wLimit(0.0),
-	rankFilterLevel(3.0), rankFilterSize(16),
+	rankFilterLevel(3.0),
+	hasShift(false), shiftRA(0.0), shiftDec(0.0),
+	rankFilterSize(16),
 	gaussianTaperBeamSize(0.0),
 	tukeyTaperInLambda(0.0), tukeyInnerTaperInLambda(0.0),
 	edgeTaperInLambda(0.0), edgeTukeyTaperInLambda(0.0),
@@ -182,6 +212,7 @@ inline WSCleanSettings::WSCleanSettings() :
 	threadCount(System::ProcessorCount()),
 	parallelReordering(1),
 	parallelGridding(1),
+	parallelWriting(4),
 	useMPI(false),
 	fieldIds{0},
 	startTimestep(0), endTimestep(0),
@@ -195,11 +226,12 @@ inline WSCleanSettings::WSCleanSettings() :
 	linkedPolarizations(),
 	parallelDeconvolutionMaxSize(0),
 	smallInversion(true), makePSF(false), makePSFOnly(false), isWeightImageSaved(false),
-	isUVImageSaved(false), isDirtySaved(true), isFirstResidualSaved(false), 	
+	isUVImageSaved(false), isDirtySaved(true), isFirstResidualSaved(false), fitsTileCompression(false),	
 	reusePsf(false), reuseDirty(false),
 	reusePsfPrefix(), reuseDirtyPrefix(),
 	writeImagingWeightSpectrumColumn(false),
 	temporaryDirectory(),
+	weightsCacheDirectory(),
 	forceReorder(false), forceNoReorder(false),
 	subtractModel(false),
 	modelUpdateRequired(true),
@@ -247,6 +279,7 @@ inline WSCleanSettings::WSCleanSettings() :
 	spectralCorrectionFrequency(0.0),
 	spectralCorrection(),
 	multiscaleFastSubMinorLoop(true),
+	saveMultiscalePSFs(false),
 	multiscaleGain(0.2),
 	multiscaleDeconvolutionScaleBias(0.6),
 	multiscaleMaxScales(0),
@@ -263,9 +296,12 @@ inline WSCleanSettings::WSCleanSettings() :
 	iuwtSNRTest(false),
 	moreSaneLocation(),
 	moreSaneArgs(),
+	moreSaneParallelRuns(1),
 	spectralFittingMode(NoSpectralFitting),
 	spectralFittingTerms(0),
-	deconvolutionChannelCount(0)
+	deconvolutionChannelCount(0),
+	deconvolutionOutOfCore(false),
+	deconvolutionSinglePrecision(false)
 {
 	polarizations.insert(Polarization::StokesI);
 }
@@ -308,7 +308,8 @@ void WSMSGridder::predictWriteThread(ao::lane<PredictionWorkItem>* predictionWor
 	PredictionWorkItem workItem;
 	while(buffer.read(workItem))
 	{
-		msData->msProvider->WriteModel(workItem.rowId, workItem.data.get());
+		const double uvw[3] = { workItem.u, workItem.v, workItem.w };
+		msData->msProvider->WriteModel(workItem.rowId, workItem.data.get(), uvw);
 	}
 }
 